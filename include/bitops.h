@@ -12,7 +12,8 @@
 
   Contains the following:
 
-  bit*_swap()  - byte-wise reverse (bit16_swap() also available)
+  bit*_swap()  - byte-wise reverse (bit16_swap() also available, and
+                 bit128_swap() if the compiler supports __int128)
   bit*_isset() - test if bit is set (single integer or array)
   bit*_set()   - set bit (single integer or array)
   bit*_unset() - unset bit (single integer or array)
@@ -447,6 +448,14 @@ bit64_swap(uint64_t v)
 #endif
 }
 
+#if defined(__SIZEOF_INT128__)
+static inline unsigned __int128
+bit128_swap(unsigned __int128 v)
+{
+    return ((unsigned __int128)bit64_swap((uint64_t)v) << 64u) | bit64_swap((uint64_t)(v >> 64u));
+}
+#endif
+
 static inline void
 barr32_set(uint32_t bits[],
            const unsigned from,
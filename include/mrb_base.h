@@ -7,6 +7,8 @@
 #ifndef MRB_BASE_H
 #define MRB_BASE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct mrb_node {
@@ -27,4 +29,200 @@ void
 mrb_erase_node_(struct mrb_node **root,
                 struct mrb_node *node);
 
+// Joins two trees and a node into one tree in O(log n) and returns its root.
+// All keys in t1 must be less than the key of k, which must be less than all
+// keys in t2. Either tree may be NULL.
+struct mrb_node *
+mrb_join_(struct mrb_node *t1,
+          struct mrb_node *k,
+          struct mrb_node *t2);
+
+// As mrb_join_() but without a middle node.
+struct mrb_node *
+mrb_concat_(struct mrb_node *t1,
+            struct mrb_node *t2);
+
+// Splits the tree that contains node in O(log n), into a tree with the
+// nodes before node, and a tree with node and the nodes after it.
+void
+mrb_split_before_(struct mrb_node *node,
+                  struct mrb_node **before,
+                  struct mrb_node **after);
+
+// Returns the number of nodes in tree a, given the total number of nodes in
+// trees a and b, in time proportional to the smaller of them.
+size_t
+mrb_count_one_of_(const struct mrb_node *a,
+                  const struct mrb_node *b,
+                  size_t total);
+
+// Links count nodes, chained in key order through child[1] and ending with
+// NULL, into a balanced tree and returns its root.
+struct mrb_node *
+mrb_build_sorted_(struct mrb_node *list,
+                  size_t count);
+
+/*
+  Order statistic variants of the above, compiled from the same source by
+  mrb_os_base.c. The nodes are struct mrb_os_node, and the subtree sizes
+  are maintained on insert, erase, rotations, join, split and build.
+*/
+struct mrb_os_node {
+    struct mrb_node node;
+    uintptr_t size; // number of nodes in the subtree
+};
+
+#define mrb_os_size_(node) \
+    ((node) == NULL ? 0 : ((const struct mrb_os_node *)(node))->size)
+
+void
+mrb_os_insert_node_(struct mrb_node **root,
+                    struct mrb_node *node,
+                    struct mrb_node *parent,
+                    struct mrb_node **link_in_parent);
+
+void
+mrb_os_erase_node_(struct mrb_node **root,
+                   struct mrb_node *node);
+
+struct mrb_node *
+mrb_os_join_(struct mrb_node *t1,
+             struct mrb_node *k,
+             struct mrb_node *t2);
+
+struct mrb_node *
+mrb_os_concat_(struct mrb_node *t1,
+               struct mrb_node *t2);
+
+void
+mrb_os_split_before_(struct mrb_node *node,
+                     struct mrb_node **before,
+                     struct mrb_node **after);
+
+// O(1) here, the size of a is kept in the node.
+size_t
+mrb_os_count_one_of_(const struct mrb_node *a,
+                     const struct mrb_node *b,
+                     size_t total);
+
+struct mrb_node *
+mrb_os_build_sorted_(struct mrb_node *list,
+                     size_t count);
+
+// Returns the number of nodes before node in its tree.
+size_t
+mrb_os_rank_(const struct mrb_node *node);
+
+// Returns the node at index in key order, or NULL if out of range.
+struct mrb_node *
+mrb_os_select_(struct mrb_node *root,
+               size_t index);
+
+/*
+  32-bit link variants, compiled from the same source by mrb32_base.c, for
+  trees where all nodes are in one array as in static memory mode. A link
+  is the byte offset from the node holding it to the linked node, 0 for
+  none. Being relative to the node itself rather than to the array, a link
+  can be followed without the array base, so iterators are still plain node
+  pointers. The lowest bit of the parent link holds the color.
+*/
+struct mrb_node32 {
+    int32_t child[2]; // 0 == left, 1 == right
+    uint32_t parent_n_color;
+};
+
+#define mrb32_link_to_(node, target)                                    \
+    ((target) == NULL ? 0 : (int32_t)((intptr_t)(target) - (intptr_t)(node)))
+#define mrb32_link_get_(node, offset)                                   \
+    ((offset) == 0 ? NULL :                                             \
+     (struct mrb_node32 *)((uintptr_t)(node) + (uintptr_t)(intptr_t)(offset)))
+#define mrb32_child_get_(node, dir) mrb32_link_get_(node, (node)->child[dir])
+#define mrb32_parent_get_(node) \
+    mrb32_link_get_(node, (int32_t)((node)->parent_n_color & ~(uint32_t)MRB_IS_BLACK_BIT))
+
+// The node is linked in as child dir of parent, or as root if parent is NULL.
+void
+mrb32_insert_node_(struct mrb_node32 **root,
+                   struct mrb_node32 *node,
+                   struct mrb_node32 *parent,
+                   int dir);
+
+void
+mrb32_erase_node_(struct mrb_node32 **root,
+                  struct mrb_node32 *node);
+
+struct mrb_node32 *
+mrb32_join_(struct mrb_node32 *t1,
+            struct mrb_node32 *k,
+            struct mrb_node32 *t2);
+
+struct mrb_node32 *
+mrb32_concat_(struct mrb_node32 *t1,
+              struct mrb_node32 *t2);
+
+void
+mrb32_split_before_(struct mrb_node32 *node,
+                    struct mrb_node32 **before,
+                    struct mrb_node32 **after);
+
+size_t
+mrb32_count_one_of_(const struct mrb_node32 *a,
+                    const struct mrb_node32 *b,
+                    size_t total);
+
+// The list is chained through 32-bit links in child[1].
+struct mrb_node32 *
+mrb32_build_sorted_(struct mrb_node32 *list,
+                    size_t count);
+
+/*
+  Threaded variants, compiled from the same source by mrb_th_base.c. A child
+  link without a child holds the in-order neighbor in that direction instead,
+  tagged with the lowest bit (a tagged NULL at the ends of the tree), so the
+  next or previous node is found without climbing parent links. The threads
+  are maintained on insert, erase, rotations, join, split and build.
+*/
+#define MRB_THREAD_BIT ((uintptr_t)1u)
+#define mrb_th_is_thread_(node, dir) (((uintptr_t)(node)->child[dir] & MRB_THREAD_BIT) != 0)
+#define mrb_th_thread_to_(target) ((struct mrb_node *)((uintptr_t)(target) | MRB_THREAD_BIT))
+// The in-order neighbor, valid only if the link is a thread.
+#define mrb_th_neighbor_get_(node, dir) \
+    ((struct mrb_node *)((uintptr_t)(node)->child[dir] & ~MRB_THREAD_BIT))
+#define mrb_th_child_get_(node, dir) \
+    (mrb_th_is_thread_(node, dir) ? NULL : (node)->child[dir])
+
+// The node is linked in as child dir of parent, or as root if parent is NULL.
+void
+mrb_th_insert_node_(struct mrb_node **root,
+                    struct mrb_node *node,
+                    struct mrb_node *parent,
+                    int dir);
+
+void
+mrb_th_erase_node_(struct mrb_node **root,
+                   struct mrb_node *node);
+
+struct mrb_node *
+mrb_th_join_(struct mrb_node *t1,
+             struct mrb_node *k,
+             struct mrb_node *t2);
+
+struct mrb_node *
+mrb_th_concat_(struct mrb_node *t1,
+               struct mrb_node *t2);
+
+void
+mrb_th_split_before_(struct mrb_node *node,
+                     struct mrb_node **before,
+                     struct mrb_node **after);
+
+size_t
+mrb_th_count_one_of_(const struct mrb_node *a,
+                     const struct mrb_node *b,
+                     size_t total);
+
+struct mrb_node *
+mrb_th_build_sorted_(struct mrb_node *list,
+                     size_t count);
+
 #endif
@@ -10,6 +10,30 @@
 
   Compile-time options / tuning:
 
+  MRB_ORDER_STATISTIC - if set to 1, each node also holds the size of its
+  subtree, which adds mrb_rank(), mrb_itrank(), mrb_select() and
+  mrb_count_range() in O(log n). The sizes are kept up to date by the base
+  functions in mrb_os_base.c, at the cost of one word per node and a walk
+  to the root on insert and erase. Without it the node size is unchanged.
+
+  MRB_LINK32 - if set to 1 (static mode only), the child and parent links are
+  32 bit offsets relative to the node that holds them instead of pointers,
+  which shrinks the link overhead from 24 to 12 bytes per node on 64 bit
+  targets, so more entries fit in each cache line. The node array is then
+  limited to INT32_MAX bytes: mrb_new() returns NULL if capacity nodes do
+  not fit, and mrb_init() uses only the first INT32_MAX bytes of a larger
+  array, which mrb_max_size() reflects. The base functions are in
+  mrb32_base.c. Cannot be combined with MRB_ORDER_STATISTIC.
+
+  MRB_THREADED - if set to 1, a child link without a child is a tagged link
+  to the in-order neighbor on that side, so mrb_next() and mrb_prev() never
+  climb parent links, they either follow the thread or walk down the other
+  subtree. This evens out the cost per step of ordered scans, as the climbs
+  can touch up to log n nodes that are no longer in cache. The node size is
+  unchanged, insert and erase cost a little more to keep the threads right.
+  The base functions are in mrb_th_base.c. Cannot be combined with
+  MRB_ORDER_STATISTIC or MRB_LINK32.
+
   MRB_KEYCMP(result, a, b) - the key comparison macro. Default is set to
   "result = a - b", or "(a > b) - (a < b)" when there can be overflow.
   'a' is the key in the tree, 'b' is the key given as the function argument.
@@ -18,6 +42,33 @@
   a <= c. For example, the comparison 'result = a - b' does not work if the
   subtraction can overflow (wrap around).
 
+  mrb_build_sorted() fills an empty tree from arrays of keys (and values) in
+  strictly ascending key order in O(n). The nodes are allocated in key order
+  and linked into a balanced tree directly, without searching or
+  rebalancing. If the tree is not empty or the keys are not strictly
+  ascending, the keys are just inserted one by one.
+
+  mrb_itfindnear() returns the entry where the search ended, which may be
+  either neighbor of the key. mrb_itlower_bound() and mrb_itupper_bound()
+  return the first entry not less than, and greater than, the key.
+  mrb_erase_range() cuts out long ranges with split and join instead of
+  rebalancing once per erased entry.
+
+  mrb_split(), mrb_extract_range() and mrb_merge() move entries between two
+  trees of the same type. Keys and values are moved, never copied or freed,
+  except for duplicates in merge. In compact mode each node is a malloc()
+  block of its own and may change tree, so the trees are split and joined
+  in O(log n) (merge when the key ranges do not overlap), and the entry
+  count of the smaller part is found by a walk that stops when either part
+  ends, or read from the root with MRB_ORDER_STATISTIC. In the other modes
+  a node belongs to the pool of its tree and cannot outlive it, so entries
+  get new nodes in the pool of the destination tree. When that tree is
+  empty (always for split and extract, and for merge into an empty tree)
+  the new nodes are allocated in key order and linked as in
+  mrb_build_sorted() in O(m), and the old nodes are cut out with split and
+  join in O(log n) and freed without rebalancing. Merge into a non-empty
+  tree moves the entries one by one in O(m log n).
+
   Default configuration:
 
   Map with 'intptr_t' keys to 'void *', with NULL as undefined value.
@@ -78,12 +129,51 @@
 #include <mrb_base.h>
 #endif // MRB_TMPL_ONCE_
 
-#define MRB_LEFT_ child[0]
-#define MRB_RIGHT_ child[1]
+#if (MRB_LINK32 - 0) + (MRB_ORDER_STATISTIC - 0) + (MRB_THREADED - 0) > 1
+#error "MRB_LINK32, MRB_ORDER_STATISTIC and MRB_THREADED cannot be combined"
+#endif
+#if MRB_LINK32 - 0 != 0
+#if MC_MM_MODE != MC_MM_STATIC
+#error "MRB_LINK32 requires MC_MM_STATIC"
+#endif
+#define MRB_NODE_T_ struct mrb_node32
+#define MRB_CHILD_(node, dir) mrb32_child_get_(node, dir)
+#define MRB_SET_CHILD_(node, dir, target) (node)->child[dir] = mrb32_link_to_(node, target)
+#define MRB_PARENT_(node) mrb32_parent_get_(node)
+#define MRB_INSERT_LINK_(mrb, parent, dir) dir
+#elif MRB_THREADED - 0 != 0
+#define MRB_NODE_T_ struct mrb_node
+#define MRB_CHILD_(node, dir) mrb_th_child_get_(node, dir)
+#define MRB_SET_CHILD_(node, dir, target) (node)->child[dir] = (target)
+#define MRB_PARENT_(node) mrb_parent_get_(node)
+#define MRB_INSERT_LINK_(mrb, parent, dir) dir
+#else
+#define MRB_NODE_T_ struct mrb_node
+#define MRB_CHILD_(node, dir) (node)->child[dir]
+#define MRB_SET_CHILD_(node, dir, target) (node)->child[dir] = (target)
+#define MRB_PARENT_(node) mrb_parent_get_(node)
+#define MRB_INSERT_LINK_(mrb, parent, dir) \
+    ((parent) == NULL ? &(mrb)->root : &(parent)->child[dir])
+#endif
+#define MRB_LEFT_(node) MRB_CHILD_(node, 0)
+#define MRB_RIGHT_(node) MRB_CHILD_(node, 1)
+
+#if MRB_ORDER_STATISTIC - 0 != 0
+#define MRB_BASE_(name) mrb_os_ ## name
+#elif MRB_LINK32 - 0 != 0
+#define MRB_BASE_(name) mrb32_ ## name
+#elif MRB_THREADED - 0 != 0
+#define MRB_BASE_(name) mrb_th_ ## name
+#else
+#define MRB_BASE_(name) mrb_ ## name
+#endif
 
 #define MRB_NODE_KV MC_CONCAT_(MC_PREFIX, _node_kv)
 struct MRB_NODE_KV {
-    struct mrb_node node;
+    MRB_NODE_T_ node;
+#if MRB_ORDER_STATISTIC - 0 != 0
+    uintptr_t size; // as struct mrb_os_node
+#endif
     MC_KEY_T key;
 #if MC_NO_VALUE - 0 == 0
     MC_VALUE_T value;
@@ -137,7 +227,7 @@ struct MRB_NODE_KV {
 #endif // MC_MM_MODE == MC_MM_PERFORMANCE
 
 typedef struct MC_T_ {
-    struct mrb_node *root;
+    MRB_NODE_T_ *root;
     uintptr_t count;
     uintptr_t capacity;
 #if MC_MM_MODE == MC_MM_PERFORMANCE
@@ -164,14 +254,14 @@ MC_FUN_(sizeof_verify_)(void)
 static inline MC_ITERATOR_T *
 MC_FUN_(begin)(MC_T * const mrb)
 {
-    struct mrb_node *node;
+    MRB_NODE_T_ *node;
 
     node = mrb->root;
     if (node == NULL) {
         return NULL;
     }
-    while (node->MRB_LEFT_ != NULL) {
-        node = node->MRB_LEFT_;
+    while (MRB_LEFT_(node) != NULL) {
+        node = MRB_LEFT_(node);
     }
     return (MC_ITERATOR_T *)node;
 }
@@ -179,14 +269,14 @@ MC_FUN_(begin)(MC_T * const mrb)
 static inline MC_ITERATOR_T *
 MC_FUN_(rbegin)(MC_T * const mrb)
 {
-    struct mrb_node *node;
+    MRB_NODE_T_ *node;
 
     node = mrb->root;
     if (node == NULL) {
         return NULL;
     }
-    while (node->MRB_RIGHT_ != NULL) {
-        node = node->MRB_RIGHT_;
+    while (MRB_RIGHT_(node) != NULL) {
+        node = MRB_RIGHT_(node);
     }
     return (MC_ITERATOR_T *)node;
 }
@@ -206,22 +296,22 @@ MC_FUN_(rend)(void)
 static inline MC_ITERATOR_T *
 MC_FUN_(next_compact_delete_)(MC_ITERATOR_T * const it)
 {
-    struct mrb_node *node = (struct mrb_node *)it;
-    struct mrb_node *parent;
+    MRB_NODE_T_ *node = (MRB_NODE_T_ *)it;
+    MRB_NODE_T_ *parent;
 
-    if (mrb_parent_get_(node) == node) {
+    if (MRB_PARENT_(node) == node) {
         free(node);
         return NULL;
     }
-    if (node->MRB_RIGHT_ != NULL) {
-        node = node->MRB_RIGHT_;
-        while (node->MRB_LEFT_ != NULL) {
-            node = node->MRB_LEFT_;
+    if (MRB_RIGHT_(node) != NULL) {
+        node = MRB_RIGHT_(node);
+        while (MRB_LEFT_(node) != NULL) {
+            node = MRB_LEFT_(node);
         }
         return (MC_ITERATOR_T *)node;
     }
-    while ((parent = mrb_parent_get_(node)) != NULL &&
-           node == parent->MRB_RIGHT_)
+    while ((parent = MRB_PARENT_(node)) != NULL &&
+           node == MRB_RIGHT_(parent))
     {
         free(node);
         node = parent;
@@ -233,21 +323,27 @@ MC_FUN_(next_compact_delete_)(MC_ITERATOR_T * const it)
 static inline MC_ITERATOR_T *
 MC_FUN_(next)(MC_ITERATOR_T * const it)
 {
-    struct mrb_node *node = (struct mrb_node *)it;
-    struct mrb_node *parent;
+    MRB_NODE_T_ *node = (MRB_NODE_T_ *)it;
+    MRB_NODE_T_ *parent;
 
-    if (mrb_parent_get_(node) == node) {
+    if (MRB_PARENT_(node) == node) {
         return NULL;
     }
-    if (node->MRB_RIGHT_ != NULL) {
-        node = node->MRB_RIGHT_;
-        while (node->MRB_LEFT_ != NULL) {
-            node = node->MRB_LEFT_;
+#if MRB_THREADED - 0 != 0
+    // without right child the successor is linked directly
+    if (mrb_th_is_thread_(node, 1)) {
+        return (MC_ITERATOR_T *)mrb_th_neighbor_get_(node, 1);
+    }
+#endif
+    if (MRB_RIGHT_(node) != NULL) {
+        node = MRB_RIGHT_(node);
+        while (MRB_LEFT_(node) != NULL) {
+            node = MRB_LEFT_(node);
         }
         return (MC_ITERATOR_T *)node;
     }
-    while ((parent = mrb_parent_get_(node)) != NULL &&
-           node == parent->MRB_RIGHT_)
+    while ((parent = MRB_PARENT_(node)) != NULL &&
+           node == MRB_RIGHT_(parent))
     {
         node = parent;
     }
@@ -257,21 +353,26 @@ MC_FUN_(next)(MC_ITERATOR_T * const it)
 static inline MC_ITERATOR_T *
 MC_FUN_(prev)(MC_ITERATOR_T * const it)
 {
-    struct mrb_node *node = (struct mrb_node *)it;
-    struct mrb_node *parent;
+    MRB_NODE_T_ *node = (MRB_NODE_T_ *)it;
+    MRB_NODE_T_ *parent;
 
-    if (mrb_parent_get_(node) == node) {
+    if (MRB_PARENT_(node) == node) {
         return NULL;
     }
-    if (node->MRB_LEFT_ != NULL) {
-        node = node->MRB_LEFT_;
-        while (node->MRB_RIGHT_ != NULL) {
-            node = node->MRB_RIGHT_;
+#if MRB_THREADED - 0 != 0
+    if (mrb_th_is_thread_(node, 0)) {
+        return (MC_ITERATOR_T *)mrb_th_neighbor_get_(node, 0);
+    }
+#endif
+    if (MRB_LEFT_(node) != NULL) {
+        node = MRB_LEFT_(node);
+        while (MRB_RIGHT_(node) != NULL) {
+            node = MRB_RIGHT_(node);
         }
         return (MC_ITERATOR_T *)node;
     }
-    while ((parent = mrb_parent_get_(node)) != NULL &&
-           node == parent->MRB_LEFT_)
+    while ((parent = MRB_PARENT_(node)) != NULL &&
+           node == MRB_LEFT_(parent))
     {
         node = parent;
     }
@@ -349,6 +450,7 @@ MC_FUN_(clear)(MC_T * const mrb)
 
 #if MC_MM_MODE == MC_MM_STATIC
 
+// With MRB_LINK32 at most INT32_MAX bytes of the node array are used.
 static inline MC_T *
 MC_FUN_(init)(MC_T * const mrb,
               struct MRB_NODE_KV * const nodes,
@@ -357,6 +459,12 @@ MC_FUN_(init)(MC_T * const mrb,
     mrb->root = NULL;
     mrb->count = 0;
     mrb->capacity = (uintptr_t)sizeof_node_array / sizeof(struct MRB_NODE_KV);
+#if MRB_LINK32 - 0 != 0
+    // links are byte offsets within the array
+    if (sizeof_node_array > INT32_MAX) {
+        mrb->capacity = INT32_MAX / sizeof(struct MRB_NODE_KV);
+    }
+#endif
     MC_FUN_(npstatic_init)(&mrb->nodepool, nodes);
     return mrb;
 }
@@ -366,6 +474,11 @@ MC_FUN_(new)(const size_t capacity)
 {
     MC_T *mrb;
 
+#if MRB_LINK32 - 0 != 0
+    if (capacity > INT32_MAX / sizeof(struct MRB_NODE_KV)) {
+        return NULL;
+    }
+#endif
     if (posix_memalign((void **)&mrb, sizeof(MC_T),
                        sizeof(MC_T) + capacity * sizeof(struct MRB_NODE_KV))
         != 0)
@@ -418,42 +531,128 @@ static inline MC_ITERATOR_T *
 MC_FUN_(itinsert)(MC_T * const mrb,
                   MC_KEY_T const key MC_OPT_VALUE_INSERT_ARG_)
 {
-    struct mrb_node **new;
-    struct mrb_node *parent;
+    MRB_NODE_T_ *node;
+    MRB_NODE_T_ *parent;
     struct MRB_NODE_KV *newnode;
     intptr_t result;
+    int dir = 0;
 
     if (mrb->count == mrb->capacity) {
         return NULL;
     }
-    new = &mrb->root;
+    node = mrb->root;
     parent = NULL;
-    while (*new != NULL) {
-        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)*new)->key, key);
+    while (node != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
         if (result == 0) {
 #if MC_NO_VALUE - 0 == 0
-            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)*new)->value);
-            MC_OPT_ASSIGN_VALUE_(((struct MRB_NODE_KV *)*new)->value, value);
-            return (MC_ITERATOR_T *)(*new);
+            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)node)->value);
+            MC_OPT_ASSIGN_VALUE_(((struct MRB_NODE_KV *)node)->value, value);
+            return (MC_ITERATOR_T *)node;
 #else
-            return (MC_ITERATOR_T *)(*new);
+            return (MC_ITERATOR_T *)node;
 #endif
         }
-        parent = *new;
+        parent = node;
+        dir = (result < 0);
+        node = MRB_CHILD_(node, dir);
+    }
+    newnode = MRB_ALLOC_NODE_(mrb);
+    MC_ASSIGN_KEY_(newnode->key, key);
+#if MC_NO_VALUE - 0 == 0
+    MC_OPT_ASSIGN_VALUE_(newnode->value, value);
+#endif
+    mrb->count++;
+    MRB_BASE_(insert_node_)(&mrb->root, &newnode->node, parent, MRB_INSERT_LINK_(mrb, parent, dir));
+    return (MC_ITERATOR_T *)newnode;
+}
+
+// As itinsert, with hint telling where key goes: next to the entry of hint,
+// or last if hint is end. If the hint is right the node is linked in there
+// without key comparisons on the way down from the root, only the hint and
+// its neighbor are compared. Finding the neighbor (or the last entry, if hint
+// is end) still follows up to O(log n) links, so an insert is O(log n), with
+// amortized O(1) rebalancing. A wrong hint costs a normal insert.
+static inline MC_ITERATOR_T *
+MC_FUN_(itinsert_hint)(MC_T * const mrb,
+                       MC_ITERATOR_T * const hint,
+                       MC_KEY_T const key MC_OPT_VALUE_INSERT_ARG_)
+{
+    MRB_NODE_T_ * const node = (MRB_NODE_T_ *)hint;
+    MRB_NODE_T_ *parent;
+    MRB_NODE_T_ *neighbor;
+    struct MRB_NODE_KV *newnode;
+    intptr_t result;
+    int dir;
+
+    if (node == NULL) {
+        parent = (MRB_NODE_T_ *)MC_FUN_(rbegin)(mrb);
+        if (parent == NULL) {
+            goto search;
+        }
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)parent)->key, key);
+        if (result >= 0) {
+            goto search;
+        }
+        dir = 1;
+    } else {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
+        if (result == 0) {
+#if MC_NO_VALUE - 0 == 0
+            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)node)->value);
+            MC_OPT_ASSIGN_VALUE_(((struct MRB_NODE_KV *)node)->value, value);
+#endif
+            return hint;
+        }
         if (result > 0) {
-            new = &(*new)->MRB_LEFT_;
+            // key goes between the previous entry and hint
+            neighbor = (MRB_NODE_T_ *)MC_FUN_(prev)(hint);
+            if (neighbor != NULL) {
+                MRB_KEYCMP(result, ((struct MRB_NODE_KV *)neighbor)->key, key);
+                if (result >= 0) {
+                    goto search;
+                }
+            }
+            if (MRB_LEFT_(node) == NULL) {
+                parent = node;
+                dir = 0;
+            } else {
+                // then the previous entry is the rightmost of the left subtree
+                parent = neighbor;
+                dir = 1;
+            }
         } else {
-            new = &(*new)->MRB_RIGHT_;
+            // key goes between hint and the next entry
+            neighbor = (MRB_NODE_T_ *)MC_FUN_(next)(hint);
+            if (neighbor != NULL) {
+                MRB_KEYCMP(result, ((struct MRB_NODE_KV *)neighbor)->key, key);
+                if (result <= 0) {
+                    goto search;
+                }
+            }
+            if (MRB_RIGHT_(node) == NULL) {
+                parent = node;
+                dir = 1;
+            } else {
+                parent = neighbor;
+                dir = 0;
+            }
         }
     }
+    if (mrb->count == mrb->capacity) {
+        return NULL;
+    }
     newnode = MRB_ALLOC_NODE_(mrb);
     MC_ASSIGN_KEY_(newnode->key, key);
 #if MC_NO_VALUE - 0 == 0
     MC_OPT_ASSIGN_VALUE_(newnode->value, value);
 #endif
     mrb->count++;
-    mrb_insert_node_(&mrb->root, &newnode->node, parent, new);
+    MRB_BASE_(insert_node_)(&mrb->root, &newnode->node, parent, MRB_INSERT_LINK_(mrb, parent, dir));
     return (MC_ITERATOR_T *)newnode;
+
+search:
+    return MC_FUN_(itinsert)(mrb, key MC_OPT_VALUE_PARAM_);
 }
 
 static inline MC_VALUE_T MC_OPT_PTR_
@@ -461,33 +660,31 @@ MC_FUN_(insert)(MC_T * const mrb,
                 MC_KEY_T const key MC_OPT_VALUE_INSERT_ARG_)
 {
     MC_DEF_VALUE_UNDEF_;
-    struct mrb_node **new;
-    struct mrb_node *parent;
+    MRB_NODE_T_ *node;
+    MRB_NODE_T_ *parent;
     struct MRB_NODE_KV *newnode;
     intptr_t result;
+    int dir = 0;
 
     if (mrb->count == mrb->capacity) {
         return undef_value;
     }
-    new = &mrb->root;
+    node = mrb->root;
     parent = NULL;
-    while (*new != NULL) {
-        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)*new)->key, key);
+    while (node != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
         if (result == 0) {
 #if MC_NO_VALUE - 0 == 0
-            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)*new)->value);
-            MC_OPT_ASSIGN_VALUE_(((struct MRB_NODE_KV *)*new)->value, value);
-            return MC_OPT_ADDROF_ ((struct MRB_NODE_KV *)*new)->value;
+            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)node)->value);
+            MC_OPT_ASSIGN_VALUE_(((struct MRB_NODE_KV *)node)->value, value);
+            return MC_OPT_ADDROF_ ((struct MRB_NODE_KV *)node)->value;
 #else
-            return MC_OPT_ADDROF_ ((struct MRB_NODE_KV *)*new)->key;
+            return MC_OPT_ADDROF_ ((struct MRB_NODE_KV *)node)->key;
 #endif
         }
-        parent = *new;
-        if (result > 0) {
-            new = &(*new)->MRB_LEFT_;
-        } else {
-            new = &(*new)->MRB_RIGHT_;
-        }
+        parent = node;
+        dir = (result < 0);
+        node = MRB_CHILD_(node, dir);
     }
     newnode = MRB_ALLOC_NODE_(mrb);
     MC_ASSIGN_KEY_(newnode->key, key);
@@ -496,7 +693,7 @@ MC_FUN_(insert)(MC_T * const mrb,
 #endif
     mrb->count++;
 
-    mrb_insert_node_(&mrb->root, &newnode->node, parent, new);
+    MRB_BASE_(insert_node_)(&mrb->root, &newnode->node, parent, MRB_INSERT_LINK_(mrb, parent, dir));
 
 #if MC_NO_VALUE - 0 == 0
     return MC_OPT_ADDROF_ newnode->value;
@@ -505,6 +702,64 @@ MC_FUN_(insert)(MC_T * const mrb,
 #endif
 }
 
+#if MC_VALUE_NO_INSERT_ARG - 0 == 0
+  #define MRB_VALUES_ARG_ , MC_VALUE_T const values[]
+  #define MRB_VALUES_PARAM_(i) , values[i]
+#else
+  #define MRB_VALUES_ARG_
+  #define MRB_VALUES_PARAM_(i)
+#endif
+
+// Returns the size of the tree afterwards, which is less than the sum if
+// capacity was reached.
+static inline size_t
+MC_FUN_(build_sorted)(MC_T * const mrb,
+                      MC_KEY_T const keys[] MRB_VALUES_ARG_,
+                      const size_t count)
+{
+    MRB_NODE_T_ *list = NULL;
+    MRB_NODE_T_ *last = NULL;
+    intptr_t result;
+    size_t n = count;
+
+    if (n > mrb->capacity - mrb->count) {
+        n = mrb->capacity - mrb->count;
+    }
+    for (size_t i = 1; i < n; i++) {
+        MRB_KEYCMP(result, keys[i - 1], keys[i]);
+        if (result >= 0) {
+            n = 0;
+            break;
+        }
+    }
+    if (mrb->root != NULL || n == 0) {
+        // not empty, or not strictly ascending
+        for (size_t i = 0; i < count; i++) {
+            MC_FUN_(insert)(mrb, keys[i] MRB_VALUES_PARAM_(i));
+        }
+        return mrb->count;
+    }
+    // nodes are allocated in key order, so the tree is laid out in key order
+    // as far as the allocator allows
+    for (size_t i = 0; i < n; i++) {
+        struct MRB_NODE_KV *newnode = MRB_ALLOC_NODE_(mrb);
+        MC_ASSIGN_KEY_(newnode->key, keys[i]);
+#if MC_NO_VALUE - 0 == 0
+        MC_OPT_ASSIGN_VALUE_(newnode->value, values[i]);
+#endif
+        if (last == NULL) {
+            list = &newnode->node;
+        } else {
+            MRB_SET_CHILD_(last, 1, &newnode->node);
+        }
+        last = &newnode->node;
+    }
+    MRB_SET_CHILD_(last, 1, NULL);
+    mrb->root = MRB_BASE_(build_sorted_)(list, n);
+    mrb->count = n;
+    return mrb->count;
+}
+
 static inline MC_ITERATOR_T *
 MC_FUN_(iterase)(MC_T * const mrb,
                  MC_ITERATOR_T * const it)
@@ -515,7 +770,7 @@ MC_FUN_(iterase)(MC_T * const mrb,
 #if MC_NO_VALUE - 0 == 0
     MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)it)->value);
 #endif
-    mrb_erase_node_(&mrb->root, (struct mrb_node *)it);
+    MRB_BASE_(erase_node_)(&mrb->root, (MRB_NODE_T_ *)it);
     mrb->count--;
 
     MRB_FREE_NODE_(mrb, (struct MRB_NODE_KV *)it);
@@ -527,7 +782,7 @@ MC_FUN_(erase)(MC_T * const mrb,
                MC_KEY_T const key)
 {
     MC_DEF_VALUE_UNDEF_;
-    struct mrb_node *node = mrb->root;
+    MRB_NODE_T_ *node = mrb->root;
     MC_VALUE_T MC_OPT_PTR_ value;
     intptr_t result;
 
@@ -537,9 +792,9 @@ MC_FUN_(erase)(MC_T * const mrb,
             goto erase;
         }
         else if (result > 0) {
-            node = node->MRB_LEFT_;
+            node = MRB_LEFT_(node);
         } else {
-            node = node->MRB_RIGHT_;
+            node = MRB_RIGHT_(node);
         }
     }
     return undef_value;
@@ -552,7 +807,7 @@ erase:
     value = MC_OPT_ADDROF_ ((struct MRB_NODE_KV *)node)->key;
     MC_OPT_FREE_KEY_(((struct MRB_NODE_KV *)node)->key);
 #endif
-    mrb_erase_node_(&mrb->root, node);
+    MRB_BASE_(erase_node_)(&mrb->root, node);
     mrb->count--;
 
     MRB_FREE_NODE_(mrb, (struct MRB_NODE_KV *)node);
@@ -563,7 +818,7 @@ static inline MC_ITERATOR_T *
 MC_FUN_(itfind)(MC_T * const mrb,
                 MC_KEY_T const key)
 {
-    struct mrb_node *node;
+    MRB_NODE_T_ *node;
     intptr_t result;
 
     node = mrb->root;
@@ -573,9 +828,9 @@ MC_FUN_(itfind)(MC_T * const mrb,
             return (MC_ITERATOR_T *)node;
         }
         if (result > 0) {
-            node = node->MRB_LEFT_;
+            node = MRB_LEFT_(node);
         } else {
-            node = node->MRB_RIGHT_;
+            node = MRB_RIGHT_(node);
         }
     }
     return NULL;
@@ -585,8 +840,8 @@ static inline MC_ITERATOR_T *
 MC_FUN_(itfindnear)(MC_T * const mrb,
                     MC_KEY_T const key)
 {
-    struct mrb_node *node;
-    struct mrb_node *next_node;
+    MRB_NODE_T_ *node;
+    MRB_NODE_T_ *next_node;
     intptr_t result;
 
     node = mrb->root;
@@ -596,9 +851,9 @@ MC_FUN_(itfindnear)(MC_T * const mrb,
             return (MC_ITERATOR_T *)node;
         }
         if (result > 0) {
-            next_node = node->MRB_LEFT_;
+            next_node = MRB_LEFT_(node);
         } else {
-            next_node = node->MRB_RIGHT_;
+            next_node = MRB_RIGHT_(node);
         }
         if (next_node == NULL) {
             return (MC_ITERATOR_T *)node;
@@ -613,7 +868,7 @@ MC_FUN_(find)(MC_T * const mrb,
               MC_KEY_T const key)
 {
     MC_DEF_VALUE_UNDEF_;
-    struct mrb_node *node;
+    MRB_NODE_T_ *node;
     intptr_t result;
 
     node = mrb->root;
@@ -627,14 +882,449 @@ MC_FUN_(find)(MC_T * const mrb,
 #endif
         }
         else if (result > 0) {
-            node = node->MRB_LEFT_;
+            node = MRB_LEFT_(node);
         } else {
-            node = node->MRB_RIGHT_;
+            node = MRB_RIGHT_(node);
         }
     }
     return undef_value;
 }
 
+static inline MRB_NODE_T_ *
+MC_FUN_(lower_bound_node_)(MRB_NODE_T_ *node,
+                           MC_KEY_T const key)
+{
+    MRB_NODE_T_ *lower_bound = NULL;
+    intptr_t result;
+
+    while (node != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
+        if (result == 0) {
+            return node;
+        }
+        if (result > 0) {
+            lower_bound = node;
+            node = MRB_LEFT_(node);
+        } else {
+            node = MRB_RIGHT_(node);
+        }
+    }
+    return lower_bound;
+}
+
+// Frees the nodes of a tree cut out from mrb, leaves first, so no
+// rebalancing is needed. Keys and values are freed too unless they have been
+// moved elsewhere. Returns the number of nodes.
+static inline size_t
+MC_FUN_(free_subtree_)(MC_T * const mrb,
+                       MRB_NODE_T_ *node,
+                       const bool do_free_entries)
+{
+    size_t count = 0;
+
+    while (node != NULL) {
+        if (MRB_LEFT_(node) != NULL) {
+            node = MRB_LEFT_(node);
+        } else if (MRB_RIGHT_(node) != NULL) {
+            node = MRB_RIGHT_(node);
+        } else {
+            MRB_NODE_T_ * const parent = MRB_PARENT_(node);
+            if (parent != NULL) {
+                if (MRB_LEFT_(parent) == node) {
+                    MRB_SET_CHILD_(parent, 0, NULL);
+                } else {
+                    MRB_SET_CHILD_(parent, 1, NULL);
+                }
+            }
+            if (do_free_entries) {
+                MC_OPT_FREE_KEY_(((struct MRB_NODE_KV *)node)->key);
+#if MC_NO_VALUE - 0 == 0
+                MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)node)->value);
+#endif
+            }
+            MRB_FREE_NODE_(mrb, (struct MRB_NODE_KV *)node);
+            count++;
+            node = parent;
+        }
+    }
+    return count;
+}
+
+#if MC_MM_MODE != MC_MM_COMPACT
+// Moves the entries of count nodes, from node on in key order, to new nodes
+// from the pool of dst, which must be empty and have room for them. The new
+// nodes are allocated in key order and linked directly into a balanced tree
+// as in build_sorted, so this is O(count). The old nodes are left to the
+// caller.
+static inline void
+MC_FUN_(move_sorted_)(MC_T * const dst,
+                      MRB_NODE_T_ *node,
+                      const size_t count)
+{
+    MRB_NODE_T_ *list = NULL;
+    MRB_NODE_T_ *last = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        struct MRB_NODE_KV *newnode = MRB_ALLOC_NODE_(dst);
+        newnode->key = ((struct MRB_NODE_KV *)node)->key;
+#if MC_NO_VALUE - 0 == 0
+        newnode->value = ((struct MRB_NODE_KV *)node)->value;
+#endif
+        if (last == NULL) {
+            list = &newnode->node;
+        } else {
+            MRB_SET_CHILD_(last, 1, &newnode->node);
+        }
+        last = &newnode->node;
+        node = (MRB_NODE_T_ *)MC_FUN_(next)((MC_ITERATOR_T *)node);
+    }
+    MRB_SET_CHILD_(last, 1, NULL);
+    dst->root = MRB_BASE_(build_sorted_)(list, count);
+    dst->count = count;
+}
+#endif
+
+// Moves the entry of node from src to dst, without copying or freeing the
+// key and value. A node changes tree only in compact mode, otherwise the
+// entry gets a new node from the pool of dst. Returns false if dst is full.
+static inline bool
+MC_FUN_(move_node_)(MC_T * const dst,
+                    MC_T * const src,
+                    struct MRB_NODE_KV * const node)
+{
+    MRB_NODE_T_ *it;
+    MRB_NODE_T_ *parent;
+    struct MRB_NODE_KV *newnode;
+    intptr_t result;
+    int dir = 0;
+
+    it = dst->root;
+    parent = NULL;
+    while (it != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)it)->key, node->key);
+        if (result == 0) {
+            // as insert, the value is replaced and the old key is kept
+#if MC_NO_VALUE - 0 == 0
+            MC_OPT_FREE_VALUE_(((struct MRB_NODE_KV *)it)->value);
+            ((struct MRB_NODE_KV *)it)->value = node->value;
+#endif
+            MC_OPT_FREE_KEY_(node->key);
+            MRB_BASE_(erase_node_)(&src->root, &node->node);
+            src->count--;
+            MRB_FREE_NODE_(src, node);
+            return true;
+        }
+        parent = it;
+        dir = (result < 0);
+        it = MRB_CHILD_(it, dir);
+    }
+    if (dst->count == dst->capacity) {
+        return false;
+    }
+    MRB_BASE_(erase_node_)(&src->root, &node->node);
+    src->count--;
+#if MC_MM_MODE == MC_MM_COMPACT
+    newnode = node;
+#else
+    newnode = MRB_ALLOC_NODE_(dst);
+    newnode->key = node->key;
+#if MC_NO_VALUE - 0 == 0
+    newnode->value = node->value;
+#endif
+    MRB_FREE_NODE_(src, node);
+#endif
+    dst->count++;
+    MRB_BASE_(insert_node_)(&dst->root, &newnode->node, parent, MRB_INSERT_LINK_(dst, parent, dir));
+    return true;
+}
+
+#if MC_MM_MODE == MC_MM_COMPACT
+// Puts the nodes of [first, last) back between the two trees they were
+// split from, when dst could not take them.
+static inline void
+MC_FUN_(unsplit_)(MC_T * const mrb,
+                  MRB_NODE_T_ * const range,
+                  MC_KEY_T const last,
+                  const bool has_last)
+{
+    MRB_NODE_T_ *before = mrb->root;
+    MRB_NODE_T_ *after = NULL;
+    MRB_NODE_T_ * const node = has_last ? MC_FUN_(lower_bound_node_)(mrb->root, last) : NULL;
+
+    if (node != NULL) {
+        MRB_BASE_(split_before_)(node, &before, &after);
+    }
+    mrb->root = MRB_BASE_(concat_)(MRB_BASE_(concat_)(before, range), after);
+}
+#endif
+
+static inline bool
+MC_FUN_(extract_range_)(MC_T * const mrb,
+                        MC_KEY_T const first,
+                        MC_KEY_T const last,
+                        const bool has_last,
+                        MC_T * const dst)
+{
+    MRB_NODE_T_ *node = MC_FUN_(lower_bound_node_)(mrb->root, first);
+    intptr_t result;
+
+    if (dst->root != NULL) {
+        return false;
+    }
+    if (node == NULL) {
+        return true;
+    }
+    if (has_last) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, last);
+        if (result >= 0) {
+            return true;
+        }
+    }
+#if MC_MM_MODE == MC_MM_COMPACT
+    MRB_NODE_T_ *before, *range, *after = NULL;
+    MRB_BASE_(split_before_)(node, &before, &range);
+    node = has_last ? MC_FUN_(lower_bound_node_)(range, last) : NULL;
+    if (node != NULL) {
+        MRB_BASE_(split_before_)(node, &range, &after);
+    }
+    mrb->root = MRB_BASE_(concat_)(before, after);
+    const size_t count = MRB_BASE_(count_one_of_)(range, mrb->root, mrb->count);
+    if (count > dst->capacity) {
+        MC_FUN_(unsplit_)(mrb, range, last, has_last);
+        return false;
+    }
+    mrb->count -= count;
+    dst->root = range;
+    dst->count = count;
+    return true;
+#else
+    size_t count = 0;
+    MRB_NODE_T_ *it = node;
+    while (it != NULL) {
+        if (has_last) {
+            MRB_KEYCMP(result, ((struct MRB_NODE_KV *)it)->key, last);
+            if (result >= 0) {
+                break;
+            }
+        }
+        it = (MRB_NODE_T_ *)MC_FUN_(next)((MC_ITERATOR_T *)it);
+        count++;
+    }
+    if (count > dst->capacity) {
+        return false;
+    }
+    // cut the range out in O(log n), then move it to the pool of dst in O(m)
+    MRB_NODE_T_ *before, *range, *after = NULL;
+    MC_FUN_(move_sorted_)(dst, node, count);
+    MRB_BASE_(split_before_)(node, &before, &range);
+    if (it != NULL) {
+        MRB_BASE_(split_before_)(it, &range, &after);
+    }
+    mrb->root = MRB_BASE_(concat_)(before, after);
+    mrb->count -= MC_FUN_(free_subtree_)(mrb, range, false);
+    return true;
+#endif
+}
+
+// Moves the entries with keys not less than key to dst, which must be
+// empty. Returns false and moves nothing if dst is not empty or cannot hold
+// the entries.
+static inline bool
+MC_FUN_(split)(MC_T * const mrb,
+               MC_KEY_T const key,
+               MC_T * const dst)
+{
+    return MC_FUN_(extract_range_)(mrb, key, key, false, dst);
+}
+
+// As split, but moves the entries with keys in [first, last).
+static inline bool
+MC_FUN_(extract_range)(MC_T * const mrb,
+                       MC_KEY_T const first,
+                       MC_KEY_T const last,
+                       MC_T * const dst)
+{
+    return MC_FUN_(extract_range_)(mrb, first, last, true, dst);
+}
+
+// Moves all entries of src to dst. Entries from src replace entries with the
+// same key in dst, as with insert. Returns false if dst got full, then the
+// entries that did not fit are left in src.
+static inline bool
+MC_FUN_(merge)(MC_T * const dst,
+               MC_T * const src)
+{
+    MRB_NODE_T_ *node;
+    intptr_t result;
+
+    if (src->root == NULL) {
+        return true;
+    }
+#if MC_MM_MODE == MC_MM_COMPACT
+    if (src->count <= dst->capacity - dst->count) {
+        struct MRB_NODE_KV * const dst_first = (struct MRB_NODE_KV *)MC_FUN_(begin)(dst);
+        struct MRB_NODE_KV * const dst_last = (struct MRB_NODE_KV *)MC_FUN_(rbegin)(dst);
+        struct MRB_NODE_KV * const src_first = (struct MRB_NODE_KV *)MC_FUN_(begin)(src);
+        struct MRB_NODE_KV * const src_last = (struct MRB_NODE_KV *)MC_FUN_(rbegin)(src);
+        bool is_joined = false;
+        if (dst_first == NULL) {
+            dst->root = src->root;
+            is_joined = true;
+        } else {
+            MRB_KEYCMP(result, dst_last->key, src_first->key);
+            if (result < 0) {
+                dst->root = MRB_BASE_(concat_)(dst->root, src->root);
+                is_joined = true;
+            } else {
+                MRB_KEYCMP(result, src_last->key, dst_first->key);
+                if (result < 0) {
+                    dst->root = MRB_BASE_(concat_)(src->root, dst->root);
+                    is_joined = true;
+                }
+            }
+        }
+        if (is_joined) {
+            dst->count += src->count;
+            src->root = NULL;
+            src->count = 0;
+            return true;
+        }
+    }
+#endif
+#if MC_MM_MODE != MC_MM_COMPACT
+    if (dst->root == NULL && src->count <= dst->capacity) {
+        MC_FUN_(move_sorted_)(dst, (MRB_NODE_T_ *)MC_FUN_(begin)(src), src->count);
+        MC_FUN_(free_subtree_)(src, src->root, false);
+        src->root = NULL;
+        src->count = 0;
+        return true;
+    }
+#endif
+    // overlapping key ranges, or the nodes belong to the pool of src
+    (void)result;
+    node = (MRB_NODE_T_ *)MC_FUN_(begin)(src);
+    while (node != NULL) {
+        MRB_NODE_T_ *next = (MRB_NODE_T_ *)MC_FUN_(next)((MC_ITERATOR_T *)node);
+        if (!MC_FUN_(move_node_)(dst, src, (struct MRB_NODE_KV *)node)) {
+            return false;
+        }
+        node = next;
+    }
+    return true;
+}
+
+// Returns the first entry with a key not less than key, or end.
+static inline MC_ITERATOR_T *
+MC_FUN_(itlower_bound)(MC_T * const mrb,
+                       MC_KEY_T const key)
+{
+    return (MC_ITERATOR_T *)MC_FUN_(lower_bound_node_)(mrb->root, key);
+}
+
+// Returns the first entry with a key greater than key, or end.
+static inline MC_ITERATOR_T *
+MC_FUN_(itupper_bound)(MC_T * const mrb,
+                       MC_KEY_T const key)
+{
+    MRB_NODE_T_ *node = mrb->root;
+    MRB_NODE_T_ *upper_bound = NULL;
+    intptr_t result;
+
+    while (node != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
+        if (result > 0) {
+            upper_bound = node;
+            node = MRB_LEFT_(node);
+        } else {
+            node = MRB_RIGHT_(node);
+        }
+    }
+    return (MC_ITERATOR_T *)upper_bound;
+}
+
+// Erases the entries in [first, last) and returns last. A short range is
+// erased entry by entry, a longer one is cut out with two splits and a join
+// in O(log n), and its nodes are then freed without rebalancing.
+static inline MC_ITERATOR_T *
+MC_FUN_(erase_range)(MC_T * const mrb,
+                     MC_ITERATOR_T *first,
+                     MC_ITERATOR_T * const last)
+{
+    MC_ITERATOR_T *it = first;
+    MRB_NODE_T_ *before;
+    MRB_NODE_T_ *range;
+    MRB_NODE_T_ *after = NULL;
+
+    for (unsigned i = 0; i < 16 && it != last; i++) {
+        it = MC_FUN_(next)(it);
+    }
+    if (it == last) {
+        while (first != last) {
+            first = MC_FUN_(iterase)(mrb, first);
+        }
+        return last;
+    }
+    MRB_BASE_(split_before_)((MRB_NODE_T_ *)first, &before, &range);
+    if (last != MC_FUN_(end)()) {
+        MRB_BASE_(split_before_)((MRB_NODE_T_ *)last, &range, &after);
+    }
+    mrb->root = MRB_BASE_(concat_)(before, after);
+    mrb->count -= MC_FUN_(free_subtree_)(mrb, range, true);
+    return last;
+}
+
+#if MRB_ORDER_STATISTIC - 0 != 0
+// Returns the number of keys less than key.
+static inline size_t
+MC_FUN_(rank)(MC_T * const mrb,
+              MC_KEY_T const key)
+{
+    MRB_NODE_T_ *node = mrb->root;
+    size_t rank = 0;
+    intptr_t result;
+
+    while (node != NULL) {
+        MRB_KEYCMP(result, ((struct MRB_NODE_KV *)node)->key, key);
+        if (result == 0) {
+            return rank + mrb_os_size_(MRB_LEFT_(node));
+        }
+        if (result > 0) {
+            node = MRB_LEFT_(node);
+        } else {
+            rank += mrb_os_size_(MRB_LEFT_(node)) + 1;
+            node = MRB_RIGHT_(node);
+        }
+    }
+    return rank;
+}
+
+// Returns the position of the iterator in key order.
+static inline size_t
+MC_FUN_(itrank)(MC_ITERATOR_T * const it)
+{
+    return mrb_os_rank_((MRB_NODE_T_ *)it);
+}
+
+// Returns the entry at position index in key order, or end if out of range.
+static inline MC_ITERATOR_T *
+MC_FUN_(select)(MC_T * const mrb,
+                const size_t index)
+{
+    return (MC_ITERATOR_T *)mrb_os_select_(mrb->root, index);
+}
+
+// Returns the number of keys in [first, last).
+static inline size_t
+MC_FUN_(count_range)(MC_T * const mrb,
+                     MC_KEY_T const first,
+                     MC_KEY_T const last)
+{
+    const size_t first_rank = MC_FUN_(rank)(mrb, first);
+    const size_t last_rank = MC_FUN_(rank)(mrb, last);
+    return last_rank > first_rank ? last_rank - first_rank : 0;
+}
+#endif // MRB_ORDER_STATISTIC
+
 static inline MC_KEY_T
 MC_FUN_(key)(MC_ITERATOR_T * const it)
 {
@@ -672,4 +1362,15 @@ MC_FUN_(setval)(MC_ITERATOR_T * const it MC_OPT_VALUE_INSERT_ARG_)
 #undef MRB_ALLOC_NODE_
 #undef MRB_FREE_NODE_
 #undef MRB_LEFT_
+#undef MRB_BASE_
+#undef MRB_ORDER_STATISTIC
+#undef MRB_LINK32
+#undef MRB_THREADED
 #undef MRB_RIGHT_
+#undef MRB_CHILD_
+#undef MRB_SET_CHILD_
+#undef MRB_PARENT_
+#undef MRB_NODE_T_
+#undef MRB_INSERT_LINK_
+#undef MRB_VALUES_ARG_
+#undef MRB_VALUES_PARAM_
@@ -7,7 +7,10 @@
 #ifndef MRX_BASE_H
 #define MRX_BASE_H
 
+#include <string.h>
+
 #include <mc_arch.h>
+#include <bitops.h>
 #include <nodepool_base.h>
 
 #if ARCH_BIG_ENDIAN - 0 != 0
@@ -23,16 +26,27 @@ struct mrx_buddyalloc {
 #elif ARCH_SIZEOF_PTR == 8
     void *freelists[3];
 #endif
-    struct nodepool superblocks;
+    union {
+        struct nodepool superblocks;
+        struct { // static mode, 128 byte superblocks from a caller-supplied region
+            void *freelist;
+            uintptr_t base;
+            uintptr_t fresh_ptr;
+            uintptr_t fresh_end;
+            uintptr_t free_count; // free superblocks, freelist and fresh part
+        } region;
+    } sb;
 };
 
 struct mrx_base_t_ {
     union mrx_node *root;
     uintptr_t count;
     uintptr_t capacity;
-#define MRX_FLAGS_MASK_ 0x80000000u
+#define MRX_FLAGS_MASK_ 0xC0000000u
 #define MRX_FLAG_IS_COMPACT_ 0x80000000u
+#define MRX_FLAG_IS_STATIC_ 0x40000000u
     uint32_t max_keylen_n_flags;
+    uint32_t mod_count; // changed on every insert/erase of a key
     struct mrx_buddyalloc nodealloc[];
 };
 
@@ -114,11 +128,157 @@ mrx_node_value_ref_(union mrx_node *node,
 }
 #endif
 
+union mrx_next_block {
+    mrx_sp_t sp[32];
+    struct {
+#define MRX_NEXT_BLOCK_LONG_PTR_HDR_ 0x5u
+        uint32_t hdr_and_pad_; // access header through macros instead
+        uint32_t lp_count;
+#define MRX_NEXT_BLOCK_MAX_LP_COUNT_ 14u
+        union mrx_node *lp[MRX_NEXT_BLOCK_MAX_LP_COUNT_];
+        union mrx_next_block *next;
+    } lp;
+};
+
+/*
+  Node access needed for the inline descent, mrx_find_fixed_(). Short
+  pointers are expanded with MRX_EP_() (prefix from reference pointer) or
+  MRX_EP2_() (prefix given separately), see mrx_base_int.h.
+ */
+#define MRX_SP_MASK_ 0xFFFFFFF8u
+#define MRX_SP_ALIGN_(ptr) ((mrx_sp_t *)(((uintptr_t)(ptr) + 3u) & ~((uintptr_t)3u)))
+#if ARCH_SIZEOF_PTR == 4
+#define MRX_EP_(lo_ptr, ref) ((void *)(uintptr_t)((lo_ptr) & MRX_SP_MASK_))
+#define MRX_EP2_(lo_ptr, hi_ptr) ((void *)(uintptr_t)((lo_ptr) & MRX_SP_MASK_))
+#define MRX_NEXT_BLOCK_IS_SHORT_PTR_(nx) 1u
+#elif ARCH_SIZEOF_PTR == 8
+#define MRX_EP_(lo_ptr, ref)  ((void *)((uintptr_t)((lo_ptr) & MRX_SP_MASK_) | ((uintptr_t)(ref) & 0xFFFFFFFF00000000u)))
+#define MRX_EP2_(lo_ptr, hi_ptr) ((void *)((uintptr_t)((lo_ptr) & MRX_SP_MASK_) | ((uintptr_t)(hi_ptr) << 32u)))
+#define MRX_NEXT_BLOCK_IS_SHORT_PTR_(nx) (MRX_NEXT_BLOCK_HDR_(nx) != MRX_NEXT_BLOCK_LONG_PTR_HDR_)
+#endif
+#define MRX_NEXT_BLOCK_HDR_(nx) ((nx)->sp[0] & ~MRX_SP_MASK_)
+#define MRX_HDR_BIT_HAS_VALUE_ 0x0100u
+#define MRX_HDR_HAS_VALUE_(hdr) (((unsigned)(hdr) & MRX_HDR_BIT_HAS_VALUE_) != 0)
+#define MRX_HDR_PX_LEN_(hdr) ((hdr) >> 9u)
+#define MRX_HDR_BR_LEN_(hdr) ((((unsigned)(hdr) >> 4u) & 0x0Fu) | ((((unsigned)(hdr) & ((unsigned)(hdr) >> 2u)) << 4u) & 0x10u))
+
+static inline union mrx_node *
+mrx_scan_node_get_child1_(const union mrx_node *node,
+                          const mrx_sp_t *brp,
+                          const uint8_t br_pos)
+{
+    if (MRX_HDR_IS_SHORT_PTR_(node->hdr)) {
+        return MRX_EP_(brp[br_pos], node);
+    }
+    const struct mrx_ptrpfx_node * const *pfxref =
+        (const struct mrx_ptrpfx_node * const *)MRX_NODE_VALUE_REF_(node, MRX_NODE_HDR_NSZ_(node->hdr));
+    const mrx_sp_t *bp = &brp[br_pos];
+    if ((uintptr_t)bp < (uintptr_t)pfxref) {
+        return MRX_EP2_(*bp, (*pfxref)->hp[br_pos]);
+    }
+    const unsigned idx = ((uintptr_t)bp - (uintptr_t)pfxref) >> 2u;
+    return MRX_EP2_((*pfxref)->orig.sp[idx], (*pfxref)->hp[br_pos]);
+}
+
+static inline union mrx_next_block *
+mrx_mask_node_get_next_block_(const union mrx_node * const node,
+                              const uint32_t b)
+{
+    union mrx_next_block *nx;
+    if (MRX_HDR_IS_SHORT_PTR_(node->hdr)) {
+        nx = MRX_EP_(node->mn.next[b >> 5u], node);
+    } else {
+        nx = MRX_EP2_(node->mn.next[b >> 5u], node->mn.local[b >> 5u]);
+    }
+    return nx;
+}
+
+static inline union mrx_node *
+mrx_next_block_get_child_(const union mrx_next_block *nx,
+                          uint32_t bidx)
+{
+    union mrx_node *node;
+    if (MRX_NEXT_BLOCK_IS_SHORT_PTR_(nx)) {
+        node = MRX_EP_(nx->sp[bidx], nx);
+    } else {
+        while (bidx >= MRX_NEXT_BLOCK_MAX_LP_COUNT_) {
+            nx = nx->lp.next;
+            bidx -= MRX_NEXT_BLOCK_MAX_LP_COUNT_;
+        }
+        node = nx->lp.lp[bidx];
+    }
+    return node;
+}
+
+/*
+  Inline find for trees where all keys have the same length, intended to be
+  called with a compile-time constant key_length so the loop is specialized
+  for it. As no key is a prefix of another the key end is always at a node
+  with a value, so there is no remaining length to track. Prefixes and
+  branch octets of fixed size keys are short, so plain octet loops are used
+  instead of the SIMD dispatched functions of mrx_find_().
+ */
+static inline void **
+mrx_find_fixed_(union mrx_node *root, // must not be NULL
+                const uint8_t key[],
+                const unsigned key_length)
+{
+    const uint8_t *s = key;
+    const uint8_t * const end = &key[key_length];
+    union mrx_node *node = root;
+
+    for (;;) {
+        const uint8_t nsz = MRX_NODE_HDR_NSZ_(node->hdr);
+        const uint8_t px_len = MRX_HDR_PX_LEN_(node->hdr);
+
+        if (px_len > 0) {
+            if (memcmp(s, node->sn.octets, px_len) != 0) {
+                return NULL;
+            }
+            s += px_len;
+        }
+        if (s == end) {
+            return mrx_node_value_ref_(node, nsz);
+        }
+        if (!MRX_IS_MASK_NODE_(nsz)) {
+            const uint8_t br_len = MRX_HDR_BR_LEN_(node->hdr);
+            const uint8_t *br = &node->sn.octets[px_len];
+            uint8_t br_pos;
+            for (br_pos = 0; br_pos < br_len && br[br_pos] != *s; br_pos++);
+            if (br_pos == br_len) {
+                return NULL;
+            }
+            node = mrx_scan_node_get_child1_(node, MRX_SP_ALIGN_(&br[br_len]), br_pos);
+        } else {
+            uint32_t b = *s;
+            uint32_t bm = node->mn.bitmask.u32[b >> 5u];
+            union mrx_next_block *nx = mrx_mask_node_get_next_block_(node, b);
+            b = 1u << (b & 0x1Fu);
+            if ((bm & b) == 0) {
+                return NULL;
+            }
+            bm &= b - 1;
+            node = mrx_next_block_get_child_(nx, bit32_count(bm));
+        }
+        s++;
+    }
+}
+
 void
 mrx_init_(mrx_base_t *mrx,
           size_t capacity,
           bool is_compact);
 
+// Superblocks an insert of a key of the given length may need at most, the
+// static mode refuses an insert with fewer than that left in the region.
+#define MRX_STATIC_INSERT_RESERVE_(key_len) (16u + (key_len) / 64u)
+
+void
+mrx_init_static_(mrx_base_t *mrx,
+                 size_t capacity,
+                 void *region,
+                 size_t region_size);
+
 void
 mrx_clear_(mrx_base_t *mrx);
 
@@ -147,18 +307,292 @@ mrx_findnear_(union mrx_node *root,
               unsigned string_length,
               int *match_len);
 
+unsigned
+mrx_findprefixes_(union mrx_node *root,
+                  const uint8_t string[],
+                  unsigned string_length,
+                  void **vrefs[],
+                  unsigned match_lens[]);
+
+struct mrx_iterator_path_element {
+    union mrx_node *node;
+    int16_t br_pos;
+    uint8_t br;
+};
+
+// Insert cursor, keeps the path of the last insert.
+typedef struct {
+    mrx_base_t *mrx;
+    uint32_t mod_count;
+    int level; // deepest path level that can be reused, -1 if none
+    unsigned capacity;
+    uint8_t *key;
+    struct mrx_iterator_path_element *path;
+    unsigned *depth; // key offset of each path node
+} mrx_cursor_t;
+
+bool
+mrx_cursor_init_(mrx_base_t *mrx,
+                 mrx_cursor_t *cursor);
+
+void
+mrx_cursor_free_(mrx_cursor_t *cursor);
+
+void **
+mrx_insert_hint_(mrx_cursor_t *cursor,
+                 const uint8_t string[],
+                 unsigned string_length,
+                 bool *is_occupied);
+
 void *
 mrx_erase_(mrx_base_t *mrx,
            const uint8_t string[],
            unsigned string_length,
            bool *was_erased);
 
-struct mrx_iterator_path_element {
-    union mrx_node *node;
-    int16_t br_pos;
-    uint8_t br;
+// First (back false) or last key in key order, up to key_size octets of
+// the key are copied to key[].
+void **
+mrx_peek_(union mrx_node *root,
+          bool back,
+          uint8_t key[],
+          unsigned key_size,
+          unsigned *key_len);
+
+void *
+mrx_pop_(mrx_base_t *mrx,
+         bool back,
+         uint8_t key[],
+         unsigned key_size,
+         unsigned *key_len);
+
+void
+mrx_bulk_order_(const uint16_t partition[],
+                size_t count,
+                uint32_t order[],
+                uint32_t tmp[]);
+
+// Inserts key idx of the input into part, without its first octet. Returns
+// false if the key could not be inserted.
+typedef bool (*mrx_build_insert_cb_t)(mrx_base_t *part, size_t idx, void *arg);
+
+bool
+mrx_build_parallel_(mrx_base_t *mrx,
+                    const uint16_t partition[],
+                    const uint32_t order[],
+                    size_t count,
+                    unsigned thread_count,
+                    mrx_build_insert_cb_t cb,
+                    void *cb_arg,
+                    size_t *inserted);
+
+enum mrx_setop {
+    MRX_SETOP_UNION,
+    MRX_SETOP_INTERSECTION,
+    MRX_SETOP_DIFFERENCE
 };
 
+// Called in key order, vref_a/vref_b is NULL if the key is not in a/b.
+typedef void (*mrx_setop_cb_t)(const uint8_t key[], unsigned key_len,
+                               void **vref_a, void **vref_b, void *arg);
+
+// Returns false if memory allocation fails, which can only happen for long
+// keys.
+bool
+mrx_setop_(mrx_base_t *a,
+           mrx_base_t *b,
+           enum mrx_setop op,
+           mrx_setop_cb_t cb,
+           void *cb_arg);
+
+// Called for each key within bound, in key order.
+typedef void (*mrx_fuzzy_cb_t)(const uint8_t key[], unsigned key_len,
+                               unsigned distance, void **vref, void *arg);
+
+void
+mrx_fuzzy_find_(mrx_base_t *mrx,
+                const uint8_t query[],
+                unsigned query_len,
+                unsigned max_distance,
+                mrx_fuzzy_cb_t cb,
+                void *cb_arg);
+
+// Called for each stored value, in key order. Keys are not reconstructed,
+// which makes it cheaper than iteration when only values are of interest.
+typedef void (*mrx_value_cb_t)(void **vref, void *arg);
+
+void
+mrx_foreach_value_(mrx_base_t *mrx,
+                   mrx_value_cb_t cb,
+                   void *cb_arg);
+
+size_t
+mrx_erase_prefix_(mrx_base_t *mrx,
+                  const uint8_t prefix[],
+                  unsigned prefix_length,
+                  mrx_value_cb_t cb,
+                  void *cb_arg);
+
+void **
+mrx_lpm_insert_(mrx_base_t *mrx,
+                const uint8_t prefix[],
+                unsigned bit_len,
+                bool *is_occupied);
+
+void **
+mrx_lpm_find_(mrx_base_t *mrx,
+              const uint8_t prefix[],
+              unsigned bit_len);
+
+void *
+mrx_lpm_erase_(mrx_base_t *mrx,
+               const uint8_t prefix[],
+               unsigned bit_len,
+               bool *was_erased);
+
+void **
+mrx_lpm_lookup_(mrx_base_t *mrx,
+                const uint8_t addr[],
+                unsigned addr_len,
+                unsigned *match_bit_len);
+
+void
+mrx_lpm_clear_entries_(mrx_base_t *mrx,
+                       void (*free_value)(void *value));
+
+#define MRX_INTERN_NO_ID 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t count;
+    uint32_t strings_capacity;
+    const uint8_t **strings; // ID to string
+    struct mrx_intern_chunk *chunks;
+    mrx_base_t mrx; // must be last
+} mrx_intern_base_t;
+
+uint64_t
+mrx_intern_hash_(const uint8_t s[],
+                 size_t len);
+
+void
+mrx_intern_init_(mrx_intern_base_t *pool,
+                 size_t capacity,
+                 bool compact);
+
+void
+mrx_intern_clear_(mrx_intern_base_t *pool);
+
+void
+mrx_intern_delete_(mrx_intern_base_t *pool);
+
+uint32_t
+mrx_intern_(mrx_intern_base_t *pool,
+            const uint8_t s[],
+            size_t len);
+
+uint32_t
+mrx_intern_find_(const mrx_intern_base_t *pool,
+                 const uint8_t s[],
+                 size_t len);
+
+const uint8_t *
+mrx_intern_str_(const mrx_intern_base_t *pool,
+                uint32_t id,
+                size_t *len);
+
+size_t
+mrx_intern_batch_(mrx_intern_base_t *pool,
+                  const uint8_t * const strs[],
+                  const size_t lens[],
+                  size_t count,
+                  uint32_t ids[]);
+
+void
+mrx_intern_find_batch_(const mrx_intern_base_t *pool,
+                       const uint8_t * const strs[],
+                       const size_t lens[],
+                       size_t count,
+                       uint32_t ids[]);
+
+typedef struct {
+    mrx_base_t *maxes; // max score below each branch of the key trie
+    mrx_base_t mrx; // key to score, must be last
+} mrx_topk_base_t;
+
+// Called for each result, in descending score order.
+typedef void (*mrx_topk_cb_t)(const uint8_t key[], unsigned key_len,
+                              uint32_t score, void *arg);
+
+bool
+mrx_topk_init_(mrx_topk_base_t *t,
+               size_t capacity,
+               bool compact);
+
+void
+mrx_topk_clear_(mrx_topk_base_t *t);
+
+void
+mrx_topk_delete_(mrx_topk_base_t *t);
+
+bool
+mrx_topk_insert_(mrx_topk_base_t *t,
+                 const uint8_t key[],
+                 unsigned key_len,
+                 uint32_t score);
+
+bool
+mrx_topk_find_(const mrx_topk_base_t *t,
+               const uint8_t key[],
+               unsigned key_len,
+               uint32_t *score);
+
+bool
+mrx_topk_erase_(mrx_topk_base_t *t,
+                const uint8_t key[],
+                unsigned key_len);
+
+size_t
+mrx_topk_query_(const mrx_topk_base_t *t,
+                const uint8_t prefix[],
+                unsigned prefix_len,
+                size_t k,
+                mrx_topk_cb_t cb,
+                void *cb_arg);
+
+// Aho-Corasick automaton compiled from the keys of a tree, see mrx_ac.c.
+typedef struct mrx_ac mrx_ac_t;
+
+// Match state carried between text chunks.
+typedef struct {
+    uint32_t state;
+    uint64_t pos; // stream offset of the next chunk
+} mrx_ac_stream_t;
+
+// Called for each match, the key occupies stream offsets
+// [end_pos - key_len, end_pos).
+typedef void (*mrx_ac_cb_t)(uint64_t end_pos, unsigned key_len,
+                            void **vref, void *arg);
+
+mrx_ac_t *
+mrx_ac_compile_(mrx_base_t *mrx);
+
+void
+mrx_ac_delete(mrx_ac_t *ac);
+
+size_t
+mrx_ac_state_count(const mrx_ac_t *ac);
+
+void
+mrx_ac_stream_init(mrx_ac_stream_t *stream);
+
+void
+mrx_ac_match(const mrx_ac_t *ac,
+             mrx_ac_stream_t *stream,
+             const uint8_t text[],
+             size_t text_len,
+             mrx_ac_cb_t cb,
+             void *cb_arg);
+
 struct mrx_iterator_t_ {
     uint8_t *key;
     int level;
@@ -177,6 +611,12 @@ void
 mrx_itinit_(mrx_base_t *mrx,
             mrx_iterator_t *it);
 
+bool
+mrx_itinit_lower_bound_(mrx_base_t *mrx,
+                        mrx_iterator_t *it,
+                        const uint8_t key[],
+                        unsigned key_len);
+
 bool
 mrx_next_(mrx_iterator_t *it);
 
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  String interning pool, based on the radix tree.
+
+  Maps strings to dense 32 bit IDs, assigned in interning order starting
+  from zero, and IDs back to strings. The string bytes are stored only once,
+  and the string pointers returned by mrx_intern_str() stay valid until the
+  pool is cleared or deleted. Strings are not erased one by one, as that
+  would break the density of IDs.
+
+  mrx_intern_batch() and mrx_intern_find_batch() process arrays of strings
+  (lens may be NULL for NUL-terminated strings). Large batches are looked up
+  in hash order for better cache locality, but IDs are still assigned in
+  input order.
+
+  MRX_INTERN_NO_ID is returned by find for strings not in the pool, and by
+  intern on memory allocation failure or if node capacity is reached.
+
+  Default configuration:
+
+  Pool named mrx_intern, in compact memory management mode.
+*/
+
+/*
+
+  Design notes: see mrx_intern.c
+
+*/
+
+#ifndef MC_PREFIX
+#define MC_PREFIX mrx_intern
+#endif
+
+#if defined(MC_KEY_T) || defined(MC_VALUE_T)
+#error "MC_KEY_T and MC_VALUE_T should not be defined for the interning pool, keys are strings and values IDs."
+#endif
+#define MC_KEY_T const char *
+#define MC_VALUE_T uint32_t
+
+#define MC_ASSOCIATIVE_CONTAINER_ 1
+#define MC_MM_DEFAULT_ MC_MM_COMPACT
+#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_COMPACT)
+#include <mc_tmpl.h>
+
+#ifndef MRX_INTERN_TMPL_ONCE_
+#define MRX_INTERN_TMPL_ONCE_
+#include <string.h>
+
+#include <mrx_base.h>
+#endif
+
+typedef struct MC_T_ {
+    mrx_intern_base_t pool;
+} MC_T;
+
+static inline MC_T *
+MC_FUN_(new)(const size_t capacity)
+{
+    MC_T *pool;
+
+#if MC_MM_MODE == MC_MM_COMPACT
+    if ((pool = malloc(sizeof(MC_T))) == NULL) {
+        return NULL;
+    }
+    mrx_intern_init_(&pool->pool, capacity, 1);
+#else
+    if ((pool = malloc(sizeof(MC_T) + sizeof(struct mrx_buddyalloc))) == NULL) {
+        return NULL;
+    }
+    mrx_intern_init_(&pool->pool, capacity, 0);
+#endif
+    return pool;
+}
+
+static inline void
+MC_FUN_(delete)(MC_T * const pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    mrx_intern_delete_(&pool->pool);
+    free(pool);
+}
+
+static inline void
+MC_FUN_(clear)(MC_T * const pool)
+{
+    mrx_intern_clear_(&pool->pool);
+}
+
+static inline int
+MC_FUN_(empty)(MC_T * const pool)
+{
+    return (pool->pool.count == 0);
+}
+
+static inline size_t
+MC_FUN_(size)(MC_T * const pool)
+{
+    return pool->pool.count;
+}
+
+static inline uint32_t
+MC_FUN_(intern)(MC_T * const pool,
+                MC_KEY_T const str,
+                const size_t len)
+{
+    return mrx_intern_(&pool->pool, (const uint8_t *)str, len);
+}
+
+static inline uint32_t
+MC_FUN_(internnt)(MC_T * const pool,
+                  MC_KEY_T const str)
+{
+    return mrx_intern_(&pool->pool, (const uint8_t *)str, strlen(str));
+}
+
+static inline uint32_t
+MC_FUN_(find)(MC_T * const pool,
+              MC_KEY_T const str,
+              const size_t len)
+{
+    return mrx_intern_find_(&pool->pool, (const uint8_t *)str, len);
+}
+
+static inline uint32_t
+MC_FUN_(findnt)(MC_T * const pool,
+                MC_KEY_T const str)
+{
+    return mrx_intern_find_(&pool->pool, (const uint8_t *)str, strlen(str));
+}
+
+// Returns NULL for unknown IDs, len may be NULL. Strings are NUL-terminated.
+static inline const char *
+MC_FUN_(str)(MC_T * const pool,
+             const uint32_t id,
+             size_t * const len)
+{
+    return (const char *)mrx_intern_str_(&pool->pool, id, len);
+}
+
+// Returns number of strings interned, which is less than count on failure.
+static inline size_t
+MC_FUN_(intern_batch)(MC_T * const pool,
+                      MC_KEY_T const strs[],
+                      const size_t lens[],
+                      const size_t count,
+                      uint32_t ids[])
+{
+    return mrx_intern_batch_(&pool->pool, (const uint8_t * const *)strs, lens, count, ids);
+}
+
+static inline void
+MC_FUN_(find_batch)(MC_T * const pool,
+                    MC_KEY_T const strs[],
+                    const size_t lens[],
+                    const size_t count,
+                    uint32_t ids[])
+{
+    mrx_intern_find_batch_(&pool->pool, (const uint8_t * const *)strs, lens, count, ids);
+}
+
+#include <mc_tmpl_undef.h>
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+
+  Self-contained header with an order-preserving composite key encoder, to
+  build radix tree keys from tuples of integers, floats and strings, such
+  that memcmp() order of the encoded keys (and thus mrx iteration order) is
+  the same as the lexicographic order of the tuples.
+
+  Encoding, field by field:
+
+  mrx_keyenc_u8/16/32/64() - unsigned integers, big endian.
+  mrx_keyenc_i8/16/32/64() - signed integers, big endian with the sign bit
+                             flipped.
+  mrx_keyenc_f32/f64()     - IEEE 754 floats, big endian, with the sign bit
+                             flipped for positive values and all bits flipped
+                             for negative values. -0.0 sorts before +0.0, and
+                             NaNs with sign bit clear sort after +inf.
+  mrx_keyenc_str()         - octet strings, with 0x00 escaped as 0x00 0xFF
+                             and terminated by 0x00 0x01, so a string sorts
+                             before any longer string it is a prefix of,
+                             and the fields that follow it cannot interfere.
+  mrx_keyenc_strprefix()   - escaped string without terminator, for building
+                             the key prefix shared by all tuples whose string
+                             field starts with the given string.
+
+  The encoder writes to a caller supplied buffer, typically on the stack, so
+  there is no heap allocation per key. If the buffer is too small the encoder
+  sets its overflow flag, and the field that did not fit and all subsequent
+  fields are ignored, so it is enough to check mrx_keyenc_ok() once after the
+  last field:
+
+    uint8_t buf[64];
+    mrx_keyenc_t enc;
+    mrx_keyenc_init(&enc, buf, sizeof(buf));
+    mrx_keyenc_u32(&enc, tenant_id);
+    mrx_keyenc_i64(&enc, timestamp);
+    mrx_keyenc_strnt(&enc, name);
+    if (mrx_keyenc_ok(&enc)) {
+        mrx_insert(tree, (const char *)buf, enc.len, value);
+    }
+
+  Encoded keys may contain zero octets, so the sized mrx functions must be
+  used rather than the *nt() variants. As the encoding of leading fields is a
+  prefix of the full key, all tuples with the same leading fields can be
+  reached with prefix operations such as mrx_erase_prefix(). For prefix and
+  range scans, encode the leading fields (or the lower end of the range) and
+  seek with mrx_lower_bound(), then iterate until the key no longer starts
+  with the prefix or passes the encoded upper end. With mrx_lower_boundst()
+  the iterator lives in caller-supplied space, so leaving the loop early
+  needs no cleanup:
+
+    void *itspace = alloca(mrx_itsize(tree));
+    mrx_keyenc_init(&enc, buf, sizeof(buf));
+    mrx_keyenc_u32(&enc, tenant_id);
+    mrx_keyenc_i64(&enc, from_timestamp);
+    for (it = mrx_lower_boundst(tree, (const char *)buf, enc.len, itspace);
+         it != mrx_end() && mrx_keylen(it) >= 4 &&
+             memcmp(mrx_key(it), buf, 4) == 0; // same tenant
+         it = mrx_next(it)) {
+        ...
+    }
+
+  The decoder reads fields back in the same order from an encoded key, such
+  as the result of mrx_key() and mrx_keylen(). On malformed or truncated
+  input it sets its error flag and returns zero values for remaining fields.
+  mrx_keydec_str() copies the unescaped string into a caller supplied buffer
+  (which may be NULL to skip the field) and returns the full string length,
+  NUL-terminating the copy if there is room.
+
+*/
+
+#ifndef MRX_KEYENC_H
+#define MRX_KEYENC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MRX_KEYENC_STR_ESCAPE_ 0xFFu
+#define MRX_KEYENC_STR_END_ 0x01u
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} mrx_keyenc_t;
+
+typedef struct {
+    const uint8_t *key;
+    size_t len;
+    size_t pos;
+    bool error;
+} mrx_keydec_t;
+
+static inline void
+mrx_keyenc_init(mrx_keyenc_t *enc,
+                void *buf,
+                const size_t size)
+{
+    enc->buf = (uint8_t *)buf;
+    enc->size = size;
+    enc->len = 0;
+    enc->overflow = false;
+}
+
+static inline bool
+mrx_keyenc_ok(const mrx_keyenc_t *enc)
+{
+    return !enc->overflow;
+}
+
+static inline uint8_t *
+mrx_keyenc_reserve_(mrx_keyenc_t *enc,
+                    const size_t len)
+{
+    if (enc->overflow || enc->size - enc->len < len) {
+        enc->overflow = true;
+        return NULL;
+    }
+    uint8_t *p = &enc->buf[enc->len];
+    enc->len += len;
+    return p;
+}
+
+static inline void
+mrx_keyenc_be_(mrx_keyenc_t *enc,
+               const uint64_t v,
+               const unsigned size)
+{
+    uint8_t *p = mrx_keyenc_reserve_(enc, size);
+    if (p == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < size; i++) {
+        p[i] = (uint8_t)(v >> (8u * (size - 1 - i)));
+    }
+}
+
+static inline void
+mrx_keyenc_u8(mrx_keyenc_t *enc,
+              const uint8_t v)
+{
+    mrx_keyenc_be_(enc, v, 1);
+}
+
+static inline void
+mrx_keyenc_u16(mrx_keyenc_t *enc,
+               const uint16_t v)
+{
+    mrx_keyenc_be_(enc, v, 2);
+}
+
+static inline void
+mrx_keyenc_u32(mrx_keyenc_t *enc,
+               const uint32_t v)
+{
+    mrx_keyenc_be_(enc, v, 4);
+}
+
+static inline void
+mrx_keyenc_u64(mrx_keyenc_t *enc,
+               const uint64_t v)
+{
+    mrx_keyenc_be_(enc, v, 8);
+}
+
+static inline void
+mrx_keyenc_i8(mrx_keyenc_t *enc,
+              const int8_t v)
+{
+    mrx_keyenc_be_(enc, (uint8_t)v ^ 0x80u, 1);
+}
+
+static inline void
+mrx_keyenc_i16(mrx_keyenc_t *enc,
+               const int16_t v)
+{
+    mrx_keyenc_be_(enc, (uint16_t)v ^ 0x8000u, 2);
+}
+
+static inline void
+mrx_keyenc_i32(mrx_keyenc_t *enc,
+               const int32_t v)
+{
+    mrx_keyenc_be_(enc, (uint32_t)v ^ 0x80000000u, 4);
+}
+
+static inline void
+mrx_keyenc_i64(mrx_keyenc_t *enc,
+               const int64_t v)
+{
+    mrx_keyenc_be_(enc, (uint64_t)v ^ 0x8000000000000000u, 8);
+}
+
+static inline void
+mrx_keyenc_f32(mrx_keyenc_t *enc,
+               const float v)
+{
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    u = (u & 0x80000000u) != 0 ? ~u : u ^ 0x80000000u;
+    mrx_keyenc_be_(enc, u, 4);
+}
+
+static inline void
+mrx_keyenc_f64(mrx_keyenc_t *enc,
+               const double v)
+{
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    u = (u & 0x8000000000000000u) != 0 ? ~u : u ^ 0x8000000000000000u;
+    mrx_keyenc_be_(enc, u, 8);
+}
+
+static inline void
+mrx_keyenc_str_(mrx_keyenc_t *enc,
+                const uint8_t s[],
+                const size_t len,
+                const bool terminate)
+{
+    size_t escaped_len = len;
+    for (size_t i = 0; i < len; i++) {
+        escaped_len += (s[i] == 0);
+    }
+    uint8_t *p = mrx_keyenc_reserve_(enc, escaped_len + (terminate ? 2 : 0));
+    if (p == NULL) {
+        return;
+    }
+    if (escaped_len == len) {
+        memcpy(p, s, len);
+        p += len;
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            *p++ = s[i];
+            if (s[i] == 0) {
+                *p++ = MRX_KEYENC_STR_ESCAPE_;
+            }
+        }
+    }
+    if (terminate) {
+        p[0] = 0;
+        p[1] = MRX_KEYENC_STR_END_;
+    }
+}
+
+static inline void
+mrx_keyenc_strprefix(mrx_keyenc_t *enc,
+                     const void *str,
+                     const size_t len)
+{
+    mrx_keyenc_str_(enc, (const uint8_t *)str, len, false);
+}
+
+static inline void
+mrx_keyenc_str(mrx_keyenc_t *enc,
+               const void *str,
+               const size_t len)
+{
+    mrx_keyenc_str_(enc, (const uint8_t *)str, len, true);
+}
+
+static inline void
+mrx_keyenc_strnt(mrx_keyenc_t *enc,
+                 const char *str)
+{
+    mrx_keyenc_str(enc, str, strlen(str));
+}
+
+static inline void
+mrx_keydec_init(mrx_keydec_t *dec,
+                const void *key,
+                const size_t len)
+{
+    dec->key = (const uint8_t *)key;
+    dec->len = len;
+    dec->pos = 0;
+    dec->error = false;
+}
+
+static inline bool
+mrx_keydec_ok(const mrx_keydec_t *dec)
+{
+    return !dec->error;
+}
+
+// True if all fields have been decoded without error.
+static inline bool
+mrx_keydec_end(const mrx_keydec_t *dec)
+{
+    return !dec->error && dec->pos == dec->len;
+}
+
+static inline uint64_t
+mrx_keydec_be_(mrx_keydec_t *dec,
+               const unsigned size)
+{
+    if (dec->error || dec->len - dec->pos < size) {
+        dec->error = true;
+        return 0;
+    }
+    const uint8_t *p = &dec->key[dec->pos];
+    uint64_t v = 0;
+    for (unsigned i = 0; i < size; i++) {
+        v = (v << 8u) | p[i];
+    }
+    dec->pos += size;
+    return v;
+}
+
+static inline uint8_t
+mrx_keydec_u8(mrx_keydec_t *dec)
+{
+    return (uint8_t)mrx_keydec_be_(dec, 1);
+}
+
+static inline uint16_t
+mrx_keydec_u16(mrx_keydec_t *dec)
+{
+    return (uint16_t)mrx_keydec_be_(dec, 2);
+}
+
+static inline uint32_t
+mrx_keydec_u32(mrx_keydec_t *dec)
+{
+    return (uint32_t)mrx_keydec_be_(dec, 4);
+}
+
+static inline uint64_t
+mrx_keydec_u64(mrx_keydec_t *dec)
+{
+    return mrx_keydec_be_(dec, 8);
+}
+
+static inline int8_t
+mrx_keydec_i8(mrx_keydec_t *dec)
+{
+    const uint8_t u = (uint8_t)mrx_keydec_be_(dec, 1);
+    return dec->error ? 0 : (int8_t)(uint8_t)(u ^ 0x80u);
+}
+
+static inline int16_t
+mrx_keydec_i16(mrx_keydec_t *dec)
+{
+    const uint16_t u = (uint16_t)mrx_keydec_be_(dec, 2);
+    return dec->error ? 0 : (int16_t)(uint16_t)(u ^ 0x8000u);
+}
+
+static inline int32_t
+mrx_keydec_i32(mrx_keydec_t *dec)
+{
+    const uint32_t u = (uint32_t)mrx_keydec_be_(dec, 4);
+    return dec->error ? 0 : (int32_t)(uint32_t)(u ^ 0x80000000u);
+}
+
+static inline int64_t
+mrx_keydec_i64(mrx_keydec_t *dec)
+{
+    const uint64_t u = mrx_keydec_be_(dec, 8);
+    return dec->error ? 0 : (int64_t)(uint64_t)(u ^ 0x8000000000000000u);
+}
+
+static inline float
+mrx_keydec_f32(mrx_keydec_t *dec)
+{
+    float v = 0;
+    uint32_t u = (uint32_t)mrx_keydec_be_(dec, 4);
+    if (!dec->error) {
+        u = (u & 0x80000000u) != 0 ? u ^ 0x80000000u : ~u;
+        memcpy(&v, &u, sizeof(v));
+    }
+    return v;
+}
+
+static inline double
+mrx_keydec_f64(mrx_keydec_t *dec)
+{
+    double v = 0;
+    uint64_t u = mrx_keydec_be_(dec, 8);
+    if (!dec->error) {
+        u = (u & 0x8000000000000000u) != 0 ? u ^ 0x8000000000000000u : ~u;
+        memcpy(&v, &u, sizeof(v));
+    }
+    return v;
+}
+
+// Returns full string length, copies at most size - 1 octets plus NUL to str
+// (str may be NULL). Returns 0 on error.
+static inline size_t
+mrx_keydec_str(mrx_keydec_t *dec,
+               void *str,
+               const size_t size)
+{
+    uint8_t *dst = (uint8_t *)str;
+    size_t len = 0;
+    size_t pos = dec->pos;
+
+    if (dec->error) {
+        return 0;
+    }
+    for (;;) {
+        if (pos == dec->len) {
+            dec->error = true;
+            return 0;
+        }
+        uint8_t c = dec->key[pos++];
+        if (c == 0) {
+            if (pos == dec->len) {
+                dec->error = true;
+                return 0;
+            }
+            const uint8_t esc = dec->key[pos++];
+            if (esc == MRX_KEYENC_STR_END_) {
+                break;
+            }
+            if (esc != MRX_KEYENC_STR_ESCAPE_) {
+                dec->error = true;
+                return 0;
+            }
+        }
+        if (dst != NULL && len + 1 < size) {
+            dst[len] = c;
+        }
+        len++;
+    }
+    if (dst != NULL && size > 0) {
+        dst[len < size ? len : size - 1] = '\0';
+    }
+    dec->pos = pos;
+    return len;
+}
+
+#undef MRX_KEYENC_STR_ESCAPE_
+#undef MRX_KEYENC_STR_END_
+
+#endif
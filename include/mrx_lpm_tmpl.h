@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Longest prefix match table, based on the radix tree.
+
+  Keys are bit-granular prefixes, given as an octet array in network order
+  and a length in bits, such as IPv4 or IPv6 routes. mrx_lpm_lookup() returns
+  the value of the longest stored prefix that matches an address, in a single
+  tree descent, without the prefix expansion that a byte-granular table needs
+  for prefix lengths that are not multiples of 8.
+
+  Bits in the last prefix octet beyond the prefix length are ignored.
+
+  Default configuration:
+
+  Table with 'void *' values, with NULL as undefined value.
+*/
+
+/*
+
+  Design notes: see mrx_lpm.c
+
+*/
+
+#ifndef MC_PREFIX
+#define MC_PREFIX mrx_lpm
+#define MC_VALUE_T void *
+#endif
+
+#ifdef MC_KEY_T
+#error "MC_KEY_T should not be defined for the prefix match table, keys are octet arrays."
+#endif
+#define MC_KEY_T const uint8_t *
+
+#define MC_ASSOCIATIVE_CONTAINER_ 1
+#define MC_MM_DEFAULT_ MC_MM_COMPACT
+#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_COMPACT)
+#include <mc_tmpl.h>
+
+#if MC_VALUE_RETURN_REF - 0 != 0
+#error "MC_VALUE_RETURN_REF=1 is not supported by the prefix match table."
+#endif
+#if MC_NO_VALUE - 0 != 0
+#error "MC_NO_VALUE=1 is not supported by the prefix match table."
+#endif
+
+#ifndef MRX_LPM_TMPL_ONCE_
+#define MRX_LPM_TMPL_ONCE_
+#include <mrx_base.h>
+#endif
+
+typedef struct MC_T_ {
+    size_t count;
+    mrx_base_t mrx;
+} MC_T;
+
+#if defined(MC_FREE_VALUE)
+static void
+MC_FUN_(free_value_)(void *value)
+{
+    MC_OPT_FREE_VALUE_((MC_VALUE_T)(uintptr_t)value);
+}
+#define MRX_LPM_FREE_VALUE_FUN_ MC_FUN_(free_value_)
+#else
+#define MRX_LPM_FREE_VALUE_FUN_ NULL
+#endif
+
+static inline MC_T *
+MC_FUN_(new)(const size_t capacity)
+{
+    MC_T *lpm;
+
+#if MC_MM_MODE == MC_MM_COMPACT
+    if ((lpm = malloc(sizeof(MC_T))) == NULL) {
+        return NULL;
+    }
+    mrx_init_(&lpm->mrx, capacity, 1);
+#else
+    if ((lpm = malloc(sizeof(MC_T) + sizeof(struct mrx_buddyalloc))) == NULL) {
+        return NULL;
+    }
+    mrx_init_(&lpm->mrx, capacity, 0);
+#endif
+    lpm->count = 0;
+    return lpm;
+}
+
+static inline void
+MC_FUN_(delete)(MC_T * const lpm)
+{
+    if (lpm == NULL) {
+        return;
+    }
+    mrx_lpm_clear_entries_(&lpm->mrx, MRX_LPM_FREE_VALUE_FUN_);
+    mrx_delete_(&lpm->mrx);
+    free(lpm);
+}
+
+static inline void
+MC_FUN_(clear)(MC_T * const lpm)
+{
+    mrx_lpm_clear_entries_(&lpm->mrx, MRX_LPM_FREE_VALUE_FUN_);
+    mrx_clear_(&lpm->mrx);
+    lpm->count = 0;
+}
+
+static inline int
+MC_FUN_(empty)(MC_T * const lpm)
+{
+    return (lpm->count == 0);
+}
+
+static inline size_t
+MC_FUN_(size)(MC_T * const lpm)
+{
+    return lpm->count;
+}
+
+static inline MC_VALUE_T
+MC_FUN_(insert)(MC_T * const lpm,
+                MC_KEY_T const prefix,
+                const unsigned bit_len MC_OPT_VALUE_INSERT_ARG_)
+{
+    MC_DEF_VALUE_UNDEF_;
+    bool is_occupied;
+    void **vref;
+
+    vref = mrx_lpm_insert_(&lpm->mrx, prefix, bit_len, &is_occupied);
+    if (vref == NULL) {
+        return undef_value;
+    }
+    if (is_occupied) {
+        MC_OPT_FREE_VALUE_(*(MC_VALUE_T *)vref);
+    } else {
+        lpm->count++;
+    }
+    MC_OPT_ASSIGN_VALUE_(*(MC_VALUE_T *)vref, value);
+    return *(MC_VALUE_T *)vref;
+}
+
+static inline MC_VALUE_T
+MC_FUN_(find)(MC_T * const lpm,
+              MC_KEY_T const prefix,
+              const unsigned bit_len)
+{
+    MC_DEF_VALUE_UNDEF_;
+    void **vref = mrx_lpm_find_(&lpm->mrx, prefix, bit_len);
+    if (vref == NULL) {
+        return undef_value;
+    }
+    return *(MC_VALUE_T *)vref;
+}
+
+static inline bool
+MC_FUN_(erase)(MC_T * const lpm,
+               MC_KEY_T const prefix,
+               const unsigned bit_len)
+{
+    bool was_erased;
+    void *value = mrx_lpm_erase_(&lpm->mrx, prefix, bit_len, &was_erased);
+    if (!was_erased) {
+        return false;
+    }
+    (void)value;
+    MC_OPT_FREE_VALUE_((MC_VALUE_T)(uintptr_t)value);
+    lpm->count--;
+    return true;
+}
+
+// addr_len is in octets, match_bit_len may be NULL
+static inline MC_VALUE_T
+MC_FUN_(lookup)(MC_T * const lpm,
+                MC_KEY_T const addr,
+                const unsigned addr_len,
+                unsigned * const match_bit_len)
+{
+    MC_DEF_VALUE_UNDEF_;
+    void **vref = mrx_lpm_lookup_(&lpm->mrx, addr, addr_len, match_bit_len);
+    if (vref == NULL) {
+        return undef_value;
+    }
+    return *(MC_VALUE_T *)vref;
+}
+
+#include <mc_tmpl_undef.h>
+#undef MRX_LPM_FREE_VALUE_FUN_
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Key-range sharded radix tree, for many threads writing to one map.
+
+  The key space is split on the first key octet into up to 256 shards, each
+  an independent radix tree with its own node allocator (in performance
+  mode) and its own read/write lock, so writers to different shards do not
+  contend. Unlike the other containers this one takes locks (POSIX threads),
+  all functions may be called concurrently.
+
+  The tree type is instantiated first with mrx_tmpl.h, and the sharded map
+  is then instantiated with the same key and value options plus
+  MRX_SHARD_TREE_PREFIX set to the prefix of the tree:
+
+    #define MC_PREFIX kv_tree
+    #define MC_KEY_T const char *
+    #define MC_VALUE_T void *
+    #define MRX_KEY_VARSIZE 1
+    #include <mrx_tmpl.h>
+
+    #define MC_PREFIX kv
+    #define MC_KEY_T const char *
+    #define MC_VALUE_T void *
+    #define MRX_KEY_VARSIZE 1
+    #define MRX_SHARD_TREE_PREFIX kv_tree
+    #include <mrx_shard_tmpl.h>
+
+  kv_new() takes the number of shards, and optionally the first octet of
+  each shard after the first in ascending order. Without it the octet range
+  is divided evenly, which suits hashed or random keys. Text keys or small
+  integers (with MRX_KEY_SORTINT the first octet is the most significant)
+  need split octets that follow the key distribution, or most writes go to
+  a few shards. kv_shard_index() tells which shard a key belongs to, for
+  routing work so that each thread mostly writes to its own shards.
+
+  As shards are key ranges in key order, ordered iteration just visits them
+  one after another, and kv_lower_bound() starts in the shard of the key,
+  no merge is needed. An iterator holds the read lock of the shard it is in
+  until it moves to the next shard or is deleted with kv_itdelete() (which
+  must be done unless it has reached the end), so a thread must not write
+  to the map while it holds an iterator, and long-lived iterators block
+  writers of one shard at a time. Iterators see each shard as it is when
+  they enter it. Keys from kv_key() are valid until the next call on the
+  iterator.
+
+  kv_size() sums the shard sizes one shard at a time, so it is exact only
+  when there are no concurrent writers.
+
+  Default configuration:
+
+  Map with 'const char *' keys to 'void *' over the default radix tree
+  'mrx', with NULL as undefined value.
+*/
+
+#ifndef MC_PREFIX
+#define MC_PREFIX mrx_shard
+#define MC_KEY_T const char *
+#define MC_VALUE_T void *
+#define MRX_KEY_VARSIZE 1
+#define MRX_SHARD_TREE_PREFIX mrx
+#endif
+
+#ifndef MRX_SHARD_TREE_PREFIX
+#error "MRX_SHARD_TREE_PREFIX must be the prefix of a radix tree from mrx_tmpl.h with the same key and value options."
+#endif
+
+#define MC_ASSOCIATIVE_CONTAINER_ 1
+#define MC_CUSTOM_ITERATOR_ 1
+#define MC_MM_DEFAULT_ MC_MM_COMPACT
+#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_STATIC | MC_MM_COMPACT)
+#include <mc_tmpl.h>
+
+#ifndef MRX_SHARD_TMPL_ONCE_
+#define MRX_SHARD_TMPL_ONCE_
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <mrx_base.h>
+
+// Shards are padded to a cache line so that the locks of different shards
+// are not written through the same line.
+#define MRX_SHARD_PADDED_SIZE_                                         \
+    ((sizeof(pthread_rwlock_t) + sizeof(void *) + MC_CACHE_LINE_SIZE - 1u) / \
+     MC_CACHE_LINE_SIZE * MC_CACHE_LINE_SIZE)
+#endif
+
+#define MRX_SHARD_TREE_FUN_(name) MC_CONCAT_(MC_CONCAT_(MRX_SHARD_TREE_PREFIX, _), name)
+#define MRX_SHARD_TREE_T_ MC_CONCAT_(MRX_SHARD_TREE_PREFIX, _t)
+#define MRX_SHARD_TREE_IT_T_ MC_CONCAT_(MRX_SHARD_TREE_PREFIX, _it_t)
+#define MRX_SHARD_T_ MC_CONCAT_(MC_PREFIX, _shard_t)
+
+#if MRX_KEY_VARSIZE - 0 == 0
+  #define MRX_KEY_SIZE_ARG_
+  #define MRX_KEY_SIZE_PARAM_
+#else
+  #define MRX_KEY_SIZE_ARG_ , const size_t key_size_
+  #define MRX_KEY_SIZE_PARAM_ , key_size_
+#endif
+
+typedef union {
+    struct {
+        pthread_rwlock_t lock;
+        MRX_SHARD_TREE_T_ *tree;
+    } s;
+    uint8_t pad_[MRX_SHARD_PADDED_SIZE_];
+} MRX_SHARD_T_;
+
+typedef struct MC_T_ {
+    MRX_SHARD_T_ *shard;
+    unsigned shard_count;
+    uint8_t shard_of[256]; // shard index for each first key octet
+} MC_T;
+
+typedef struct {
+    MC_T *sh;
+    unsigned shard; // the read lock of this shard is held
+    size_t space_size;
+    MRX_SHARD_TREE_IT_T_ *it; // in space of space_size octets
+} MC_ITERATOR_T;
+
+static inline unsigned
+MC_FUN_(shard_index)(MC_T * const sh,
+                     MC_KEY_T const key MRX_KEY_SIZE_ARG_)
+{
+#if MRX_KEY_VARSIZE - 0 != 0
+    const uint8_t octet = key_size_ > 0 ? ((const uint8_t *)key)[0] : 0;
+#elif MRX_KEY_SORTINT - 0 != 0
+    const uint8_t octet = (uint8_t)(key >> (8u * (sizeof(key) - 1u)));
+#else
+    const uint8_t octet = ((const uint8_t *)&key)[0];
+#endif
+    return sh->shard_of[octet];
+}
+
+// Returns NULL on memory allocation failure or if split[] is not strictly
+// ascending. Each shard can hold up to shard_capacity keys.
+static inline MC_T *
+MC_FUN_(new)(const unsigned shard_count,
+             const uint8_t split[],
+             const size_t shard_capacity)
+{
+    MC_T *sh;
+    void *mem;
+
+    if (shard_count == 0 || shard_count > 256) {
+        return NULL;
+    }
+    if (split != NULL) {
+        for (unsigned i = 0; i < shard_count - 1; i++) {
+            if (split[i] == 0 || (i > 0 && split[i] <= split[i - 1])) {
+                return NULL;
+            }
+        }
+    }
+    if ((sh = malloc(sizeof(*sh))) == NULL) {
+        return NULL;
+    }
+    if (posix_memalign(&mem, MC_CACHE_LINE_SIZE, shard_count * sizeof(sh->shard[0])) != 0) {
+        free(sh);
+        return NULL;
+    }
+    sh->shard = (MRX_SHARD_T_ *)mem;
+    sh->shard_count = shard_count;
+    unsigned s = 0;
+    for (unsigned c = 0; c < 256; c++) {
+        if (split == NULL) {
+            s = c * shard_count / 256u;
+        } else {
+            while (s < shard_count - 1 && split[s] <= c) {
+                s++;
+            }
+        }
+        sh->shard_of[c] = (uint8_t)s;
+    }
+    for (unsigned i = 0; i < shard_count; i++) {
+        if ((sh->shard[i].s.tree = MRX_SHARD_TREE_FUN_(new)(shard_capacity)) == NULL) {
+            while (i-- > 0) {
+                pthread_rwlock_destroy(&sh->shard[i].s.lock);
+                MRX_SHARD_TREE_FUN_(delete)(sh->shard[i].s.tree);
+            }
+            free(sh->shard);
+            free(sh);
+            return NULL;
+        }
+        pthread_rwlock_init(&sh->shard[i].s.lock, NULL);
+    }
+    return sh;
+}
+
+static inline void
+MC_FUN_(delete)(MC_T * const sh)
+{
+    if (sh == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < sh->shard_count; i++) {
+        pthread_rwlock_destroy(&sh->shard[i].s.lock);
+        MRX_SHARD_TREE_FUN_(delete)(sh->shard[i].s.tree);
+    }
+    free(sh->shard);
+    free(sh);
+}
+
+static inline void
+MC_FUN_(clear)(MC_T * const sh)
+{
+    for (unsigned i = 0; i < sh->shard_count; i++) {
+        pthread_rwlock_wrlock(&sh->shard[i].s.lock);
+        MRX_SHARD_TREE_FUN_(clear)(sh->shard[i].s.tree);
+        pthread_rwlock_unlock(&sh->shard[i].s.lock);
+    }
+}
+
+static inline size_t
+MC_FUN_(size)(MC_T * const sh)
+{
+    size_t size = 0;
+    for (unsigned i = 0; i < sh->shard_count; i++) {
+        pthread_rwlock_rdlock(&sh->shard[i].s.lock);
+        size += MRX_SHARD_TREE_FUN_(size)(sh->shard[i].s.tree);
+        pthread_rwlock_unlock(&sh->shard[i].s.lock);
+    }
+    return size;
+}
+
+static inline int
+MC_FUN_(empty)(MC_T * const sh)
+{
+    return MC_FUN_(size)(sh) == 0;
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(insert)(MC_T * const sh,
+                MC_KEY_T const key MRX_KEY_SIZE_ARG_ MC_OPT_VALUE_INSERT_ARG_)
+{
+    MRX_SHARD_T_ * const shard = &sh->shard[MC_FUN_(shard_index)(sh, key MRX_KEY_SIZE_PARAM_)];
+    pthread_rwlock_wrlock(&shard->s.lock);
+    MC_VALUE_T MC_OPT_PTR_ const ret =
+        MRX_SHARD_TREE_FUN_(insert)(shard->s.tree, key MRX_KEY_SIZE_PARAM_ MC_OPT_VALUE_PARAM_);
+    pthread_rwlock_unlock(&shard->s.lock);
+    return ret;
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(erase)(MC_T * const sh,
+               MC_KEY_T const key MRX_KEY_SIZE_ARG_)
+{
+    MRX_SHARD_T_ * const shard = &sh->shard[MC_FUN_(shard_index)(sh, key MRX_KEY_SIZE_PARAM_)];
+    pthread_rwlock_wrlock(&shard->s.lock);
+    MC_VALUE_T MC_OPT_PTR_ const ret = MRX_SHARD_TREE_FUN_(erase)(shard->s.tree, key MRX_KEY_SIZE_PARAM_);
+    pthread_rwlock_unlock(&shard->s.lock);
+    return ret;
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(find)(MC_T * const sh,
+              MC_KEY_T const key MRX_KEY_SIZE_ARG_)
+{
+    MRX_SHARD_T_ * const shard = &sh->shard[MC_FUN_(shard_index)(sh, key MRX_KEY_SIZE_PARAM_)];
+    pthread_rwlock_rdlock(&shard->s.lock);
+    MC_VALUE_T MC_OPT_PTR_ const ret = MRX_SHARD_TREE_FUN_(find)(shard->s.tree, key MRX_KEY_SIZE_PARAM_);
+    pthread_rwlock_unlock(&shard->s.lock);
+    return ret;
+}
+
+#if MRX_KEY_VARSIZE - 0 != 0
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(insertnt)(MC_T * const sh,
+                  MC_KEY_T const key MC_OPT_VALUE_INSERT_ARG_)
+{
+    return MC_FUN_(insert)(sh, key, strlen((const char *)key) MC_OPT_VALUE_PARAM_);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(erasent)(MC_T * const sh,
+                 MC_KEY_T const key)
+{
+    return MC_FUN_(erase)(sh, key, strlen((const char *)key));
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(findnt)(MC_T * const sh,
+                MC_KEY_T const key)
+{
+    return MC_FUN_(find)(sh, key, strlen((const char *)key));
+}
+#endif
+
+// Makes the iterator space large enough for the tree of the current shard,
+// whose read lock must be held.
+static inline bool
+MC_FUN_(itspace_)(MC_ITERATOR_T * const it)
+{
+    const size_t size = MRX_SHARD_TREE_FUN_(itsize)(it->sh->shard[it->shard].s.tree);
+    if (size > it->space_size) {
+        void *space = realloc(it->it, size);
+        if (space == NULL) {
+            return false;
+        }
+        it->it = (MRX_SHARD_TREE_IT_T_ *)space;
+        it->space_size = size;
+    }
+    return true;
+}
+
+// Moves to the first key of the first non-empty shard from the current one
+// (whose read lock is held) and on, frees the iterator if there is none.
+static inline MC_ITERATOR_T *
+MC_FUN_(itenter_)(MC_ITERATOR_T * const it)
+{
+    MC_T * const sh = it->sh;
+    for (;;) {
+        MRX_SHARD_T_ * const shard = &sh->shard[it->shard];
+        if (!MRX_SHARD_TREE_FUN_(empty)(shard->s.tree)) {
+            if (!MC_FUN_(itspace_)(it)) {
+                break;
+            }
+            MRX_SHARD_TREE_FUN_(beginst)(shard->s.tree, it->it);
+            return it;
+        }
+        pthread_rwlock_unlock(&shard->s.lock);
+        if (++it->shard == sh->shard_count) {
+            free(it->it);
+            free(it);
+            return NULL;
+        }
+        pthread_rwlock_rdlock(&sh->shard[it->shard].s.lock);
+    }
+    pthread_rwlock_unlock(&sh->shard[it->shard].s.lock);
+    free(it->it);
+    free(it);
+    return NULL;
+}
+
+static inline MC_ITERATOR_T *
+MC_FUN_(begin)(MC_T * const sh)
+{
+    MC_ITERATOR_T *it;
+    if ((it = malloc(sizeof(*it))) == NULL) {
+        return NULL;
+    }
+    it->sh = sh;
+    it->shard = 0;
+    it->space_size = 0;
+    it->it = NULL;
+    pthread_rwlock_rdlock(&sh->shard[0].s.lock);
+    return MC_FUN_(itenter_)(it);
+}
+
+// Iterator at the first key not less than the given key, or end if none.
+static inline MC_ITERATOR_T *
+MC_FUN_(lower_bound)(MC_T * const sh,
+                     MC_KEY_T const key MRX_KEY_SIZE_ARG_)
+{
+    MC_ITERATOR_T *it;
+    if ((it = malloc(sizeof(*it))) == NULL) {
+        return NULL;
+    }
+    it->sh = sh;
+    it->shard = MC_FUN_(shard_index)(sh, key MRX_KEY_SIZE_PARAM_);
+    it->space_size = 0;
+    it->it = NULL;
+    MRX_SHARD_T_ * const shard = &sh->shard[it->shard];
+    pthread_rwlock_rdlock(&shard->s.lock);
+    if (!MC_FUN_(itspace_)(it)) {
+        pthread_rwlock_unlock(&shard->s.lock);
+        free(it);
+        return NULL;
+    }
+    if (MRX_SHARD_TREE_FUN_(lower_boundst)(shard->s.tree, key MRX_KEY_SIZE_PARAM_, it->it) != NULL) {
+        return it;
+    }
+    // all keys of later shards are larger
+    pthread_rwlock_unlock(&shard->s.lock);
+    if (++it->shard == sh->shard_count) {
+        free(it->it);
+        free(it);
+        return NULL;
+    }
+    pthread_rwlock_rdlock(&sh->shard[it->shard].s.lock);
+    return MC_FUN_(itenter_)(it);
+}
+
+static inline MC_ITERATOR_T *
+MC_FUN_(next)(MC_ITERATOR_T * const it)
+{
+    if (MRX_SHARD_TREE_FUN_(next)(it->it) != NULL) {
+        return it;
+    }
+    MC_T * const sh = it->sh;
+    pthread_rwlock_unlock(&sh->shard[it->shard].s.lock);
+    if (++it->shard == sh->shard_count) {
+        free(it->it);
+        free(it);
+        return NULL;
+    }
+    pthread_rwlock_rdlock(&sh->shard[it->shard].s.lock);
+    return MC_FUN_(itenter_)(it);
+}
+
+static inline MC_ITERATOR_T *
+MC_FUN_(end)(void)
+{
+    return NULL;
+}
+
+// Releases an iterator that has not reached the end.
+static inline void
+MC_FUN_(itdelete)(MC_ITERATOR_T * const it)
+{
+    if (it == NULL) {
+        return;
+    }
+    pthread_rwlock_unlock(&it->sh->shard[it->shard].s.lock);
+    free(it->it);
+    free(it);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(val)(MC_ITERATOR_T * const it)
+{
+    return MRX_SHARD_TREE_FUN_(val)(it->it);
+}
+
+#if MRX_KEY_VARSIZE - 0 == 0
+static inline MC_KEY_T
+MC_FUN_(key)(MC_ITERATOR_T * const it)
+{
+    return MRX_SHARD_TREE_FUN_(key)(it->it);
+}
+#else
+static inline const MC_KEY_T
+MC_FUN_(key)(MC_ITERATOR_T * const it)
+{
+    return MRX_SHARD_TREE_FUN_(key)(it->it);
+}
+
+static inline size_t
+MC_FUN_(keylen)(MC_ITERATOR_T * const it)
+{
+    return MRX_SHARD_TREE_FUN_(keylen)(it->it);
+}
+#endif
+
+#include <mc_tmpl_undef.h>
+#undef MRX_KEY_VARSIZE
+#undef MRX_KEY_SORTINT
+#undef MRX_KEY_SIZE_ARG_
+#undef MRX_KEY_SIZE_PARAM_
+#undef MRX_SHARD_TREE_PREFIX
+#undef MRX_SHARD_TREE_FUN_
+#undef MRX_SHARD_TREE_T_
+#undef MRX_SHARD_TREE_IT_T_
+#undef MRX_SHARD_T_
@@ -15,10 +15,92 @@
   functions for NULL-terminated strings are added, mrx_insertnt(),
   mrx_findnt() etc.
 
+  mrx_build() inserts an unsorted array of keys (and values) in one call. The
+  input is radix-partitioned on the first two key octets before insertion,
+  which makes building large trees significantly more cache-friendly than
+  inserting the keys one by one in input order. mrx_build_parallel() does
+  the same with a number of threads, each building the subtrees of a range
+  of first key octets with its own node allocator, which are then linked
+  under the root. It builds in parallel only into an empty tree, not in
+  static mode, and if the keys have at least two different first octets,
+  otherwise it is the same as mrx_build(). MC_FREE_VALUE (for duplicate
+  keys) may then be called from the worker threads.
+
+  mrx_union(), mrx_intersection() and mrx_difference() insert the result of
+  a set operation on two trees into a third (the value is taken from the
+  first tree if the key exists there). The trees are traversed simultaneously
+  and subtrees that only exist in one of them are skipped or copied without
+  being looked up in the other. For a callback stream instead of a result
+  tree, use mrx_setop_() directly.
+
+  mrx_insert_hint() inserts using a cursor from mrx_cursor_new(), which keeps
+  the path of the previous insert, so that the descent resumes from the
+  deepest node shared with the previous key instead of from the root. This
+  makes inserting near-sorted keys (timestamps, sequence numbers) faster. Any
+  insert or erase not made through the cursor makes it start over from the
+  root on the next call, so the cursor never refers to freed nodes.
+
+  mrx_erase_prefix() (variable key size only) erases all keys starting with
+  a given prefix by unlinking the subtree that covers them, at a cost
+  proportional to the number of nodes in the subtree rather than the number
+  of keys times tree depth.
+
+  mrx_keylen() (variable key size only) returns the length of the current
+  iterator key, which is needed for keys that may contain zero octets, such
+  as composite keys from the encoder in mrx_keyenc.h.
+
+  mrx_pop_front() and mrx_pop_back() erase and return the first and last
+  key in key order, and mrx_peek_front() and mrx_peek_back() return them
+  without erasing. They follow the leftmost or rightmost path down the tree,
+  so with MRX_KEY_SORTINT the tree can serve as an ordered priority queue
+  (deadlines, timers) with a single descent per operation. The key is
+  returned through key_out if non-NULL. With variable key size the key is
+  copied to a buffer of key_buf_size octets (truncated if longer), and the
+  full key length is stored in *key_size (if non-NULL).
+
+  mrx_lower_bound() returns an iterator at the first key not less than the
+  given key (end if there is none), for ordered range scans. It descends
+  along the key once, like mrx_find(), and mrx_lower_boundst() is the
+  variant with caller-supplied iterator space of mrx_itsize() octets.
+
+  mrx_fuzzy_find() (variable key size only) calls a callback for each key
+  within a given Levenshtein edit distance from the query key.
+
+  mrx_ac_compile() (variable key size only) compiles the keys into an
+  Aho-Corasick automaton, which finds all occurrences of all keys in a text
+  in a single pass, independent of the number of keys. Text can be fed in
+  chunks with mrx_ac_match() and a stream state from mrx_ac_stream_init(),
+  matches spanning chunk boundaries are found too. The automaton is a
+  snapshot with copies of the values, later changes to the tree are not
+  reflected. The empty key never matches. Free with mrx_ac_delete().
+
+  In MC_MM_STATIC mode all nodes are taken from one memory region, which
+  mrx_new() allocates up front with room for about capacity keys, or which
+  the caller supplies with mrx_init() (the tree struct is placed first in
+  the region, and such a tree is not passed to mrx_delete()). Tree
+  operations allocate nothing after that: insert fails (as when capacity is
+  reached) if the region is nearly exhausted, keeping a reserve so that any
+  insert that is accepted completes, and erase never allocates, it just
+  skips node size reductions if there is no room for them. Keys are limited
+  to MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK octets in this mode, which bounds
+  mrx_itsize() so iteration with mrx_beginst() needs no allocation either,
+  and mrx_cursor_new() allocates the cursor at its final size so that
+  mrx_insert_hint() does not allocate. Functions that return new objects,
+  such as iterators from mrx_begin() or the automaton from
+  mrx_ac_compile(), still allocate those. On 64 bit platforms only the
+  largest part of the region within one 4GB span is used.
+
   MRX_KEY_SORTINT 1 - indicates that the key is an integer and adapts
   insertion such that integers will be correctly sorted. This requires
   swapping on little endian machines. If sort order is not important, do
-  not enable this.
+  not enable this. Supported key sizes are 2, 4, 8 and 16 bytes, the latter
+  for 'unsigned __int128' (on compilers that have it), such as IPv6
+  addresses. Keys that are byte arrays in network order already, such as
+  UUIDs in a 16 byte struct, sort correctly without MRX_KEY_SORTINT.
+
+  With fixed size keys (MRX_KEY_VARSIZE not enabled) mrx_find() is inlined
+  from mrx_base.h with the key size as a compile-time constant, so there is
+  no library call and no remaining key length bookkeeping.
 
   Default configuration:
 
@@ -41,7 +123,7 @@
 #define MC_ASSOCIATIVE_CONTAINER_ 1
 #define MC_CUSTOM_ITERATOR_ 1
 #define MC_MM_DEFAULT_ MC_MM_COMPACT
-#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_COMPACT)
+#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_STATIC | MC_MM_COMPACT)
 #include <mc_tmpl.h>
 
 #if defined(MC_COPY_KEY) || defined(MC_FREE_KEY)
@@ -67,24 +149,49 @@
 #if MRX_KEY_VARSIZE - 0 == 0
   #define MRX_KEY_SIZE_ sizeof(MC_KEY_T)
   #define MRX_KEY_SIZE_ARG_
+  #define MRX_KEY_SIZES_ARG_
+  #define MRX_KEY_SIZES_PARAM_(i)
+  #define MRX_KEY_SIZES_ALL_
   #define MRX_KEY_ADDROF_ &
+  #define MRX_KEY_OUT_ARG_ , MC_KEY_T * const key_out
 #else
   #define MRX_KEY_SIZE_ key_size_
   #define MRX_KEY_SIZE_ARG_ , const size_t key_size_
+  #define MRX_KEY_SIZES_ARG_ , const size_t key_sizes_[]
+  #define MRX_KEY_SIZES_PARAM_(i) , key_sizes_[i]
+  #define MRX_KEY_SIZES_ALL_ , key_sizes_
   #define MRX_KEY_ADDROF_
+  #define MRX_KEY_OUT_ARG_ , void * const key_out, const size_t key_buf_size, size_t * const key_size
+#endif
+
+#if MC_VALUE_NO_INSERT_ARG - 0 == 0
+  #define MRX_VALUES_ARG_ , MC_VALUE_T const values[]
+  #define MRX_VALUES_PARAM_(i) , values[i]
+  #define MRX_VALUES_ALL_ , values
+#else
+  #define MRX_VALUES_ARG_
+  #define MRX_VALUES_PARAM_(i)
+  #define MRX_VALUES_ALL_
 #endif
 
 #if MRX_KEY_SORTINT - 0 != 0
   #if MRX_KEY_VARSIZE - 0 != 0
     #error "MRX_KEY_SORTINT and MRX_KEY_VARSIZE cannot both be enabled"
   #endif
+  #if defined(__SIZEOF_INT128__)
+    #define MRX_KEY_SORTINT128_ 1
+    #define MRX_KEY_SWAP128_(key) bit128_swap(key)
+  #else
+    #define MRX_KEY_SORTINT128_ 0
+    #define MRX_KEY_SWAP128_(key) (key)
+  #endif
 static inline void
 MC_FUN_(compile_time_sortint_keysize_testing_)(void)
 {
     // If this does not compile, the key size does not work with MRX_KEY_SORTINT
     MC_KEY_T key;
     switch(0){case 0:break;
-    case sizeof(key)==2||sizeof(key)==4||sizeof(key)==8:break;
+    case sizeof(key)==2||sizeof(key)==4||sizeof(key)==8||(MRX_KEY_SORTINT128_ && sizeof(key)==16):break;
     }
 }
   #if ARCH_LITTLE_ENDIAN - 0 != 0
@@ -97,13 +204,17 @@ MC_FUN_(compile_time_sortint_keysize_testing_)(void)
                 sizeof(key) == 4, MRX_SWAPPED_KEY_ = bit32_swap(key),      \
                 __builtin_choose_expr(                                     \
                     sizeof(key) == 8, MRX_SWAPPED_KEY_ = bit64_swap(key),  \
-                    (void)0)));
+                    __builtin_choose_expr(                                 \
+                        sizeof(key) == 16,                                 \
+                        MRX_SWAPPED_KEY_ = MRX_KEY_SWAP128_(key),          \
+                        (void)0))));
     #else
     #define MRX_KEY_SWAP_(key)                                             \
         MC_KEY_T MRX_SWAPPED_KEY_ =                                        \
            ((sizeof(key) == 2) ? bit16_swap(key) :                         \
             ((sizeof(key) == 4) ? bit32_swap(key) :                        \
-             ((sizeof(key) == 8) ? bit64_swap(key) : 0)));
+             ((sizeof(key) == 8) ? bit64_swap(key) :                       \
+              ((sizeof(key) == 16) ? MRX_KEY_SWAP128_(key) : 0))));
     #endif
   #elif ARCH_BIG_ENDIAN - 0 != 0
     #define MRX_KEY_SWAP_(key)
@@ -158,6 +269,46 @@ MC_FUN_(beginst)(MC_T * const mrx,
     return it;
 }
 
+// Iterator at the first key not less than the given key, or end if none.
+static inline MC_ITERATOR_T *
+MC_FUN_(lower_bound)(MC_T * const mrx,
+                     MC_KEY_T const key MRX_KEY_SIZE_ARG_)
+{
+    MC_ITERATOR_T *it;
+    if (mrx->mrx.root == NULL) {
+        return NULL;
+    }
+    it = malloc(MC_FUN_(itsize)(mrx));
+    it->is_on_stack = false;
+    MRX_KEY_SWAP_(key);
+    if (!mrx_itinit_lower_bound_(&mrx->mrx, &it->it,
+                                 (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
+                                 MRX_KEY_SIZE_)) {
+        free(it);
+        return NULL;
+    }
+    return it;
+}
+
+static inline MC_ITERATOR_T *
+MC_FUN_(lower_boundst)(MC_T * const mrx,
+                       MC_KEY_T const key MRX_KEY_SIZE_ARG_,
+                       void *itsize_space)
+{
+    MC_ITERATOR_T *it = (MC_ITERATOR_T *)itsize_space;
+    if (mrx->mrx.root == NULL) {
+        return NULL;
+    }
+    it->is_on_stack = true;
+    MRX_KEY_SWAP_(key);
+    if (!mrx_itinit_lower_bound_(&mrx->mrx, &it->it,
+                                 (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
+                                 MRX_KEY_SIZE_)) {
+        return NULL;
+    }
+    return it;
+}
+
 static inline MC_ITERATOR_T *
 MC_FUN_(next)(MC_ITERATOR_T * const it)
 {
@@ -230,29 +381,63 @@ MC_FUN_(key)(MC_ITERATOR_T * const it)
     }
     return (const MC_KEY_T)mrx_key_(&it->it);
 }
+
+// Length of the current key, not including the NUL terminator of mrx_key().
+static inline size_t
+MC_FUN_(keylen)(MC_ITERATOR_T * const it)
+{
+    return (size_t)it->it.key_len - 1;
+}
+#endif
+
+#if defined(MC_FREE_VALUE)
+static void
+MC_FUN_(free_value_cb_)(void **vref,
+                        void *arg)
+{
+    (void)arg;
+    MC_OPT_FREE_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)vref));
+}
 #endif
 
 static inline void
 MC_FUN_(clear_nodes_)(MC_T * const mrx)
 {
 #if defined(MC_FREE_VALUE)
-    void *itspace = alloca(MC_FUN_(itsize)(mrx));
-    MC_ITERATOR_T *it;
-    for (it = MC_FUN_(beginst)(mrx, itspace);
-         it != MC_FUN_(end)();
-         it = MC_FUN_(next)(it))
-    {
-        MC_OPT_FREE_VALUE_(MC_FUN_(val)(it));
-    }
+    mrx_foreach_value_(&mrx->mrx, MC_FUN_(free_value_cb_), NULL);
 #endif
 }
 
+#if MC_MM_MODE == MC_MM_STATIC
+
+static inline MC_T *
+MC_FUN_(init)(void * const mem,
+              const size_t mem_size)
+{
+    MC_T *mrx = (MC_T *)mem;
+    const size_t hdr_size = sizeof(MC_T) + sizeof(struct mrx_buddyalloc);
+    if (mem_size < hdr_size) {
+        return NULL;
+    }
+    mrx_init_static_(&mrx->mrx, ~(size_t)0, (uint8_t *)mem + hdr_size, mem_size - hdr_size);
+    return mrx;
+}
+
+#endif // MC_MM_MODE == MC_MM_STATIC
+
 static inline MC_T *
 MC_FUN_(new)(const size_t capacity)
 {
     MC_T *mrx;
 
-#if MC_MM_MODE == MC_MM_COMPACT
+#if MC_MM_MODE == MC_MM_STATIC
+    // one 128 byte superblock per key, plus the insert reserve and one for alignment
+    const size_t region_size = (capacity + MRX_STATIC_INSERT_RESERVE_(0) + 1) * 128u;
+    if ((mrx = malloc(sizeof(MC_T) + sizeof(struct mrx_buddyalloc) + region_size)) == NULL) {
+        return NULL;
+    }
+    mrx_init_static_(&mrx->mrx, capacity, (uint8_t *)&mrx->mrx.nodealloc[1], region_size);
+#elif MC_MM_MODE == MC_MM_COMPACT
     if ((mrx = malloc(sizeof(MC_T))) == NULL) {
         return NULL;
     }
@@ -324,6 +509,52 @@ MC_FUN_(insert)(MC_T * const mrx,
     return MC_OPT_DREF_ (MC_VALUE_T *)val;
 }
 
+static inline mrx_cursor_t *
+MC_FUN_(cursor_new)(MC_T * const mrx)
+{
+    mrx_cursor_t *cursor;
+    if ((cursor = malloc(sizeof(*cursor))) == NULL) {
+        return NULL;
+    }
+    if (!mrx_cursor_init_(&mrx->mrx, cursor)) {
+        free(cursor);
+        return NULL;
+    }
+    return cursor;
+}
+
+static inline void
+MC_FUN_(cursor_delete)(mrx_cursor_t * const cursor)
+{
+    if (cursor == NULL) {
+        return;
+    }
+    mrx_cursor_free_(cursor);
+    free(cursor);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(insert_hint)(mrx_cursor_t * const cursor,
+                     MC_KEY_T const key MRX_KEY_SIZE_ARG_ MC_OPT_VALUE_INSERT_ARG_)
+{
+    MC_DEF_VALUE_UNDEF_;
+    bool is_occupied;
+    void *val;
+
+    MRX_KEY_SWAP_(key);
+    val = mrx_insert_hint_(cursor,
+                           (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
+                           MRX_KEY_SIZE_, &is_occupied);
+    if (val == NULL) {
+        return undef_value;
+    }
+    if (is_occupied) {
+        MC_OPT_FREE_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val));
+    }
+    MC_OPT_ASSIGN_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val), value);
+    return MC_OPT_DREF_ (MC_VALUE_T *)val;
+}
+
 static inline MC_VALUE_T MC_OPT_PTR_
 MC_FUN_(erase)(MC_T * const mrx,
                MC_KEY_T const key MRX_KEY_SIZE_ARG_)
@@ -359,15 +590,327 @@ MC_FUN_(find)(MC_T * const mrx,
         return undef_value;
     }
     MRX_KEY_SWAP_(key);
+#if MRX_KEY_VARSIZE - 0 == 0
+    void *val = mrx_find_fixed_(mrx->mrx.root,
+                                (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
+                                MRX_KEY_SIZE_);
+#else
     void *val = mrx_find_(mrx->mrx.root,
                           (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
                           MRX_KEY_SIZE_);
+#endif
     if (val == NULL) {
         return undef_value;
     }
     return MC_OPT_DREF_ (MC_VALUE_T *)val;
 }
 
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(peek_edge_)(MC_T * const mrx,
+               const bool back
+               MRX_KEY_OUT_ARG_)
+{
+    MC_DEF_VALUE_UNDEF_;
+    if (mrx->mrx.root == NULL) {
+        return undef_value;
+    }
+    unsigned key_len;
+#if MRX_KEY_VARSIZE - 0 == 0
+    MC_KEY_T key;
+    void *val = mrx_peek_(mrx->mrx.root, back, (uint8_t *)&key, sizeof(key), &key_len);
+    if (key_out != NULL) {
+        MRX_KEY_SWAP_(key);
+        *key_out = MRX_SWAPPED_KEY_;
+    }
+#else
+    void *val = mrx_peek_(mrx->mrx.root, back, key_out, key_out == NULL ? 0 : key_buf_size, &key_len);
+    if (key_size != NULL) {
+        *key_size = key_len;
+    }
+#endif
+    return MC_OPT_DREF_ (MC_VALUE_T *)val;
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(pop_edge_)(MC_T * const mrx,
+              const bool back
+              MRX_KEY_OUT_ARG_)
+{
+    MC_VALUE_T MC_OPT_PTR_ value;
+    MC_DEF_VALUE_UNDEF_;
+    if (mrx->mrx.root == NULL) {
+        return undef_value;
+    }
+    unsigned key_len;
+#if MRX_KEY_VARSIZE - 0 == 0
+    MC_KEY_T key;
+    value = (MC_VALUE_T MC_OPT_PTR_)(uintptr_t)
+        mrx_pop_(&mrx->mrx, back, (uint8_t *)&key, sizeof(key), &key_len);
+    if (key_out != NULL) {
+        MRX_KEY_SWAP_(key);
+        *key_out = MRX_SWAPPED_KEY_;
+    }
+#else
+    value = (MC_VALUE_T MC_OPT_PTR_)(uintptr_t)
+        mrx_pop_(&mrx->mrx, back, key_out, key_out == NULL ? 0 : key_buf_size, &key_len);
+    if (key_size != NULL) {
+        *key_size = key_len;
+    }
+#endif
+    // pointer cast hack to avoid warning of returning free'd value for certain configurations
+    uintptr_t valptr = (uintptr_t)value;
+    (void)valptr;
+    MC_OPT_FREE_VALUE_((MC_VALUE_T MC_OPT_PTR_)valptr);
+    return value;
+}
+
+#if MRX_KEY_VARSIZE - 0 == 0
+  #define MRX_KEY_OUT_PARAM_ , key_out
+#else
+  #define MRX_KEY_OUT_PARAM_ , key_out, key_buf_size, key_size
+#endif
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(peek_front)(MC_T * const mrx
+                    MRX_KEY_OUT_ARG_)
+{
+    return MC_FUN_(peek_edge_)(mrx, false MRX_KEY_OUT_PARAM_);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(peek_back)(MC_T * const mrx
+                   MRX_KEY_OUT_ARG_)
+{
+    return MC_FUN_(peek_edge_)(mrx, true MRX_KEY_OUT_PARAM_);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(pop_front)(MC_T * const mrx
+                   MRX_KEY_OUT_ARG_)
+{
+    return MC_FUN_(pop_edge_)(mrx, false MRX_KEY_OUT_PARAM_);
+}
+
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(pop_back)(MC_T * const mrx
+                  MRX_KEY_OUT_ARG_)
+{
+    return MC_FUN_(pop_edge_)(mrx, true MRX_KEY_OUT_PARAM_);
+}
+#undef MRX_KEY_OUT_PARAM_
+
+// As insert, but returns false if the key could not be inserted.
+static inline bool
+MC_FUN_(build_insert_)(MC_T * const mrx,
+                       MC_KEY_T const key MRX_KEY_SIZE_ARG_ MC_OPT_VALUE_INSERT_ARG_)
+{
+    bool is_occupied;
+    void *val;
+
+    MRX_KEY_SWAP_(key);
+    val = mrx_insert_(&mrx->mrx,
+                      (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_,
+                      MRX_KEY_SIZE_, &is_occupied);
+    if (val == NULL) {
+        return false;
+    }
+    if (is_occupied) {
+        MC_OPT_FREE_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val));
+    }
+    MC_OPT_ASSIGN_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val), value);
+    return true;
+}
+
+struct MC_FUN_(build_arg_) {
+    MC_KEY_T const *keys;
+#if MRX_KEY_VARSIZE - 0 != 0
+    const size_t *key_sizes;
+#endif
+#if MC_VALUE_NO_INSERT_ARG - 0 == 0
+    MC_VALUE_T const *values;
+#endif
+};
+
+// Worker thread insert of a parallel build, into the subtree of the first key
+// octet. An empty key has no first octet and is left to the caller.
+static inline bool
+MC_FUN_(build_part_insert_)(mrx_base_t *part,
+                            const size_t idx,
+                            void *arg)
+{
+    const struct MC_FUN_(build_arg_) *a = (const struct MC_FUN_(build_arg_) *)arg;
+    MC_KEY_T const key = a->keys[idx];
+#if MRX_KEY_VARSIZE - 0 != 0
+    const size_t key_size_ = a->key_sizes[idx];
+    if (key_size_ == 0) {
+        return true;
+    }
+#endif
+#if MC_VALUE_NO_INSERT_ARG - 0 == 0
+    MC_VALUE_T const value = a->values[idx];
+#endif
+    bool is_occupied;
+    void *val;
+
+    MRX_KEY_SWAP_(key);
+    val = mrx_insert_(part,
+                      (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_ + 1,
+                      MRX_KEY_SIZE_ - 1, &is_occupied);
+    if (val == NULL) {
+        return false;
+    }
+    if (is_occupied) {
+        MC_OPT_FREE_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val));
+    }
+    MC_OPT_ASSIGN_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val), value);
+    return true;
+}
+
+static inline size_t
+MC_FUN_(build_)(MC_T * const mrx,
+                MC_KEY_T const keys[] MRX_KEY_SIZES_ARG_ MRX_VALUES_ARG_,
+                const size_t count,
+                const unsigned thread_count)
+{
+    const size_t entry_size = 2 * sizeof(uint32_t) + sizeof(uint16_t);
+    uint32_t *order = NULL;
+    uint16_t *partition;
+    size_t i;
+
+    if (count >= 2 && count <= UINT32_MAX && count <= SIZE_MAX / entry_size) {
+        order = malloc(count * entry_size);
+    }
+    if (order == NULL) {
+        for (i = 0; i < count; i++) {
+            if (!MC_FUN_(build_insert_)(mrx, keys[i] MRX_KEY_SIZES_PARAM_(i) MRX_VALUES_PARAM_(i))) {
+                break;
+            }
+        }
+        return i;
+    }
+    partition = (uint16_t *)&order[2 * count];
+    for (i = 0; i < count; i++) {
+#if MRX_KEY_VARSIZE - 0 == 0
+        MC_KEY_T const key = keys[i];
+        MRX_KEY_SWAP_(key);
+        const uint8_t *k = (const uint8_t *) MRX_KEY_ADDROF_ MRX_SWAPPED_KEY_;
+#else
+        const size_t key_size_ = key_sizes_[i];
+        const uint8_t *k = (const uint8_t *)keys[i];
+#endif
+        partition[i] = (uint16_t)(((MRX_KEY_SIZE_ > 0) ? (unsigned)k[0] << 8u : 0u) |
+                                  ((MRX_KEY_SIZE_ > 1) ? (unsigned)k[1] : 0u));
+    }
+    mrx_bulk_order_(partition, count, order, &order[count]);
+    if (thread_count > 1) {
+        struct MC_FUN_(build_arg_) arg;
+        size_t inserted;
+        arg.keys = keys;
+#if MRX_KEY_VARSIZE - 0 != 0
+        arg.key_sizes = key_sizes_;
+#endif
+#if MC_VALUE_NO_INSERT_ARG - 0 == 0
+        arg.values = values;
+#endif
+        if (mrx_build_parallel_(&mrx->mrx, partition, order, count, thread_count,
+                                MC_FUN_(build_part_insert_), &arg, &inserted))
+        {
+            free(order);
+#if MRX_KEY_VARSIZE - 0 != 0
+            for (i = 0; i < count; i++) {
+                if (key_sizes_[i] == 0 &&
+                    !MC_FUN_(build_insert_)(mrx, keys[i] MRX_KEY_SIZES_PARAM_(i) MRX_VALUES_PARAM_(i)))
+                {
+                    inserted--;
+                }
+            }
+#endif
+            return inserted;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        const uint32_t idx = order[i];
+        if (!MC_FUN_(build_insert_)(mrx, keys[idx] MRX_KEY_SIZES_PARAM_(idx) MRX_VALUES_PARAM_(idx))) {
+            break;
+        }
+    }
+    free(order);
+    return i;
+}
+
+// Returns number of keys inserted (including replaced), which equals count
+// on success. It is less than count if capacity is reached or if memory
+// allocation fails, then it stops at the first key that could not be
+// inserted. The input is inserted unpartitioned, in input order, if it is too
+// large for 32-bit indices or if the partitioning buffer cannot be allocated.
+static inline size_t
+MC_FUN_(build)(MC_T * const mrx,
+               MC_KEY_T const keys[] MRX_KEY_SIZES_ARG_ MRX_VALUES_ARG_,
+               const size_t count)
+{
+    return MC_FUN_(build_)(mrx, keys MRX_KEY_SIZES_ALL_ MRX_VALUES_ALL_, count, 1);
+}
+
+// As build, with up to thread_count threads including the calling one. If
+// memory allocation fails in a parallel build, each thread stops at the first
+// key it could not insert, so the keys not inserted can be anywhere in the
+// input.
+static inline size_t
+MC_FUN_(build_parallel)(MC_T * const mrx,
+                        MC_KEY_T const keys[] MRX_KEY_SIZES_ARG_ MRX_VALUES_ARG_,
+                        const size_t count,
+                        const unsigned thread_count)
+{
+    return MC_FUN_(build_)(mrx, keys MRX_KEY_SIZES_ALL_ MRX_VALUES_ALL_, count, thread_count);
+}
+
+static inline void
+MC_FUN_(setop_insert_)(const uint8_t key[],
+                       const unsigned key_len,
+                       void **vref_a,
+                       void **vref_b,
+                       void *arg)
+{
+    MC_T *dst = (MC_T *)arg;
+    void **src = (vref_a != NULL) ? vref_a : vref_b;
+    bool is_occupied;
+    void *val = mrx_insert_(&dst->mrx, key, key_len, &is_occupied);
+    (void)src;
+    if (val == NULL) {
+        return;
+    }
+    if (is_occupied) {
+        MC_OPT_FREE_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val));
+    }
+    MC_OPT_ASSIGN_VALUE_((MC_OPT_DREF_(MC_VALUE_T *)val), (MC_OPT_DREF_(MC_VALUE_T *)src));
+}
+
+// dst must not be the same tree as a or b. Returns false if memory for the
+// traversal cannot be allocated (long keys only), then dst is unchanged.
+static inline bool
+MC_FUN_(union)(MC_T * const dst,
+               MC_T * const a,
+               MC_T * const b)
+{
+    return mrx_setop_(&a->mrx, &b->mrx, MRX_SETOP_UNION, MC_FUN_(setop_insert_), dst);
+}
+
+static inline bool
+MC_FUN_(intersection)(MC_T * const dst,
+                      MC_T * const a,
+                      MC_T * const b)
+{
+    return mrx_setop_(&a->mrx, &b->mrx, MRX_SETOP_INTERSECTION, MC_FUN_(setop_insert_), dst);
+}
+
+static inline bool
+MC_FUN_(difference)(MC_T * const dst,
+                    MC_T * const a,
+                    MC_T * const b)
+{
+    return mrx_setop_(&a->mrx, &b->mrx, MRX_SETOP_DIFFERENCE, MC_FUN_(setop_insert_), dst);
+}
+
 #if MRX_KEY_VARSIZE - 0 != 0
 static inline MC_VALUE_T MC_OPT_PTR_
 MC_FUN_(insertnt)(MC_T * const mrx,
@@ -377,6 +920,14 @@ MC_FUN_(insertnt)(MC_T * const mrx,
                            MC_OPT_VALUE_PARAM_);
 }
 
+static inline MC_VALUE_T MC_OPT_PTR_
+MC_FUN_(insert_hintnt)(mrx_cursor_t * const cursor,
+                       MC_KEY_T const key MC_OPT_VALUE_INSERT_ARG_)
+{
+    return MC_FUN_(insert_hint)(cursor, key, strlen((const char *)key)
+                                MC_OPT_VALUE_PARAM_);
+}
+
 static inline MC_VALUE_T MC_OPT_PTR_
 MC_FUN_(erasent)(MC_T * const mrx,
                  MC_KEY_T const key)
@@ -385,6 +936,25 @@ MC_FUN_(erasent)(MC_T * const mrx,
     return MC_FUN_(erase)(mrx, key, slen);
 }
 
+// Returns number of erased keys
+static inline size_t
+MC_FUN_(erase_prefix)(MC_T * const mrx,
+                      MC_KEY_T const prefix MRX_KEY_SIZE_ARG_)
+{
+#if defined(MC_FREE_VALUE)
+    return mrx_erase_prefix_(&mrx->mrx, (const uint8_t *)prefix, MRX_KEY_SIZE_, MC_FUN_(free_value_cb_), NULL);
+#else
+    return mrx_erase_prefix_(&mrx->mrx, (const uint8_t *)prefix, MRX_KEY_SIZE_, NULL, NULL);
+#endif
+}
+
+static inline size_t
+MC_FUN_(erase_prefixnt)(MC_T * const mrx,
+                        MC_KEY_T const prefix)
+{
+    return MC_FUN_(erase_prefix)(mrx, prefix, strlen((const char *)prefix));
+}
+
 static inline MC_VALUE_T MC_OPT_PTR_
 MC_FUN_(findnt)(MC_T * const mrx,
                 MC_KEY_T const key)
@@ -433,13 +1003,49 @@ MC_FUN_(findnearnt)(MC_T * const mrx,
     const size_t slen = strlen((const char *)key);
     return MC_FUN_(findnear)(mrx, key, slen, match_len);
 }
+
+static inline void
+MC_FUN_(fuzzy_find)(MC_T * const mrx,
+                    MC_KEY_T const key MRX_KEY_SIZE_ARG_,
+                    const unsigned max_distance,
+                    mrx_fuzzy_cb_t cb,
+                    void *cb_arg)
+{
+    mrx_fuzzy_find_(&mrx->mrx, (const uint8_t *)key, MRX_KEY_SIZE_, max_distance, cb, cb_arg);
+}
+
+static inline void
+MC_FUN_(fuzzy_findnt)(MC_T * const mrx,
+                      MC_KEY_T const key,
+                      const unsigned max_distance,
+                      mrx_fuzzy_cb_t cb,
+                      void *cb_arg)
+{
+    mrx_fuzzy_find_(&mrx->mrx, (const uint8_t *)key, strlen((const char *)key), max_distance, cb, cb_arg);
+}
+
+// Returns NULL on memory allocation failure.
+static inline mrx_ac_t *
+MC_FUN_(ac_compile)(MC_T * const mrx)
+{
+    return mrx_ac_compile_(&mrx->mrx);
+}
 #endif // MRX_KEY_VARSIZE - 0 != 0
 
 #include <mc_tmpl_undef.h>
 #undef MRX_KEY_VARSIZE
 #undef MRX_KEY_SORTINT
 #undef MRX_KEY_SWAP_
+#undef MRX_KEY_SWAP128_
+#undef MRX_KEY_SORTINT128_
 #undef MRX_SWAPPED_KEY_
 #undef MRX_KEY_SIZE_ARG_
+#undef MRX_KEY_OUT_ARG_
+#undef MRX_KEY_SIZES_ARG_
+#undef MRX_KEY_SIZES_PARAM_
+#undef MRX_KEY_SIZES_ALL_
+#undef MRX_VALUES_ARG_
+#undef MRX_VALUES_PARAM_
+#undef MRX_VALUES_ALL_
 #undef MRX_KEY_SIZE_
 #undef MRX_KEY_ADDROF_
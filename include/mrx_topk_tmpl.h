@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Top-k completion index, based on the radix tree.
+
+  Keys are octet strings with a 32 bit score each. mrx_topk_query() calls a
+  callback for the k highest-scored keys that start with a given prefix, in
+  descending score order, such as for search-box autocomplete. The maximum
+  score below each branch is kept up to date on insert and erase, so a query
+  visits about k times key depth nodes instead of all completions of the
+  prefix. The order of keys with equal score is unspecified.
+
+  Inserting an existing key changes its score. The score augmentation makes
+  insert and erase slower than for the plain tree, and takes additional
+  memory on the order of one tree entry per key.
+
+  Default configuration:
+
+  Index named mrx_topk, in compact memory management mode.
+*/
+
+/*
+
+  Design notes: see mrx_topk.c
+
+*/
+
+#ifndef MC_PREFIX
+#define MC_PREFIX mrx_topk
+#endif
+
+#if defined(MC_KEY_T) || defined(MC_VALUE_T)
+#error "MC_KEY_T and MC_VALUE_T should not be defined for the top-k index, keys are strings and values scores."
+#endif
+#define MC_KEY_T const char *
+#define MC_VALUE_T uint32_t
+
+#define MC_ASSOCIATIVE_CONTAINER_ 1
+#define MC_MM_DEFAULT_ MC_MM_COMPACT
+#define MC_MM_SUPPORT_ (MC_MM_PERFORMANCE | MC_MM_COMPACT)
+#include <mc_tmpl.h>
+
+#ifndef MRX_TOPK_TMPL_ONCE_
+#define MRX_TOPK_TMPL_ONCE_
+#include <string.h>
+
+#include <mrx_base.h>
+#endif
+
+typedef struct MC_T_ {
+    mrx_topk_base_t t;
+} MC_T;
+
+static inline MC_T *
+MC_FUN_(new)(const size_t capacity)
+{
+    MC_T *t;
+
+#if MC_MM_MODE == MC_MM_COMPACT
+    if ((t = malloc(sizeof(MC_T))) == NULL) {
+        return NULL;
+    }
+    if (!mrx_topk_init_(&t->t, capacity, 1)) {
+        free(t);
+        return NULL;
+    }
+#else
+    if ((t = malloc(sizeof(MC_T) + sizeof(struct mrx_buddyalloc))) == NULL) {
+        return NULL;
+    }
+    if (!mrx_topk_init_(&t->t, capacity, 0)) {
+        free(t);
+        return NULL;
+    }
+#endif
+    return t;
+}
+
+static inline void
+MC_FUN_(delete)(MC_T * const t)
+{
+    if (t == NULL) {
+        return;
+    }
+    mrx_topk_delete_(&t->t);
+    free(t);
+}
+
+static inline void
+MC_FUN_(clear)(MC_T * const t)
+{
+    mrx_topk_clear_(&t->t);
+}
+
+static inline int
+MC_FUN_(empty)(MC_T * const t)
+{
+    return (t->t.mrx.count == 0);
+}
+
+static inline size_t
+MC_FUN_(size)(MC_T * const t)
+{
+    return t->t.mrx.count;
+}
+
+// Returns false on memory allocation failure or if capacity is reached.
+static inline bool
+MC_FUN_(insert)(MC_T * const t,
+                MC_KEY_T const key,
+                const size_t key_size,
+                const uint32_t score)
+{
+    return mrx_topk_insert_(&t->t, (const uint8_t *)key, key_size, score);
+}
+
+static inline bool
+MC_FUN_(insertnt)(MC_T * const t,
+                  MC_KEY_T const key,
+                  const uint32_t score)
+{
+    return mrx_topk_insert_(&t->t, (const uint8_t *)key, strlen(key), score);
+}
+
+// Returns false if not found, score may be NULL.
+static inline bool
+MC_FUN_(find)(MC_T * const t,
+              MC_KEY_T const key,
+              const size_t key_size,
+              uint32_t * const score)
+{
+    uint32_t score_;
+    return mrx_topk_find_(&t->t, (const uint8_t *)key, key_size, score == NULL ? &score_ : score);
+}
+
+static inline bool
+MC_FUN_(findnt)(MC_T * const t,
+                MC_KEY_T const key,
+                uint32_t * const score)
+{
+    return MC_FUN_(find)(t, key, strlen(key), score);
+}
+
+static inline bool
+MC_FUN_(erase)(MC_T * const t,
+               MC_KEY_T const key,
+               const size_t key_size)
+{
+    return mrx_topk_erase_(&t->t, (const uint8_t *)key, key_size);
+}
+
+static inline bool
+MC_FUN_(erasent)(MC_T * const t,
+                 MC_KEY_T const key)
+{
+    return mrx_topk_erase_(&t->t, (const uint8_t *)key, strlen(key));
+}
+
+// Returns number of results, which is less than k if fewer keys match.
+static inline size_t
+MC_FUN_(query)(MC_T * const t,
+               MC_KEY_T const prefix,
+               const size_t prefix_size,
+               const size_t k,
+               mrx_topk_cb_t cb,
+               void *cb_arg)
+{
+    return mrx_topk_query_(&t->t, (const uint8_t *)prefix, prefix_size, k, cb, cb_arg);
+}
+
+static inline size_t
+MC_FUN_(querynt)(MC_T * const t,
+                 MC_KEY_T const prefix,
+                 const size_t k,
+                 mrx_topk_cb_t cb,
+                 void *cb_arg)
+{
+    return mrx_topk_query_(&t->t, (const uint8_t *)prefix, strlen(prefix), k, cb, cb_arg);
+}
+
+#include <mc_tmpl_undef.h>
@@ -89,6 +89,11 @@ void
 nodepool_block_to_front_(struct nodepool *nodepool,
                          struct nodepool_bh *bh);
 
+void
+nodepool_adopt_(struct nodepool *nodepool,
+                struct nodepool *src,
+                size_t node_size);
+
 struct nodepool_allocation_stats {
     size_t superblock_size; // total allocated from buddy allocator
     size_t overhead_size; // headers and padding
@@ -215,6 +215,15 @@ NODEPOOL_FUN_(nodepool_free)(struct nodepool *nodepool,
     }
 }
 
+// Moves all blocks of src to nodepool, so that nodes allocated from src can be
+// freed to nodepool. src must not be used afterwards.
+static inline void
+NODEPOOL_FUN_(nodepool_adopt)(struct nodepool *nodepool,
+                              struct nodepool *src)
+{
+    nodepool_adopt_(nodepool, src, sizeof(NODEPOOL_NODE_TYPE));
+}
+
 static inline void
 NODEPOOL_FUN_(nodepool_allocation_stats)(struct nodepool_allocation_stats *stats,
                                          struct nodepool *nodepool)
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  The red-black tree base with 32-bit relative links, for instances of
+  mrb_tmpl.h with MRB_LINK32. Compiled from the same source as the pointer
+  variant so that rebalancing exists in one place only.
+*/
+#define MRB_LINK32 1
+#include "mrb_base.c"
@@ -14,8 +14,46 @@
 
 #include <mrb_base.h>
 
-#define left child[0]
-#define right child[1]
+#if MRB_ORDER_STATISTIC - 0 != 0
+// The order statistic variant, see mrb_os_base.c
+#define mrb_insert_node_ mrb_os_insert_node_
+#define mrb_erase_node_ mrb_os_erase_node_
+#define mrb_join_ mrb_os_join_
+#define mrb_concat_ mrb_os_concat_
+#define mrb_split_before_ mrb_os_split_before_
+#define mrb_count_one_of_ mrb_os_count_one_of_
+#define mrb_build_sorted_ mrb_os_build_sorted_
+#define size_of(node) ((struct mrb_os_node *)(node))->size
+#endif
+
+#if (MRB_LINK32 - 0) + (MRB_ORDER_STATISTIC - 0) + (MRB_THREADED - 0) > 1
+#error "MRB_LINK32, MRB_ORDER_STATISTIC and MRB_THREADED cannot be combined"
+#endif
+
+#if MRB_LINK32 - 0 != 0
+// The 32-bit link variant, see mrb32_base.c. The node type is renamed too,
+// so the code below reads the same for both.
+#define mrb_node mrb_node32
+#define mrb_insert_node_ mrb32_insert_node_
+#define mrb_erase_node_ mrb32_erase_node_
+#define mrb_join_ mrb32_join_
+#define mrb_concat_ mrb32_concat_
+#define mrb_split_before_ mrb32_split_before_
+#define mrb_count_one_of_ mrb32_count_one_of_
+#define mrb_build_sorted_ mrb32_build_sorted_
+#endif
+
+#if MRB_THREADED - 0 != 0
+// The threaded variant, see mrb_th_base.c
+#define mrb_insert_node_ mrb_th_insert_node_
+#define mrb_erase_node_ mrb_th_erase_node_
+#define mrb_join_ mrb_th_join_
+#define mrb_concat_ mrb_th_concat_
+#define mrb_split_before_ mrb_th_split_before_
+#define mrb_count_one_of_ mrb_th_count_one_of_
+#define mrb_build_sorted_ mrb_th_build_sorted_
+#endif
+
 enum direction {
     LEFT = 0,
     RIGHT = 1
@@ -37,9 +75,36 @@ enum direction {
         ((dest)->parent_n_color & ~MRB_IS_BLACK_BIT) | \
         ((src)->parent_n_color & MRB_IS_BLACK_BIT);
 
+#if MRB_LINK32 - 0 != 0
+#define child_get(node, dir) mrb32_child_get_(node, dir)
+#define child_set(node, dir, c) ((node)->child[dir] = mrb32_link_to_(node, c))
+#define parent_get(node) mrb32_parent_get_(node)
+#define parent_set(node, p)                                             \
+    ((node)->parent_n_color = (uint32_t)mrb32_link_to_(node, p) |       \
+     ((node)->parent_n_color & MRB_IS_BLACK_BIT))
+#else
+#if MRB_THREADED - 0 != 0
+#define child_get(node, dir) mrb_th_child_get_(node, dir)
+#else
+#define child_get(node, dir) (node)->child[dir]
+#endif
+#define child_set(node, dir, c) ((node)->child[dir] = (c))
 #define parent_get(node) mrb_parent_get_(node)
 #define parent_set(node, p) \
     ((node)->parent_n_color = (uintptr_t)(p) | ((node)->parent_n_color & 0x3u))
+#endif
+#define left_of(node) child_get(node, LEFT)
+#define right_of(node) child_get(node, RIGHT)
+
+// Sets a child link that may be NULL, in which case the threaded variant
+// links to the in-order neighbor instead.
+#if MRB_THREADED - 0 != 0
+#define thread_set(node, dir, neighbor) ((node)->child[dir] = mrb_th_thread_to_(neighbor))
+#define link_set(node, dir, c, neighbor)                                \
+    ((c) != NULL ? child_set(node, dir, c) : thread_set(node, dir, neighbor))
+#else
+#define link_set(node, dir, c, neighbor) child_set(node, dir, c)
+#endif
 
 /*
 
@@ -64,24 +129,42 @@ rotate_nodes(struct mrb_node **root,
     struct mrb_node *c;
 
     c = parent_get(a);
-    b = a->child[!dir];
-    a->child[!dir] = b->child[dir];
-    if (b->child[dir] != NULL) {
-        parent_set(b->child[dir], a);
+    b = child_get(a, !dir);
+    struct mrb_node * const y = child_get(b, dir);
+    link_set(a, !dir, y, b);
+    if (y != NULL) {
+        parent_set(y, a);
     }
-    b->child[dir] = a;
+    child_set(b, dir, a);
     parent_set(b, c);
     if (c != NULL) {
-        if (a == c->child[dir]) {
-            c->child[dir] = b;
+        if (a == child_get(c, dir)) {
+            child_set(c, dir, b);
         } else {
-            c->child[!dir] = b;
+            child_set(c, !dir, b);
         }
     } else {
         *root = b;
     }
     parent_set(a, b);
+#if MRB_ORDER_STATISTIC - 0 != 0
+    size_of(b) = size_of(a);
+    size_of(a) = mrb_os_size_(left_of(a)) + mrb_os_size_(right_of(a)) + 1;
+#endif
+}
+
+#if MRB_ORDER_STATISTIC - 0 != 0
+// Adds delta to the subtree sizes from node up to the root, a delta of
+// (uintptr_t)-1 subtracts one.
+static void
+add_to_sizes(struct mrb_node *node,
+             const uintptr_t delta)
+{
+    for (; node != NULL; node = parent_get(node)) {
+        size_of(node) += delta;
+    }
 }
+#endif
 
 // Maintain red-black tree coloring properties after erase (RB-Delete-Fixup page 274 in ItA book.)
 static void
@@ -94,38 +177,41 @@ erase_rebalance(struct mrb_node **root,
 
         /* Pick left or right. The cases are exactly mirrored so we don't have
            separate code for left and right */
-        if (parent->child[dir] != child) {
+        if (child_get(parent, dir) != child) {
             dir = !dir;
         }
 
-        struct mrb_node *sibling = parent->child[!dir];
+        struct mrb_node *sibling = child_get(parent, !dir);
         if (is_nonnil_red(sibling)) {
             // Case 1
             make_black(sibling);
             make_red(parent);
             rotate_nodes(root, parent, dir);
-            sibling = parent->child[!dir];
+            sibling = child_get(parent, !dir);
         }
-        if (is_black(sibling->child[0]) && is_black(sibling->child[1])) {
+        if (is_black(left_of(sibling)) && is_black(right_of(sibling))) {
             // Case 2
             make_red(sibling);
             child = parent;
             parent = parent_get(child);
         } else {
-            if (is_black(sibling->child[!dir])) {
+            struct mrb_node *far = child_get(sibling, !dir);
+            if (is_black(far)) {
                 // Case 3
-                if (sibling->child[dir] != NULL) {
-                    make_black(sibling->child[dir]);
+                struct mrb_node * const near = child_get(sibling, dir);
+                if (near != NULL) {
+                    make_black(near);
                 }
                 make_red(sibling);
                 rotate_nodes(root, sibling, !dir);
-                sibling = parent->child[!dir];
+                sibling = child_get(parent, !dir);
+                far = child_get(sibling, !dir);
             }
             // Case 4
             copy_color(sibling, parent);
             make_black(parent);
-            if (sibling->child[!dir] != NULL) {
-                make_black(sibling->child[!dir]);
+            if (far != NULL) {
+                make_black(far);
             }
             rotate_nodes(root, parent, dir);
             child = *root;
@@ -138,29 +224,25 @@ erase_rebalance(struct mrb_node **root,
     }
 }
 
-// A pseudo code description exists in book ItA "RB-Insert" page 268.
-void
-mrb_insert_node_(struct mrb_node **root,
+// Maintain red-black tree coloring properties after a red node has been
+// linked in. Returns true if the black height of the tree grew, which happens
+// when the root had to be recolored back to black.
+static bool
+insert_rebalance(struct mrb_node **root,
                  struct mrb_node *node,
-                 struct mrb_node *parent,
-                 struct mrb_node **link_in_parent)
+                 struct mrb_node *parent)
 {
     enum direction dir = LEFT;
 
-    node->parent_n_color = (uintptr_t)parent; // no bit set == red color
-    node->child[LEFT] = NULL;
-    node->child[RIGHT] = NULL;
-    *link_in_parent = node;
-
     while (is_red(parent)) {
         struct mrb_node *grandp = parent_get(parent);
 
         // test which direction to go
-        if (parent != grandp->child[dir]) {
+        if (parent != child_get(grandp, dir)) {
             dir = !dir;
         }
 
-        struct mrb_node *uncle = grandp->child[!dir];
+        struct mrb_node *uncle = child_get(grandp, !dir);
         if (is_red(uncle)) {
             // Case 1
             make_black(uncle);
@@ -168,7 +250,7 @@ mrb_insert_node_(struct mrb_node **root,
             make_red(grandp);
             node = grandp;
         } else {
-            if (parent->child[!dir] == node) {
+            if (child_get(parent, !dir) == node) {
                 // Case 2
                 rotate_nodes(root, parent, dir);
                 struct mrb_node *tmp = parent;
@@ -182,7 +264,50 @@ mrb_insert_node_(struct mrb_node **root,
         }
         parent = parent_get(node);
     }
+    const bool grew = is_nonnil_red(*root);
     make_black(*root);
+    return grew;
+}
+
+// A pseudo code description exists in book ItA "RB-Insert" page 268.
+void
+#if MRB_LINK32 - 0 != 0 || MRB_THREADED - 0 != 0
+mrb_insert_node_(struct mrb_node **root,
+                 struct mrb_node *node,
+                 struct mrb_node *parent,
+                 const int dir)
+#else
+mrb_insert_node_(struct mrb_node **root,
+                 struct mrb_node *node,
+                 struct mrb_node *parent,
+                 struct mrb_node **link_in_parent)
+#endif
+{
+    node->parent_n_color = 0; // no bit set == red color
+    parent_set(node, parent);
+#if MRB_THREADED - 0 != 0
+    // the parent is the neighbor on one side, and on the other side the
+    // neighbor the parent had
+    thread_set(node, !dir, parent);
+    node->child[dir] = (parent != NULL) ? parent->child[dir] : mrb_th_thread_to_(NULL);
+#else
+    child_set(node, LEFT, NULL);
+    child_set(node, RIGHT, NULL);
+#endif
+#if MRB_LINK32 - 0 != 0 || MRB_THREADED - 0 != 0
+    if (parent != NULL) {
+        child_set(parent, dir, node);
+    } else {
+        *root = node;
+    }
+#else
+    *link_in_parent = node;
+#endif
+#if MRB_ORDER_STATISTIC - 0 != 0
+    size_of(node) = 1;
+    add_to_sizes(parent, 1);
+#endif
+    insert_rebalance(root, node, parent);
 }
 
 // A pseudo code description exists in book ItA "RB-Delete" page 273. The order
@@ -197,59 +322,82 @@ mrb_erase_node_(struct mrb_node **root,
 
     // Remove erased node from tree by relinking, and check color of node,
     // if it's black we need to rebalance.
-    if (node->left != NULL) {
-        if (node->right != NULL) {
+    struct mrb_node * const nleft = left_of(node);
+    struct mrb_node * const nright = right_of(node);
+    if (nleft != NULL) {
+        if (nright != NULL) {
             // Two children, more complex case.
 
             struct mrb_node *successor;
-            for (successor = node->right;
-                 successor->left != NULL;
-                 successor = successor->left) { }
+            for (successor = nright;
+                 left_of(successor) != NULL;
+                 successor = left_of(successor)) { }
 
             erased_is_black = is_nonnil_black(successor);
-            echild = successor->right;
+            echild = right_of(successor);
             eparent = parent_get(successor);
 
             // Remove successor node from the tree and put it back into the
-            // tree in the place of erase-node.
-            successor->parent_n_color = node->parent_n_color;
-            successor->left = node->left;
-            parent_set(node->left, successor);
+            // tree in the place of erase-node. Links are set one by one, as
+            // 32-bit links are relative to the node that holds them.
+            struct mrb_node *tmpparent = parent_get(node);
+            parent_set(successor, tmpparent);
+            copy_color(successor, node);
+            child_set(successor, LEFT, nleft);
+            parent_set(nleft, successor);
             if (eparent == node) {
-                successor->right = echild;
+                // successor keeps its right child
                 eparent = successor;
             } else {
-                successor->right = node->right;
-                parent_set(node->right, successor);
-                eparent->left = echild;
+                child_set(successor, RIGHT, nright);
+                parent_set(nright, successor);
+                link_set(eparent, LEFT, echild, successor);
             }
+#if MRB_THREADED - 0 != 0
+            // the predecessor of node now precedes successor
+            struct mrb_node *pred;
+            for (pred = nleft; right_of(pred) != NULL; pred = right_of(pred)) { }
+            thread_set(pred, RIGHT, successor);
+#endif
             if (echild != NULL) {
                 parent_set(echild, eparent);
             }
 
             // If erase-node had a parent, replace link in that
-            struct mrb_node *tmpparent = parent_get(node);
             if (tmpparent != NULL) {
-                if (tmpparent->left == node) {
-                    tmpparent->left = successor;
+                if (left_of(tmpparent) == node) {
+                    child_set(tmpparent, LEFT, successor);
                 } else {
-                    tmpparent->right = successor;
+                    child_set(tmpparent, RIGHT, successor);
                 }
             } else {
                 *root = successor;
             }
+#if MRB_ORDER_STATISTIC - 0 != 0
+            size_of(successor) = size_of(node);
+#endif
             goto erase_rebalance;
         } else {
             // one child
-            echild = node->left;
+            echild = nleft;
             eparent = parent_get(node);
             parent_set(echild, eparent);
+#if MRB_THREADED - 0 != 0
+            struct mrb_node *pred;
+            for (pred = nleft; right_of(pred) != NULL; pred = right_of(pred)) { }
+            pred->child[RIGHT] = node->child[RIGHT];
+#endif
         }
-    } else if (node->right != NULL) {
+    } else if (nright != NULL) {
         // one child
-        echild = node->right;
+        echild = nright;
         eparent = parent_get(node);
         parent_set(echild, eparent);
+#if MRB_THREADED - 0 != 0
+        struct mrb_node *succ;
+        for (succ = nright; left_of(succ) != NULL; succ = left_of(succ)) { }
+        succ->child[LEFT] = node->child[LEFT];
+#endif
     } else {
         // zero children
         echild = NULL;
@@ -258,22 +406,387 @@ mrb_erase_node_(struct mrb_node **root,
     // this is only done for the one/zero child cases
     erased_is_black = is_nonnil_black(node);
     if (eparent != NULL) {
-        if (eparent->left == node) {
-            eparent->left = echild;
+        // without children, node's neighbor on that side becomes eparent's
+        if (left_of(eparent) == node) {
+            link_set(eparent, LEFT, echild, mrb_th_neighbor_get_(node, LEFT));
         } else {
-            eparent->right = echild;
+            link_set(eparent, RIGHT, echild, mrb_th_neighbor_get_(node, RIGHT));
         }
     } else {
         *root = echild;
     }
 
 erase_rebalance:
+#if MRB_ORDER_STATISTIC - 0 != 0
+    add_to_sizes(eparent, (uintptr_t)-1);
+#endif
     if (erased_is_black) {
         erase_rebalance(root, echild, eparent);
     }
 
     // mess up node so if it is reused illegaly we get a crash
-    node->left = (struct mrb_node *)0x0000DEAD;
-    node->right = (struct mrb_node *)0x0000DEAD;
+#if MRB_LINK32 - 0 != 0
+    node->child[LEFT] = 0x0DEAD000;
+    node->child[RIGHT] = 0x0DEAD000;
+#else
+    node->child[LEFT] = (struct mrb_node *)0x0000DEAD;
+    node->child[RIGHT] = (struct mrb_node *)0x0000DEAD;
+#endif
     node->parent_n_color = 0x000DEAD0;
 }
+
+/*
+  Join and split.
+
+  Black height here is the number of black nodes on any path from a node
+  (inclusive) down to a leaf, which is the same for both children of a node.
+  Join of t1, k and t2 (all keys of t1 less than k, and k less than all keys
+  of t2) walks down the facing spine of the tree with the larger black
+  height until it finds a black node with the black height of the other
+  tree, puts k there as a red node with the found subtree and the other tree
+  as children, and fixes a red parent as after insert. The cost is
+  proportional to the difference of black heights.
+
+  Split is done bottom-up from the split node: each ancestor and its other
+  subtree is joined to the left or right result, depending on which side
+  the path came from. The black heights of the joined trees grow along the
+  path, so the join costs telescope to O(log n) in total. Black heights are
+  tracked instead of recomputed, which would give O(log^2 n).
+*/
+
+static unsigned
+black_height(const struct mrb_node *node)
+{
+    unsigned height = 0;
+    for (; node != NULL; node = left_of(node)) {
+        if (is_nonnil_black(node)) {
+            height++;
+        }
+    }
+    return height;
+}
+
+// Makes a subtree a tree of its own, returns its black height given the
+// black height it had as a subtree.
+static unsigned
+detach_subtree(struct mrb_node *node,
+               const unsigned height)
+{
+    if (node == NULL) {
+        return height;
+    }
+    const unsigned new_height = height + (is_nonnil_red(node) ? 1u : 0u);
+    node->parent_n_color = MRB_IS_BLACK_BIT;
+    return new_height;
+}
+
+static struct mrb_node *
+join_trees(struct mrb_node *t1,
+           const unsigned height1,
+           struct mrb_node *k,
+           struct mrb_node *t2,
+           const unsigned height2,
+           unsigned *height)
+{
+    // walk down the right spine of t1 if it is taller, else the left of t2
+    const enum direction dir = (height1 >= height2) ? RIGHT : LEFT;
+    struct mrb_node * const tall = (dir == RIGHT) ? t1 : t2;
+    struct mrb_node * const other = (dir == RIGHT) ? t2 : t1;
+    const unsigned target = (dir == RIGHT) ? height2 : height1;
+    unsigned h = (dir == RIGHT) ? height1 : height2;
+    struct mrb_node *parent = NULL;
+    struct mrb_node *y = tall;
+    while (h > target || is_red(y)) {
+        if (is_nonnil_black(y)) {
+            h--;
+        }
+        parent = y;
+        y = child_get(y, dir);
+    }
+    k->parent_n_color = 0; // red
+    parent_set(k, parent);
+    // in the threaded variant the caller has set the threads of k to its
+    // neighbors, which are kept where k gets no child, unless k ends up
+    // below the last node of the spine
+    link_set(k, !dir, y, parent != NULL ? parent : mrb_th_neighbor_get_(k, !dir));
+    link_set(k, dir, other, mrb_th_neighbor_get_(k, dir));
+    if (y != NULL) {
+        parent_set(y, k);
+    }
+    if (other != NULL) {
+        parent_set(other, k);
+    }
+#if MRB_ORDER_STATISTIC - 0 != 0
+    size_of(k) = mrb_os_size_(y) + mrb_os_size_(other) + 1;
+    add_to_sizes(parent, mrb_os_size_(other) + 1);
+#endif
+    if (parent == NULL) {
+        make_black(k);
+        *height = target + 1;
+        return k;
+    }
+    child_set(parent, dir, k);
+    struct mrb_node *root = tall;
+    *height = (dir == RIGHT ? height1 : height2) + (insert_rebalance(&root, k, parent) ? 1u : 0u);
+    return root;
+}
+
+#if MRB_THREADED - 0 != 0
+// Returns the first (LEFT) or last (RIGHT) node of a tree, NULL if empty.
+static struct mrb_node *
+extreme_node(struct mrb_node *node,
+             const enum direction dir)
+{
+    if (node != NULL) {
+        while (child_get(node, dir) != NULL) {
+            node = child_get(node, dir);
+        }
+    }
+    return node;
+}
+#endif
+
+struct mrb_node *
+mrb_join_(struct mrb_node *t1,
+          struct mrb_node *k,
+          struct mrb_node *t2)
+{
+    unsigned height;
+    const unsigned height1 = detach_subtree(t1, black_height(t1));
+    const unsigned height2 = detach_subtree(t2, black_height(t2));
+#if MRB_THREADED - 0 != 0
+    struct mrb_node * const last1 = extreme_node(t1, RIGHT);
+    struct mrb_node * const first2 = extreme_node(t2, LEFT);
+    thread_set(k, LEFT, last1);
+    thread_set(k, RIGHT, first2);
+    if (last1 != NULL) {
+        thread_set(last1, RIGHT, k);
+    }
+    if (first2 != NULL) {
+        thread_set(first2, LEFT, k);
+    }
+#endif
+    return join_trees(t1, height1, k, t2, height2, &height);
+}
+
+struct mrb_node *
+mrb_concat_(struct mrb_node *t1,
+            struct mrb_node *t2)
+{
+    if (t1 == NULL) {
+        return t2;
+    }
+    if (t2 == NULL) {
+        return t1;
+    }
+    // the smallest node of t2 is taken out and used as the join node
+    struct mrb_node *k = t2;
+    while (left_of(k) != NULL) {
+        k = left_of(k);
+    }
+    mrb_erase_node_(&t2, k);
+    return mrb_join_(t1, k, t2);
+}
+
+void
+mrb_split_before_(struct mrb_node *node,
+                  struct mrb_node **before,
+                  struct mrb_node **after)
+{
+    // black height of the subtree where the path currently is
+    struct mrb_node *l = left_of(node);
+    struct mrb_node *r = right_of(node);
+    unsigned height = black_height(l);
+    unsigned height_l = detach_subtree(l, height);
+    unsigned height_r = detach_subtree(r, height);
+    if (is_nonnil_black(node)) {
+        height++;
+    }
+    struct mrb_node *cur = node;
+    struct mrb_node *p = parent_get(node);
+    while (p != NULL) {
+        struct mrb_node * const grandp = parent_get(p);
+        const bool p_is_black = is_nonnil_black(p);
+        if (left_of(p) == cur) {
+            struct mrb_node * const sibling = right_of(p);
+#if MRB_THREADED - 0 != 0
+            // the threads inside the parts are still valid, as each part
+            // keeps its neighbors from the original tree, except for the
+            // ends at node which are fixed when done
+            thread_set(p, LEFT, node);
+#endif
+            const unsigned height_s = detach_subtree(sibling, height);
+            r = join_trees(r, height_r, p, sibling, height_s, &height_r);
+        } else {
+            struct mrb_node * const sibling = left_of(p);
+#if MRB_THREADED - 0 != 0
+            thread_set(p, RIGHT, node);
+#endif
+            const unsigned height_s = detach_subtree(sibling, height);
+            l = join_trees(sibling, height_s, p, l, height_l, &height_l);
+        }
+        if (p_is_black) {
+            height++;
+        }
+        cur = p;
+        p = grandp;
+    }
+    *before = l;
+#if MRB_THREADED - 0 != 0
+    if (l != NULL) {
+        thread_set(extreme_node(l, RIGHT), RIGHT, NULL);
+    }
+    thread_set(node, LEFT, NULL);
+#endif
+    *after = join_trees(NULL, 0, node, r, height_r, &height_r);
+}
+
+#if MRB_ORDER_STATISTIC - 0 == 0
+static const struct mrb_node *
+first_node(const struct mrb_node *node)
+{
+    if (node != NULL) {
+        while (left_of(node) != NULL) {
+            node = left_of(node);
+        }
+    }
+    return node;
+}
+
+static const struct mrb_node *
+next_node(const struct mrb_node *node)
+{
+    const struct mrb_node *parent;
+    if (right_of(node) != NULL) {
+        return first_node(right_of(node));
+    }
+    while ((parent = parent_get(node)) != NULL && node == right_of(parent)) {
+        node = parent;
+    }
+    return parent;
+}
+#endif
+
+size_t
+mrb_count_one_of_(const struct mrb_node *a,
+                  const struct mrb_node *b,
+                  const size_t total)
+{
+#if MRB_ORDER_STATISTIC - 0 != 0
+    (void)b;
+    (void)total;
+    return mrb_os_size_(a);
+#else
+    size_t count = 0;
+    a = first_node(a);
+    b = first_node(b);
+    for (;;) {
+        if (a == NULL) {
+            return count;
+        }
+        if (b == NULL) {
+            return total - count;
+        }
+        a = next_node(a);
+        b = next_node(b);
+        count++;
+    }
+#endif
+}
+
+static struct mrb_node *
+build_balanced(struct mrb_node **list,
+               const size_t count,
+               const unsigned depth,
+               const unsigned red_depth)
+{
+    if (count == 0) {
+        return NULL;
+    }
+    // left subtree first, so nodes are taken from the list in key order
+    const size_t left_count = (count - 1) / 2;
+    struct mrb_node *left_child = build_balanced(list, left_count, depth + 1, red_depth);
+    struct mrb_node *node = *list;
+    struct mrb_node * const next = right_of(node);
+    *list = next;
+#if MRB_THREADED - 0 != 0
+    // the left link of the next node is not used for the list, and holds
+    // the thread until that node gets its left child
+    if (next != NULL) {
+        thread_set(next, LEFT, node);
+    }
+#endif
+    node->parent_n_color = (depth == red_depth) ? 0 : MRB_IS_BLACK_BIT;
+#if MRB_ORDER_STATISTIC - 0 != 0
+    size_of(node) = count;
+#endif
+    link_set(node, LEFT, left_child, mrb_th_neighbor_get_(node, LEFT));
+    if (left_child != NULL) {
+        parent_set(left_child, node);
+    }
+    struct mrb_node * const right_child = build_balanced(list, count - 1 - left_count, depth + 1, red_depth);
+    link_set(node, RIGHT, right_child, next);
+    if (right_child != NULL) {
+        parent_set(right_child, node);
+    }
+    return node;
+}
+
+/*
+  Splitting in the middle at each level gives a tree where all levels are
+  full except possibly the deepest. Coloring that level red and all others
+  black gives the same black height on all paths, and no red node has a red
+  parent, so no rotations or recoloring is needed.
+*/
+struct mrb_node *
+mrb_build_sorted_(struct mrb_node *list,
+                  const size_t count)
+{
+    unsigned full_depth = 0; // depth of the deepest full level
+    while (((size_t)2 << full_depth) - 1 <= count && full_depth < 8 * sizeof(size_t) - 1) {
+        full_depth++;
+    }
+    // if the deepest level is full too (count is 2^n - 1) no node is red
+    const unsigned red_depth = (((size_t)1 << full_depth) - 1 == count) ? ~0u : full_depth;
+#if MRB_THREADED - 0 != 0
+    if (list != NULL) {
+        thread_set(list, LEFT, NULL);
+    }
+#endif
+    return build_balanced(&list, count, 0, red_depth);
+}
+
+#if MRB_ORDER_STATISTIC - 0 != 0
+size_t
+mrb_os_rank_(const struct mrb_node *node)
+{
+    size_t rank = mrb_os_size_(left_of(node));
+    const struct mrb_node *parent;
+    while ((parent = parent_get(node)) != NULL) {
+        if (right_of(parent) == node) {
+            rank += mrb_os_size_(left_of(parent)) + 1;
+        }
+        node = parent;
+    }
+    return rank;
+}
+
+struct mrb_node *
+mrb_os_select_(struct mrb_node *node,
+               size_t index)
+{
+    while (node != NULL) {
+        const size_t left_size = mrb_os_size_(left_of(node));
+        if (index == left_size) {
+            return node;
+        }
+        if (index < left_size) {
+            node = left_of(node);
+        } else {
+            index -= left_size + 1;
+            node = right_of(node);
+        }
+    }
+    return NULL;
+}
+#endif // MRB_ORDER_STATISTIC
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  The red-black tree base with subtree sizes in the nodes, for instances
+  of mrb_tmpl.h with MRB_ORDER_STATISTIC. Compiled from the same source as
+  the plain variant so that rebalancing exists in one place only.
+*/
+#define MRB_ORDER_STATISTIC 1
+#include "mrb_base.c"
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2022 Xarepo AB. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  The threaded red-black tree base, for instances of mrb_tmpl.h with
+  MRB_THREADED. Compiled from the same source as the plain variant so that
+  rebalancing exists in one place only.
+*/
+#define MRB_THREADED 1
+#include "mrb_base.c"
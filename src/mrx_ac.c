@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Multi-pattern matching (Aho-Corasick) over the keys of a radix tree.
+
+   - The automaton is a snapshot, compiled in one breadth-first walk over the
+     tree. Every prefix octet of a node and every branch point becomes one
+     state, so states are numbered in breadth-first order and the children of
+     a state are consecutive, addressed as first child + branch rank. The
+     state array doubles as the queue of the walk and grows as states are
+     added, so there is no separate (recursive) counting pass.
+   - Branch octets are encoded like in the tree nodes. Up to four sorted
+     octets are stored inline in the state (single-octet prefix chains are the
+     common case), up to AC_SCAN_MAX_BRANCH_COUNT in a separate octet array
+     that is scanned, and above that in a 256 bit bitmask where the rank is a
+     popcount plus a per-word base count, as in mask nodes.
+   - A state is 16 bytes, and only the state array is touched per text octet
+     unless there is a match. Key lengths, output links and values are kept
+     in separate arrays, read only when reporting.
+   - Failure links are computed when a state is created. The failure target
+     is always at lower depth and therefore earlier in breadth-first order,
+     so its branches are already encoded. Output links point to the nearest
+     key state on the failure chain, so reporting never walks non-key states.
+   - The first AC_DENSE_MAX_STATE_COUNT states, which are the shallowest and
+     by far the most visited, also get a fully resolved 256 entry transition
+     row (a DFA), with a has-output bit in each entry. Text is consumed with
+     a single table load per octet while in these states, and a failure
+     chain from a deeper state ends as soon as it reaches one of them.
+ */
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+#define AC_INLINE_MAX_BRANCH_COUNT 4u
+#define AC_SCAN_MAX_BRANCH_COUNT 16u
+
+#define AC_DENSE_MAX_STATE_COUNT 1024u
+#define AC_DENSE_OUTPUT_BIT 0x80000000u
+
+#define AC_FLAG_IS_KEY 0x1u
+#define AC_FLAG_HAS_OUTPUT 0x2u
+
+struct ac_state {
+    uint32_t child; // first child
+    uint32_t fail;
+    uint32_t br; // inline octets, octet array offset or mask index
+    uint16_t br_count;
+    uint16_t flags;
+};
+
+struct ac_mask {
+    uint32_t bm[8];
+    uint16_t base[8]; // branch count in lower words
+};
+
+struct mrx_ac {
+    uint32_t state_count;
+    uint32_t dense_count;
+    uint32_t *dense; // resolved transitions of the first dense_count states
+    struct ac_state *states;
+    uint8_t *octets;
+    struct ac_mask *masks;
+    uint32_t *out; // next key state on the failure chain, 0 if none
+    uint32_t *depth;
+    void **values;
+};
+
+// Returns child state, or 0 (the root, which is never a child) if none.
+static inline uint32_t
+ac_goto(const struct mrx_ac *ac,
+        const struct ac_state *st,
+        const uint8_t c)
+{
+    const unsigned br_count = st->br_count;
+    if (br_count <= AC_INLINE_MAX_BRANCH_COUNT) {
+        uint32_t br = st->br;
+        for (unsigned i = 0; i < br_count; i++) {
+            if ((uint8_t)br == c) {
+                return st->child + i;
+            }
+            br >>= 8u;
+        }
+        return 0;
+    }
+    if (br_count <= AC_SCAN_MAX_BRANCH_COUNT) {
+        const uint8_t *br = &ac->octets[st->br];
+        for (unsigned i = 0; i < br_count && br[i] <= c; i++) {
+            if (br[i] == c) {
+                return st->child + i;
+            }
+        }
+        return 0;
+    }
+    const struct ac_mask *mask = &ac->masks[st->br];
+    const uint32_t bm = mask->bm[c >> 5u];
+    const uint32_t bit = 1u << (c & 0x1Fu);
+    if ((bm & bit) == 0) {
+        return 0;
+    }
+    return st->child + mask->base[c >> 5u] + bit32_count(bm & (bit - 1));
+}
+
+struct ac_build {
+    struct mrx_ac *ac;
+    const union mrx_node **node; // tree node of each state
+    uint8_t *pos; // prefix position within node, px_len for the branch point
+    uint32_t state_count;
+    uint32_t octet_count;
+    uint32_t mask_count;
+    size_t state_capacity;
+    size_t octet_capacity;
+    size_t mask_capacity;
+};
+
+// Makes room for the states, octets and mask that the next expanded state
+// can add at most.
+static bool
+ac_reserve(struct ac_build *b)
+{
+    struct mrx_ac *ac = b->ac;
+    void *p;
+    if (b->state_count + 256 > b->state_capacity) {
+        if (b->state_count + 256 > AC_DENSE_OUTPUT_BIT) {
+            return false;
+        }
+        size_t cap = 2 * b->state_capacity + 256;
+        if (cap > AC_DENSE_OUTPUT_BIT) {
+            cap = AC_DENSE_OUTPUT_BIT;
+        }
+        if ((p = realloc(b->node, cap * sizeof(b->node[0]))) == NULL) {
+            return false;
+        }
+        b->node = p;
+        if ((p = realloc(b->pos, cap)) == NULL) {
+            return false;
+        }
+        b->pos = p;
+        if ((p = realloc(ac->states, cap * sizeof(ac->states[0]))) == NULL) {
+            return false;
+        }
+        ac->states = p;
+        if ((p = realloc(ac->out, cap * sizeof(ac->out[0]))) == NULL) {
+            return false;
+        }
+        ac->out = p;
+        if ((p = realloc(ac->depth, cap * sizeof(ac->depth[0]))) == NULL) {
+            return false;
+        }
+        ac->depth = p;
+        if ((p = realloc(ac->values, cap * sizeof(ac->values[0]))) == NULL) {
+            return false;
+        }
+        ac->values = p;
+        b->state_capacity = cap;
+    }
+    if (b->octet_count + AC_SCAN_MAX_BRANCH_COUNT > b->octet_capacity) {
+        const size_t cap = 2 * b->octet_capacity + 16 * AC_SCAN_MAX_BRANCH_COUNT;
+        if ((p = realloc(ac->octets, cap)) == NULL) {
+            return false;
+        }
+        ac->octets = p;
+        b->octet_capacity = cap;
+    }
+    if (b->mask_count + 1 > b->mask_capacity) {
+        const size_t cap = 2 * b->mask_capacity + 16;
+        if ((p = realloc(ac->masks, cap * sizeof(ac->masks[0]))) == NULL) {
+            return false;
+        }
+        ac->masks = p;
+        b->mask_capacity = cap;
+    }
+    return true;
+}
+
+static void
+ac_add_state(struct ac_build *b,
+             const uint32_t parent,
+             const uint8_t c,
+             const union mrx_node *node,
+             const uint8_t pos)
+{
+    struct mrx_ac *ac = b->ac;
+    const uint32_t s = b->state_count++;
+    struct ac_state *st = &ac->states[s];
+
+    b->node[s] = node;
+    b->pos[s] = pos;
+    st->child = 0;
+    st->br = 0;
+    st->br_count = 0;
+    st->flags = 0;
+    ac->depth[s] = ac->depth[parent] + 1;
+    ac->values[s] = NULL;
+    if (pos == HDR_PX_LEN(node->hdr) && HDR_HAS_VALUE(node->hdr)) {
+        st->flags = AC_FLAG_IS_KEY;
+        ac->values[s] = *mrx_node_value_ref_((union mrx_node *)(uintptr_t)node, HDR_NSZ(node->hdr));
+    }
+
+    // the failure target has lower depth, so it has been encoded already
+    uint32_t fail = 0;
+    if (parent != 0) {
+        uint32_t f = ac->states[parent].fail;
+        for (;;) {
+            if ((fail = ac_goto(ac, &ac->states[f], c)) != 0 || f == 0) {
+                break;
+            }
+            f = ac->states[f].fail;
+        }
+    }
+    st->fail = fail;
+    ac->out[s] = (ac->states[fail].flags & AC_FLAG_IS_KEY) != 0 ? fail : ac->out[fail];
+    if (ac->out[s] != 0 || (st->flags & AC_FLAG_IS_KEY) != 0) {
+        st->flags |= AC_FLAG_HAS_OUTPUT;
+    }
+}
+
+static void
+ac_expand(struct ac_build *b,
+          const uint32_t s)
+{
+    struct mrx_ac *ac = b->ac;
+    const union mrx_node *node = b->node[s];
+    const uint8_t pos = b->pos[s];
+    const uint8_t px_len = HDR_PX_LEN(node->hdr);
+    uint8_t brs[256];
+    unsigned br_count = 0;
+
+    if (pos < px_len) {
+        brs[br_count++] = node->sn.octets[pos];
+    } else if (IS_SCAN_NODE(HDR_NSZ(node->hdr))) {
+        const uint8_t br_len = HDR_BR_LEN(node->hdr);
+        memcpy(brs, &node->sn.octets[px_len], br_len);
+        br_count = br_len;
+    } else {
+        int bb = -1;
+        while ((bb = mask_node_next_branch(node, (unsigned)(bb + 1))) != -1) {
+            brs[br_count++] = (uint8_t)bb;
+        }
+    }
+    struct ac_state *st = &ac->states[s];
+    st->child = b->state_count;
+    st->br_count = (uint16_t)br_count;
+    if (br_count <= AC_INLINE_MAX_BRANCH_COUNT) {
+        for (unsigned i = 0; i < br_count; i++) {
+            st->br |= (uint32_t)brs[i] << (8u * i);
+        }
+    } else if (br_count <= AC_SCAN_MAX_BRANCH_COUNT) {
+        st->br = b->octet_count;
+        memcpy(&ac->octets[b->octet_count], brs, br_count);
+        b->octet_count += br_count;
+    } else {
+        struct ac_mask *mask = &ac->masks[b->mask_count];
+        st->br = b->mask_count++;
+        memset(mask, 0, sizeof(*mask));
+        for (unsigned i = 0; i < br_count; i++) {
+            mask->bm[brs[i] >> 5u] |= 1u << (brs[i] & 0x1Fu);
+        }
+        for (unsigned i = 1; i < 8; i++) {
+            mask->base[i] = (uint16_t)(mask->base[i-1] + bit32_count(mask->bm[i-1]));
+        }
+    }
+
+    if (pos < px_len) {
+        ac_add_state(b, s, brs[0], node, pos + 1);
+    } else if (IS_SCAN_NODE(HDR_NSZ(node->hdr))) {
+        const uint8_t *br = &node->sn.octets[px_len];
+        for (uint8_t i = 0; i < br_count; i++) {
+            ac_add_state(b, s, br[i], scan_node_get_child(node, br, (uint8_t)br_count, i), 0);
+        }
+    } else {
+        for (unsigned i = 0; i < br_count; i++) {
+            ac_add_state(b, s, brs[i], mask_node_get_child(node, brs[i]), 0);
+        }
+    }
+}
+
+void
+mrx_ac_delete(mrx_ac_t *ac)
+{
+    if (ac == NULL) {
+        return;
+    }
+    free(ac->dense);
+    free(ac->states);
+    free(ac->octets);
+    free(ac->masks);
+    free(ac->out);
+    free(ac->depth);
+    free(ac->values);
+    free(ac);
+}
+
+mrx_ac_t *
+mrx_ac_compile_(mrx_base_t *mrx)
+{
+    struct mrx_ac *ac = calloc(1, sizeof(*ac));
+    if (ac == NULL) {
+        return NULL;
+    }
+    struct ac_build b = {
+        .ac = ac,
+        .state_count = 1
+    };
+    if (!ac_reserve(&b)) {
+        goto fail;
+    }
+
+    // the empty key is not a pattern, so the root is never a key state
+    memset(&ac->states[0], 0, sizeof(ac->states[0]));
+    ac->out[0] = 0;
+    ac->depth[0] = 0;
+    ac->values[0] = NULL;
+    if (mrx->root != NULL) {
+        b.node[0] = mrx->root;
+        b.pos[0] = 0;
+        for (uint32_t s = 0; s < b.state_count; s++) {
+            if (!ac_reserve(&b)) {
+                goto fail;
+            }
+            ac_expand(&b, s);
+        }
+    }
+    ac->state_count = b.state_count;
+    ac->dense_count = b.state_count < AC_DENSE_MAX_STATE_COUNT ? b.state_count : AC_DENSE_MAX_STATE_COUNT;
+    if ((ac->dense = malloc((size_t)ac->dense_count * 256 * sizeof(ac->dense[0]))) == NULL) {
+        goto fail;
+    }
+    // the failure target of a state is before it in breadth-first order, so
+    // its row is already resolved
+    for (uint32_t s = 0; s < ac->dense_count; s++) {
+        uint32_t *row = &ac->dense[s << 8u];
+        for (unsigned c = 0; c < 256; c++) {
+            uint32_t next = ac_goto(ac, &ac->states[s], (uint8_t)c);
+            if (next == 0) {
+                next = s == 0 ? 0 : ac->dense[(ac->states[s].fail << 8u) + c] & ~AC_DENSE_OUTPUT_BIT;
+            }
+            if ((ac->states[next].flags & AC_FLAG_HAS_OUTPUT) != 0) {
+                next |= AC_DENSE_OUTPUT_BIT;
+            }
+            row[c] = next;
+        }
+    }
+    free(b.node);
+    free(b.pos);
+    return ac;
+
+fail:
+    free(b.node);
+    free(b.pos);
+    mrx_ac_delete(ac);
+    return NULL;
+}
+
+void
+mrx_ac_stream_init(mrx_ac_stream_t *stream)
+{
+    stream->state = 0;
+    stream->pos = 0;
+}
+
+size_t
+mrx_ac_state_count(const mrx_ac_t *ac)
+{
+    return ac->state_count;
+}
+
+static void
+ac_report(const struct mrx_ac *ac,
+          uint32_t s,
+          const uint64_t end_pos,
+          mrx_ac_cb_t cb,
+          void *cb_arg)
+{
+    if ((ac->states[s].flags & AC_FLAG_IS_KEY) == 0) {
+        s = ac->out[s];
+    }
+    do {
+        cb(end_pos, ac->depth[s], &ac->values[s], cb_arg);
+        s = ac->out[s];
+    } while (s != 0);
+}
+
+void
+mrx_ac_match(const mrx_ac_t *ac,
+             mrx_ac_stream_t *stream,
+             const uint8_t text[],
+             const size_t text_len,
+             mrx_ac_cb_t cb,
+             void *cb_arg)
+{
+    const struct ac_state *states = ac->states;
+    const uint32_t *dense = ac->dense;
+    const uint32_t dense_count = ac->dense_count;
+    uint32_t s = stream->state;
+    size_t i = 0;
+
+    while (i < text_len) {
+        if (s < dense_count) {
+            const uint32_t next = dense[(s << 8u) + text[i++]];
+            s = next & ~AC_DENSE_OUTPUT_BIT;
+            if ((next & AC_DENSE_OUTPUT_BIT) != 0) {
+                ac_report(ac, s, stream->pos + i, cb, cb_arg);
+            }
+            continue;
+        }
+        const uint8_t c = text[i++];
+        uint32_t next;
+        while ((next = ac_goto(ac, &states[s], c)) == 0) {
+            if ((s = states[s].fail) < dense_count) {
+                next = dense[(s << 8u) + c] & ~AC_DENSE_OUTPUT_BIT;
+                break;
+            }
+        }
+        s = next;
+        if ((states[s].flags & AC_FLAG_HAS_OUTPUT) != 0) {
+            ac_report(ac, s, stream->pos + i, cb, cb_arg);
+        }
+    }
+    stream->state = s;
+    stream->pos += text_len;
+}
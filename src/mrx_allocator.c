@@ -11,6 +11,17 @@
 
   To not waste any data on headers, the alignment of pointers to at least 8 bytes is used meaning that
   three bits of the pointer is unused and instead reserved to store free bit and block size.
+
+  Allocation can be given a "near" hint, typically the parent of the node to allocate. The freelists
+  are then searched (a few blocks only) for a block in the same page as the hint, or failing that one
+  with the same upper 32 address bits, so the node can be reached with a short pointer. This gives
+  better cache and TLB locality when traversing the tree, and fewer pointer prefix nodes. 128 byte
+  nodes come directly from the superblock allocator which has no placement control.
+
+  In static mode the superblocks are instead carved out of a caller-supplied region, with a freelist
+  for returned superblocks, and alloc returns NULL when the region is exhausted. On 64 bit platforms
+  the region is cut to stay within one 4GB span, so that all nodes can reach each other with short
+  pointers and no pointer prefix nodes are ever needed.
  */
 #include <assert.h>
 #include <stdbool.h>
@@ -48,13 +59,32 @@ static inline void
 superblock_free(mrx_base_t *mrx,
                 void *ptr)
 {
-    node128_nodepool_free(&mrx->nodealloc->superblocks, ptr);
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        *(void **)ptr = mrx->nodealloc->sb.region.freelist;
+        mrx->nodealloc->sb.region.freelist = ptr;
+        mrx->nodealloc->sb.region.free_count++;
+        return;
+    }
+    node128_nodepool_free(&mrx->nodealloc->sb.superblocks, ptr);
 }
 
 static inline void *
 superblock_alloc(mrx_base_t *mrx)
 {
-    return node128_nodepool_alloc(&mrx->nodealloc->superblocks);
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        void *ptr = mrx->nodealloc->sb.region.freelist;
+        if (ptr != NULL) {
+            mrx->nodealloc->sb.region.freelist = *(void **)ptr;
+        } else if (mrx->nodealloc->sb.region.fresh_ptr != mrx->nodealloc->sb.region.fresh_end) {
+            ptr = (void *)mrx->nodealloc->sb.region.fresh_ptr;
+            mrx->nodealloc->sb.region.fresh_ptr += sizeof(struct node128);
+        } else {
+            return NULL;
+        }
+        mrx->nodealloc->sb.region.free_count--;
+        return ptr;
+    }
+    return node128_nodepool_alloc(&mrx->nodealloc->sb.superblocks);
 }
 
 static inline bool
@@ -121,9 +151,56 @@ pop_from_freelist(struct mrx_buddyalloc *ba,
     return head;
 }
 
+// Max number of free blocks to look at when searching for one near the hint
+#define NEAR_SCAN_LENGTH 4u
+#define NEAR_PAGE_SHIFT 12u
+
+// Returns a free block from the nonempty freelists in the same page as near,
+// or else the first with matching pointer prefix, or NULL if none is found.
+static void *
+find_near_free_block(struct mrx_buddyalloc *ba,
+                     uint32_t nonempty,
+                     const void *near,
+                     uint_fast8_t *free_p2)
+{
+    struct free_block *prefix_match = NULL;
+    uint_fast8_t prefix_match_p2 = 0;
+    unsigned scan_count = 0;
+    do {
+        const uint_fast8_t p2 = bit32_bsf(nonempty);
+        struct free_block *fb = (struct free_block *)ba->freelists[p2-MIN_P2];
+        do {
+            if (((uintptr_t)fb >> NEAR_PAGE_SHIFT) == ((uintptr_t)near >> NEAR_PAGE_SHIFT)) {
+                *free_p2 = p2;
+                return fb;
+            }
+            if (prefix_match == NULL && PTR_PREFIX_MATCHES(fb, near)) {
+                prefix_match = fb;
+                prefix_match_p2 = p2;
+            }
+            if (++scan_count == NEAR_SCAN_LENGTH) {
+                *free_p2 = prefix_match_p2;
+                return prefix_match;
+            }
+            fb = NEXT_PTR(fb->next_sz_freebit);
+        } while (fb != NULL);
+        nonempty &= nonempty - 1;
+    } while (nonempty != 0);
+    *free_p2 = prefix_match_p2;
+    return prefix_match;
+}
+
 void *
 mrx_alloc_node_(mrx_base_t *mrx,
                 const uint8_t nsz)
+{
+    return mrx_alloc_node_near_(mrx, nsz, NULL);
+}
+
+void *
+mrx_alloc_node_near_(mrx_base_t *mrx,
+                     const uint8_t nsz,
+                     const void *near)
 {
 #if ARCH_SIZEOF_PTR == 8
     assert(nsz != 0);
@@ -141,13 +218,20 @@ mrx_alloc_node_(mrx_base_t *mrx,
     uint32_t nonempty = mrx->nodealloc->nonempty_freelists;
     nonempty &= ~((1u << p2)  - 1);
     if (nonempty != 0) {
-        free_p2 = bit32_bsf(nonempty);
-        ptr = pop_from_freelist(mrx->nodealloc, free_p2);
+        if (near != NULL && (ptr = find_near_free_block(mrx->nodealloc, nonempty, near, &free_p2)) != NULL) {
+            try_erase_from_freelist(mrx->nodealloc, ptr, free_p2);
+            ((struct free_block *)ptr)->next_sz_freebit &= ~FREEBIT;
+        } else {
+            free_p2 = bit32_bsf(nonempty);
+            ptr = pop_from_freelist(mrx->nodealloc, free_p2);
+        }
         if (free_p2 == p2) {
             return ptr;
         }
     } else {
-        ptr = superblock_alloc(mrx);
+        if ((ptr = superblock_alloc(mrx)) == NULL) {
+            return NULL;
+        }
         free_p2 = MAX_P2;
     }
 
@@ -211,42 +295,113 @@ mrx_init_(mrx_base_t *mrx,
     mrx->count = 0;
     mrx->capacity = (uintptr_t)capacity;
     mrx->max_keylen_n_flags = compact ? MRX_FLAG_IS_COMPACT_ : 0;
+    mrx->mod_count = 0;
     if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) == 0) {
         mrx->nodealloc->nonempty_freelists = 0;
         for (size_t i = 0; i < sizeof(mrx->nodealloc->freelists)/sizeof(mrx->nodealloc->freelists[0]); i++) {
             mrx->nodealloc->freelists[i] = 0;
         }
-        node128_nodepool_init(&mrx->nodealloc->superblocks);
+        node128_nodepool_init(&mrx->nodealloc->sb.superblocks);
+    }
+}
+
+static void
+static_region_reset(mrx_base_t *mrx)
+{
+    mrx->nodealloc->nonempty_freelists = 0;
+    for (size_t i = 0; i < sizeof(mrx->nodealloc->freelists)/sizeof(mrx->nodealloc->freelists[0]); i++) {
+        mrx->nodealloc->freelists[i] = 0;
+    }
+    mrx->nodealloc->sb.region.freelist = NULL;
+    mrx->nodealloc->sb.region.fresh_ptr = mrx->nodealloc->sb.region.base;
+    mrx->nodealloc->sb.region.free_count =
+        (mrx->nodealloc->sb.region.fresh_end - mrx->nodealloc->sb.region.base) / sizeof(struct node128);
+}
+
+void
+mrx_init_static_(mrx_base_t *mrx,
+                 const size_t capacity,
+                 void *region,
+                 const size_t region_size)
+{
+    uintptr_t base = ((uintptr_t)region + 127u) & ~(uintptr_t)127u;
+    uintptr_t end = ((uintptr_t)region + region_size) & ~(uintptr_t)127u;
+    if (end < base) {
+        end = base;
+    }
+#if ARCH_SIZEOF_PTR == 8
+    if ((base >> 32u) != ((end - 1) >> 32u) && end != base) {
+        // keep the larger part within one 4GB span
+        const uintptr_t split = (base + ((uintptr_t)1u << 32u)) & ~(((uintptr_t)1u << 32u) - 1);
+        if (split - base >= end - split) {
+            end = split;
+        } else {
+            base = split;
+            if (end - base > ((uintptr_t)1u << 32u)) {
+                end = base + ((uintptr_t)1u << 32u);
+            }
+        }
     }
+#endif
+    mrx->root = NULL;
+    mrx->count = 0;
+    mrx->capacity = (uintptr_t)capacity;
+    mrx->max_keylen_n_flags = MRX_FLAG_IS_STATIC_;
+    mrx->mod_count = 0;
+    mrx->nodealloc->sb.region.base = base;
+    mrx->nodealloc->sb.region.fresh_end = end;
+    static_region_reset(mrx);
 }
 
 void
 mrx_clear_(mrx_base_t *mrx)
 {
-    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) == 0) {
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        static_region_reset(mrx);
+    } else if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) == 0) {
         mrx->nodealloc->nonempty_freelists = 0;
         for (size_t i = 0; i < sizeof(mrx->nodealloc->freelists)/sizeof(mrx->nodealloc->freelists[0]); i++) {
             mrx->nodealloc->freelists[i] = 0;
         }
-        node128_nodepool_clear(&mrx->nodealloc->superblocks);
+        node128_nodepool_clear(&mrx->nodealloc->sb.superblocks);
     } else {
         mrx_traverse_erase_all_nodes_(mrx);
     }
     mrx->root = NULL;
     mrx->count = 0;
     mrx->max_keylen_n_flags = (mrx->max_keylen_n_flags & MRX_FLAGS_MASK_);
+    mrx->mod_count++;
 }
 
 void
 mrx_delete_(mrx_base_t *mrx)
 {
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        // the region belongs to the caller
+        return;
+    }
     if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) == 0) {
-        node128_nodepool_delete(&mrx->nodealloc->superblocks);
+        node128_nodepool_delete(&mrx->nodealloc->sb.superblocks);
     } else {
         mrx_traverse_erase_all_nodes_(mrx);
     }
 }
 
+void
+mrx_alloc_adopt_(mrx_base_t *mrx,
+                 mrx_base_t *src)
+{
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) != 0) {
+        return;
+    }
+    for (uint_fast8_t p2 = MIN_P2; p2 < MAX_P2; p2++) {
+        while ((src->nodealloc->nonempty_freelists & (1u << p2)) != 0) {
+            push_to_freelist(mrx->nodealloc, pop_from_freelist(src->nodealloc, p2), p2);
+        }
+    }
+    node128_nodepool_adopt(&mrx->nodealloc->sb.superblocks, &src->nodealloc->sb.superblocks);
+}
+
 void
 mrx_alloc_debug_stats(mrx_base_t *mrx,
                       struct mrx_debug_allocator_stats *stats)
@@ -267,8 +422,12 @@ mrx_alloc_debug_stats(mrx_base_t *mrx,
             } while (p != NULL);
         }
     }
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        stats->freelist_size = freelist_sz + mrx->nodealloc->sb.region.free_count * sizeof(struct node128);
+        return;
+    }
     struct nodepool_allocation_stats npstats;
-    node128_nodepool_allocation_stats(&npstats, &mrx->nodealloc->superblocks);
+    node128_nodepool_allocation_stats(&npstats, &mrx->nodealloc->sb.superblocks);
     stats->freelist_size = freelist_sz + npstats.free_size;
     stats->unused_superblock_size = npstats.overhead_size;
 }
@@ -327,7 +327,7 @@ prefix_lengthen_in_parent(mrx_base_t *mrx,
     }
 
     // new parent required
-    union mrx_node *newparent = alloc_node(mrx, new_nsz);
+    union mrx_node *newparent = alloc_node_near(mrx, new_nsz, parent);
     HDR_SET(newparent->hdr, new_nsz, 1, false, px_len + extra_px_len, false);
     memcpy(newparent->sn.octets, parent->sn.octets, px_len + 1);
     memcpy(&newparent->sn.octets[px_len + 1], extra_px, extra_px_len);
@@ -380,7 +380,7 @@ prefix_shorten(mrx_base_t *mrx,
     }
 
     // different size, new node required
-    union mrx_node *newnode = alloc_node(mrx, new_nsz);
+    union mrx_node *newnode = alloc_node_near(mrx, new_nsz, node);
     HDR_SET(newnode->hdr, new_nsz, br_len, false, new_px_len, false);
     memcpy(newnode->sn.octets, &node->sn.octets[strip_px_len], new_px_len);
     memcpy(&newnode->sn.octets[new_px_len], &node->sn.octets[px_len], br_len);
@@ -482,7 +482,7 @@ prefix_move_up(mrx_base_t *mrx,
 
         // New parent required
         debug_print(" creating parent %d (%d)\n", move_px_len, new_nsz);
-        union mrx_node *newnode = alloc_node(mrx, new_nsz);
+        union mrx_node *newnode = alloc_node_near(mrx, new_nsz, node);
         HDR_SET(newnode->hdr, new_nsz, 1, false, move_px_len - 1, false);
         memcpy(newnode->sn.octets, node->sn.octets, move_px_len);
         mrx_sp_t *brp = SP_ALIGN(&newnode->sn.octets[move_px_len]);
@@ -515,7 +515,7 @@ enlarge_node(mrx_base_t *mrx,
     union mrx_node *newnode;
     const uint8_t nsz = HDR_NSZ(node->hdr);
 
-    newnode = alloc_node(mrx, nsz + 1u);
+    newnode = alloc_node_near(mrx, nsz + 1u, node);
     HDR_SET(newnode->hdr, nsz + 1u, 0, false, 0, false);
     path[level].node = newnode;
     ptrpfx_sn_copy_to_short(newnode, node, nsz);
@@ -571,6 +571,14 @@ scan_node_child_merge(mrx_base_t *mrx,
         return;
     }
     const uint8_t nsz = HDR_SN_FLATTENED_NSZ(node->hdr);
+    union mrx_node *newnode = NULL;
+    if (nsz != new_nsz && HDR_SN_FLATTENED_NSZ(child->hdr) != new_nsz) {
+        // merge to new, allocate before any change as it fails if a static mode region is exhausted
+        if ((newnode = alloc_node_near(mrx, new_nsz, node)) == NULL) {
+            debug_print("merge skipped (out of nodes)\n");
+            return;
+        }
+    }
     ptrpfx_sn_free_restore_if_necessary(mrx, node);
     if (nsz == new_nsz) {
         // Merge to current
@@ -603,7 +611,6 @@ scan_node_child_merge(mrx_base_t *mrx,
     }
 
     // Merge to new
-    union mrx_node *newnode = alloc_node(mrx, new_nsz);
     HDR_SET(newnode->hdr, new_nsz, ch_br_len, false, new_px_len, false);
     memcpy(newnode->sn.octets, node->sn.octets, px_len + 1);
     memcpy(&newnode->sn.octets[px_len + 1], child->sn.octets, ch_px_len + ch_br_len);
@@ -689,7 +696,13 @@ sn_reduce_to_value_only(mrx_base_t *mrx,
     if (px_len <= 2) {
         // Nodes are reduced when br_len > 1 so there is only one case left when
         // further reduction is possible, which we handle here
-        union mrx_node *newnode = alloc_node(mrx, 0);
+        union mrx_node *newnode = alloc_node_near(mrx, 0, node);
+        if (newnode == NULL) {
+            // static mode region exhausted, keep the larger node
+            HDR_SET_BR_LEN(node->hdr, 0);
+            debug_check_node(node);
+            return;
+        }
         HDR_SET(newnode->hdr, 0, 0, false, px_len, true);
         newnode->sn.octets[0] = node->sn.octets[0];
         newnode->sn.octets[1] = node->sn.octets[1];
@@ -779,7 +792,12 @@ scan_node_erase_branch(mrx_base_t *mrx,
             debug_check_node(node);
         } else {
             // Merge to new
-            union mrx_node *newnode = alloc_node(mrx, new_nsz);
+            union mrx_node *newnode = alloc_node_near(mrx, new_nsz, parent);
+            if (newnode == NULL) {
+                // static mode region exhausted
+                sn_reduce_to_value_only(mrx, path, level);
+                return;
+            }
             HDR_SET(newnode->hdr, new_nsz, 0, false, pr_px_len + px_len + 1, true);
             memcpy(&newnode->sn.octets[pr_px_len + 1], node->sn.octets, px_len);
             *VALUE_REF(newnode, new_nsz) = *mrx_node_value_ref_(node, nsz);
@@ -830,7 +848,14 @@ scan_node_erase_branch(mrx_base_t *mrx,
         }
     }
 
-    union mrx_node *newnode = alloc_node(mrx, nsz - 1);
+    union mrx_node *newnode = alloc_node_near(mrx, nsz - 1, node);
+    if (newnode == NULL) {
+        // static mode region exhausted, keep the larger node
+        sn_erase_branch(mrx, node, br_pos, br, br_len);
+        debug_print("keep current node 3\n");
+        debug_check_node(node);
+        return;
+    }
     uint8_t *new_br = &newnode->sn.octets[px_len];
     mrx_sp_t *brp = SP_ALIGN(&node->sn.octets[px_len + br_len + 1]);
     mrx_sp_t *new_brp = SP_ALIGN(&newnode->sn.octets[px_len + br_len]);
@@ -1004,8 +1029,15 @@ mask_node_erase_branch(mrx_base_t *mrx,
             debug_check_node(node);
         } else {
             // Merge to new
+            union mrx_node *newnode = alloc_node_near(mrx, new_nsz, parent);
+            if (newnode == NULL) {
+                // static mode region exhausted, convert without merge
+                HDR_SET_NSZ_BR_LEN(node->hdr, 4, br_len);
+                mask_node_to_scan_node_branch(mrx, node->sn.octets, br_len, node, node, skip_octet);
+                debug_check_node(node);
+                return;
+            }
             debug_print("merge to new\n");
-            union mrx_node *newnode = alloc_node(mrx, new_nsz);
             HDR_SET(newnode->hdr, new_nsz, br_len, false, pr_px_len + 1, HDR_HAS_VALUE(node->hdr));
             memcpy(newnode->sn.octets, parent->sn.octets, pr_px_len + 1);
             ptrpfx_sn_free(mrx, parent);
@@ -1079,13 +1111,18 @@ mask_node_erase_branch(mrx_base_t *mrx,
             const uint8_t bc_sizedown_limit = (nsz_to_bc_sizedown_limit >> ((unsigned)old_sz << 2u)) & 0xFu;
             const uint8_t new_sz = old_sz - (bc < bc_sizedown_limit);
             if (new_sz < old_sz) {
-                newnx = alloc_node(mrx, new_sz);
-                NEXT_BLOCK_HDR_SET(newnx, new_sz);
-                if (!PTR_PREFIX_MATCHES(newnx, oldnx)) {
-                    // we got unlucky and the newnx will have to be long pointer, then it's
-                    // better to just keep the old
-                    free_node(mrx, newnx, new_sz);
+                newnx = alloc_node_near(mrx, new_sz, node);
+                if (newnx == NULL) {
+                    // static mode region exhausted, erase in place
                     newnx = oldnx;
+                } else {
+                    NEXT_BLOCK_HDR_SET(newnx, new_sz);
+                    if (!PTR_PREFIX_MATCHES(newnx, oldnx)) {
+                        // we got unlucky and the newnx will have to be long pointer, then it's
+                        // better to just keep the old
+                        free_node(mrx, newnx, new_sz);
+                        newnx = oldnx;
+                    }
                 }
             }
         }
@@ -1182,6 +1219,34 @@ mask_node_erase_branch(mrx_base_t *mrx,
     }
 }
 
+// The node at path[level] has been freed, erase the branch to it from the
+// parent, which may lead to erases of parents too.
+static void
+erase_branch_to_freed_node(mrx_base_t *mrx,
+                           struct mrx_iterator_path_element path[],
+                           int level)
+{
+    while (level > 0) {
+        level--;
+        union mrx_node *node = path[level].node;
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        if (IS_MASK_NODE(nsz)) {
+            mask_node_erase_branch(mrx, path, level);
+            return;
+        }
+        if (HDR_BR_LEN(node->hdr) > 1 || HDR_HAS_VALUE(node->hdr)) {
+            scan_node_erase_branch(mrx, path, level);
+            return;
+        }
+        // last child erased and no value, erase this node too
+        ptrpfx_sn_free(mrx, node);
+        free_node(mrx, node, nsz);
+    }
+    // root was erased!
+    mrx->root = NULL;
+    mrx->max_keylen_n_flags = mrx->max_keylen_n_flags & MRX_FLAGS_MASK_;
+}
+
 static void
 erase_value_from_node(mrx_base_t *mrx,
                       struct mrx_iterator_path_element path[],
@@ -1207,26 +1272,7 @@ erase_value_from_node(mrx_base_t *mrx,
 
     // no branches, erase the whole node, this may lead to erases of parents too
     free_node(mrx, node, nsz);
-    while (level > 0) {
-        level--;
-        node = path[level].node;
-        nsz = HDR_NSZ(node->hdr);
-        if (IS_MASK_NODE(nsz)) {
-            mask_node_erase_branch(mrx, path, level);
-            return;
-        }
-        br_len = HDR_BR_LEN(node->hdr);
-        if (br_len > 1 || HDR_HAS_VALUE(node->hdr)) {
-            scan_node_erase_branch(mrx, path, level);
-            return;
-        }
-        // last child erased and no value, erase this node too
-        ptrpfx_sn_free(mrx, node);
-        free_node(mrx, node, nsz);
-    }
-    // root was erased!
-    mrx->root = NULL;
-    mrx->max_keylen_n_flags = mrx->max_keylen_n_flags & MRX_FLAGS_MASK_;
+    erase_branch_to_freed_node(mrx, path, level);
 }
 
 static void
@@ -1389,7 +1435,7 @@ mn_ib_first_branch_in_block(mrx_base_t *mrx,
 #else
     const uint8_t min_nsz = 0;
 #endif
-    union mrx_next_block *newnx = alloc_node(mrx, min_nsz);
+    union mrx_next_block *newnx = alloc_node_near(mrx, min_nsz, node);
     if (PTR_PREFIX_MATCHES(branch, newnx)) {
         newnx->sp[0] = SP(branch);
         NEXT_BLOCK_HDR_SET(newnx, min_nsz);
@@ -1460,7 +1506,7 @@ mask_node_insert_branch(mrx_base_t *mrx,
                 new_sz = 1; // don't use 8 byte node size on 64 bit
             }
 #endif
-            newnx = alloc_node(mrx, new_sz);
+            newnx = alloc_node_near(mrx, new_sz, node);
             NEXT_BLOCK_HDR_SET(newnx, new_sz);
             if (PTR_PREFIX_MATCHES(nx, newnx)) {
                 mn_ib_old_short_new_short(mrx, node, nx, newnx, nb, bc, branch_octet, branch);
@@ -1487,7 +1533,7 @@ mask_node_insert_branch(mrx_base_t *mrx,
             mn_ib_inplace_short(nx, nb, bc, branch);
         } else {
             debug_print("local exceeded\n");
-            newnx = alloc_node(mrx, 3);
+            newnx = alloc_node_near(mrx, 3, node);
             NEXT_BLOCK_HDR_SET(newnx, 3);
             if (PTR_PREFIX_MATCHES(newnx, node)) {
                 mn_ib_old_short_new_short(mrx, node, nx, newnx, nb, bc, branch_octet, branch);
@@ -1702,7 +1748,7 @@ scan_node_to_mask_node(mrx_base_t *mrx,
             local_bc = bc;
             memcpy(local, n_sp, bc * sizeof(mrx_sp_t));
         } else {
-            nxp[i] = alloc_node(mrx, nsz);
+            nxp[i] = alloc_node_near(mrx, nsz, node);
             bool long_ptr_nx = false;
 #if ARCH_SIZEOF_PTR == 8
             if (nsz < 4 && !PTR_PREFIX_MATCHES(nxp[i], n_fp[0])) {
@@ -1924,6 +1970,7 @@ static union mrx_node *
 new_leaf(mrx_base_t *mrx,
          const uint8_t rest_string[],
          const unsigned rest_length,
+         const void *near, // placement hint, the parent or NULL
          void ***vrefp)
 {
     // if rest string is long, we need to store the leaf in a chain of nodes
@@ -1936,7 +1983,7 @@ new_leaf(mrx_base_t *mrx,
     unsigned tot_size_p2 = slen + occupied_space < 128 ? next_power_of_two_for_8bit(slen + occupied_space) : 128;
     uint8_t px_len = tot_size_p2 - occupied_space;
     uint8_t nsz = NODE_SIZE_P2_TO_NSZ(tot_size_p2);
-    union mrx_node *first_node = alloc_node(mrx, nsz);
+    union mrx_node *first_node = alloc_node_near(mrx, nsz, near);
     union mrx_node *node = first_node;
     union mrx_node *prev_node;
     mrx_sp_t *prev_node_handle;
@@ -1963,7 +2010,7 @@ new_leaf(mrx_base_t *mrx,
         tot_size_p2 = slen + occupied_space < 128 ? next_power_of_two_for_8bit(slen + occupied_space) : 128;
         px_len = tot_size_p2 - occupied_space;
         nsz = NODE_SIZE_P2_TO_NSZ(tot_size_p2);
-        node = alloc_node(mrx, nsz);
+        node = alloc_node_near(mrx, nsz, prev_node);
 
         // Try init short pointer, then attach pointer prefix node if it turns out to be
         // necessary.
@@ -2007,7 +2054,7 @@ scan_node_split(mrx_base_t *mrx,
         const int occupied_space = 2 + 1 + 8;
 #endif
         offset = 64 - occupied_space + 1; // offset == px_len + the branch octet
-        union mrx_node *newnode = alloc_node(mrx, 3);
+        union mrx_node *newnode = alloc_node_near(mrx, 3, node);
         HDR_SET(newnode->hdr, 3, 1, false, offset - 1, false);
         memcpy(newnode->sn.octets, node->sn.octets, offset);
         mrx_sp_t *brp = SP_ALIGN(&newnode->sn.octets[offset]);
@@ -2028,7 +2075,7 @@ scan_node_split(mrx_base_t *mrx,
     }
 
     // current as second
-    union mrx_node *newnode = alloc_node(mrx, nsz);
+    union mrx_node *newnode = alloc_node_near(mrx, nsz, node);
     HDR_SET(newnode->hdr, nsz, br_len, false, equal_len, has_value);
     void **vref;
     if (has_value) {
@@ -2055,7 +2102,7 @@ scan_node_split(mrx_base_t *mrx,
         vref = mrx_node_value_ref_(path[vref_level].node, HDR_NSZ(path[vref_level].node->hdr));
     } else {
         debug_print("insert branch in first\n");
-        union mrx_node *leaf = new_leaf(mrx, &rest_string[1], rest_length - 1, &vref);
+        union mrx_node *leaf = new_leaf(mrx, &rest_string[1], rest_length - 1, newnode, &vref);
         union mrx_node *branches[2];
         mrx_sp_t *brp = SP_ALIGN(&newnode->sn.octets[equal_len + 2]);
         memcpy(newnode->sn.octets, &node->sn.octets[offset], equal_len+1);
@@ -2090,42 +2137,21 @@ scan_node_split(mrx_base_t *mrx,
     return vref;
 }
 
-void **
-mrx_insert_(mrx_base_t *mrx,
-            const uint8_t string[],
-            const unsigned string_length,
-            bool *is_occupied)
+// Descends from path[level] and inserts, sets *mod_level to the level where
+// the descent ended, the tree may have been modified from the level above.
+static inline void **
+insert_from_level(mrx_base_t *mrx,
+                  struct mrx_iterator_path_element path[],
+                  int level,
+                  const uint8_t *s,
+                  unsigned slen,
+                  bool *is_occupied,
+                  int *mod_level)
 {
-    if (mrx->count == mrx->capacity) {
-        return NULL;
-    }
-    *is_occupied = false;
-    if (string_length > (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_)) {
-        mrx->max_keylen_n_flags = string_length | (mrx->max_keylen_n_flags & MRX_FLAGS_MASK_);
-    }
-    if (mrx->root == NULL) {
-        void **vref;
-        mrx->root = new_leaf(mrx, string, string_length, &vref);
-        mrx->count++;
-        return vref;
-    }
-
-    const uint8_t *s = string;
-    unsigned slen = string_length;
-    union mrx_node *node = mrx->root;
-    int level = 0;
+    union mrx_node *node = path[level].node;
     void **vref = NULL;
 
-    struct mrx_iterator_path_element *path;
-    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
-    const bool path_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
-    if (path_is_on_stack) {
-        path = alloca((max_keylen + 1) * sizeof(*path));
-    } else {
-        path = malloc((max_keylen + 1) * sizeof(*path));
-    }
-    path[0].node = node;
-
+    *is_occupied = false;
     for (;;) {
         const uint8_t nsz = HDR_NSZ(node->hdr);
         const uint8_t px_len = HDR_PX_LEN(node->hdr);
@@ -2136,12 +2162,14 @@ mrx_insert_(mrx_base_t *mrx,
             slen -= equal_len;
             assert(!IS_MASK_NODE(nsz)); // mask nodes cannot have prefix
             mrx->count++;
+            *mod_level = level;
             vref = scan_node_split(mrx, path, &level, equal_len, s, slen);
             break;
         }
         s += px_len;
         slen -= px_len;
         if (slen == 0) {
+            *mod_level = level;
             if (HDR_HAS_VALUE(node->hdr)) {
                 *is_occupied = true;
             } else {
@@ -2161,7 +2189,8 @@ mrx_insert_(mrx_base_t *mrx,
             const int8_t br_pos = find_branch(*s, br, br_len);
             if ((uint8_t)br_pos == br_len) {
                 mrx->count++;
-                union mrx_node *leaf = new_leaf(mrx, &s[1], slen - 1, &vref);
+                *mod_level = level;
+                union mrx_node *leaf = new_leaf(mrx, &s[1], slen - 1, node, &vref);
                 scan_node_insert_branch(mrx, path, &level, nsz, br, br_len, *s, leaf);
                 break;
             }
@@ -2177,7 +2206,8 @@ mrx_insert_(mrx_base_t *mrx,
             b = 1u << (b & 0x1Fu);
             if ((bm & b) == 0) {
                 mrx->count++;
-                union mrx_node *leaf = new_leaf(mrx, &s[1], slen - 1, &vref);
+                *mod_level = level;
+                union mrx_node *leaf = new_leaf(mrx, &s[1], slen - 1, node, &vref);
                 mask_node_insert_branch(mrx, node, *s, leaf);
                 break;
             }
@@ -2190,12 +2220,176 @@ mrx_insert_(mrx_base_t *mrx,
         level++;
         path[level].node = node;
     }
+    if (!*is_occupied) {
+        mrx->mod_count++;
+    }
+    return vref;
+}
+
+// In static mode an insert is refused unless the region surely holds it, and
+// key length is limited such that erase always has the path on the stack.
+static inline bool
+static_region_lacks_room(const mrx_base_t *mrx,
+                         const unsigned key_len)
+{
+    return (mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0 &&
+        (key_len > MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK ||
+         mrx->nodealloc->sb.region.free_count < MRX_STATIC_INSERT_RESERVE_(key_len));
+}
+
+void **
+mrx_insert_(mrx_base_t *mrx,
+            const uint8_t string[],
+            const unsigned string_length,
+            bool *is_occupied)
+{
+    if (mrx->count == mrx->capacity || static_region_lacks_room(mrx, string_length)) {
+        return NULL;
+    }
+    *is_occupied = false;
+    if (string_length > (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_)) {
+        mrx->max_keylen_n_flags = string_length | (mrx->max_keylen_n_flags & MRX_FLAGS_MASK_);
+    }
+    if (mrx->root == NULL) {
+        void **vref;
+        mrx->root = new_leaf(mrx, string, string_length, NULL, &vref);
+        mrx->count++;
+        mrx->mod_count++;
+        return vref;
+    }
+
+    struct mrx_iterator_path_element *path;
+    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    const bool path_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+    if (path_is_on_stack) {
+        path = alloca((max_keylen + 1) * sizeof(*path));
+    } else {
+        path = malloc((max_keylen + 1) * sizeof(*path));
+    }
+    path[0].node = mrx->root;
+    int mod_level;
+    void **vref = insert_from_level(mrx, path, 0, string, string_length, is_occupied, &mod_level);
     if (!path_is_on_stack) {
         free(path);
     }
     return vref;
 }
 
+bool
+mrx_cursor_init_(mrx_base_t *mrx,
+                 mrx_cursor_t *cursor)
+{
+    cursor->mrx = mrx;
+    cursor->mod_count = mrx->mod_count - 1; // invalid
+    cursor->level = -1;
+    cursor->capacity = 0;
+    cursor->key = NULL;
+    cursor->path = NULL;
+    cursor->depth = NULL;
+    if ((mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0) {
+        // keys are bounded in static mode, so the buffers get their final
+        // size here and inserts never allocate
+        const unsigned capacity = MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 1;
+        cursor->key = malloc(capacity);
+        cursor->path = malloc(capacity * sizeof(*cursor->path));
+        cursor->depth = malloc(capacity * sizeof(*cursor->depth));
+        if (cursor->key == NULL || cursor->path == NULL || cursor->depth == NULL) {
+            mrx_cursor_free_(cursor);
+            return false;
+        }
+        cursor->capacity = capacity;
+    }
+    return true;
+}
+
+void
+mrx_cursor_free_(mrx_cursor_t *cursor)
+{
+    free(cursor->key);
+    free(cursor->path);
+    free(cursor->depth);
+}
+
+void **
+mrx_insert_hint_(mrx_cursor_t *cursor,
+                 const uint8_t string[],
+                 const unsigned string_length,
+                 bool *is_occupied)
+{
+    mrx_base_t *mrx = cursor->mrx;
+    if (mrx->root == NULL || mrx->count == mrx->capacity || static_region_lacks_room(mrx, string_length)) {
+        cursor->level = -1;
+        void **vref = mrx_insert_(mrx, string, string_length, is_occupied);
+        cursor->mod_count = mrx->mod_count;
+        return vref;
+    }
+    if (string_length > (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_)) {
+        mrx->max_keylen_n_flags = string_length | (mrx->max_keylen_n_flags & MRX_FLAGS_MASK_);
+    }
+    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    if (max_keylen + 1 > cursor->capacity) {
+        void *key = realloc(cursor->key, max_keylen + 1);
+        void *path = realloc(cursor->path, (max_keylen + 1) * sizeof(*cursor->path));
+        void *depth = realloc(cursor->depth, (max_keylen + 1) * sizeof(*cursor->depth));
+        if (key != NULL) {
+            cursor->key = key;
+        }
+        if (path != NULL) {
+            cursor->path = path;
+        }
+        if (depth != NULL) {
+            cursor->depth = depth;
+        }
+        if (key == NULL || path == NULL || depth == NULL) {
+            cursor->level = -1;
+            return mrx_insert_(mrx, string, string_length, is_occupied);
+        }
+        cursor->capacity = max_keylen + 1;
+    }
+    if (cursor->mod_count != mrx->mod_count) {
+        cursor->level = -1;
+    }
+
+    // resume from the deepest node that the new key shares with the previous
+    struct mrx_iterator_path_element *path = cursor->path;
+    int level = cursor->level;
+    if (level > 0) {
+        const unsigned key_len = cursor->depth[level];
+        if (string_length < key_len || memcmp(string, cursor->key, key_len) != 0) {
+            unsigned common_len = 0;
+            const unsigned test_len = string_length < key_len ? string_length : key_len;
+            while (common_len < test_len && string[common_len] == cursor->key[common_len]) {
+                common_len++;
+            }
+            while (level > 0 && cursor->depth[level] > common_len) {
+                level--;
+            }
+        }
+    }
+    if (level <= 0) {
+        level = 0;
+        path[0].node = mrx->root;
+        cursor->depth[0] = 0;
+    }
+    const unsigned depth = cursor->depth[level];
+    int mod_level;
+    void **vref = insert_from_level(mrx, path, level, &string[depth], string_length - depth, is_occupied, &mod_level);
+
+    // Nodes above the modified level are unchanged, except the parent which
+    // may have been replaced or got a longer prefix, which the insert helpers
+    // have reflected in the path.
+    cursor->level = *is_occupied ? mod_level : mod_level - 1;
+    for (int i = level; i < cursor->level; i++) {
+        cursor->depth[i + 1] = cursor->depth[i] + HDR_PX_LEN(path[i].node->hdr) + 1;
+    }
+    cursor->mod_count = mrx->mod_count;
+    if (cursor->level > 0) {
+        // only the part leading to the deepest path node is compared next time
+        memcpy(cursor->key, string, cursor->depth[cursor->level]);
+    }
+    return vref;
+}
+
 void *
 mrx_erase_(mrx_base_t *mrx, // root must be non-null
            const uint8_t string[],
@@ -2232,6 +2426,7 @@ mrx_erase_(mrx_base_t *mrx, // root must be non-null
                 *was_erased = true;
                 erase_value_from_node(mrx, path, level);
                 mrx->count--;
+                mrx->mod_count++;
             }
             break;
         }
@@ -2270,6 +2465,223 @@ mrx_erase_(mrx_base_t *mrx, // root must be non-null
     return value;
 }
 
+// Erases all keys starting with prefix by unlinking and freeing the subtree
+// that covers them, instead of erasing key by key. Returns number of erased
+// keys, cb (if non-NULL) is called with each erased value.
+size_t
+mrx_erase_prefix_(mrx_base_t *mrx,
+                  const uint8_t prefix[],
+                  const unsigned prefix_length,
+                  mrx_value_cb_t cb,
+                  void *cb_arg)
+{
+    if (mrx->root == NULL) {
+        return 0;
+    }
+    const uint8_t *s = prefix;
+    unsigned slen = prefix_length;
+    int level = 0;
+    union mrx_node *node = mrx->root;
+    struct mrx_iterator_path_element *path;
+
+    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    const bool path_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+    if (path_is_on_stack) {
+        path = alloca((max_keylen + 1) * sizeof(*path));
+    } else {
+        path = malloc((max_keylen + 1) * sizeof(*path));
+    }
+    path[0].node = node;
+    size_t count = 0;
+    for (;;) {
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        if (slen <= px_len) {
+            // prefix ends within (or right after) this node's prefix, so the
+            // whole subtree is covered if what remains matches
+            if (!prefix_differs(s, node->sn.octets, slen)) {
+                count = mrx_erase_subtree_(mrx, node, cb, cb_arg);
+                erase_branch_to_freed_node(mrx, path, level);
+                mrx->count -= count;
+                mrx->mod_count++;
+            }
+            break;
+        }
+        if (prefix_differs(s, node->sn.octets, px_len)) {
+            break;
+        }
+        s += px_len;
+        slen -= px_len;
+        if (IS_SCAN_NODE(HDR_NSZ(node->hdr))) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            const uint8_t *br = &node->sn.octets[px_len];
+            const int8_t br_pos = find_branch(*s, br, br_len);
+            if ((uint8_t)br_pos == br_len) {
+                break;
+            }
+            path[level].br_pos = (int16_t)br_pos;
+            path[level].br = *s;
+            node = scan_node_get_child(node, br, br_len, br_pos);
+        } else {
+            path[level].br_pos = *s;
+            path[level].br = *s;
+            uint32_t b = *s;
+            uint32_t bm = node->mn.bitmask.u32[b >> 5u];
+            union mrx_next_block *nx = mask_node_get_next_block(node, b);
+            b = 1u << (b & 0x1Fu);
+            if ((bm & b) == 0) {
+                break;
+            }
+            bm &= b - 1;
+            b = bit32_count(bm);
+            node = next_block_get_child(nx, b);
+        }
+        s++;
+        slen--;
+        level++;
+        path[level].node = node;
+    }
+    if (!path_is_on_stack) {
+        free(path);
+    }
+    return count;
+}
+
+void
+mrx_graft_(mrx_base_t *mrx,
+           const uint8_t octet,
+           union mrx_node *subtree)
+{
+    struct mrx_iterator_path_element path[1];
+    union mrx_node *root = mrx->root;
+    union mrx_node *leaf;
+
+    path[0].node = root;
+    path[0].br = octet;
+    if (IS_SCAN_NODE(HDR_NSZ(root->hdr))) {
+        const uint8_t br_len = HDR_BR_LEN(root->hdr);
+        const uint8_t *br = &root->sn.octets[HDR_PX_LEN(root->hdr)];
+        const int8_t br_pos = find_branch(octet, br, br_len);
+        path[0].br_pos = (int16_t)br_pos;
+        leaf = scan_node_get_child(root, br, br_len, br_pos);
+    } else {
+        path[0].br_pos = octet;
+        leaf = mask_node_get_child(root, octet);
+    }
+    set_link_in_parent(mrx, path, 0, subtree);
+    mrx_erase_subtree_(mrx, leaf, NULL, NULL);
+}
+
+// Descends to the first (back is false) or last key in key order, which is
+// the leftmost or rightmost path, no key comparisons needed. Up to key_size
+// octets of the key are copied to key[], and its full length is returned.
+// The path is recorded if non-NULL, with the level of the key node in *level.
+static unsigned
+descend_edge(union mrx_node *root, // must not be NULL
+             const bool back,
+             uint8_t key[],
+             const unsigned key_size,
+             struct mrx_iterator_path_element path[],
+             int *level,
+             union mrx_node **key_node)
+{
+    union mrx_node *node = root;
+    unsigned depth = 0;
+    int lvl = 0;
+
+    if (path != NULL) {
+        path[0].node = node;
+    }
+    for (;;) {
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        if (depth < key_size) {
+            memcpy(&key[depth], node->sn.octets, key_size - depth < px_len ? key_size - depth : px_len);
+        }
+        depth += px_len;
+        if (!back && HDR_HAS_VALUE(node->hdr)) {
+            // a key sorts before all keys it is a prefix of
+            break;
+        }
+        uint8_t br;
+        int16_t br_pos;
+        if (IS_SCAN_NODE(nsz)) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            if (br_len == 0) {
+                break;
+            }
+            const uint8_t *brp = &node->sn.octets[px_len];
+            br_pos = back ? (int16_t)(br_len - 1) : 0;
+            br = brp[br_pos];
+            node = scan_node_get_child(node, brp, br_len, (uint8_t)br_pos);
+        } else {
+            if (back) {
+                const unsigned idx = bit32_bsr(node->mn.used);
+                br = (uint8_t)((idx << 5u) + bit32_bsr(node->mn.bitmask.u32[idx]));
+            } else {
+                br = (uint8_t)mask_node_next_branch(node, 0);
+            }
+            br_pos = br;
+            node = mask_node_get_child(node, br);
+        }
+        if (depth < key_size) {
+            key[depth] = br;
+        }
+        depth++;
+        if (path != NULL) {
+            path[lvl].br_pos = br_pos;
+            path[lvl].br = br;
+            path[lvl + 1].node = node;
+        }
+        lvl++;
+    }
+    *level = lvl;
+    *key_node = node;
+    return depth;
+}
+
+void **
+mrx_peek_(union mrx_node *root, // must not be NULL
+          const bool back,
+          uint8_t key[],
+          const unsigned key_size,
+          unsigned *key_len) // must be non-null
+{
+    union mrx_node *node;
+    int level;
+    *key_len = descend_edge(root, back, key, key_size, NULL, &level, &node);
+    return mrx_node_value_ref_(node, HDR_NSZ(node->hdr));
+}
+
+// Erases the first or last key, with the same descent as mrx_peek_() and
+// the erase made from the recorded path, without a lookup by key.
+void *
+mrx_pop_(mrx_base_t *mrx, // root must not be NULL
+         const bool back,
+         uint8_t key[],
+         const unsigned key_size,
+         unsigned *key_len) // must be non-null
+{
+    struct mrx_iterator_path_element *path;
+    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    const bool path_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+    if (path_is_on_stack) {
+        path = alloca((max_keylen + 1) * sizeof(*path));
+    } else {
+        path = malloc((max_keylen + 1) * sizeof(*path));
+    }
+    union mrx_node *node;
+    int level;
+    *key_len = descend_edge(mrx->root, back, key, key_size, path, &level, &node);
+    void *value = *mrx_node_value_ref_(node, HDR_NSZ(node->hdr));
+    erase_value_from_node(mrx, path, level);
+    mrx->count--;
+    mrx->mod_count++;
+    if (!path_is_on_stack) {
+        free(path);
+    }
+    return value;
+}
+
 void **
 mrx_findnear_(union mrx_node *root, // must not be NULL
               const uint8_t string[],
@@ -2330,6 +2742,65 @@ mrx_findnear_(union mrx_node *root, // must not be NULL
     }
 }
 
+// Collects values of all stored keys that are a prefix of (or equal to) the
+// string, shortest first. Arrays must fit string_length + 1 elements.
+unsigned
+mrx_findprefixes_(union mrx_node *root, // must not be NULL
+                  const uint8_t string[],
+                  const unsigned string_length,
+                  void **vrefs[],
+                  unsigned match_lens[])
+{
+    const uint8_t *s = string;
+    unsigned slen = string_length;
+    union mrx_node *node = root;
+    unsigned count = 0;
+
+    for (;;) {
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+
+        if (px_len > slen) {
+            return count;
+        }
+        if (px_len > 0) {
+            if (prefix_differs(s, node->sn.octets, px_len)) {
+                return count;
+            }
+        }
+        if (HDR_HAS_VALUE(node->hdr)) {
+            match_lens[count] = string_length - slen + px_len;
+            vrefs[count] = mrx_node_value_ref_(node, nsz);
+            count++;
+        }
+        if (slen == px_len) {
+            return count;
+        }
+        if (IS_SCAN_NODE(nsz)) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            const uint8_t *br = &node->sn.octets[px_len];
+            const int8_t br_pos = find_branch(s[px_len], br, br_len);
+            if ((uint8_t)br_pos == br_len) {
+                return count;
+            }
+            node = scan_node_get_child(node, br, br_len, br_pos);
+        } else {
+            uint32_t b = s[px_len];
+            uint32_t bm = node->mn.bitmask.u32[b >> 5u];
+            union mrx_next_block *nx = mask_node_get_next_block(node, b);
+            b = 1u << (b & 0x1Fu);
+            if ((bm & b) == 0) {
+                return count;
+            }
+            bm &= b - 1;
+            b = bit32_count(bm);
+            node = next_block_get_child(nx, b);
+        }
+        s += px_len + 1;
+        slen -= px_len + 1;
+    }
+}
+
 void **
 mrx_find_(union mrx_node *root, // must not be NULL
           const uint8_t string[],
@@ -32,25 +32,12 @@
 #endif
 
 
-union mrx_next_block {
-    mrx_sp_t sp[32];
-    struct {
-#define NEXT_BLOCK_LONG_PTR_HDR 0x5u
-        uint32_t hdr_and_pad_; // access header through macros instead
-        uint32_t lp_count;
-#define NEXT_BLOCK_MAX_LP_COUNT 14u
-        union mrx_node *lp[NEXT_BLOCK_MAX_LP_COUNT];
-        union mrx_next_block *next;
-    } lp;
-};
-#define SP_MASK 0xFFFFFFF8u
-#if ARCH_SIZEOF_PTR == 4
-#define NEXT_BLOCK_IS_SHORT_PTR(nx) 1u
-#elif ARCH_SIZEOF_PTR == 8
-#define NEXT_BLOCK_IS_SHORT_PTR(nx) (NEXT_BLOCK_HDR(nx) != NEXT_BLOCK_LONG_PTR_HDR)
-#endif
+#define NEXT_BLOCK_LONG_PTR_HDR MRX_NEXT_BLOCK_LONG_PTR_HDR_
+#define NEXT_BLOCK_MAX_LP_COUNT MRX_NEXT_BLOCK_MAX_LP_COUNT_
+#define SP_MASK MRX_SP_MASK_
+#define NEXT_BLOCK_IS_SHORT_PTR(nx) MRX_NEXT_BLOCK_IS_SHORT_PTR_(nx)
 #define NEXT_BLOCK_HDR_SET(nx, nsz) (nx)->sp[0] &= SP_MASK; (nx)->sp[0] |= (unsigned)(nsz)
-#define NEXT_BLOCK_HDR(nx) ((nx)->sp[0] & ~SP_MASK)
+#define NEXT_BLOCK_HDR(nx) MRX_NEXT_BLOCK_HDR_(nx)
 
 /*
   This code has been checked with a clang-tidy rule that requires all binary bitwise operators
@@ -82,22 +69,20 @@ union mrx_next_block {
 #define SP(ptr) ((mrx_sp_t)((uintptr_t)(ptr) & SP_MASK))
 #if ARCH_SIZEOF_PTR == 4
 #define HP(ptr) 0
-#define EP(ptr, ref) ((void *)SP(ptr))
-#define EP2(lo_ptr, hi_ptr) ((void *)((lo_ptr) & SP_MASK))
 #elif ARCH_SIZEOF_PTR == 8
 #define HP(ptr) ((mrx_sp_t)((uintptr_t)(ptr) >> 32u))
-#define EP(lo_ptr, ref)  ((void *)((uintptr_t)((lo_ptr) & SP_MASK) | ((uintptr_t)(ref) & 0xFFFFFFFF00000000u)))
-#define EP2(lo_ptr, hi_ptr) ((void *)((uintptr_t)((lo_ptr) & SP_MASK) | ((uintptr_t)(hi_ptr) << 32u)))
 #endif
+#define EP(lo_ptr, ref) MRX_EP_(lo_ptr, ref)
+#define EP2(lo_ptr, hi_ptr) MRX_EP2_(lo_ptr, hi_ptr)
 
-#define SP_ALIGN(ptr) ((mrx_sp_t *)(((uintptr_t)(ptr) + 3u) & ~((uintptr_t)3u)))
+#define SP_ALIGN(ptr) MRX_SP_ALIGN_(ptr)
 #define NODE_END_REF_(node, nsz) (&(node)->nptr.s[(((2u << (unsigned)(nsz)) - 1u) & 0x1Fu) + 1u])
 #define NODE_END_REF(node, nsz) ((void *)NODE_END_REF_(node, nsz))
 #define NODE_END_CONST_REF(node, nsz) ((const void *)NODE_END_REF_(node, nsz))
 #define VALUE_REF(node, nsz) MRX_NODE_VALUE_REF_(node, nsz)
 
 #define HDR_BITS_MASK_NODE_NSZ = 0x7u
-#define HDR_BIT_HAS_VALUE 0x0100u
+#define HDR_BIT_HAS_VALUE MRX_HDR_BIT_HAS_VALUE_
 #define HDR_BIT_LONGPTR MRX_HDR_BIT_LONGPTR_
 #define HDR_INIT_PX_LEN(hdr, px_len) hdr |= ((unsigned)(px_len) << 9u)
 #define HDR_INIT_BR_LEN(hdr, br_len) hdr |= ((((unsigned)(br_len) & 0x0Fu) << 4u) | (((unsigned)(br_len) & 0x10u) >> 4u))
@@ -126,10 +111,10 @@ union mrx_next_block {
 #define IS_MASK_NODE(nsz) MRX_IS_MASK_NODE_(nsz)
 #define HDR_NSZ(hdr) MRX_NODE_HDR_NSZ_(hdr)
 #define HDR_SN_FLATTENED_NSZ(hdr) (MRX_NODE_HDR_NSZ_(hdr) & ~((unsigned)MRX_NODE_HDR_NSZ_(hdr) >> 2u)) // same as applying FLATTEN_SN_NSZ()
-#define HDR_HAS_VALUE(hdr) (((unsigned)(hdr) & HDR_BIT_HAS_VALUE) != 0)
+#define HDR_HAS_VALUE(hdr) MRX_HDR_HAS_VALUE_(hdr)
 #define HDR_IS_SHORT_PTR(hdr) MRX_HDR_IS_SHORT_PTR_(hdr)
-#define HDR_PX_LEN(hdr) ((hdr) >> 9u)
-#define HDR_BR_LEN(hdr) ((((unsigned)(hdr) >> 4u) & 0x0Fu) | ((((unsigned)(hdr) & ((unsigned)(hdr) >> 2u)) << 4u) & 0x10u))
+#define HDR_PX_LEN(hdr) MRX_HDR_PX_LEN_(hdr)
+#define HDR_BR_LEN(hdr) MRX_HDR_BR_LEN_(hdr)
 #define HDR_MN_LOCAL_USED(hdr) ((unsigned)(hdr) & 0x10u)
 #define HDR_MN_SET_LOCAL_USED(hdr, used) (hdr) &= ~0x10u; (hdr) |= ((unsigned)!!(used)) << 4u
 
@@ -204,6 +189,12 @@ scan_node_min_size_nsz(const uint8_t px_len,
 void
 mrx_traverse_erase_all_nodes_(mrx_base_t *mrx);
 
+size_t
+mrx_erase_subtree_(mrx_base_t *mrx,
+                   union mrx_node *node,
+                   mrx_value_cb_t cb,
+                   void *cb_arg);
+
 void
 mrx_print_node_(union mrx_node *node);
 
@@ -211,11 +202,33 @@ void *
 mrx_alloc_node_(mrx_base_t *mrx,
                 uint8_t nsz);
 
+// near is a placement hint, the node is preferably allocated close to it
+void *
+mrx_alloc_node_near_(mrx_base_t *mrx,
+                     uint8_t nsz,
+                     const void *near);
+
 void
 mrx_free_node_(mrx_base_t *mrx,
                void *ptr,
                uint8_t nsz);
 
+// Hands over the node memory of src to mrx (same memory mode, not static), so
+// that the nodes of src can be linked into mrx and freed there. Only the base
+// struct of src remains, to be freed by the caller.
+void
+mrx_alloc_adopt_(mrx_base_t *mrx,
+                 mrx_base_t *src);
+
+// Links subtree in place of the placeholder leaf at branch octet of the root,
+// which must have no prefix, and frees the leaf. The subtree holds keys
+// without their first octet and its nodes must be owned by mrx. Count and max
+// key length are left to the caller.
+void
+mrx_graft_(mrx_base_t *mrx,
+           uint8_t octet,
+           union mrx_node *subtree);
+
 // for the unit test code, make it possible to enable a test allocator
 #if MRX_TEST_ALLOCATOR - 0 != 0
 
@@ -235,6 +248,16 @@ alloc_node(mrx_base_t *mrx,
     }
     return mrx_alloc_node_(mrx, nsz);
 }
+static inline void *
+alloc_node_near(mrx_base_t *mrx,
+                const uint8_t nsz,
+                const void *near)
+{
+    if (mrx_test_allocator_.alloc_node != NULL) {
+        return mrx_test_allocator_.alloc_node(mrx, nsz);
+    }
+    return mrx_alloc_node_near_(mrx, nsz, near);
+}
 static inline void
 free_node(mrx_base_t *mrx,
           void *ptr,
@@ -248,6 +271,7 @@ free_node(mrx_base_t *mrx,
 }
 #else
 #define alloc_node mrx_alloc_node_
+#define alloc_node_near mrx_alloc_node_near_
 #define free_node mrx_free_node_
 #endif // MRX_TEST_ALLOCATOR
 
@@ -275,22 +299,7 @@ mask_node_next_branch(const union mrx_node * const node,
     return -1;
 }
 
-static inline union mrx_node *
-scan_node_get_child1(const union mrx_node *node,
-                     const mrx_sp_t *brp,
-                     const uint8_t br_pos)
-{
-    if (HDR_IS_SHORT_PTR(node->hdr)) {
-        return EP(brp[br_pos], node);
-    }
-    const struct mrx_ptrpfx_node * const *pfxref = &SN_PREFIX_CONST_PTR(node);
-    const mrx_sp_t *bp = &brp[br_pos];
-    if ((uintptr_t)bp < (uintptr_t)pfxref) {
-        return EP2(*bp, (*pfxref)->hp[br_pos]);
-    }
-    const unsigned idx = ((uintptr_t)bp - (uintptr_t)pfxref) >> 2u;
-    return EP2((*pfxref)->orig.sp[idx], (*pfxref)->hp[br_pos]);
-}
+#define scan_node_get_child1(node, brp, br_pos) mrx_scan_node_get_child1_(node, brp, br_pos)
 
 static inline union mrx_node *
 scan_node_get_child(const union mrx_node *node,
@@ -321,34 +330,19 @@ scan_node_set_child(union mrx_node *node,
     }
 }
 
-static inline union mrx_next_block *
-mask_node_get_next_block(const union mrx_node * const node,
-                         const uint32_t b)
-{
-    union mrx_next_block *nx;
-    if (HDR_IS_SHORT_PTR(node->hdr)) {
-        nx = EP(node->mn.next[b >> 5u], node);
-    } else {
-        nx = EP2(node->mn.next[b >> 5u], node->mn.local[b >> 5u]);
-    }
-    return nx;
-}
+#define mask_node_get_next_block(node, b) mrx_mask_node_get_next_block_(node, b)
+#define next_block_get_child(nx, bidx) mrx_next_block_get_child_(nx, bidx)
 
+// Input requirement: the branch must exist
 static inline union mrx_node *
-next_block_get_child(const union mrx_next_block *nx,
-                     uint32_t bidx)
+mask_node_get_child(const union mrx_node * const node,
+                    uint32_t b)
 {
-    union mrx_node *node;
-    if (NEXT_BLOCK_IS_SHORT_PTR(nx)) {
-        node = EP(nx->sp[bidx], nx);
-    } else {
-        while (bidx >= NEXT_BLOCK_MAX_LP_COUNT) {
-            nx = nx->lp.next;
-            bidx -= NEXT_BLOCK_MAX_LP_COUNT;
-        }
-        node = nx->lp.lp[bidx];
-    }
-    return node;
+    uint32_t bm = node->mn.bitmask.u32[b >> 5u];
+    const union mrx_next_block *nx = mask_node_get_next_block(node, b);
+    b = 1u << (b & 0x1Fu);
+    bm &= b - 1;
+    return next_block_get_child(nx, bit32_count(bm));
 }
 
 void
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Bulk operations on the radix tree.
+
+  Build from unsorted input:
+
+   - Inserting a large unsorted key set is dominated by cache misses, as each
+     insert lands in a random part of the tree and the tree quickly grows
+     larger than the cache.
+   - Radix-partitioning the input on the first two key octets first means
+     that consecutive inserts work on the same small subtree (about 1/65536 of
+     the tree for uniform keys), which stays in cache while it is built. The
+     root (and often the second level) becomes a mask node just as it would
+     have with plain inserts, so the result is a normal tree.
+   - Partitioning is a stable two-pass LSD counting sort with 256 buckets,
+     ie O(n) and no comparisons. Exact sort order is not required, so keys
+     shorter than two octets just use zero for the missing octets.
+   - The indices are 32 bit to keep the buffer small, larger inputs (and
+     inputs for which the buffer cannot be allocated) are inserted in input
+     order instead.
+
+  Parallel build:
+
+   - Keys with different first octets end up in different subtrees under the
+     root, so each first octet partition is built as a separate tree from the
+     keys without their first octet, by a number of worker threads.
+   - Each worker has its own mrx base, ie its own node allocator, and builds
+     its partitions one after another in it, detaching the subtree root when
+     a partition is done. The allocators take their memory from malloc()
+     (compact mode) or from 128 byte superblocks of the global nodepool
+     memory, which is thread-safe, so the workers share nothing else.
+   - Before the workers start, a placeholder single-octet key is inserted per
+     partition, which gives the tree a root without prefix that has one
+     branch per partition, scan or mask node depending on count, as with
+     normal inserts. After the workers are done the allocators are handed
+     over to the tree, and the subtrees are linked in place of the
+     placeholder leaves.
+   - The partitions are split over the workers in input order, in contiguous
+     ranges of about the same number of keys. A single dominating first
+     octet is not split further, so skewed input does not scale.
+   - Static mode has one fixed region per tree and cannot hand over memory
+     between trees, so it is always built serially.
+ */
+#ifndef _WIN32
+#include <alloca.h>
+#endif
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+static void
+counting_sort_pass(const uint16_t partition[],
+                   const size_t count,
+                   const uint32_t src[],
+                   uint32_t dst[],
+                   const unsigned shift)
+{
+    size_t offset[256] = {0};
+    size_t i, sum;
+
+    for (i = 0; i < count; i++) {
+        offset[(partition[src[i]] >> shift) & 0xFFu]++;
+    }
+    for (i = 0, sum = 0; i < 256; i++) {
+        const size_t bucket_size = offset[i];
+        offset[i] = sum;
+        sum += bucket_size;
+    }
+    for (i = 0; i < count; i++) {
+        const uint32_t idx = src[i];
+        dst[offset[(partition[idx] >> shift) & 0xFFu]++] = idx;
+    }
+}
+
+void
+mrx_bulk_order_(const uint16_t partition[],
+                const size_t count,
+                uint32_t order[],
+                uint32_t tmp[])
+{
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (uint32_t)i;
+    }
+    counting_sort_pass(partition, count, order, tmp, 0);
+    counting_sort_pass(partition, count, tmp, order, 8);
+}
+
+struct build_part {
+    union mrx_node *root;
+    uintptr_t count;
+    uint32_t max_keylen;
+};
+
+struct build_worker {
+    pthread_t thread;
+    bool is_started;
+    mrx_base_t *mrx; // allocator for the subtrees, detached when done
+    unsigned first_octet;
+    unsigned end_octet;
+    const uint32_t *order;
+    const size_t *bucket_start;
+    struct build_part *parts;
+    mrx_build_insert_cb_t cb;
+    void *cb_arg;
+    size_t inserted;
+};
+
+// Builds the partitions of the worker, stops at the first key that cannot be
+// inserted.
+static void *
+build_worker_run(void *arg)
+{
+    struct build_worker *w = (struct build_worker *)arg;
+    mrx_base_t *mrx = w->mrx;
+
+    for (unsigned b = w->first_octet; b < w->end_octet; b++) {
+        size_t i;
+        for (i = w->bucket_start[b]; i < w->bucket_start[b+1]; i++) {
+            if (!w->cb(mrx, w->order[i], w->cb_arg)) {
+                break;
+            }
+            w->inserted++;
+        }
+        w->parts[b].root = mrx->root;
+        w->parts[b].count = mrx->count;
+        w->parts[b].max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+        mrx->root = NULL;
+        mrx->count = 0;
+        mrx->max_keylen_n_flags &= MRX_FLAGS_MASK_;
+        if (i != w->bucket_start[b+1]) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void
+build_workers_free(struct build_worker workers[],
+                   const unsigned worker_count,
+                   struct build_part parts[])
+{
+    for (unsigned t = 0; t < worker_count; t++) {
+        free(workers[t].mrx);
+    }
+    free(workers);
+    free(parts);
+}
+
+bool
+mrx_build_parallel_(mrx_base_t *mrx,
+                    const uint16_t partition[],
+                    const uint32_t order[],
+                    const size_t count,
+                    unsigned thread_count,
+                    mrx_build_insert_cb_t cb,
+                    void *cb_arg,
+                    size_t *inserted)
+{
+    size_t bucket_start[257] = {0};
+    unsigned bucket_count = 0;
+
+    if (mrx->root != NULL || count > mrx->capacity || thread_count < 2 ||
+        (mrx->max_keylen_n_flags & MRX_FLAG_IS_STATIC_) != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bucket_start[(partition[i] >> 8u) + 1]++;
+    }
+    for (unsigned b = 0; b < 256; b++) {
+        bucket_count += (bucket_start[b+1] != 0);
+        bucket_start[b+1] += bucket_start[b];
+    }
+    if (bucket_count < 2) {
+        // a root without prefix needs at least two branches
+        return false;
+    }
+    if (thread_count > bucket_count) {
+        thread_count = bucket_count;
+    }
+
+    const bool compact = (mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) != 0;
+    struct build_part *parts = calloc(256, sizeof(*parts));
+    struct build_worker *workers = calloc(thread_count, sizeof(*workers));
+    if (parts == NULL || workers == NULL) {
+        free(parts);
+        free(workers);
+        return false;
+    }
+    for (unsigned t = 0; t < thread_count; t++) {
+        workers[t].mrx = malloc(sizeof(mrx_base_t) + (compact ? 0 : sizeof(struct mrx_buddyalloc)));
+        if (workers[t].mrx == NULL) {
+            build_workers_free(workers, t, parts);
+            return false;
+        }
+    }
+    for (unsigned b = 0; b < 256; b++) {
+        if (bucket_start[b+1] != bucket_start[b]) {
+            const uint8_t octet = (uint8_t)b;
+            bool is_occupied;
+            if (mrx_insert_(mrx, &octet, 1, &is_occupied) == NULL) {
+                mrx_clear_(mrx);
+                build_workers_free(workers, thread_count, parts);
+                return false;
+            }
+        }
+    }
+
+    unsigned b = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        struct build_worker *w = &workers[t];
+        const size_t end = (t + 1 == thread_count) ? count : count / thread_count * (t + 1);
+        w->first_octet = b;
+        while (b < 256 && bucket_start[b] < end) {
+            b++;
+        }
+        w->end_octet = b;
+        w->order = order;
+        w->bucket_start = bucket_start;
+        w->parts = parts;
+        w->cb = cb;
+        w->cb_arg = cb_arg;
+        mrx_init_(w->mrx, mrx->capacity, compact);
+        // the calling thread is worker 0
+        w->is_started = (t > 0 && pthread_create(&w->thread, NULL, build_worker_run, w) == 0);
+    }
+    build_worker_run(&workers[0]);
+    for (unsigned t = 1; t < thread_count; t++) {
+        if (workers[t].is_started) {
+            pthread_join(workers[t].thread, NULL);
+        } else {
+            build_worker_run(&workers[t]);
+        }
+    }
+
+    *inserted = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        mrx_alloc_adopt_(mrx, workers[t].mrx);
+        *inserted += workers[t].inserted;
+    }
+    uintptr_t total = 0;
+    uint32_t max_keylen = 0;
+    for (b = 0; b < 256; b++) {
+        if (parts[b].root != NULL) {
+            mrx_graft_(mrx, (uint8_t)b, parts[b].root);
+            total += parts[b].count;
+            if (parts[b].max_keylen > max_keylen) {
+                max_keylen = parts[b].max_keylen;
+            }
+        }
+    }
+    mrx->max_keylen_n_flags = (max_keylen + 1) | (mrx->max_keylen_n_flags & MRX_FLAGS_MASK_);
+    for (b = 0; b < 256; b++) {
+        if (bucket_start[b+1] != bucket_start[b] && parts[b].root == NULL) {
+            // nothing inserted in the partition, remove the placeholder
+            const uint8_t octet = (uint8_t)b;
+            bool was_erased;
+            mrx_erase_(mrx, &octet, 1, &was_erased);
+        }
+    }
+    mrx->count = total;
+    mrx->mod_count++;
+    build_workers_free(workers, thread_count, parts);
+    return true;
+}
+
+/*
+  Set operations on two trees:
+
+   - Both trees are traversed simultaneously in key order. Where both trees
+     have a prefix the octets are compared directly, at branch points the
+     branch octets of the two nodes are merged in order (union), matched
+     (intersection) or taken from the first tree only (difference), and
+     only those branches are followed.
+   - Subtrees that exist in only one of the trees are never compared with the
+     other tree, they are either skipped in full (intersection, difference
+     with subtree only in b) or emitted in full without further lookups.
+   - A mismatching prefix octet is handled as a branch point where each tree
+     has a single branch, so disjoint subtrees need no special case.
+   - The walk keeps an explicit path with one element per branch point
+     rather than recursing, as the depth grows with key length. The path and
+     the key buffer are on the stack for short keys, else on the heap.
+ */
+struct setop_ctx {
+    enum mrx_setop op;
+    uint8_t *key;
+    mrx_setop_cb_t cb;
+    void *cb_arg;
+};
+
+// A branch point in the walk, a or b is NULL if the subtree only exists in
+// the other tree. A position before the end of the prefix means that the
+// next octet of the prefix is the only branch.
+struct setop_path_element {
+    union mrx_node *a;
+    union mrx_node *b;
+    unsigned a_pos;
+    unsigned b_pos;
+    unsigned key_len;
+    int br;
+};
+
+// Returns the first branch octet at pos of node which is >= start, or -1.
+static int
+next_branch_at(const union mrx_node *node,
+               const unsigned pos,
+               const unsigned start)
+{
+    if (node == NULL || start > 255) {
+        return -1;
+    }
+    const uint8_t px_len = HDR_PX_LEN(node->hdr);
+    if (pos < px_len) {
+        return (node->sn.octets[pos] >= start) ? node->sn.octets[pos] : -1;
+    }
+    if (IS_MASK_NODE(HDR_NSZ(node->hdr))) {
+        return mask_node_next_branch(node, start);
+    }
+    // scan node branches are sorted
+    const uint8_t br_len = HDR_BR_LEN(node->hdr);
+    const uint8_t *br = &node->sn.octets[px_len];
+    for (uint8_t i = 0; i < br_len; i++) {
+        if (br[i] >= start) {
+            return br[i];
+        }
+    }
+    return -1;
+}
+
+// Input requirement: the branch must exist
+static union mrx_node *
+node_get_child(union mrx_node *node,
+               const uint8_t octet)
+{
+    if (IS_MASK_NODE(HDR_NSZ(node->hdr))) {
+        return mask_node_get_child(node, octet);
+    }
+    const uint8_t br_len = HDR_BR_LEN(node->hdr);
+    const uint8_t *br = &node->sn.octets[HDR_PX_LEN(node->hdr)];
+    const uint8_t br_pos = (uint8_t)((const uint8_t *)memchr(br, octet, br_len) - br);
+    return scan_node_get_child(node, br, br_len, br_pos);
+}
+
+// Follows branch octet from pos of node, which must have it.
+static union mrx_node *
+child_at(union mrx_node *node,
+         const unsigned pos,
+         const uint8_t octet,
+         unsigned *child_pos)
+{
+    if (pos < HDR_PX_LEN(node->hdr)) {
+        *child_pos = pos + 1;
+        return node;
+    }
+    *child_pos = 0;
+    return node_get_child(node, octet);
+}
+
+// Consumes the common prefix and reports the key at the branch point, if it
+// is in the result.
+static void
+setop_enter(struct setop_ctx *ctx,
+            struct setop_path_element *pe,
+            union mrx_node *a,
+            unsigned a_pos,
+            union mrx_node *b,
+            unsigned b_pos,
+            unsigned key_len)
+{
+    if (a != NULL && b != NULL) {
+        const uint8_t a_px_len = HDR_PX_LEN(a->hdr);
+        const uint8_t b_px_len = HDR_PX_LEN(b->hdr);
+        while (a_pos < a_px_len && b_pos < b_px_len && a->sn.octets[a_pos] == b->sn.octets[b_pos]) {
+            ctx->key[key_len++] = a->sn.octets[a_pos];
+            a_pos++;
+            b_pos++;
+        }
+    } else if (a != NULL) {
+        const uint8_t px_len = HDR_PX_LEN(a->hdr);
+        memcpy(&ctx->key[key_len], &a->sn.octets[a_pos], px_len - a_pos);
+        key_len += px_len - a_pos;
+        a_pos = px_len;
+    } else {
+        const uint8_t px_len = HDR_PX_LEN(b->hdr);
+        memcpy(&ctx->key[key_len], &b->sn.octets[b_pos], px_len - b_pos);
+        key_len += px_len - b_pos;
+        b_pos = px_len;
+    }
+
+    void **a_vref = NULL;
+    void **b_vref = NULL;
+    if (a != NULL && a_pos == HDR_PX_LEN(a->hdr) && HDR_HAS_VALUE(a->hdr)) {
+        a_vref = mrx_node_value_ref_(a, HDR_NSZ(a->hdr));
+    }
+    if (b != NULL && b_pos == HDR_PX_LEN(b->hdr) && HDR_HAS_VALUE(b->hdr)) {
+        b_vref = mrx_node_value_ref_(b, HDR_NSZ(b->hdr));
+    }
+    switch (ctx->op) {
+    case MRX_SETOP_UNION:
+        if (a_vref != NULL || b_vref != NULL) {
+            ctx->cb(ctx->key, key_len, a_vref, b_vref, ctx->cb_arg);
+        }
+        break;
+    case MRX_SETOP_INTERSECTION:
+        if (a_vref != NULL && b_vref != NULL) {
+            ctx->cb(ctx->key, key_len, a_vref, b_vref, ctx->cb_arg);
+        }
+        break;
+    case MRX_SETOP_DIFFERENCE:
+        if (a_vref != NULL && b_vref == NULL) {
+            ctx->cb(ctx->key, key_len, a_vref, NULL, ctx->cb_arg);
+        }
+        break;
+    }
+    pe->a = a;
+    pe->b = b;
+    pe->a_pos = a_pos;
+    pe->b_pos = b_pos;
+    pe->key_len = key_len;
+    pe->br = -1;
+}
+
+// Returns the next branch octet >= start to follow from the branch point, or
+// -1. Intersection never has a NULL subtree, and difference only in b.
+static int
+setop_next_branch(const enum mrx_setop op,
+                  const struct setop_path_element *pe,
+                  const unsigned start)
+{
+    int a_br = next_branch_at(pe->a, pe->a_pos, start);
+    int b_br;
+    switch (op) {
+    case MRX_SETOP_UNION:
+        b_br = next_branch_at(pe->b, pe->b_pos, start);
+        if (a_br == -1 || (b_br != -1 && b_br < a_br)) {
+            return b_br;
+        }
+        return a_br;
+    case MRX_SETOP_INTERSECTION:
+        b_br = next_branch_at(pe->b, pe->b_pos, start);
+        while (a_br != -1 && b_br != -1 && a_br != b_br) {
+            if (a_br < b_br) {
+                a_br = next_branch_at(pe->a, pe->a_pos, (unsigned)b_br);
+            } else {
+                b_br = next_branch_at(pe->b, pe->b_pos, (unsigned)a_br);
+            }
+        }
+        return (b_br == -1) ? -1 : a_br;
+    case MRX_SETOP_DIFFERENCE:
+    default:
+        return a_br;
+    }
+}
+
+bool
+mrx_setop_(mrx_base_t *a,
+           mrx_base_t *b,
+           const enum mrx_setop op,
+           mrx_setop_cb_t cb,
+           void *cb_arg)
+{
+    if (a->root == NULL && op != MRX_SETOP_UNION) {
+        return true;
+    }
+    if (b->root == NULL && op == MRX_SETOP_INTERSECTION) {
+        return true;
+    }
+    if (a->root == NULL && b->root == NULL) {
+        return true;
+    }
+    uint32_t max_keylen = (a->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    if ((b->max_keylen_n_flags & ~MRX_FLAGS_MASK_) > max_keylen) {
+        max_keylen = (b->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    }
+    struct setop_ctx ctx = {
+        .op = op,
+        .cb = cb,
+        .cb_arg = cb_arg
+    };
+    // one path element per octet at most, plus the root
+    struct setop_path_element *path;
+    const size_t buf_size = (max_keylen + 1) * (sizeof(*path) + 1);
+    const bool path_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+    if (path_is_on_stack) {
+        path = alloca(buf_size);
+    } else if ((path = malloc(buf_size)) == NULL) {
+        return false;
+    }
+    ctx.key = (uint8_t *)&path[max_keylen + 1];
+
+    int level = 0;
+    setop_enter(&ctx, &path[0], a->root, 0, b->root, 0, 0);
+    while (level >= 0) {
+        struct setop_path_element *pe = &path[level];
+        const int br = setop_next_branch(op, pe, (unsigned)(pe->br + 1));
+        if (br == -1) {
+            level--;
+            continue;
+        }
+        pe->br = br;
+        const uint8_t octet = (uint8_t)br;
+        union mrx_node *a_child = NULL;
+        union mrx_node *b_child = NULL;
+        unsigned a_child_pos = 0;
+        unsigned b_child_pos = 0;
+        if (next_branch_at(pe->a, pe->a_pos, octet) == br) {
+            a_child = child_at(pe->a, pe->a_pos, octet, &a_child_pos);
+        }
+        if (next_branch_at(pe->b, pe->b_pos, octet) == br) {
+            b_child = child_at(pe->b, pe->b_pos, octet, &b_child_pos);
+        }
+        ctx.key[pe->key_len] = octet;
+        setop_enter(&ctx, &path[level + 1], a_child, a_child_pos, b_child, b_child_pos, pe->key_len + 1);
+        level++;
+    }
+    if (!path_is_on_stack) {
+        free(path);
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Bounded edit distance (Levenshtein) search.
+
+   - The tree is walked depth-first while keeping the dynamic programming row
+     of edit distances between the key traversed so far and all prefixes of
+     the query, one row update per key octet.
+   - Only cells within max_distance of the diagonal can be within bound, so
+     the row is stored as a band of 2 * max_distance + 1 cells, which makes
+     each row update O(max_distance) regardless of query length. Cells
+     outside the bound are saturated at max_distance + 1.
+   - A subtree is pruned as soon as the minimum of the band exceeds the
+     bound. Prefix octets are processed in a tight loop within the node, and
+     branch octets are tested before the child node is loaded, so pruned
+     branches cost no child node cache misses.
+   - Recursion only happens at branch points, and the band rules out any key
+     longer than query length + max_distance, so recursion depth is bounded.
+ */
+#ifndef _WIN32
+#include <alloca.h>
+#endif
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+struct fuzzy_ctx {
+    const uint8_t *query;
+    unsigned query_len;
+    unsigned max_distance;
+    unsigned band_len;
+    uint8_t *key;
+    mrx_fuzzy_cb_t cb;
+    void *cb_arg;
+};
+
+// Band cell t at key depth d represents query prefix length d - max_distance + t.
+static unsigned
+band_step(const struct fuzzy_ctx *ctx,
+          const unsigned band[],
+          unsigned new_band[],
+          const unsigned depth,
+          const uint8_t octet)
+{
+    const unsigned inf = ctx->max_distance + 1;
+    unsigned min = inf;
+    for (unsigned t = 0; t < ctx->band_len; t++) {
+        const int j = (int)(depth + 1 + t) - (int)ctx->max_distance;
+        unsigned v = inf;
+        if (j >= 0 && j <= (int)ctx->query_len) {
+            if (t + 1 < ctx->band_len) {
+                v = band[t + 1] + 1; // octet not in query
+            }
+            if (j > 0) {
+                if (t > 0 && new_band[t - 1] + 1 < v) {
+                    v = new_band[t - 1] + 1; // query octet not in key
+                }
+                const unsigned subst = band[t] + (ctx->query[j - 1] != octet);
+                if (subst < v) {
+                    v = subst;
+                }
+            }
+            if (v > inf) {
+                v = inf;
+            }
+        }
+        new_band[t] = v;
+        if (v < min) {
+            min = v;
+        }
+    }
+    return min;
+}
+
+static inline unsigned
+band_distance(const struct fuzzy_ctx *ctx,
+              const unsigned band[],
+              const unsigned depth)
+{
+    const int t = (int)(ctx->query_len + ctx->max_distance) - (int)depth;
+    if (t < 0 || t >= (int)ctx->band_len) {
+        return ctx->max_distance + 1;
+    }
+    return band[t];
+}
+
+static void
+fuzzy_walk(const struct fuzzy_ctx *ctx,
+           union mrx_node *node,
+           const unsigned band_in[],
+           unsigned depth)
+{
+    unsigned band[2][ctx->band_len];
+    unsigned cur = 0;
+
+    memcpy(band[cur], band_in, ctx->band_len * sizeof(band_in[0]));
+    const uint8_t nsz = HDR_NSZ(node->hdr);
+    const uint8_t px_len = HDR_PX_LEN(node->hdr);
+    for (uint8_t i = 0; i < px_len; i++) {
+        const uint8_t octet = node->sn.octets[i];
+        if (band_step(ctx, band[cur], band[cur ^ 1u], depth, octet) > ctx->max_distance) {
+            return;
+        }
+        ctx->key[depth++] = octet;
+        cur ^= 1u;
+    }
+    if (HDR_HAS_VALUE(node->hdr)) {
+        const unsigned distance = band_distance(ctx, band[cur], depth);
+        if (distance <= ctx->max_distance) {
+            ctx->cb(ctx->key, depth, distance, mrx_node_value_ref_(node, nsz), ctx->cb_arg);
+        }
+    }
+    unsigned *child_band = band[cur ^ 1u];
+    if (IS_SCAN_NODE(nsz)) {
+        const uint8_t br_len = HDR_BR_LEN(node->hdr);
+        const uint8_t *br = &node->sn.octets[px_len];
+        for (uint8_t i = 0; i < br_len; i++) {
+            if (band_step(ctx, band[cur], child_band, depth, br[i]) <= ctx->max_distance) {
+                ctx->key[depth] = br[i];
+                fuzzy_walk(ctx, scan_node_get_child(node, br, br_len, i), child_band, depth + 1);
+            }
+        }
+    } else {
+        int b = -1;
+        while ((b = mask_node_next_branch(node, (unsigned)(b + 1))) != -1) {
+            if (band_step(ctx, band[cur], child_band, depth, (uint8_t)b) <= ctx->max_distance) {
+                ctx->key[depth] = (uint8_t)b;
+                fuzzy_walk(ctx, mask_node_get_child(node, (uint32_t)b), child_band, depth + 1);
+            }
+        }
+    }
+}
+
+void
+mrx_fuzzy_find_(mrx_base_t *mrx,
+                const uint8_t query[],
+                const unsigned query_len,
+                const unsigned max_distance,
+                mrx_fuzzy_cb_t cb,
+                void *cb_arg)
+{
+    if (mrx->root == NULL) {
+        return;
+    }
+    struct fuzzy_ctx ctx = {
+        .query = query,
+        .query_len = query_len,
+        .max_distance = max_distance,
+        .band_len = 2 * max_distance + 1,
+        .cb = cb,
+        .cb_arg = cb_arg
+    };
+
+    // keys longer than this can never be within bound
+    uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    if (max_keylen > query_len + max_distance) {
+        max_keylen = query_len + max_distance;
+    }
+    const bool key_is_on_stack = (max_keylen <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+    if (key_is_on_stack) {
+        ctx.key = alloca(max_keylen + 1);
+    } else {
+        ctx.key = malloc(max_keylen + 1);
+    }
+    unsigned band[ctx.band_len];
+    for (unsigned t = 0; t < ctx.band_len; t++) {
+        const int j = (int)t - (int)max_distance;
+        band[t] = (j >= 0 && j <= (int)query_len) ? (unsigned)j : max_distance + 1;
+    }
+    fuzzy_walk(&ctx, mrx->root, band, 0);
+    if (!key_is_on_stack) {
+        free(ctx.key);
+    }
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  String interning pool.
+
+   - String bytes are stored once, in an append-only arena of chunks, with
+     the length in front and a terminating NUL after. Strings never move, so
+     the pointers returned by reverse lookup are stable for the lifetime of
+     the pool (until clear).
+   - IDs are dense, assigned in interning order, and index a table of string
+     pointers, so reverse lookup is a single array access.
+   - The radix tree is keyed on a 64 bit hash of the string (8 octet fixed
+     keys, inline descent) with the ID as value. A string key tree would
+     store the bytes a second time, and tree nodes are relocated on insert
+     and have no parent links, so a leaf cannot serve as a stable reference
+     to walk back from.
+   - Hash collisions are resolved with linear probing on the hash key, ie
+     the next free key hash + 1, hash + 2 and so on. Nothing is erased except
+     by clear, so probe sequences are never broken.
+   - Batch lookups are made in hash order (the same radix partitioning as
+     mrx_build()), so consecutive descents share the upper tree levels in
+     cache. New strings in a batch are then interned in input order, so ID
+     assignment is the same as for one-by-one interning.
+ */
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+struct mrx_intern_chunk {
+    struct mrx_intern_chunk *next;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+};
+
+#define INTERN_CHUNK_SIZE (64u * 1024u - sizeof(struct mrx_intern_chunk))
+
+uint64_t
+mrx_intern_hash_(const uint8_t s[],
+                 const size_t len)
+{
+    const uint64_t m = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (uint64_t)len * m;
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, &s[i], 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29u;
+    }
+    if (i < len) {
+        uint64_t w = 0;
+        memcpy(&w, &s[i], len - i);
+        h = (h ^ w) * m;
+        h ^= h >> 29u;
+    }
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 32u);
+}
+
+static inline bool
+id_string_equals(const mrx_intern_base_t *pool,
+                 const uint32_t id,
+                 const uint8_t s[],
+                 const size_t len)
+{
+    const uint8_t *str = pool->strings[id];
+    uint32_t str_len;
+    memcpy(&str_len, str - sizeof(str_len), sizeof(str_len));
+    return str_len == len && memcmp(str, s, len) == 0;
+}
+
+// Returns ID, or MRX_INTERN_NO_ID with *free_hash set to the key where the
+// string would be inserted.
+static uint32_t
+lookup_hashed(const mrx_intern_base_t *pool,
+              const uint8_t s[],
+              const size_t len,
+              uint64_t hash,
+              uint64_t *free_hash)
+{
+    if (pool->mrx.root != NULL) {
+        void **vref;
+        while ((vref = mrx_find_fixed_(pool->mrx.root, (const uint8_t *)&hash, sizeof(hash))) != NULL) {
+            const uint32_t id = (uint32_t)(uintptr_t)*vref;
+            if (id_string_equals(pool, id, s, len)) {
+                return id;
+            }
+            hash++;
+        }
+    }
+    *free_hash = hash;
+    return MRX_INTERN_NO_ID;
+}
+
+static uint8_t *
+arena_alloc(mrx_intern_base_t *pool,
+            const size_t size)
+{
+    struct mrx_intern_chunk *chunk = pool->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        const size_t chunk_size = size > INTERN_CHUNK_SIZE ? size : INTERN_CHUNK_SIZE;
+        if ((chunk = malloc(sizeof(*chunk) + chunk_size)) == NULL) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+    uint8_t *p = &chunk->data[chunk->used];
+    chunk->used += size;
+    return p;
+}
+
+static uint32_t
+intern_hashed(mrx_intern_base_t *pool,
+              const uint8_t s[],
+              const size_t len,
+              const uint64_t hash)
+{
+    uint64_t free_hash;
+    uint32_t id = lookup_hashed(pool, s, len, hash, &free_hash);
+    if (id != MRX_INTERN_NO_ID) {
+        return id;
+    }
+    if (len > UINT32_MAX || pool->count == MRX_INTERN_NO_ID) {
+        return MRX_INTERN_NO_ID;
+    }
+    if (pool->count == pool->strings_capacity) {
+        const uint32_t capacity = pool->strings_capacity == 0 ? 64 :
+            (pool->strings_capacity > MRX_INTERN_NO_ID / 2 ? MRX_INTERN_NO_ID : pool->strings_capacity * 2);
+        const uint8_t **strings = realloc(pool->strings, capacity * sizeof(strings[0]));
+        if (strings == NULL) {
+            return MRX_INTERN_NO_ID;
+        }
+        pool->strings = strings;
+        pool->strings_capacity = capacity;
+    }
+    const uint32_t str_len = (uint32_t)len;
+    const size_t size = sizeof(str_len) + len + 1;
+    uint8_t *str = arena_alloc(pool, size);
+    if (str == NULL) {
+        return MRX_INTERN_NO_ID;
+    }
+    bool is_occupied;
+    void **vref = mrx_insert_(&pool->mrx, (const uint8_t *)&free_hash, sizeof(free_hash), &is_occupied);
+    if (vref == NULL) {
+        pool->chunks->used -= size;
+        return MRX_INTERN_NO_ID;
+    }
+    memcpy(str, &str_len, sizeof(str_len));
+    str += sizeof(str_len);
+    memcpy(str, s, len);
+    str[len] = '\0';
+    id = pool->count++;
+    pool->strings[id] = str;
+    *vref = (void *)(uintptr_t)id;
+    return id;
+}
+
+void
+mrx_intern_init_(mrx_intern_base_t *pool,
+                 const size_t capacity,
+                 const bool compact)
+{
+    pool->count = 0;
+    pool->strings_capacity = 0;
+    pool->strings = NULL;
+    pool->chunks = NULL;
+    mrx_init_(&pool->mrx, capacity, compact);
+}
+
+static void
+free_chunks(mrx_intern_base_t *pool)
+{
+    struct mrx_intern_chunk *chunk = pool->chunks;
+    while (chunk != NULL) {
+        struct mrx_intern_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+}
+
+void
+mrx_intern_clear_(mrx_intern_base_t *pool)
+{
+    free_chunks(pool);
+    pool->count = 0;
+    mrx_clear_(&pool->mrx);
+}
+
+void
+mrx_intern_delete_(mrx_intern_base_t *pool)
+{
+    free_chunks(pool);
+    free(pool->strings);
+    mrx_delete_(&pool->mrx);
+}
+
+uint32_t
+mrx_intern_(mrx_intern_base_t *pool,
+            const uint8_t s[],
+            const size_t len)
+{
+    return intern_hashed(pool, s, len, mrx_intern_hash_(s, len));
+}
+
+uint32_t
+mrx_intern_find_(const mrx_intern_base_t *pool,
+                 const uint8_t s[],
+                 const size_t len)
+{
+    uint64_t free_hash;
+    return lookup_hashed(pool, s, len, mrx_intern_hash_(s, len), &free_hash);
+}
+
+const uint8_t *
+mrx_intern_str_(const mrx_intern_base_t *pool,
+                const uint32_t id,
+                size_t *len)
+{
+    if (id >= pool->count) {
+        return NULL;
+    }
+    const uint8_t *str = pool->strings[id];
+    if (len != NULL) {
+        uint32_t str_len;
+        memcpy(&str_len, str - sizeof(str_len), sizeof(str_len));
+        *len = str_len;
+    }
+    return str;
+}
+
+#define INTERN_BATCH_MIN_ORDERED 64u
+
+// Lookup in hash order, hashes[] is filled in input order. Returns false if
+// out of memory for ordering, then nothing is done.
+static bool
+find_batch_ordered(const mrx_intern_base_t *pool,
+                   const uint8_t * const strs[],
+                   const size_t lens[],
+                   const size_t count,
+                   uint32_t ids[],
+                   uint64_t hashes[])
+{
+    if (count == 0) {
+        return true;
+    }
+    uint32_t *order = malloc(count * (2 * sizeof(*order) + sizeof(uint16_t)));
+    if (order == NULL) {
+        return false;
+    }
+    uint16_t *partition = (uint16_t *)&order[2 * count];
+    for (size_t i = 0; i < count; i++) {
+        const size_t len = lens == NULL ? strlen((const char *)strs[i]) : lens[i];
+        hashes[i] = mrx_intern_hash_(strs[i], len);
+        partition[i] = (uint16_t)(hashes[i] >> 48u);
+    }
+    mrx_bulk_order_(partition, count, order, &order[count]);
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t idx = order[i];
+        const size_t len = lens == NULL ? strlen((const char *)strs[idx]) : lens[idx];
+        uint64_t free_hash;
+        ids[idx] = lookup_hashed(pool, strs[idx], len, hashes[idx], &free_hash);
+    }
+    free(order);
+    return true;
+}
+
+void
+mrx_intern_find_batch_(const mrx_intern_base_t *pool,
+                       const uint8_t * const strs[],
+                       const size_t lens[], // NULL for NUL-terminated strings
+                       const size_t count,
+                       uint32_t ids[])
+{
+    if (count >= INTERN_BATCH_MIN_ORDERED && count <= UINT32_MAX) {
+        uint64_t *hashes = malloc(count * sizeof(*hashes));
+        if (hashes != NULL) {
+            const bool done = find_batch_ordered(pool, strs, lens, count, ids, hashes);
+            free(hashes);
+            if (done) {
+                return;
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        const size_t len = lens == NULL ? strlen((const char *)strs[i]) : lens[i];
+        ids[i] = mrx_intern_find_(pool, strs[i], len);
+    }
+}
+
+size_t
+mrx_intern_batch_(mrx_intern_base_t *pool,
+                  const uint8_t * const strs[],
+                  const size_t lens[], // NULL for NUL-terminated strings
+                  const size_t count,
+                  uint32_t ids[])
+{
+    uint64_t *hashes = NULL;
+    if (count >= INTERN_BATCH_MIN_ORDERED && count <= UINT32_MAX) {
+        if ((hashes = malloc(count * sizeof(*hashes))) != NULL &&
+            !find_batch_ordered(pool, strs, lens, count, ids, hashes))
+        {
+            free(hashes);
+            hashes = NULL;
+        }
+    }
+    size_t i;
+    for (i = 0; i < count; i++) {
+        if (hashes != NULL && ids[i] != MRX_INTERN_NO_ID) {
+            continue;
+        }
+        const size_t len = lens == NULL ? strlen((const char *)strs[i]) : lens[i];
+        const uint64_t hash = hashes != NULL ? hashes[i] : mrx_intern_hash_(strs[i], len);
+        if ((ids[i] = intern_hashed(pool, strs[i], len, hash)) == MRX_INTERN_NO_ID) {
+            break;
+        }
+    }
+    free(hashes);
+    return i;
+}
@@ -85,27 +85,125 @@ mrx_traverse_children_(mrx_base_t *mrx,
     }
 }
 
+// Depth first, so no list of pending nodes is needed. A node is freed before
+// its last child is visited, which is done in a loop rather than by recursion
+// to keep the stack flat for long keys. Returns number of values in the
+// subtree, cb (if non-NULL) is called for each before its node is freed.
+// Links to the subtree are not touched.
+size_t
+mrx_erase_subtree_(mrx_base_t *mrx,
+                   union mrx_node *node,
+                   mrx_value_cb_t cb,
+                   void *cb_arg)
+{
+    size_t count = 0;
+    while (node != NULL) {
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        union mrx_node *last_child = NULL;
+        if (HDR_HAS_VALUE(node->hdr)) {
+            if (cb != NULL) {
+                cb(mrx_node_value_ref_(node, nsz), cb_arg);
+            }
+            count++;
+        }
+        if (IS_SCAN_NODE(nsz)) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            uint8_t * const br = &node->sn.octets[HDR_PX_LEN(node->hdr)];
+            mrx_sp_t * const brp = SP_ALIGN(&br[br_len]);
+            for (uint8_t i = 0; i + 1 < br_len; i++) {
+                count += mrx_erase_subtree_(mrx, scan_node_get_child1(node, brp, i), cb, cb_arg);
+            }
+            if (br_len > 0) {
+                last_child = scan_node_get_child1(node, brp, br_len - 1);
+            }
+            ptrpfx_sn_free(mrx, node);
+            free_node(mrx, node, nsz);
+        } else {
+            union mrx_next_block * const local_nx = (union mrx_next_block *)node->mn.local;
+            union mrx_next_block *last_nx = NULL;
+            int br = barr32_bsf(node->mn.bitmask.u32, 0, 255);
+            while (br != -1) {
+                uint32_t b = br;
+                uint32_t bm = node->mn.bitmask.u32[b >> 5u];
+                union mrx_next_block *nx = mask_node_get_next_block(node, b);
+                if (nx != last_nx) {
+                    if (last_nx != NULL && last_nx != local_nx) {
+                        free_nx_node(mrx, last_nx);
+                    }
+                    last_nx = nx;
+                }
+                b = 1u << (b & 0x1Fu);
+                bm &= b - 1;
+                b = bit32_count(bm);
+                union mrx_node * const child = next_block_get_child(nx, b);
+                br = barr32_bsf(node->mn.bitmask.u32, (unsigned)(br + 1), 255);
+                if (br == -1) {
+                    last_child = child;
+                } else {
+                    count += mrx_erase_subtree_(mrx, child, cb, cb_arg);
+                }
+            }
+            if (last_nx != NULL && last_nx != local_nx) {
+                free_nx_node(mrx, last_nx);
+            }
+            free_node(mrx, node, nsz);
+        }
+        node = last_child;
+    }
+    return count;
+}
+
 void
 mrx_traverse_erase_all_nodes_(mrx_base_t *mrx)
 {
-    // FIXME: can this be made more efficient? Compact delete/clear would be more efficient then
     if (mrx->root == NULL) {
         return;
     }
-    nl_t *parents = nl_new(~0u, 64);
-    nl_t *children = nl_new(~0u, 64);
-    mrx_traverse_children_(mrx, parents, mrx->root, true);
-    do {
-        for (nl_it_t *it = nl_begin(parents); it != nl_end(parents); it = nl_next(it)) {
-            mrx_traverse_children_(mrx, children, nl_val(it), true);
-        }
-        nl_clear(parents);
-        nl_t *swaptmp = children;
-        children = parents;
-        parents = swaptmp;
-    } while (nl_size(parents) > 0);
-    nl_delete(children);
-    nl_delete(parents);
+    mrx_erase_subtree_(mrx, mrx->root, NULL, NULL);
+}
+
+static void
+foreach_value_walk(union mrx_node *node,
+                   mrx_value_cb_t cb,
+                   void *cb_arg)
+{
+    for (;;) {
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        if (HDR_HAS_VALUE(node->hdr)) {
+            cb(mrx_node_value_ref_(node, nsz), cb_arg);
+        }
+        if (IS_SCAN_NODE(nsz)) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            if (br_len == 0) {
+                return;
+            }
+            const uint8_t *br = &node->sn.octets[HDR_PX_LEN(node->hdr)];
+            for (uint8_t i = 0; i < br_len - 1; i++) {
+                foreach_value_walk(scan_node_get_child(node, br, br_len, i), cb, cb_arg);
+            }
+            // no recursion for the last child, keeps stack flat for long keys
+            node = scan_node_get_child(node, br, br_len, br_len - 1);
+        } else {
+            int b = mask_node_next_branch(node, 0);
+            int next_b;
+            while ((next_b = mask_node_next_branch(node, (unsigned)(b + 1))) != -1) {
+                foreach_value_walk(mask_node_get_child(node, (uint32_t)b), cb, cb_arg);
+                b = next_b;
+            }
+            node = mask_node_get_child(node, (uint32_t)b);
+        }
+    }
+}
+
+void
+mrx_foreach_value_(mrx_base_t *mrx,
+                   mrx_value_cb_t cb,
+                   void *cb_arg)
+{
+    if (mrx->root == NULL) {
+        return;
+    }
+    foreach_value_walk(mrx->root, cb, cb_arg);
 }
 
 size_t
@@ -129,6 +227,75 @@ mrx_itinit_(mrx_base_t *mrx,
     iterator_scan_to_leftmost_value(it);
 }
 
+// Positions the iterator at the first key not less than key[], returns false
+// if there is none. The descent follows the key, and only at the node where
+// the tree and the key part ways it steps to the leftmost value of the next
+// larger subtree, or lets mrx_next_() leave the subtree if all of it is less.
+bool
+mrx_itinit_lower_bound_(mrx_base_t *mrx,
+                        mrx_iterator_t *it,
+                        const uint8_t key[],
+                        unsigned key_len)
+{
+    const uint32_t max_keylen = (mrx->max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    it->key = &((uint8_t *)it)[sizeof(*it) + (max_keylen + 1) * sizeof(struct mrx_iterator_path_element)];
+    it->key_len = 0;
+    it->key_level = -1;
+    it->key_level_len = 0;
+    it->path[0].node = mrx->root;
+    it->level = 0;
+    for (;;) {
+        union mrx_node * const node = it->path[it->level].node;
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        const int cmp = memcmp(node->sn.octets, key, key_len < px_len ? key_len : px_len);
+        if (cmp > 0 || (cmp == 0 && key_len <= px_len)) {
+            // all keys in the subtree are larger, or the first is the key itself
+            iterator_scan_to_leftmost_value(it);
+            return true;
+        }
+        if (cmp < 0) {
+            break;
+        }
+        const uint8_t octet = key[px_len];
+        key += px_len + 1;
+        key_len -= px_len + 1;
+        union mrx_node *child;
+        int br_pos;
+        uint8_t br;
+        if (IS_SCAN_NODE(HDR_NSZ(node->hdr))) {
+            const uint8_t br_len = HDR_BR_LEN(node->hdr);
+            const uint8_t * const brp = &node->sn.octets[px_len];
+            for (br_pos = 0; br_pos < br_len && brp[br_pos] < octet; br_pos++);
+            if (br_pos == br_len) {
+                break;
+            }
+            br = brp[br_pos];
+            child = scan_node_get_child(node, brp, br_len, (uint8_t)br_pos);
+        } else {
+            if ((br_pos = mask_node_next_branch(node, octet)) == -1) {
+                break;
+            }
+            br = (uint8_t)br_pos;
+            child = mask_node_get_child(node, br);
+        }
+        it->key_len += px_len + 1;
+        it->path[it->level].br_pos = (int16_t)br_pos;
+        it->path[it->level].br = br;
+        it->level++;
+        it->path[it->level].node = child;
+        if (br != octet) {
+            iterator_scan_to_leftmost_value(it);
+            return true;
+        }
+    }
+    // all keys in the subtree are less, continue after it in the parent
+    it->level--;
+    if (it->level == -1) {
+        return false;
+    }
+    return mrx_next_(it);
+}
+
 bool
 mrx_next_(mrx_iterator_t *it)
 {
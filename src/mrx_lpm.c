@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Bit-granular longest prefix match.
+
+   - A prefix of bit length 8 * q + r (r = 0..7) is stored under its first q
+     octets as tree key, so the radix tree itself stays byte-granular. The
+     tree value is an entry holding all prefixes with that byte-aligned part,
+     ie the one with r = 0 and those with a partial last octet.
+   - Within an entry each prefix is identified by a slot number,
+     (1 << r) - 1 + (top r bits of the partial octet), which ranges 0..254.
+     Slots are kept sorted, which means that longer partial octets always
+     have higher slot numbers, so a backwards scan finds the longest
+     matching prefix first.
+   - Lookup is a single descent which collects the entries on the path with
+     mrx_findprefixes_(). As a deeper entry always holds longer prefixes than
+     a shallower, the entries are checked from the deepest and up, and the
+     first matching slot is the result.
+   - This replaces prefix expansion, where a /17 would need 128 byte-aligned
+     entries. Most entries hold a single prefix and then take 16 bytes (on
+     64 bit machines), larger entries grow their slot and value arrays in
+     powers of two.
+ */
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+struct mrx_lpm_entry {
+    uint8_t count;
+    uint8_t capacity;
+    uint8_t slots[];
+};
+
+#define LPM_MAX_SLOTS 255u
+
+static inline size_t
+entry_values_offset(const unsigned capacity)
+{
+    const size_t offset = sizeof(struct mrx_lpm_entry) + capacity;
+    return (offset + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static inline void **
+entry_values(struct mrx_lpm_entry *entry)
+{
+    return (void **)((uint8_t *)entry + entry_values_offset(entry->capacity));
+}
+
+static inline uint8_t
+prefix_slot(const unsigned r,
+            const uint8_t octet)
+{
+    return (uint8_t)(((1u << r) - 1u) + (octet >> (8u - r)));
+}
+
+static inline unsigned
+slot_bit_len(const uint8_t slot)
+{
+    return (unsigned)(31 - __builtin_clz((unsigned)slot + 1u));
+}
+
+static inline bool
+slot_matches(const uint8_t slot,
+             const uint8_t octet)
+{
+    const unsigned r = slot_bit_len(slot);
+    return prefix_slot(r, octet) == slot;
+}
+
+// Returns position of slot, or insert position with *found set to false.
+static unsigned
+entry_slot_pos(const struct mrx_lpm_entry *entry,
+               const uint8_t slot,
+               bool *found)
+{
+    unsigned i;
+    for (i = 0; i < entry->count && entry->slots[i] < slot; i++);
+    *found = (i < entry->count && entry->slots[i] == slot);
+    return i;
+}
+
+static struct mrx_lpm_entry *
+entry_grow(struct mrx_lpm_entry *entry)
+{
+    const unsigned capacity = entry->capacity * 2 > LPM_MAX_SLOTS ? LPM_MAX_SLOTS : entry->capacity * 2;
+    struct mrx_lpm_entry *new_entry = malloc(entry_values_offset(capacity) + capacity * sizeof(void *));
+    if (new_entry == NULL) {
+        return NULL;
+    }
+    new_entry->count = entry->count;
+    new_entry->capacity = (uint8_t)capacity;
+    memcpy(new_entry->slots, entry->slots, entry->count);
+    memcpy(entry_values(new_entry), entry_values(entry), entry->count * sizeof(void *));
+    free(entry);
+    return new_entry;
+}
+
+void **
+mrx_lpm_insert_(mrx_base_t *mrx,
+                const uint8_t prefix[],
+                const unsigned bit_len,
+                bool *is_occupied)
+{
+    const unsigned q = bit_len >> 3u;
+    const unsigned r = bit_len & 0x7u;
+    const uint8_t slot = r == 0 ? 0 : prefix_slot(r, prefix[q]);
+    bool occupied;
+
+    void **vref = mrx_insert_(mrx, prefix, q, &occupied);
+    if (vref == NULL) {
+        *is_occupied = false;
+        return NULL;
+    }
+    struct mrx_lpm_entry *entry;
+    if (!occupied) {
+        if ((entry = malloc(entry_values_offset(1) + sizeof(void *))) == NULL) {
+            mrx_erase_(mrx, prefix, q, &occupied);
+            *is_occupied = false;
+            return NULL;
+        }
+        entry->count = 0;
+        entry->capacity = 1;
+        *vref = entry;
+    } else {
+        entry = *vref;
+    }
+    bool found;
+    const unsigned pos = entry_slot_pos(entry, slot, &found);
+    *is_occupied = found;
+    if (found) {
+        return &entry_values(entry)[pos];
+    }
+    if (entry->count == entry->capacity) {
+        if ((entry = entry_grow(entry)) == NULL) {
+            return NULL;
+        }
+        *vref = entry;
+    }
+    void **values = entry_values(entry);
+    memmove(&entry->slots[pos + 1], &entry->slots[pos], entry->count - pos);
+    memmove(&values[pos + 1], &values[pos], (entry->count - pos) * sizeof(void *));
+    entry->slots[pos] = slot;
+    entry->count++;
+    return &values[pos];
+}
+
+void **
+mrx_lpm_find_(mrx_base_t *mrx,
+              const uint8_t prefix[],
+              const unsigned bit_len)
+{
+    const unsigned q = bit_len >> 3u;
+    const unsigned r = bit_len & 0x7u;
+    const uint8_t slot = r == 0 ? 0 : prefix_slot(r, prefix[q]);
+
+    if (mrx->root == NULL) {
+        return NULL;
+    }
+    void **vref = mrx_find_(mrx->root, prefix, q);
+    if (vref == NULL) {
+        return NULL;
+    }
+    struct mrx_lpm_entry *entry = *vref;
+    bool found;
+    const unsigned pos = entry_slot_pos(entry, slot, &found);
+    return found ? &entry_values(entry)[pos] : NULL;
+}
+
+void *
+mrx_lpm_erase_(mrx_base_t *mrx,
+               const uint8_t prefix[],
+               const unsigned bit_len,
+               bool *was_erased)
+{
+    const unsigned q = bit_len >> 3u;
+    const unsigned r = bit_len & 0x7u;
+    const uint8_t slot = r == 0 ? 0 : prefix_slot(r, prefix[q]);
+
+    *was_erased = false;
+    if (mrx->root == NULL) {
+        return NULL;
+    }
+    void **vref = mrx_find_(mrx->root, prefix, q);
+    if (vref == NULL) {
+        return NULL;
+    }
+    struct mrx_lpm_entry *entry = *vref;
+    bool found;
+    const unsigned pos = entry_slot_pos(entry, slot, &found);
+    if (!found) {
+        return NULL;
+    }
+    void **values = entry_values(entry);
+    void *value = values[pos];
+    entry->count--;
+    memmove(&entry->slots[pos], &entry->slots[pos + 1], entry->count - pos);
+    memmove(&values[pos], &values[pos + 1], (entry->count - pos) * sizeof(void *));
+    *was_erased = true;
+    if (entry->count == 0) {
+        bool erased;
+        free(entry);
+        mrx_erase_(mrx, prefix, q, &erased);
+    }
+    return value;
+}
+
+void **
+mrx_lpm_lookup_(mrx_base_t *mrx,
+                const uint8_t addr[],
+                const unsigned addr_len,
+                unsigned *match_bit_len)
+{
+    if (mrx->root == NULL) {
+        return NULL;
+    }
+    void **vrefs[addr_len + 1];
+    unsigned match_lens[addr_len + 1];
+    unsigned i = mrx_findprefixes_(mrx->root, addr, addr_len, vrefs, match_lens);
+    while (i-- > 0) {
+        struct mrx_lpm_entry *entry = *vrefs[i];
+        const unsigned q = match_lens[i];
+        const uint8_t octet = q < addr_len ? addr[q] : 0;
+        for (unsigned pos = entry->count; pos-- > 0;) {
+            const uint8_t slot = entry->slots[pos];
+            if (slot == 0 || (q < addr_len && slot_matches(slot, octet))) {
+                if (match_bit_len != NULL) {
+                    *match_bit_len = 8 * q + slot_bit_len(slot);
+                }
+                return &entry_values(entry)[pos];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void
+clear_entry(void **vref,
+            void *arg)
+{
+    void (*free_value)(void *value) = *(void (**)(void *))arg;
+    struct mrx_lpm_entry *entry = *vref;
+    if (free_value != NULL) {
+        void **values = entry_values(entry);
+        for (unsigned i = 0; i < entry->count; i++) {
+            free_value(values[i]);
+        }
+    }
+    free(entry);
+}
+
+void
+mrx_lpm_clear_entries_(mrx_base_t *mrx,
+                       void (*free_value)(void *value))
+{
+    mrx_foreach_value_(mrx, clear_entry, &free_value);
+}
@@ -0,0 +1,610 @@
+/*
+ * Copyright (c) 2013, 2022 Xarepo. All rights reserved.
+ *
+ * This program is open source under the ISC License.
+ *
+ */
+
+/*
+  Top-k completion with subtree max-score augmentation.
+
+   - The key tree maps each key to its score. The augmentation is kept in a
+     second tree, which for each branch of the trie (the key tree with
+     single-child paths collapsed) maps the branch point key plus the branch
+     octet to the maximum score of all keys below it. Tree nodes have no
+     spare room and are relocated on insert, so the augmentation cannot be
+     stored in the nodes themselves.
+   - Every entry holds the exact maximum of the keys that start with its
+     key. Entries are never left pointing at an empty subtree, but when an
+     erase collapses a branch point the entry of the remaining branch is
+     kept, and it is still exact as it covers the same keys as the branch
+     above it.
+   - Insert adds at most two entries, the new branch of the inserted key and
+     the remaining branch if it splits a single-child path, and then raises
+     the maximum of all entries on the key path in a single descent with
+     mrx_findprefixes_(). Erase and score decrease recompute the entries on
+     the key path that held the old score, deepest first, from the entries
+     of the branches right below, and stop at the first entry that held a
+     higher score.
+   - Queries are best-first from the trie node at the prefix, with a binary
+     heap of frontier branches ordered by maximum score and keys ordered by
+     score. A key is reported when it is at the top of the heap, as no
+     frontier branch can then hold a higher score. This expands about k times
+     depth trie nodes rather than the whole subtree under the prefix.
+ */
+#ifndef _WIN32
+#include <alloca.h>
+#endif
+#include <stdlib.h>
+
+#include <mrx_base_int.h>
+
+#define SCORE(value) ((uint32_t)(uintptr_t)(value))
+#define SCORE_VALUE(score) ((void *)(uintptr_t)(score))
+
+static union mrx_node *
+node_child(const union mrx_node *node,
+           const uint8_t octet)
+{
+    const uint8_t px_len = HDR_PX_LEN(node->hdr);
+    if (IS_SCAN_NODE(HDR_NSZ(node->hdr))) {
+        const uint8_t br_len = HDR_BR_LEN(node->hdr);
+        const uint8_t *br = &node->sn.octets[px_len];
+        for (uint8_t i = 0; i < br_len; i++) {
+            if (br[i] == octet) {
+                return scan_node_get_child(node, br, br_len, i);
+            }
+        }
+        return NULL;
+    }
+    if ((node->mn.bitmask.u32[octet >> 5u] & (1u << (octet & 0x1Fu))) == 0) {
+        return NULL;
+    }
+    return mask_node_get_child(node, octet);
+}
+
+// Extends key[0..len) to the first position where a key ends or the path
+// branches. Returns the new length, or -1 if no key starts with key[0..len).
+// The branch octets are stored in order in branches[], and *vref is set to
+// the value reference if a key ends there, else NULL.
+static int
+trie_node(const union mrx_node *root,
+          uint8_t key[],
+          unsigned len,
+          uint8_t branches[256],
+          unsigned *br_count,
+          void ***vref)
+{
+    const uint8_t *s = key;
+    unsigned slen = len;
+    const union mrx_node *node = root;
+
+    for (;;) {
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        if (slen <= px_len) {
+            if (memcmp(s, node->sn.octets, slen) != 0) {
+                return -1;
+            }
+            memcpy(&key[len], &node->sn.octets[slen], px_len - slen);
+            len += px_len - slen;
+            break;
+        }
+        if (memcmp(s, node->sn.octets, px_len) != 0) {
+            return -1;
+        }
+        s += px_len;
+        slen -= px_len;
+        if ((node = node_child(node, *s)) == NULL) {
+            return -1;
+        }
+        s++;
+        slen--;
+    }
+    for (;;) {
+        const uint8_t nsz = HDR_NSZ(node->hdr);
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        unsigned count = 0;
+        if (IS_SCAN_NODE(nsz)) {
+            count = HDR_BR_LEN(node->hdr);
+            memcpy(branches, &node->sn.octets[px_len], count);
+        } else {
+            int b = -1;
+            while ((b = mask_node_next_branch(node, (unsigned)(b + 1))) != -1) {
+                branches[count++] = (uint8_t)b;
+            }
+        }
+        if (HDR_HAS_VALUE(node->hdr) || count != 1) {
+            *br_count = count;
+            *vref = HDR_HAS_VALUE(node->hdr) ? mrx_node_value_ref_((union mrx_node *)(uintptr_t)node, nsz) : NULL;
+            return (int)len;
+        }
+        key[len++] = branches[0];
+        node = node_child(node, branches[0]);
+        memcpy(&key[len], node->sn.octets, HDR_PX_LEN(node->hdr));
+        len += HDR_PX_LEN(node->hdr);
+    }
+}
+
+static uint32_t
+trie_node_max(const mrx_topk_base_t *t,
+              uint8_t key[],
+              const unsigned len,
+              const uint8_t branches[],
+              const unsigned br_count,
+              void **vref)
+{
+    uint32_t max = vref != NULL ? SCORE(*vref) : 0;
+    for (unsigned i = 0; i < br_count; i++) {
+        key[len] = branches[i];
+        const uint32_t score = SCORE(*mrx_find_(t->maxes->root, key, len + 1));
+        if (score > max) {
+            max = score;
+        }
+    }
+    return max;
+}
+
+// Max score of keys starting with key[0..len), false if there are none. The
+// key buffer must fit the longest key plus one octet.
+static bool
+subtree_max(const mrx_topk_base_t *t,
+            uint8_t key[],
+            const unsigned len,
+            uint32_t *max)
+{
+    uint8_t branches[256];
+    unsigned br_count;
+    void **vref;
+
+    if (t->mrx.root == NULL) {
+        return false;
+    }
+    const int node_len = trie_node(t->mrx.root, key, len, branches, &br_count, &vref);
+    if (node_len < 0) {
+        return false;
+    }
+    *max = trie_node_max(t, key, (unsigned)node_len, branches, br_count, vref);
+    return true;
+}
+
+// Length of the longest prefix of key shared with any key in the tree.
+static unsigned
+common_prefix_len(const union mrx_node *root,
+                  const uint8_t key[],
+                  const unsigned key_len)
+{
+    const uint8_t *s = key;
+    unsigned slen = key_len;
+    const union mrx_node *node = root;
+
+    for (;;) {
+        const uint8_t px_len = HDR_PX_LEN(node->hdr);
+        const unsigned n = slen < px_len ? slen : px_len;
+        unsigned i = 0;
+        while (i < n && s[i] == node->sn.octets[i]) {
+            i++;
+        }
+        if (i < px_len) {
+            return key_len - slen + i;
+        }
+        s += px_len;
+        slen -= px_len;
+        if (slen == 0 || (node = node_child(node, *s)) == NULL) {
+            return key_len - slen;
+        }
+        s++;
+        slen--;
+    }
+}
+
+// Scratch space for updating the entries on a key path, allocated before the
+// trees are modified so the update itself cannot fail.
+struct prefix_scratch {
+    void ***vrefs;        // key_len + 1 entries for mrx_findprefixes_()
+    unsigned *match_lens; // key_len + 1 entries for mrx_findprefixes_()
+    uint8_t *buf;         // key buffer, key_buffer_size() octets
+};
+
+static void
+raise_prefix_maxes(mrx_topk_base_t *t,
+                   const uint8_t key[],
+                   const unsigned key_len,
+                   const uint32_t score,
+                   const struct prefix_scratch *ps)
+{
+    if (t->maxes->root == NULL) {
+        return;
+    }
+    void ***vrefs = ps->vrefs;
+    const unsigned count = mrx_findprefixes_(t->maxes->root, key, key_len, vrefs, ps->match_lens);
+    for (unsigned i = 0; i < count; i++) {
+        if (SCORE(*vrefs[i]) < score) {
+            *vrefs[i] = SCORE_VALUE(score);
+        }
+    }
+}
+
+// Recomputes entries on the key path after the key with old_score has been
+// erased or got a lower score.
+static void
+lower_prefix_maxes(mrx_topk_base_t *t,
+                   const uint8_t key[],
+                   const unsigned key_len,
+                   const uint32_t old_score,
+                   const struct prefix_scratch *ps)
+{
+    if (t->maxes->root == NULL) {
+        return;
+    }
+    void ***vrefs = ps->vrefs;
+    unsigned *match_lens = ps->match_lens;
+    uint8_t *buf = ps->buf;
+    const unsigned count = mrx_findprefixes_(t->maxes->root, key, key_len, vrefs, match_lens);
+    unsigned empty_pos = count;
+    for (unsigned i = count; i-- > 0;) {
+        if (SCORE(*vrefs[i]) != old_score) {
+            break;
+        }
+        uint32_t max;
+        memcpy(buf, key, match_lens[i]);
+        if (subtree_max(t, buf, match_lens[i], &max)) {
+            *vrefs[i] = SCORE_VALUE(max);
+        } else {
+            empty_pos = i; // subtrees only get empty from the deepest entry and up
+        }
+    }
+    // erase last, as erasing may move the values of the other entries
+    for (unsigned i = empty_pos; i < count; i++) {
+        bool was_erased;
+        mrx_erase_(t->maxes, key, match_lens[i], &was_erased);
+    }
+}
+
+// Size of key buffers for trie_node(), fits the longest key plus one octet.
+static inline unsigned
+key_buffer_size(const mrx_topk_base_t *t,
+                const unsigned key_len)
+{
+    const uint32_t max_keylen = (t->mrx.max_keylen_n_flags & ~MRX_FLAGS_MASK_);
+    return (max_keylen > key_len ? max_keylen : key_len) + 1;
+}
+
+#define KEY_BUFFER_IS_ON_STACK(size) ((size) <= MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK)
+
+static inline size_t
+prefix_scratch_size(const unsigned key_len,
+                    const unsigned buf_size)
+{
+    return ((size_t)key_len + 1) * (sizeof(void **) + sizeof(unsigned)) + buf_size;
+}
+
+static inline void
+prefix_scratch_init(struct prefix_scratch *ps,
+                    void *mem,
+                    const unsigned key_len)
+{
+    ps->vrefs = (void ***)mem;
+    ps->match_lens = (unsigned *)&ps->vrefs[key_len + 1];
+    ps->buf = (uint8_t *)&ps->match_lens[key_len + 1];
+}
+
+bool
+mrx_topk_init_(mrx_topk_base_t *t,
+               const size_t capacity,
+               const bool compact)
+{
+    const size_t maxes_size = sizeof(mrx_base_t) + (compact ? 0 : sizeof(struct mrx_buddyalloc));
+    if ((t->maxes = malloc(maxes_size)) == NULL) {
+        return false;
+    }
+    mrx_init_(t->maxes, ~(size_t)0, compact);
+    mrx_init_(&t->mrx, capacity, compact);
+    return true;
+}
+
+void
+mrx_topk_clear_(mrx_topk_base_t *t)
+{
+    mrx_clear_(t->maxes);
+    mrx_clear_(&t->mrx);
+}
+
+void
+mrx_topk_delete_(mrx_topk_base_t *t)
+{
+    mrx_delete_(t->maxes);
+    free(t->maxes);
+    mrx_delete_(&t->mrx);
+}
+
+bool
+mrx_topk_insert_(mrx_topk_base_t *t,
+                 const uint8_t key[],
+                 const unsigned key_len,
+                 const uint32_t score)
+{
+    const unsigned buf_size = key_buffer_size(t, key_len);
+    const size_t mem_size = prefix_scratch_size(key_len, buf_size);
+    void *mem = KEY_BUFFER_IS_ON_STACK(buf_size) ? alloca(mem_size) : malloc(mem_size);
+    if (mem == NULL) {
+        return false;
+    }
+    struct prefix_scratch ps;
+    prefix_scratch_init(&ps, mem, key_len);
+    bool success = false;
+
+    if (t->mrx.root != NULL) {
+        void **vref = mrx_find_(t->mrx.root, key, key_len);
+        if (vref != NULL) {
+            const uint32_t old_score = SCORE(*vref);
+            *vref = SCORE_VALUE(score);
+            if (score >= old_score) {
+                raise_prefix_maxes(t, key, key_len, score, &ps);
+            } else {
+                lower_prefix_maxes(t, key, key_len, old_score, &ps);
+            }
+            success = true;
+            goto out;
+        }
+    }
+
+    // Find where the new key leaves the tree. If that is within a
+    // single-child path, the rest of the path becomes a new branch.
+    unsigned diff_len = 0;
+    bool is_split = false;
+    uint8_t split_octet = 0;
+    uint32_t split_max = 0;
+    if (t->mrx.root != NULL) {
+        uint8_t branches[256];
+        unsigned br_count;
+        void **vref;
+        diff_len = common_prefix_len(t->mrx.root, key, key_len);
+        memcpy(ps.buf, key, diff_len);
+        const int node_len = trie_node(t->mrx.root, ps.buf, diff_len, branches, &br_count, &vref);
+        if ((unsigned)node_len > diff_len) {
+            is_split = true;
+            split_octet = ps.buf[diff_len];
+            split_max = trie_node_max(t, ps.buf, (unsigned)node_len, branches, br_count, vref);
+        }
+    }
+    bool is_occupied;
+    void **vref = mrx_insert_(&t->mrx, key, key_len, &is_occupied);
+    if (vref == NULL) {
+        goto out;
+    }
+    *vref = SCORE_VALUE(score);
+    void **eref;
+    if (is_split) {
+        memcpy(ps.buf, key, diff_len);
+        ps.buf[diff_len] = split_octet;
+        if ((eref = mrx_insert_(t->maxes, ps.buf, diff_len + 1, &is_occupied)) == NULL) {
+            goto fail;
+        }
+        *eref = SCORE_VALUE(split_max);
+    }
+    if (diff_len < key_len) {
+        if ((eref = mrx_insert_(t->maxes, key, diff_len + 1, &is_occupied)) == NULL) {
+            goto fail;
+        }
+        *eref = SCORE_VALUE(score);
+    }
+    raise_prefix_maxes(t, key, key_len, score, &ps);
+    success = true;
+    goto out;
+
+fail:
+    // a split entry is exact also without the new key, so it can stay
+    mrx_erase_(&t->mrx, key, key_len, &is_occupied);
+out:
+    if (!KEY_BUFFER_IS_ON_STACK(buf_size)) {
+        free(mem);
+    }
+    return success;
+}
+
+bool
+mrx_topk_find_(const mrx_topk_base_t *t,
+               const uint8_t key[],
+               const unsigned key_len,
+               uint32_t *score)
+{
+    if (t->mrx.root == NULL) {
+        return false;
+    }
+    void **vref = mrx_find_(t->mrx.root, key, key_len);
+    if (vref == NULL) {
+        return false;
+    }
+    *score = SCORE(*vref);
+    return true;
+}
+
+bool
+mrx_topk_erase_(mrx_topk_base_t *t,
+                const uint8_t key[],
+                const unsigned key_len)
+{
+    if (t->mrx.root == NULL) {
+        return false;
+    }
+    const unsigned buf_size = key_buffer_size(t, key_len);
+    const size_t mem_size = prefix_scratch_size(key_len, buf_size);
+    void *mem = KEY_BUFFER_IS_ON_STACK(buf_size) ? alloca(mem_size) : malloc(mem_size);
+    if (mem == NULL) {
+        return false;
+    }
+    struct prefix_scratch ps;
+    prefix_scratch_init(&ps, mem, key_len);
+    bool was_erased;
+    void *value = mrx_erase_(&t->mrx, key, key_len, &was_erased);
+    if (was_erased) {
+        lower_prefix_maxes(t, key, key_len, SCORE(value), &ps);
+    }
+    if (!KEY_BUFFER_IS_ON_STACK(buf_size)) {
+        free(mem);
+    }
+    return was_erased;
+}
+
+struct topk_item {
+    uint32_t score;
+    bool is_key;
+    unsigned len;
+    size_t key_pos;
+};
+
+struct topk_query {
+    const mrx_topk_base_t *t;
+    struct topk_item *heap;
+    size_t heap_len;
+    size_t heap_capacity;
+    uint8_t *keys;
+    size_t keys_len;
+    size_t keys_capacity;
+    bool out_of_memory;
+};
+
+static inline bool
+item_before(const struct topk_item *a,
+            const struct topk_item *b)
+{
+    // keys before branches of equal score, so they are reported right away
+    return a->score > b->score || (a->score == b->score && a->is_key && !b->is_key);
+}
+
+static void
+heap_push(struct topk_query *q,
+          const uint32_t score,
+          const bool is_key,
+          const uint8_t key[],
+          const unsigned len)
+{
+    if (q->heap_len == q->heap_capacity) {
+        const size_t capacity = q->heap_capacity == 0 ? 64 : 2 * q->heap_capacity;
+        struct topk_item *heap = realloc(q->heap, capacity * sizeof(*heap));
+        if (heap == NULL) {
+            q->out_of_memory = true;
+            return;
+        }
+        q->heap = heap;
+        q->heap_capacity = capacity;
+    }
+    if (q->keys_capacity - q->keys_len < len) {
+        size_t capacity = q->keys_capacity == 0 ? 1024 : 2 * q->keys_capacity;
+        if (capacity - q->keys_len < len) {
+            capacity = q->keys_len + len;
+        }
+        uint8_t *keys = realloc(q->keys, capacity);
+        if (keys == NULL) {
+            q->out_of_memory = true;
+            return;
+        }
+        q->keys = keys;
+        q->keys_capacity = capacity;
+    }
+    const struct topk_item item = {
+        .score = score,
+        .is_key = is_key,
+        .len = len,
+        .key_pos = q->keys_len
+    };
+    memcpy(&q->keys[q->keys_len], key, len);
+    q->keys_len += len;
+    size_t i = q->heap_len++;
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+        if (!item_before(&item, &q->heap[parent])) {
+            break;
+        }
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = item;
+}
+
+static struct topk_item
+heap_pop(struct topk_query *q)
+{
+    const struct topk_item top = q->heap[0];
+    const struct topk_item last = q->heap[--q->heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= q->heap_len) {
+            break;
+        }
+        if (child + 1 < q->heap_len && item_before(&q->heap[child + 1], &q->heap[child])) {
+            child++;
+        }
+        if (!item_before(&q->heap[child], &last)) {
+            break;
+        }
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    if (q->heap_len > 0) {
+        q->heap[i] = last;
+    }
+    return top;
+}
+
+static void
+expand(struct topk_query *q,
+       uint8_t key[],
+       const unsigned len)
+{
+    uint8_t branches[256];
+    unsigned br_count;
+    void **vref;
+
+    const int node_len = trie_node(q->t->mrx.root, key, len, branches, &br_count, &vref);
+    if (node_len < 0) {
+        return;
+    }
+    if (vref != NULL) {
+        heap_push(q, SCORE(*vref), true, key, (unsigned)node_len);
+    }
+    for (unsigned i = 0; i < br_count; i++) {
+        key[node_len] = branches[i];
+        const uint32_t max = SCORE(*mrx_find_(q->t->maxes->root, key, (unsigned)node_len + 1));
+        heap_push(q, max, false, key, (unsigned)node_len + 1);
+    }
+}
+
+size_t
+mrx_topk_query_(const mrx_topk_base_t *t,
+                const uint8_t prefix[],
+                const unsigned prefix_len,
+                const size_t k,
+                mrx_topk_cb_t cb,
+                void *cb_arg)
+{
+    if (t->mrx.root == NULL || k == 0) {
+        return 0;
+    }
+    const unsigned buf_size = key_buffer_size(t, prefix_len);
+    uint8_t *buf = KEY_BUFFER_IS_ON_STACK(buf_size) ? alloca(buf_size) : malloc(buf_size);
+    if (buf == NULL) {
+        return 0;
+    }
+    struct topk_query q = { .t = t };
+    size_t count = 0;
+    memcpy(buf, prefix, prefix_len);
+    expand(&q, buf, prefix_len);
+    while (count < k && q.heap_len > 0 && !q.out_of_memory) {
+        const struct topk_item item = heap_pop(&q);
+        if (item.is_key) {
+            cb(&q.keys[item.key_pos], item.len, item.score, cb_arg);
+            count++;
+        } else {
+            memcpy(buf, &q.keys[item.key_pos], item.len);
+            expand(&q, buf, item.len);
+        }
+    }
+    free(q.keys);
+    free(q.heap);
+    if (!KEY_BUFFER_IS_ON_STACK(buf_size)) {
+        free(buf);
+    }
+    return count;
+}
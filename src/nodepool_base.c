@@ -200,6 +200,34 @@ nodepool_block_to_front_(struct nodepool *nodepool,
     }
 }
 
+void
+nodepool_adopt_(struct nodepool *nodepool,
+                struct nodepool *src,
+                const size_t node_size)
+{
+    // only the head block may have a fresh part, so the fresh part of src is
+    // put on the free list of its block
+    struct nodepool_bh *bh = src->fresh_block;
+    if (bh != NULL) {
+        for (uintptr_t p = src->fresh_ptr; p != src->fresh_end; p += node_size) {
+            struct nodepool_freenode *fn = (struct nodepool_freenode *)p;
+            fn->next = bh->freelist;
+            bh->freelist = fn;
+            bh->free_count++;
+        }
+        src->fresh_block = NULL;
+    }
+
+    // insert the blocks of src after the head block
+    struct nodepool_bh *head = nodepool->blist_head;
+    struct nodepool_bh *first = src->blist_head;
+    struct nodepool_bh *last = first->prev;
+    last->next = head->next;
+    head->next->prev = last;
+    head->next = first;
+    first->prev = head;
+}
+
 void
 nodepool_allocation_stats_(struct nodepool_allocation_stats *stats,
                            struct nodepool *nodepool,
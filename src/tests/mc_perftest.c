@@ -286,6 +286,24 @@ generate_set(unsigned int set_size,
 
 #endif
 
+#ifdef PERFTEST_MRB_HINT
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrb
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#include <mrb_tmpl.h>
+
+#define TESTTYPE_NAME "mrb"
+#define TESTTYPE_INIT(base_key_count, iter_count) \
+    mrb_t *tt = mrb_new(base_key_count + iter_count + 1); \
+    mrb_it_t *hint = mrb_end()
+#define TESTTYPE_INSERT(key) hint = mrb_itinsert_hint(tt, hint, key, (void *)(uintptr_t)key)
+#define TESTTYPE_FIND(ret, key) ret = mrb_find(tt, key)
+#define TESTTYPE_ERASE(key) mrb_erase(tt, key); hint = mrb_end()
+#define TESTTYPE_DELETE() mrb_delete(tt)
+
+#endif
+
 #ifdef PERFTEST_MRB_STR
 #define STRING_KEYS 1
 #define MC_MM_MODE MC_MM_PERFORMANCE
@@ -326,6 +344,10 @@ generate_set(unsigned int set_size,
 
 #endif // PERFTEST_MHT
 
+#if defined(PERFTEST_MRX) || defined(PERFTEST_MRX_INT)
+#include <mrx_base_int.h> // for mrx_debug_memory_stats()
+#endif
+
 #ifdef PERFTEST_MRX_INT
 #define MC_MM_MODE MC_MM_PERFORMANCE
 #define MC_PREFIX mrx
@@ -344,6 +366,25 @@ generate_set(unsigned int set_size,
 
 #endif
 
+#ifdef PERFTEST_MRX_INT_HINT
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRX_KEY_SORTINT 1
+#include <mrx_tmpl.h>
+
+#define TESTTYPE_NAME "mrx"
+#define TESTTYPE_INIT(base_key_count, iter_count) \
+    mrx_t *tt = mrx_new(base_key_count + iter_count + 1); \
+    mrx_cursor_t *cursor = mrx_cursor_new(tt)
+#define TESTTYPE_INSERT(key) mrx_insert_hint(cursor, key, (void *)(uintptr_t)key)
+#define TESTTYPE_FIND(ret, key) ret = mrx_find(tt, key)
+#define TESTTYPE_ERASE(key) mrx_erase(tt, key)
+#define TESTTYPE_DELETE() mrx_cursor_delete(cursor); mrx_delete(tt)
+
+#endif
+
 #ifdef PERFTEST_MRX_INT_SLOW
 #define MC_MM_MODE MC_MM_COMPACT
 #define MC_PREFIX mrx
@@ -402,6 +443,117 @@ generate_set(unsigned int set_size,
 
 #endif
 
+#if defined(PERFTEST_MRX_LPM) || defined(PERFTEST_MRX_LPM_EXPAND)
+// IPv4 routes of length /16 to /24, like the bulk of a BGP table
+static inline unsigned
+lpm_route(uint8_t prefix[4],
+          uintptr_t key)
+{
+    const uint32_t k = (uint32_t)key;
+    prefix[0] = (uint8_t)(k >> 24);
+    prefix[1] = (uint8_t)(k >> 16);
+    prefix[2] = (uint8_t)(k >> 8);
+    prefix[3] = (uint8_t)k;
+    return 16 + (unsigned)(key % 9);
+}
+#endif
+
+#ifdef PERFTEST_MRX_LPM
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx_lpm
+#define MC_VALUE_T void *
+#include <mrx_lpm_tmpl.h>
+
+static inline void
+lpm_insert(mrx_lpm_t *tt,
+           uintptr_t key)
+{
+    uint8_t prefix[4];
+    const unsigned bit_len = lpm_route(prefix, key);
+    mrx_lpm_insert(tt, prefix, bit_len, (void *)key);
+}
+
+static inline void *
+lpm_lookup(mrx_lpm_t *tt,
+           uintptr_t key)
+{
+    uint8_t addr[4];
+    lpm_route(addr, key);
+    return mrx_lpm_lookup(tt, addr, 4, NULL);
+}
+
+static inline void
+lpm_erase(mrx_lpm_t *tt,
+          uintptr_t key)
+{
+    uint8_t prefix[4];
+    const unsigned bit_len = lpm_route(prefix, key);
+    mrx_lpm_erase(tt, prefix, bit_len);
+}
+
+#define TESTTYPE_NAME "mrx_lpm"
+#define TESTTYPE_INIT(base_key_count, iter_count) \
+    mrx_lpm_t *tt = mrx_lpm_new(base_key_count + iter_count + 1)
+#define TESTTYPE_INSERT(key) lpm_insert(tt, key)
+#define TESTTYPE_FIND(ret, key) ret = lpm_lookup(tt, key)
+#define TESTTYPE_ERASE(key) lpm_erase(tt, key)
+#define TESTTYPE_DELETE() mrx_lpm_delete(tt)
+
+#endif // PERFTEST_MRX_LPM
+
+#ifdef PERFTEST_MRX_LPM_EXPAND
+// Reference for PERFTEST_MRX_LPM: a byte-granular tree with routes expanded
+// to the next octet boundary, and lookup with mrx_findnear().
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx
+#define MC_KEY_T const uint8_t *
+#define MC_VALUE_T void *
+#define MRX_KEY_VARSIZE 1
+#include <mrx_tmpl.h>
+
+static inline void
+lpm_expand_insert(mrx_t *tt,
+                  uintptr_t key,
+                  bool is_erase)
+{
+    uint8_t prefix[4];
+    const unsigned bit_len = lpm_route(prefix, key);
+    const unsigned q = (bit_len + 7) / 8;
+    const unsigned r = bit_len % 8;
+    const unsigned n = (r == 0) ? 1 : 1u << (8 - r);
+    const uint8_t base = (r == 0) ? 0 : (uint8_t)(prefix[q - 1] & (0xFFu << (8 - r)));
+    for (unsigned i = 0; i < n; i++) {
+        if (r != 0) {
+            prefix[q - 1] = (uint8_t)(base + i);
+        }
+        if (is_erase) {
+            mrx_erase(tt, prefix, q);
+        } else {
+            mrx_insert(tt, prefix, q, (void *)key);
+        }
+    }
+}
+
+static inline void *
+lpm_expand_lookup(mrx_t *tt,
+                  uintptr_t key)
+{
+    uint8_t addr[4];
+    int match_len;
+    lpm_route(addr, key);
+    return mrx_findnear(tt, addr, 4, &match_len);
+}
+
+#define TESTTYPE_NAME "mrx prefix expansion"
+#define TESTTYPE_INIT(base_key_count, iter_count) \
+    mrx_t *tt = mrx_new(128 * (base_key_count + iter_count + 1))
+#define TESTTYPE_INSERT(key) lpm_expand_insert(tt, key, false)
+#define TESTTYPE_FIND(ret, key) ret = lpm_expand_lookup(tt, key)
+#define TESTTYPE_ERASE(key) lpm_expand_insert(tt, key, true)
+#define TESTTYPE_DELETE() mrx_delete(tt)
+
+#endif // PERFTEST_MRX_LPM_EXPAND
+
 #ifdef PERFTEST_JUDY_INT
 #include <Judy.h>
 #define TESTTYPE_NAME "Judy"
@@ -530,11 +682,15 @@ test(unsigned int ts_ohd,
     }
 
 #if defined(PERFTEST_MRX)
-    //mrx_debug_memory_stats(&tt->mrx, 0);
+    if (getenv("MC_PERFTEST_MEMORY_STATS") != NULL) {
+        mrx_debug_memory_stats(&tt->mrx, 0);
+    }
     //mrx_debug_sanity_check_str2ref(&tt->mrx);
 #endif
 #if defined(PERFTEST_MRX_INT)
-    //mrx_debug_memory_stats(&tt->mrx, sizeof(uintptr_t));
+    if (getenv("MC_PERFTEST_MEMORY_STATS") != NULL) {
+        mrx_debug_memory_stats(&tt->mrx, sizeof(uintptr_t));
+    }
     //mrx_debug_sanity_check_int2ref(&tt->mrx);
 #endif
     tsa = (uint64_t *)malloc(iter_count * sizeof(uint64_t));
@@ -146,6 +146,11 @@ main(void)
             }
             ASSERT(bit64_swap(mask) == swapped_mask);
             ASSERT(bit64_swap_generic(mask) == swapped_mask);
+#if defined(__SIZEOF_INT128__)
+            const unsigned __int128 mask128 = ((unsigned __int128)mask << 64u) | ~mask;
+            ASSERT(bit128_swap(mask128) == (((unsigned __int128)bit64_swap(~mask) << 64u) | swapped_mask));
+            ASSERT(bit128_swap(bit128_swap(mask128)) == mask128);
+#endif
 
             unsigned int count = 0;
             uint64_t masks[2] = { 0xdeadbeefdeadbeefull, mask };
@@ -11,6 +11,11 @@
 #define erase_rebalance TEST_erase_rebalance
 #define mrb_insert_node_ TEST_mrb_insert_node_
 #define mrb_erase_node_ TEST_mrb_erase_node_
+#define mrb_build_sorted_ TEST_mrb_build_sorted_
+#define mrb_join_ TEST_mrb_join_
+#define mrb_concat_ TEST_mrb_concat_
+#define mrb_split_before_ TEST_mrb_split_before_
+#define mrb_count_one_of_ TEST_mrb_count_one_of_
 #include <mrb_base.c>
 
 #include <mrb_tmpl.h>
@@ -39,6 +44,39 @@
 #define MC_KEY_T uint32_t
 #include <mrb_tmpl.h>
 
+#define MC_PREFIX mrbos
+#define MC_KEY_T intptr_t
+#define MC_VALUE_T void *
+#define MRB_ORDER_STATISTIC 1
+#include <mrb_tmpl.h>
+
+#define MC_MM_MODE MC_MM_STATIC
+#define MC_PREFIX mrboss
+#define MC_KEY_T uint32_t
+#define MC_NO_VALUE 1
+#define MRB_ORDER_STATISTIC 1
+#include <mrb_tmpl.h>
+
+#define MC_MM_MODE MC_MM_STATIC
+#define MC_PREFIX mrbs32
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRB_LINK32 1
+#include <mrb_tmpl.h>
+
+#define MC_PREFIX mrbth
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRB_THREADED 1
+#include <mrb_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrbthp
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRB_THREADED 1
+#include <mrb_tmpl.h>
+
 static uint32_t taus_state[3];
 
 static void
@@ -527,6 +565,886 @@ mrb_alt_configs(void)
     fprintf(stderr, "pass\n");
 }
 
+// Checks links, coloring and key order, returns the black height.
+static unsigned
+verify_subtree(const struct mrb_node *node,
+               const struct mrb_node *parent,
+               size_t *count)
+{
+    if (node == NULL) {
+        return 1;
+    }
+    ASSERT(parent_get(node) == parent);
+    if (is_nonnil_red(node)) {
+        ASSERT(parent != NULL && is_nonnil_black(parent));
+    }
+    for (int i = 0; i < 2; i++) {
+        if (node->child[i] != NULL) {
+            const uintptr_t ckey = ((const struct mrbp_node_kv *)node->child[i])->key;
+            const uintptr_t key = ((const struct mrbp_node_kv *)node)->key;
+            ASSERT(i == 0 ? ckey < key : ckey > key);
+        }
+    }
+    const unsigned lh = verify_subtree(left_of(node), node, count);
+    const unsigned rh = verify_subtree(right_of(node), node, count);
+    ASSERT(lh == rh);
+    (*count)++;
+    return lh + (is_nonnil_black(node) ? 1 : 0);
+}
+
+static void
+verify_tree(const struct mrb_node *root,
+            const size_t count)
+{
+    size_t n = 0;
+    ASSERT(root == NULL || is_nonnil_black(root));
+    verify_subtree(root, NULL, &n);
+    ASSERT(n == count);
+}
+
+static void
+mrb_build_tests(void)
+{
+    fprintf(stderr, "Test: mrb build from sorted input...");
+    {
+        const size_t max_size = 5000;
+        uintptr_t *keys = malloc(max_size * sizeof(keys[0]));
+        void **values = malloc(max_size * sizeof(values[0]));
+        for (size_t i = 0; i < max_size; i++) {
+            keys[i] = i * 3 + 1;
+            values[i] = (void *)(uintptr_t)(i + 1);
+        }
+        for (size_t size = 0; size < max_size; size = (size < 40) ? size + 1 : size * 3 / 2) {
+            mrbp_t *tt = mrbp_new(~0u);
+            ASSERT(mrbp_build_sorted(tt, keys, values, size) == size);
+            ASSERT(mrbp_size(tt) == size);
+            verify_tree(tt->root, size);
+            size_t i = 0;
+            for (mrbp_it_t *it = mrbp_begin(tt); it != mrbp_end(); it = mrbp_next(it)) {
+                ASSERT(mrbp_key(it) == keys[i]);
+                ASSERT(mrbp_val(it) == values[i]);
+                i++;
+            }
+            ASSERT(i == size);
+            // the tree is a normal tree afterwards
+            for (i = 0; i < size; i += 2) {
+                ASSERT(mrbp_erase(tt, keys[i]) == values[i]);
+                mrbp_insert(tt, keys[i] + 1, values[i]);
+            }
+            verify_tree(tt->root, size);
+            mrbp_delete(tt);
+        }
+
+        // same in the other memory modes
+        mrb_t *t1 = mrb_new(~0u);
+        ASSERT(mrb_build_sorted(t1, (intptr_t *)keys, values, max_size) == max_size);
+        verify_tree(t1->root, max_size);
+        ASSERT(mrb_find(t1, (intptr_t)keys[1234]) == values[1234]);
+        mrb_delete(t1);
+        mrbs_t *t2 = mrbs_new(1000);
+        ASSERT(mrbs_build_sorted(t2, keys, values, max_size) == 1000);
+        verify_tree(t2->root, 1000);
+        ASSERT(mrbs_find(t2, keys[999]) == values[999]);
+        ASSERT(mrbs_find(t2, keys[1000]) == NULL);
+        mrbs_delete(t2);
+
+        // unsorted, duplicates or a non-empty tree fall back to insert
+        mrbp_t *tt = mrbp_new(~0u);
+        keys[10] = keys[9];
+        ASSERT(mrbp_build_sorted(tt, keys, values, 100) == 99);
+        verify_tree(tt->root, 99);
+        ASSERT(mrbp_find(tt, keys[9]) == values[10]);
+        keys[10] = 10 * 3 + 1;
+        ASSERT(mrbp_build_sorted(tt, &keys[100], &values[100], 100) == 199);
+        verify_tree(tt->root, 199);
+        mrbp_delete(tt);
+
+        // copied keys
+        const char *skeys[] = { "a", "ab", "b", "c" };
+        strset_t *ss = strset_new(~0u);
+        ASSERT(strset_build_sorted(ss, skeys, 4) == 4);
+        ASSERT(strcmp(strset_key(strset_begin(ss)), "a") == 0);
+        ASSERT(strset_key(strset_begin(ss)) != skeys[0]);
+        ASSERT(strcmp(strset_key(strset_rbegin(ss)), "c") == 0);
+        strset_delete(ss);
+        free(keys);
+        free(values);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+// Checks that the tree holds the keys first, first + step ... below last.
+static void
+verify_keys(mrb_t *tt,
+            intptr_t first,
+            intptr_t last,
+            intptr_t step)
+{
+    verify_tree(tt->root, mrb_size(tt));
+    for (mrb_it_t *it = mrb_begin(tt); it != mrb_end(); it = mrb_next(it)) {
+        ASSERT(mrb_key(it) == first);
+        ASSERT(mrb_val(it) == (void *)(first + 1));
+        first += step;
+    }
+    ASSERT(first >= last);
+}
+
+static void
+mrb_split_merge_tests(void)
+{
+    fprintf(stderr, "Test: mrb split, extract range and merge...");
+    for (int mode = 0; mode < 2; mode++) {
+        for (intptr_t size = 0; size < 3000; size = (size < 40) ? size + 1 : size * 3 / 2) {
+            // random insertion order so the trees are not perfectly balanced
+            mrb_t *tt = mrb_new(~0u);
+            for (intptr_t i = 0; i < size; i++) {
+                const intptr_t key = (intptr_t)(tausrand(taus_state) % (unsigned)size) * 2;
+                mrb_insert(tt, key, (void *)(key + 1));
+            }
+            for (intptr_t i = 0; i < size; i++) {
+                mrb_insert(tt, i * 2, (void *)(i * 2 + 1));
+            }
+            verify_keys(tt, 0, size * 2, 2);
+            for (int k = 0; k < 10; k++) {
+                const intptr_t first = (intptr_t)(tausrand(taus_state) % (unsigned)(size * 2 + 3)) - 1;
+                const intptr_t last = first + (intptr_t)(tausrand(taus_state) % (unsigned)(size * 2 + 3));
+                mrb_t *dst = mrb_new(~0u);
+                if (mode == 0) {
+                    ASSERT(mrb_split(tt, first, dst));
+                    verify_keys(tt, 0, first < size * 2 ? first : size * 2, 2);
+                    verify_keys(dst, first <= 0 ? 0 : (first + 1) / 2 * 2, size * 2, 2);
+                    ASSERT(mrb_size(tt) + mrb_size(dst) == (size_t)size);
+                } else {
+                    ASSERT(mrb_extract_range(tt, first, last, dst));
+                    verify_tree(tt->root, mrb_size(tt));
+                    verify_keys(dst, first <= 0 ? 0 : (first + 1) / 2 * 2, last < size * 2 ? last : size * 2, 2);
+                    for (mrb_it_t *it = mrb_begin(tt); it != mrb_end(); it = mrb_next(it)) {
+                        ASSERT(mrb_key(it) < first || mrb_key(it) >= last);
+                    }
+                }
+                if (!mrb_empty(dst)) {
+                    ASSERT(!mrb_split(tt, 0, dst));
+                }
+                // disjoint ranges are joined, in either order
+                if (k % 2 == 0) {
+                    ASSERT(mrb_merge(tt, dst));
+                    ASSERT(mrb_empty(dst));
+                } else {
+                    ASSERT(mrb_merge(dst, tt));
+                    ASSERT(mrb_empty(tt));
+                    mrb_t *tmp = tt;
+                    tt = dst;
+                    dst = tmp;
+                }
+                verify_keys(tt, 0, size * 2, 2);
+                ASSERT(mrb_size(tt) == (size_t)size);
+                mrb_delete(dst);
+            }
+            mrb_delete(tt);
+        }
+    }
+
+    // base join of trees of different black heights
+    for (intptr_t size = 1; size < 300; size += 7) {
+        mrb_t *t1 = mrb_new(~0u);
+        mrb_t *t2 = mrb_new(~0u);
+        for (intptr_t i = 0; i < size; i++) {
+            mrb_insert(t1, i, (void *)(i + 1));
+        }
+        for (intptr_t i = 0; i < 300 - size; i++) {
+            mrb_insert(t2, 1001 + i, (void *)(1002 + i));
+        }
+        mrb_insert(t2, 1000, (void *)1001);
+        struct mrb_node *k = (struct mrb_node *)mrb_begin(t2);
+        TEST_mrb_erase_node_(&t2->root, k);
+        t1->root = TEST_mrb_join_(t1->root, k, t2->root);
+        verify_tree(t1->root, 301);
+        ASSERT(TEST_mrb_count_one_of_(t1->root, NULL, 301) == 301);
+        ASSERT(TEST_mrb_count_one_of_(NULL, t1->root, 301) == 0);
+        t1->count = 301;
+        t2->root = NULL;
+        t2->count = 0;
+        mrb_delete(t1);
+        mrb_delete(t2);
+    }
+
+    // dst capacity, compact mode keeps the tree untouched
+    {
+        mrb_t *tt = mrb_new(~0u);
+        mrb_t *dst = mrb_new(5);
+        for (intptr_t i = 0; i < 100; i++) {
+            mrb_insert(tt, i, (void *)(i + 1));
+        }
+        ASSERT(!mrb_extract_range(tt, 10, 20, dst));
+        ASSERT(!mrb_split(tt, 94, dst));
+        verify_keys(tt, 0, 100, 1);
+        ASSERT(mrb_size(tt) == 100);
+        ASSERT(mrb_extract_range(tt, 10, 15, dst));
+        ASSERT(mrb_size(tt) == 95);
+        verify_keys(dst, 10, 15, 1);
+        ASSERT(!mrb_split(tt, 50, dst));
+        mrb_delete(dst);
+        mrb_delete(tt);
+    }
+
+    // pooled modes move entries to nodes of the destination pool
+    {
+        mrbp_t *tp = mrbp_new(~0u);
+        mrbp_t *dp = mrbp_new(~0u);
+        for (uintptr_t i = 0; i < 1000; i++) {
+            mrbp_insert(tp, i, (void *)(i + 1));
+        }
+        ASSERT(mrbp_split(tp, 500, dp));
+        ASSERT(mrbp_size(tp) == 500 && mrbp_size(dp) == 500);
+        verify_tree(tp->root, 500);
+        verify_tree(dp->root, 500);
+        ASSERT(mrbp_key(mrbp_begin(dp)) == 500);
+        // overlapping merge, values of src replace those in dst
+        mrbp_insert(tp, 700, (void *)7);
+        ASSERT(mrbp_merge(dp, tp));
+        ASSERT(mrbp_empty(tp));
+        verify_tree(dp->root, 1000);
+        ASSERT(mrbp_find(dp, 700) == (void *)7);
+        ASSERT(mrbp_find(dp, 499) == (void *)500);
+        // into an empty tree the new nodes are linked in one pass
+        ASSERT(mrbp_merge(tp, dp));
+        ASSERT(mrbp_empty(dp) && mrbp_size(tp) == 1000);
+        verify_tree(tp->root, 1000);
+        ASSERT(mrbp_find(tp, 700) == (void *)7);
+        ASSERT(mrbp_key(mrbp_rbegin(tp)) == 999);
+        mrbp_delete(tp);
+        mrbp_delete(dp);
+
+        mrbs_t *ts = mrbs_new(100);
+        mrbs_t *ds = mrbs_new(10);
+        for (uintptr_t i = 0; i < 100; i++) {
+            mrbs_insert(ts, i, (void *)(i + 1));
+        }
+        ASSERT(!mrbs_extract_range(ts, 0, 11, ds));
+        ASSERT(mrbs_size(ts) == 100 && mrbs_empty(ds));
+        ASSERT(mrbs_extract_range(ts, 20, 30, ds));
+        ASSERT(mrbs_size(ts) == 90 && mrbs_size(ds) == 10);
+        verify_tree(ts->root, 90);
+        verify_tree(ds->root, 10);
+        ASSERT(mrbs_find(ds, 29) == (void *)30);
+        ASSERT(mrbs_find(ts, 29) == NULL);
+        ASSERT(mrbs_merge(ts, ds));
+        verify_tree(ts->root, 100);
+        // an empty tree that is too small takes what fits, one by one
+        ASSERT(!mrbs_merge(ds, ts));
+        ASSERT(mrbs_size(ds) == 10 && mrbs_size(ts) == 90);
+        verify_tree(ts->root, 90);
+        verify_tree(ds->root, 10);
+        mrbs_delete(ts);
+        mrbs_delete(ds);
+    }
+
+    // owned keys are moved, not copied
+    {
+        strset_t *ss = strset_new(~0u);
+        strset_t *ds = strset_new(~0u);
+        strset_insert(ss, "a");
+        strset_insert(ss, "b");
+        strset_insert(ss, "c");
+        const char *b = strset_key(strset_itfind(ss, "b"));
+        ASSERT(strset_split(ss, "b", ds));
+        ASSERT(strset_size(ss) == 1 && strset_size(ds) == 2);
+        ASSERT(strset_key(strset_begin(ds)) == b);
+        strset_insert(ss, "c");
+        ASSERT(strset_merge(ds, ss));
+        ASSERT(strset_size(ds) == 3);
+        ASSERT(strcmp(strset_key(strset_rbegin(ds)), "c") == 0);
+        strset_delete(ss);
+        strset_delete(ds);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+// Checks parent links and subtree sizes, returns the size.
+static size_t
+verify_os_subtree(const struct mrb_node *node,
+                  const struct mrb_node *parent)
+{
+    if (node == NULL) {
+        return 0;
+    }
+    ASSERT(parent_get(node) == parent);
+    const size_t size = verify_os_subtree(left_of(node), node) + verify_os_subtree(right_of(node), node) + 1;
+    ASSERT(mrb_os_size_(node) == size);
+    return size;
+}
+
+static void
+mrb_order_statistic_tests(void)
+{
+    fprintf(stderr, "Test: mrb order statistic...");
+    {
+        ASSERT(sizeof(struct mrbos_node_kv) == sizeof(struct mrb_node_kv) + sizeof(uintptr_t));
+        const intptr_t key_range = 2000;
+        char *present = calloc((size_t)key_range, 1);
+        mrbos_t *tt = mrbos_new(~0u);
+        for (int i = 0; i < 20000; i++) {
+            const intptr_t key = (intptr_t)(tausrand(taus_state) % (unsigned)key_range);
+            if (tausrand(taus_state) % 3 == 0) {
+                mrbos_erase(tt, key);
+                present[key] = 0;
+            } else {
+                mrbos_insert(tt, key, (void *)(key + 1));
+                present[key] = 1;
+            }
+            if (i % 1000 != 0) {
+                continue;
+            }
+            ASSERT(verify_os_subtree(tt->root, NULL) == mrbos_size(tt));
+            size_t rank = 0;
+            for (intptr_t k = 0; k < key_range; k++) {
+                ASSERT(mrbos_rank(tt, k) == rank);
+                if (present[k]) {
+                    mrbos_it_t *it = mrbos_select(tt, rank);
+                    ASSERT(mrbos_key(it) == k);
+                    ASSERT(mrbos_itrank(it) == rank);
+                    rank++;
+                }
+            }
+            ASSERT(rank == mrbos_size(tt));
+            ASSERT(mrbos_select(tt, rank) == mrbos_end());
+            ASSERT(mrbos_count_range(tt, 0, key_range) == rank);
+            ASSERT(mrbos_count_range(tt, key_range, 0) == 0);
+        }
+
+        // sizes survive split, extract range, merge and build
+        const size_t size = mrbos_size(tt);
+        mrbos_t *dst = mrbos_new(~0u);
+        ASSERT(mrbos_split(tt, key_range / 3, dst));
+        ASSERT(mrbos_size(tt) == mrbos_rank(tt, key_range) && mrbos_size(tt) + mrbos_size(dst) == size);
+        ASSERT(verify_os_subtree(tt->root, NULL) == mrbos_size(tt));
+        ASSERT(verify_os_subtree(dst->root, NULL) == mrbos_size(dst));
+        ASSERT(mrbos_merge(tt, dst));
+        ASSERT(verify_os_subtree(tt->root, NULL) == size);
+        ASSERT(mrbos_extract_range(tt, 100, 1100, dst));
+        ASSERT(verify_os_subtree(tt->root, NULL) == mrbos_size(tt));
+        ASSERT(verify_os_subtree(dst->root, NULL) == mrbos_size(dst));
+        ASSERT(mrbos_count_range(tt, 100, 1100) == 0);
+        ASSERT(mrbos_size(dst) == mrbos_count_range(dst, 0, key_range));
+        ASSERT(mrbos_merge(dst, tt));
+        ASSERT(verify_os_subtree(dst->root, NULL) == size);
+        mrbos_delete(dst);
+        mrbos_clear(tt);
+        intptr_t keys[100];
+        void *values[100];
+        for (int i = 0; i < 100; i++) {
+            keys[i] = i * 2;
+            values[i] = NULL;
+        }
+        ASSERT(mrbos_build_sorted(tt, keys, values, 100) == 100);
+        ASSERT(verify_os_subtree(tt->root, NULL) == 100);
+        ASSERT(mrbos_rank(tt, 101) == 51);
+        ASSERT(mrbos_key(mrbos_select(tt, 99)) == 198);
+        mrbos_delete(tt);
+        free(present);
+
+        mrboss_t *ts = mrboss_new(100);
+        for (uint32_t i = 0; i < 100; i++) {
+            mrboss_insert(ts, 99 - i);
+        }
+        mrboss_insert(ts, 1000);
+        ASSERT(mrboss_size(ts) == 100);
+        for (uint32_t i = 0; i < 100; i += 2) {
+            mrboss_erase(ts, i);
+        }
+        ASSERT(verify_os_subtree(ts->root, NULL) == 50);
+        ASSERT(mrboss_key(mrboss_select(ts, 10)) == 21);
+        ASSERT(mrboss_count_range(ts, 10, 20) == 5);
+        mrboss_t *ds = mrboss_new(100);
+        ASSERT(mrboss_extract_range(ts, 10, 30, ds));
+        ASSERT(verify_os_subtree(ts->root, NULL) == 40);
+        ASSERT(verify_os_subtree(ds->root, NULL) == 10);
+        ASSERT(mrboss_key(mrboss_select(ds, 3)) == 17);
+        ASSERT(mrboss_count_range(ts, 0, 100) == 40);
+        mrboss_delete(ds);
+        mrboss_delete(ts);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static void
+mrb_hint_tests(void)
+{
+    fprintf(stderr, "Test: mrb insert with hint...");
+    {
+        // ascending and descending runs with the previous entry as hint
+        mrbp_t *tt = mrbp_new(~0u);
+        mrbp_it_t *hint = mrbp_end();
+        for (uintptr_t i = 1000; i < 2000; i++) {
+            hint = mrbp_itinsert_hint(tt, hint, i, (void *)(i + 1));
+            ASSERT(mrbp_key(hint) == i);
+        }
+        hint = mrbp_begin(tt);
+        for (uintptr_t i = 999; i > 0; i--) {
+            hint = mrbp_itinsert_hint(tt, hint, i, (void *)(i + 1));
+            ASSERT(mrbp_key(hint) == i);
+        }
+        verify_tree(tt->root, 1999);
+        uintptr_t key = 1;
+        for (mrbp_it_t *it = mrbp_begin(tt); it != mrbp_end(); it = mrbp_next(it)) {
+            ASSERT(mrbp_key(it) == key && mrbp_val(it) == (void *)(key + 1));
+            key++;
+        }
+        // existing key replaces the value
+        hint = mrbp_itinsert_hint(tt, mrbp_itfind(tt, 500), 500, (void *)7);
+        ASSERT(mrbp_key(hint) == 500 && mrbp_val(hint) == (void *)7);
+        ASSERT(mrbp_itinsert_hint(tt, mrbp_end(), 1500, (void *)8) == mrbp_itfind(tt, 1500));
+        ASSERT(mrbp_find(tt, 1500) == (void *)8);
+        ASSERT(mrbp_size(tt) == 1999);
+        mrbp_delete(tt);
+
+        // random hints, right or wrong
+        for (int round = 0; round < 20; round++) {
+            tt = mrbp_new(~0u);
+            char present[500] = { 0 };
+            size_t count = 0;
+            hint = mrbp_end();
+            for (int i = 0; i < 400; i++) {
+                key = tausrand(taus_state) % 500;
+                if (tausrand(taus_state) % 4 == 0) {
+                    hint = mrbp_end();
+                } else if (tausrand(taus_state) % 2 == 0) {
+                    hint = mrbp_itfindnear(tt, key);
+                }
+                hint = mrbp_itinsert_hint(tt, hint, key, (void *)(key + 1));
+                ASSERT(mrbp_key(hint) == key);
+                if (!present[key]) {
+                    present[key] = 1;
+                    count++;
+                }
+            }
+            verify_tree(tt->root, count);
+            for (key = 0; key < 500; key++) {
+                ASSERT(mrbp_find(tt, key) == (present[key] ? (void *)(key + 1) : NULL));
+            }
+            mrbp_delete(tt);
+        }
+
+        // full tree
+        mrbs_t *ts = mrbs_new(3);
+        mrbs_it_t *hs = mrbs_end();
+        for (uintptr_t i = 0; i < 3; i++) {
+            hs = mrbs_itinsert_hint(ts, hs, i, NULL);
+        }
+        ASSERT(mrbs_itinsert_hint(ts, hs, 3, NULL) == NULL);
+        ASSERT(mrbs_itinsert_hint(ts, hs, 2, (void *)1) == hs);
+        mrbs_delete(ts);
+
+        // order statistic sizes are kept
+        mrbos_t *to = mrbos_new(~0u);
+        mrbos_it_t *ho = mrbos_end();
+        for (intptr_t i = 0; i < 100; i++) {
+            ho = mrbos_itinsert_hint(to, ho, i, NULL);
+        }
+        ASSERT(verify_os_subtree(to->root, NULL) == 100);
+        ASSERT(mrbos_itrank(ho) == 99);
+        mrbos_delete(to);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static void
+mrb_range_tests(void)
+{
+    fprintf(stderr, "Test: mrb lower/upper bound and erase range...");
+    {
+        mrbp_t *tt = mrbp_new(~0u);
+        ASSERT(mrbp_itlower_bound(tt, 5) == mrbp_end());
+        ASSERT(mrbp_itupper_bound(tt, 5) == mrbp_end());
+        for (uintptr_t i = 10; i < 1000; i += 10) {
+            mrbp_insert(tt, i, (void *)(i + 1));
+        }
+        for (uintptr_t k = 0; k < 1010; k++) {
+            mrbp_it_t *lb = mrbp_itlower_bound(tt, k);
+            mrbp_it_t *ub = mrbp_itupper_bound(tt, k);
+            const uintptr_t lk = (k + 9) / 10 * 10;
+            const uintptr_t uk = (k / 10 + 1) * 10;
+            ASSERT(lk >= 1000 ? lb == mrbp_end() : mrbp_key(lb) == (lk == 0 ? 10 : lk));
+            ASSERT(uk >= 1000 ? ub == mrbp_end() : mrbp_key(ub) == uk);
+        }
+        mrbp_delete(tt);
+
+        // short and long ranges, in the middle and at the ends
+        for (int round = 0; round < 200; round++) {
+            const uintptr_t size = 1 + tausrand(taus_state) % 2000;
+            uintptr_t first = tausrand(taus_state) % (size + 1);
+            uintptr_t last = first + tausrand(taus_state) % (round % 2 == 0 ? 20 : size + 1);
+            tt = mrbp_new(~0u);
+            for (uintptr_t i = 0; i < size; i++) {
+                mrbp_insert(tt, tausrand(taus_state) % size, NULL);
+            }
+            for (uintptr_t i = 0; i < size; i++) {
+                mrbp_insert(tt, i, (void *)(i + 1));
+            }
+            mrbp_it_t *last_it = mrbp_itlower_bound(tt, last);
+            ASSERT(mrbp_erase_range(tt, mrbp_itlower_bound(tt, first), last_it) == last_it);
+            if (last > size) {
+                last = size;
+            }
+            ASSERT(mrbp_size(tt) == size - (last - first));
+            verify_tree(tt->root, size - (last - first));
+            for (uintptr_t i = 0; i < size; i++) {
+                ASSERT(mrbp_find(tt, i) == ((i >= first && i < last) ? NULL : (void *)(i + 1)));
+            }
+            mrbp_delete(tt);
+        }
+
+        // owned keys are freed, order statistic sizes are kept
+        str2ref_t *ts = str2ref_new(~0u);
+        char key[16];
+        for (int i = 0; i < 100; i++) {
+            sprintf(key, "%03d", i);
+            str2ref_insert(ts, key, NULL);
+        }
+        str2ref_erase_range(ts, str2ref_itlower_bound(ts, "010"), str2ref_itupper_bound(ts, "089"));
+        ASSERT(str2ref_size(ts) == 20);
+        ASSERT(strcmp(str2ref_key(str2ref_itupper_bound(ts, "009")), "090") == 0);
+        str2ref_delete(ts);
+        mrbos_t *to = mrbos_new(~0u);
+        for (intptr_t i = 0; i < 1000; i++) {
+            mrbos_insert(to, i, NULL);
+        }
+        ASSERT(mrbos_erase_range(to, mrbos_select(to, 100), mrbos_end()) == mrbos_end());
+        ASSERT(mrbos_size(to) == 100);
+        ASSERT(verify_os_subtree(to->root, NULL) == 100);
+        mrbos_delete(to);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+// As verify_subtree, for 32-bit links.
+static unsigned
+verify_link32_subtree(const struct mrb_node32 *node,
+                      const struct mrb_node32 *parent,
+                      size_t *count)
+{
+    if (node == NULL) {
+        return 1;
+    }
+    const bool is_black = (node->parent_n_color & MRB_IS_BLACK_BIT) != 0;
+    ASSERT(mrb32_parent_get_(node) == parent);
+    if (!is_black) {
+        ASSERT(parent != NULL && (parent->parent_n_color & MRB_IS_BLACK_BIT) != 0);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (node->child[i] != 0) {
+            const uintptr_t ckey = ((const struct mrbs32_node_kv *)mrb32_child_get_(node, i))->key;
+            const uintptr_t key = ((const struct mrbs32_node_kv *)node)->key;
+            ASSERT(i == 0 ? ckey < key : ckey > key);
+        }
+    }
+    const unsigned lh = verify_link32_subtree(mrb32_child_get_(node, 0), node, count);
+    const unsigned rh = verify_link32_subtree(mrb32_child_get_(node, 1), node, count);
+    ASSERT(lh == rh);
+    (*count)++;
+    return lh + (is_black ? 1 : 0);
+}
+
+static void
+verify_link32_tree(mrbs32_t *tt)
+{
+    size_t n = 0;
+    ASSERT(tt->root == NULL || (tt->root->parent_n_color & MRB_IS_BLACK_BIT) != 0);
+    verify_link32_subtree(tt->root, NULL, &n);
+    ASSERT(n == mrbs32_size(tt));
+}
+
+static void
+mrb_link32_tests(void)
+{
+    fprintf(stderr, "Test: mrb with 32-bit links...");
+    {
+        ASSERT(sizeof(struct mrbs32_node_kv) < sizeof(struct mrbs_node_kv));
+
+        // offsets are 32 bit, so the node array is limited to INT32_MAX bytes
+        const size_t max_nodes = INT32_MAX / sizeof(struct mrbs32_node_kv);
+        ASSERT(mrbs32_new(max_nodes + 1) == NULL);
+        mrbs32_t big_;
+        struct mrbs32_node_kv big_node;
+        ASSERT(mrbs32_max_size(mrbs32_init(&big_, &big_node, (size_t)INT32_MAX + 4096)) == max_nodes);
+
+        const int test_size = 3000;
+        void **kv = calloc(test_size, sizeof(*kv));
+        mrbs32_t tt_;
+        struct mrbs32_node_kv *tt_nodes = calloc(test_size, sizeof(*tt_nodes));
+        mrbs32_t *tt = mrbs32_init(&tt_, tt_nodes, test_size * sizeof(*tt_nodes));
+
+        // random inserts and erases compared with a plain array
+        for (int i = 0; i < 20000; i++) {
+            const uintptr_t key = tausrand(taus_state) % test_size;
+            if (tausrand(taus_state) % 3 == 0) {
+                ASSERT(mrbs32_erase(tt, key) == kv[key]);
+                kv[key] = NULL;
+            } else {
+                kv[key] = (void *)(key + 1);
+                ASSERT(mrbs32_insert(tt, key, kv[key]) != NULL);
+            }
+            if (i % 1000 == 0) {
+                verify_link32_tree(tt);
+            }
+        }
+        verify_link32_tree(tt);
+        uintptr_t k = 0;
+        for (mrbs32_it_t *it = mrbs32_begin(tt); it != mrbs32_end(); it = mrbs32_next(it)) {
+            while (kv[k] == NULL) {
+                k++;
+            }
+            ASSERT(mrbs32_key(it) == k && mrbs32_val(it) == kv[k]);
+            k++;
+        }
+        k = test_size;
+        for (mrbs32_it_t *it = mrbs32_rbegin(tt); it != mrbs32_rend(); it = mrbs32_prev(it)) {
+            do {
+                k--;
+            } while (kv[k] == NULL);
+            ASSERT(mrbs32_key(it) == k);
+        }
+
+        // range erase and removal of the rest through iterase
+        mrbs32_erase_range(tt, mrbs32_itlower_bound(tt, 100), mrbs32_itlower_bound(tt, 2000));
+        verify_link32_tree(tt);
+        for (uintptr_t i = 0; i < (uintptr_t)test_size; i++) {
+            ASSERT(mrbs32_find(tt, i) == ((i >= 100 && i < 2000) ? NULL : kv[i]));
+        }
+        mrbs32_it_t *it = mrbs32_begin(tt);
+        while (it != mrbs32_end()) {
+            it = mrbs32_iterase(tt, it);
+        }
+        ASSERT(mrbs32_empty(tt));
+
+        // sorted build, hinted inserts, split and merge
+        uintptr_t keys[1000];
+        void *values[1000];
+        for (uintptr_t i = 0; i < 1000; i++) {
+            keys[i] = i * 2;
+            values[i] = (void *)(i + 1);
+        }
+        ASSERT(mrbs32_build_sorted(tt, keys, values, 1000) == 1000);
+        verify_link32_tree(tt);
+        it = mrbs32_end();
+        for (uintptr_t i = 2000; i < 2500; i++) {
+            it = mrbs32_itinsert_hint(tt, it, i, NULL);
+            ASSERT(mrbs32_key(it) == i);
+            it = mrbs32_next(it);
+        }
+        for (uintptr_t i = 1; i < 200; i += 2) {
+            ASSERT(mrbs32_key(mrbs32_itinsert_hint(tt, mrbs32_itfind(tt, i + 1), i, NULL)) == i);
+        }
+        verify_link32_tree(tt);
+        ASSERT(mrbs32_size(tt) == 1600);
+        mrbs32_t dst_;
+        struct mrbs32_node_kv *dst_nodes = calloc(test_size, sizeof(*dst_nodes));
+        mrbs32_t *dst = mrbs32_init(&dst_, dst_nodes, test_size * sizeof(*dst_nodes));
+        ASSERT(mrbs32_split(tt, 1000, dst));
+        verify_link32_tree(tt);
+        verify_link32_tree(dst);
+        ASSERT(mrbs32_size(tt) == 600 && mrbs32_size(dst) == 1000);
+        ASSERT(mrbs32_key(mrbs32_begin(dst)) == 1000);
+        ASSERT(mrbs32_merge(tt, dst));
+        verify_link32_tree(tt);
+        ASSERT(mrbs32_size(tt) == 1600 && mrbs32_empty(dst));
+        ASSERT(mrbs32_merge(dst, tt));
+        verify_link32_tree(dst);
+        ASSERT(mrbs32_size(dst) == 1600 && mrbs32_empty(tt));
+        free(dst_nodes);
+        free(tt_nodes);
+        free(kv);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+// Checks the tree as verify_subtree, and that each link without a child is
+// a thread to the neighbor in key order. The nodes are collected in order.
+static unsigned
+verify_threaded_subtree(struct mrb_node *node,
+                        const struct mrb_node *parent,
+                        struct mrb_node **nodes,
+                        size_t *count)
+{
+    if (node == NULL) {
+        return 1;
+    }
+    const bool is_black = (node->parent_n_color & MRB_IS_BLACK_BIT) != 0;
+    ASSERT(mrb_parent_get_(node) == parent);
+    if (!is_black) {
+        ASSERT(parent != NULL && (parent->parent_n_color & MRB_IS_BLACK_BIT) != 0);
+    }
+    const unsigned lh = verify_threaded_subtree(mrb_th_child_get_(node, 0), node, nodes, count);
+    if (*count > 0) {
+        ASSERT(((const struct mrbth_node_kv *)nodes[*count - 1])->key <
+               ((const struct mrbth_node_kv *)node)->key);
+    }
+    nodes[(*count)++] = node;
+    const unsigned rh = verify_threaded_subtree(mrb_th_child_get_(node, 1), node, nodes, count);
+    ASSERT(lh == rh);
+    return lh + (is_black ? 1 : 0);
+}
+
+static void
+verify_threaded_tree(struct mrb_node *root,
+                     const size_t count)
+{
+    struct mrb_node **nodes = calloc(count + 1, sizeof(*nodes));
+    size_t n = 0;
+    ASSERT(root == NULL || (root->parent_n_color & MRB_IS_BLACK_BIT) != 0);
+    verify_threaded_subtree(root, NULL, nodes, &n);
+    ASSERT(n == count);
+    for (size_t i = 0; i < n; i++) {
+        if (mrb_th_is_thread_(nodes[i], 0)) {
+            ASSERT(mrb_th_neighbor_get_(nodes[i], 0) == (i == 0 ? NULL : nodes[i - 1]));
+        }
+        if (mrb_th_is_thread_(nodes[i], 1)) {
+            ASSERT(mrb_th_neighbor_get_(nodes[i], 1) == (i + 1 == n ? NULL : nodes[i + 1]));
+        }
+        ASSERT(mrbth_next((mrbth_it_t *)nodes[i]) == (mrbth_it_t *)(i + 1 == n ? NULL : nodes[i + 1]));
+        ASSERT(mrbth_prev((mrbth_it_t *)nodes[i]) == (mrbth_it_t *)(i == 0 ? NULL : nodes[i - 1]));
+    }
+    free(nodes);
+}
+
+static void
+mrb_threaded_tests(void)
+{
+    fprintf(stderr, "Test: threaded mrb...");
+    {
+        ASSERT(sizeof(struct mrbth_node_kv) == sizeof(struct mrbp_node_kv));
+
+        // random inserts and erases compared with a plain array
+        const uintptr_t test_size = 2000;
+        void **kv = calloc(test_size, sizeof(*kv));
+        mrbth_t *tt = mrbth_new(~0u);
+        mrbthp_t *tp = mrbthp_new(~0u);
+        for (int i = 0; i < 20000; i++) {
+            const uintptr_t key = tausrand(taus_state) % test_size;
+            if (tausrand(taus_state) % 3 == 0) {
+                ASSERT(mrbth_erase(tt, key) == kv[key]);
+                ASSERT(mrbthp_erase(tp, key) == kv[key]);
+                kv[key] = NULL;
+            } else {
+                kv[key] = (void *)(key + 1);
+                ASSERT(mrbth_insert(tt, key, kv[key]) != NULL);
+                ASSERT(mrbthp_insert(tp, key, kv[key]) != NULL);
+            }
+            if (i % 1000 == 0) {
+                verify_threaded_tree(tt->root, mrbth_size(tt));
+                verify_threaded_tree(tp->root, mrbthp_size(tp));
+            }
+        }
+        verify_threaded_tree(tt->root, mrbth_size(tt));
+        uintptr_t k = 0;
+        for (mrbth_it_t *it = mrbth_begin(tt); it != mrbth_end(); it = mrbth_next(it)) {
+            while (kv[k] == NULL) {
+                k++;
+            }
+            ASSERT(mrbth_key(it) == k && mrbth_val(it) == kv[k]);
+            k++;
+        }
+        mrbth_it_t *it = mrbth_begin(tt);
+        while (it != mrbth_end()) {
+            it = mrbth_iterase(tt, it);
+            if (mrbth_size(tt) % 100 == 0) {
+                verify_threaded_tree(tt->root, mrbth_size(tt));
+            }
+        }
+        ASSERT(mrbth_empty(tt));
+        mrbthp_clear(tp);
+        free(kv);
+
+        // sorted build and hinted inserts
+        uintptr_t keys[1000];
+        void *values[1000];
+        for (uintptr_t i = 0; i < 1000; i++) {
+            keys[i] = i * 2;
+            values[i] = (void *)(i + 1);
+        }
+        for (size_t n = 0; n <= 1000; n += 37) {
+            ASSERT(mrbth_build_sorted(tt, keys, values, n) == n);
+            verify_threaded_tree(tt->root, n);
+            mrbth_clear(tt);
+        }
+        ASSERT(mrbth_build_sorted(tt, keys, values, 1000) == 1000);
+        it = mrbth_end();
+        for (uintptr_t i = 2000; i < 2500; i++) {
+            it = mrbth_itinsert_hint(tt, it, i, NULL);
+            it = mrbth_next(it);
+        }
+        for (uintptr_t i = 1; i < 200; i += 2) {
+            ASSERT(mrbth_key(mrbth_itinsert_hint(tt, mrbth_itfind(tt, i + 1), i, NULL)) == i);
+        }
+        verify_threaded_tree(tt->root, 1600);
+
+        // split, extract range and merge through the base join and split
+        for (int round = 0; round < 50; round++) {
+            const uintptr_t first = tausrand(taus_state) % 2600;
+            const uintptr_t last = first + tausrand(taus_state) % 600;
+            mrbth_t *dst = mrbth_new(~0u);
+            if (round % 2 == 0) {
+                ASSERT(mrbth_split(tt, first, dst));
+            } else {
+                ASSERT(mrbth_extract_range(tt, first, last, dst));
+            }
+            verify_threaded_tree(tt->root, mrbth_size(tt));
+            verify_threaded_tree(dst->root, mrbth_size(dst));
+            ASSERT(mrbth_size(tt) + mrbth_size(dst) == 1600);
+            ASSERT(mrbth_merge(tt, dst));
+            verify_threaded_tree(tt->root, 1600);
+            mrbth_delete(dst);
+        }
+        // the same in pooled mode, where the entries get new nodes
+        for (it = mrbth_begin(tt); it != mrbth_end(); it = mrbth_next(it)) {
+            mrbthp_insert(tp, mrbth_key(it), NULL);
+        }
+        for (int round = 0; round < 20; round++) {
+            const uintptr_t first = tausrand(taus_state) % 2600;
+            const uintptr_t last = first + tausrand(taus_state) % 600;
+            mrbthp_t *dst = mrbthp_new(~0u);
+            if (round % 2 == 0) {
+                ASSERT(mrbthp_split(tp, first, dst));
+            } else {
+                ASSERT(mrbthp_extract_range(tp, first, last, dst));
+            }
+            verify_threaded_tree(tp->root, mrbthp_size(tp));
+            verify_threaded_tree(dst->root, mrbthp_size(dst));
+            ASSERT(mrbthp_size(tp) + mrbthp_size(dst) == 1600);
+            if (round % 4 < 2) {
+                ASSERT(mrbthp_merge(tp, dst));
+                verify_threaded_tree(tp->root, 1600);
+            } else {
+                ASSERT(mrbthp_merge(dst, tp));
+                verify_threaded_tree(dst->root, 1600);
+                ASSERT(mrbthp_merge(tp, dst));
+                verify_threaded_tree(tp->root, 1600);
+            }
+            mrbthp_delete(dst);
+        }
+
+        // short and long erased ranges
+        for (int round = 0; round < 50; round++) {
+            const uintptr_t first = tausrand(taus_state) % 2600;
+            const uintptr_t last = first + tausrand(taus_state) % (round % 2 == 0 ? 20 : 600);
+            mrbth_t *copy = mrbth_new(~0u);
+            for (it = mrbth_begin(tt); it != mrbth_end(); it = mrbth_next(it)) {
+                mrbth_insert(copy, mrbth_key(it), NULL);
+            }
+            mrbth_erase_range(copy, mrbth_itlower_bound(copy, first), mrbth_itlower_bound(copy, last));
+            verify_threaded_tree(copy->root, mrbth_size(copy));
+            for (it = mrbth_begin(tt); it != mrbth_end(); it = mrbth_next(it)) {
+                const uintptr_t key = mrbth_key(it);
+                ASSERT((mrbth_itfind(copy, key) == mrbth_end()) == (key >= first && key < last));
+            }
+            mrbth_delete(copy);
+        }
+        mrbth_delete(tt);
+        mrbthp_delete(tp);
+    }
+    fprintf(stderr, "pass\n");
+}
+
 #if TRACKMEM_DEBUG - 0 != 0
 extern trackmem_t *buddyalloc_tm;
 trackmem_t *buddyalloc_tm;
@@ -544,6 +1462,13 @@ main(void)
     mrb_base_tests();
     mrb_basic_tests();
     mrb_alt_configs();
+    mrb_build_tests();
+    mrb_split_merge_tests();
+    mrb_order_statistic_tests();
+    mrb_hint_tests();
+    mrb_range_tests();
+    mrb_link32_tests();
+    mrb_threaded_tests();
 #if TRACKMEM_DEBUG - 0 != 0
     trackmem_delete(nodepool_tm);
     trackmem_delete(buddyalloc_tm);
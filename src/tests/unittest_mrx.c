@@ -5,11 +5,13 @@
  *
  */
 #include <ctype.h>
+#include <math.h>
 
 #include <unittest_helpers.h>
 
 #include <bitops.h>
 #include <mrx_base_int.h>
+#include <mrx_keyenc.h>
 #include <mrx_scan.h>
 #include <mrx_tmpl.h>
 
@@ -29,6 +31,93 @@
 #define MRX_KEY_SORTINT 1
 #include <mrx_tmpl.h>
 
+#if defined(__SIZEOF_INT128__)
+#define MC_PREFIX mrxq
+#define MC_KEY_T unsigned __int128
+#define MC_VALUE_T uintptr_t
+#define MRX_KEY_SORTINT 1
+#include <mrx_tmpl.h>
+#endif
+
+struct uuid {
+    uint8_t octets[16];
+};
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrxu
+#define MC_KEY_T struct uuid
+#define MC_VALUE_T uintptr_t
+#include <mrx_tmpl.h>
+
+static size_t free_value_count;
+
+#define MC_PREFIX mrxc
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T uintptr_t
+#define MC_FREE_VALUE(value) free_value_count += (value)
+#define MRX_KEY_SORTINT 1
+#include <mrx_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrxcp
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T uintptr_t
+#define MC_FREE_VALUE(value) free_value_count += (value)
+#define MRX_KEY_SORTINT 1
+#include <mrx_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrxs
+#define MC_KEY_T const char *
+#define MC_VALUE_T uintptr_t
+#define MC_FREE_VALUE(value) free_value_count += (value)
+#define MRX_KEY_VARSIZE 1
+#include <mrx_tmpl.h>
+
+#define MC_MM_MODE MC_MM_STATIC
+#define MC_PREFIX mrxst
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRX_KEY_SORTINT 1
+#include <mrx_tmpl.h>
+
+#define MC_MM_MODE MC_MM_STATIC
+#define MC_PREFIX mrxss
+#define MC_KEY_T const char *
+#define MC_VALUE_T void *
+#define MRX_KEY_VARSIZE 1
+#include <mrx_tmpl.h>
+
+#include <mrx_lpm_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx_lpma
+#define MC_VALUE_T char *
+#define MC_COPY_VALUE(dest, src) dest = strdup(src)
+#define MC_FREE_VALUE(value) free(value)
+#include <mrx_lpm_tmpl.h>
+
+#include <mrx_intern_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx_internp
+#include <mrx_intern_tmpl.h>
+
+#include <mrx_topk_tmpl.h>
+
+#define MC_MM_MODE MC_MM_PERFORMANCE
+#define MC_PREFIX mrx_topkp
+#include <mrx_topk_tmpl.h>
+
+#define MC_PREFIX mrxsh
+#define MC_KEY_T uintptr_t
+#define MC_VALUE_T void *
+#define MRX_KEY_SORTINT 1
+#define MRX_SHARD_TREE_PREFIX mrxi
+#include <mrx_shard_tmpl.h>
+
+#include <mrx_shard_tmpl.h>
+
 static uint32_t taus_state[3];
 
 #define BUILD_AVX2 0
@@ -549,7 +638,14 @@ mrx_alloc_free_tests(mrx_base_t *mrx)
     unsigned p2s[alloc_test_size];
     for (int i = 0; i < alloc_test_size; i++) {
         int p2 = MIN_P2 + tausrand(taus_state) % (MAX_P2 - MIN_P2 + 1);
-        mrx_sp_t *node = mrx_alloc_node_(mrx, p2 == MAX_P2 ? p2 + tausrand(taus_state) % 10: p2);
+        const uint8_t nsz = p2 == MAX_P2 ? p2 + tausrand(taus_state) % 10: p2;
+        mrx_sp_t *node;
+        const void *near = (i % 2 == 1) ? nodes[i / 2] : NULL;
+        if (near != NULL) {
+            node = mrx_alloc_node_near_(mrx, nsz, near);
+        } else {
+            node = mrx_alloc_node_(mrx, nsz);
+        }
         unsigned size = (8u << p2) / sizeof(mrx_sp_t);
         if (compact_mode) {
             node[0] = tausrand(taus_state);
@@ -680,6 +776,21 @@ mrx_allocator_tests(void)
         ASSERT((mrx->max_keylen_n_flags & MRX_FLAG_IS_COMPACT_) == 0);
         ASSERT(mrx->nodealloc->nonempty_freelists == 0);
 
+        // near allocation prefers a free block in the same page over the freelist head
+        void **nodes = malloc(600 * sizeof(nodes[0]));
+        for (int i = 0; i < 600; i++) {
+            nodes[i] = mrx_alloc_node_(mrx, 1);
+        }
+        mrx_free_node_(mrx, nodes[1], 1);
+        mrx_free_node_(mrx, nodes[599], 1);
+        nodes[1] = mrx_alloc_node_near_(mrx, 1, nodes[0]);
+        ASSERT(((uintptr_t)nodes[1] >> 12u) == ((uintptr_t)nodes[0] >> 12u));
+        nodes[599] = mrx_alloc_node_(mrx, 1);
+        for (int i = 0; i < 600; i++) {
+            mrx_free_node_(mrx, nodes[i], 1);
+        }
+        free(nodes);
+
         mrx_alloc_free_tests(mrx);
 
         stats = malloc(sizeof(*stats));
@@ -692,6 +803,2279 @@ mrx_allocator_tests(void)
     fprintf(stderr, "pass\n");
 }
 
+static void
+mrx_foreach_value_sum(void **vref,
+                      void *arg)
+{
+    *(uintptr_t *)arg += (uintptr_t)*vref;
+}
+
+static void
+mrx_clear_tests(void)
+{
+    fprintf(stderr, "Test: mrx clear and delete with value freeing...");
+    for (int round = 0; round < 4; round++) {
+        mrxc_t *tc = mrxc_new(~0u);
+        mrxcp_t *tp = mrxcp_new(~0u);
+        uintptr_t sum = 0;
+        for (int i = 0; i < 20000; i++) {
+            const uintptr_t key = random_key();
+            const uintptr_t value = 1 + tausrand(taus_state) % 1000;
+            if (mrxc_find(tc, key) != 0) {
+                continue;
+            }
+            mrxc_insert(tc, key, value);
+            mrxcp_insert(tp, key, value);
+            sum += value;
+        }
+        uintptr_t visited = 0;
+        mrx_foreach_value_(&tc->mrx, mrx_foreach_value_sum, &visited);
+        ASSERT(visited == sum);
+        visited = 0;
+        mrx_foreach_value_(&tp->mrx, mrx_foreach_value_sum, &visited);
+        ASSERT(visited == sum);
+
+        free_value_count = 0;
+        if (round % 2 == 0) {
+            mrxc_clear(tc);
+            ASSERT(free_value_count == sum);
+            ASSERT(mrxc_size(tc) == 0);
+            mrxcp_clear(tp);
+            ASSERT(free_value_count == 2 * sum);
+            ASSERT(mrxcp_size(tp) == 0);
+            // cleared trees must be reusable
+            mrxc_insert(tc, 17, 3);
+            mrxcp_insert(tp, 17, 3);
+            ASSERT(mrxc_find(tc, 17) == 3);
+            ASSERT(mrxcp_find(tp, 17) == 3);
+            free_value_count = 0;
+            sum = 3;
+        }
+        mrxc_delete(tc);
+        ASSERT(free_value_count == sum);
+        mrxcp_delete(tp);
+        ASSERT(free_value_count == 2 * sum);
+    }
+    {
+        // long keys, chains of single-branch nodes
+        mrx_t *tt = mrx_new(~0u);
+        char key[2000];
+        memset(key, 'a', sizeof(key));
+        uintptr_t sum = 0;
+        for (uintptr_t len = 1; len < sizeof(key); len += 97) {
+            mrx_insert(tt, key, len, (void *)len);
+            sum += len;
+        }
+        uintptr_t visited = 0;
+        mrx_foreach_value_(&tt->mrx, mrx_foreach_value_sum, &visited);
+        ASSERT(visited == sum);
+        mrx_clear(tt);
+        visited = 0;
+        mrx_foreach_value_(&tt->mrx, mrx_foreach_value_sum, &visited);
+        ASSERT(visited == 0);
+        mrx_delete(tt);
+    }
+    {
+        // very long keys with a side branch at every step, the long key path
+        // must not be followed by recursion when erasing
+        mrx_t *tt = mrx_new(~0u);
+        static char key[40001];
+        memset(key, 'a', sizeof(key));
+        uintptr_t sum = 0;
+        for (uintptr_t len = 1; len < sizeof(key); len += 5) {
+            key[len - 1] = '0';
+            mrx_insert(tt, key, len, (void *)len);
+            key[len - 1] = 'a';
+            sum += len;
+        }
+        uintptr_t visited = 0;
+        mrx_foreach_value_(&tt->mrx, mrx_foreach_value_sum, &visited);
+        ASSERT(visited == sum);
+        mrx_clear(tt);
+        ASSERT(mrx_size(tt) == 0);
+        mrx_insert(tt, key, sizeof(key), (void *)1);
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#if defined(__SIZEOF_INT128__)
+static int
+u128_cmp(const void *a,
+         const void *b)
+{
+    const unsigned __int128 x = *(const unsigned __int128 *)a;
+    const unsigned __int128 y = *(const unsigned __int128 *)b;
+    return (x > y) - (x < y);
+}
+#endif
+
+static void
+mrx_key16_tests(void)
+{
+    fprintf(stderr, "Test: mrx 16 byte keys...");
+#if defined(__SIZEOF_INT128__)
+    {
+        const size_t count = 50000;
+        unsigned __int128 *keys = malloc(count * sizeof(*keys));
+        mrxq_t *tt = mrxq_new(~0u);
+        for (size_t i = 0; i < count; i++) {
+            // few distinct high parts (like IPv6 network prefixes), random low parts
+            const uint64_t hi = 0x20010db800000000ull | (tausrand(taus_state) % 64);
+            uint64_t lo = (uint64_t)tausrand(taus_state) << 32u | tausrand(taus_state);
+            if (i % 3 == 0) {
+                lo &= 0xFFFFu;
+            }
+            keys[i] = ((unsigned __int128)hi << 64u) | lo;
+            mrxq_insert(tt, keys[i], i + 1);
+        }
+        qsort(keys, count, sizeof(keys[0]), u128_cmp);
+        size_t unique = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (i == 0 || keys[i] != keys[unique - 1]) {
+                keys[unique++] = keys[i];
+            }
+        }
+        ASSERT(mrxq_size(tt) == unique);
+        size_t i = 0;
+        for (mrxq_it_t *it = mrxq_begin(tt); it != mrxq_end(); it = mrxq_next(it)) {
+            ASSERT(mrxq_key(it) == keys[i]);
+            ASSERT(mrxq_find(tt, keys[i]) == mrxq_val(it));
+            i++;
+        }
+        ASSERT(i == unique);
+        for (i = 0; i < unique; i++) {
+            ASSERT(mrxq_find(tt, keys[i] ^ ((unsigned __int128)1 << 100u)) == 0);
+            if (i % 2 == 0) {
+                ASSERT(mrxq_erase(tt, keys[i]) != 0);
+            }
+        }
+        mrx_debug_sanity_check_node_with_children(tt->mrx.root);
+        for (i = 0; i < unique; i++) {
+            ASSERT((mrxq_find(tt, keys[i]) != 0) == (i % 2 != 0));
+        }
+        mrxq_delete(tt);
+        free(keys);
+    }
+#endif
+    {
+        mrxu_t *tt = mrxu_new(~0u);
+        struct uuid key = {{0}};
+        for (uintptr_t i = 0; i < 10000; i++) {
+            key.octets[0] = (uint8_t)(i >> 8u);
+            key.octets[15] = (uint8_t)i;
+            key.octets[7] = (uint8_t)(i >> 8u);
+            mrxu_insert(tt, key, i + 1);
+        }
+        ASSERT(mrxu_size(tt) == 10000);
+        uintptr_t last = 0;
+        for (mrxu_it_t *it = mrxu_begin(tt); it != mrxu_end(); it = mrxu_next(it)) {
+            const struct uuid k = mrxu_key(it);
+            const uintptr_t i = ((uintptr_t)k.octets[0] << 8u) | k.octets[15];
+            ASSERT(mrxu_val(it) == i + 1);
+            ASSERT(mrxu_find(tt, k) == i + 1);
+            // byte order is sort order, so key order is index order
+            ASSERT(mrxu_val(it) > last);
+            last = mrxu_val(it);
+        }
+        key.octets[7] = (uint8_t)(key.octets[0] + 1);
+        ASSERT(mrxu_find(tt, key) == 0);
+        mrxu_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#define ERASE_PREFIX_KEY_COUNT 20000
+
+static void
+erase_prefix_check(mrx_t *tt,
+                   mrxs_t *ts,
+                   char keys[][32],
+                   bool alive[],
+                   const char *prefix)
+{
+    const size_t prefix_len = strlen(prefix);
+    size_t expected = 0;
+    uintptr_t expected_sum = 0;
+    for (uintptr_t i = 0; i < ERASE_PREFIX_KEY_COUNT; i++) {
+        if (alive[i] && strncmp(keys[i], prefix, prefix_len) == 0) {
+            alive[i] = false;
+            expected++;
+            expected_sum += i + 1;
+        }
+    }
+    const size_t size = mrx_size(tt);
+    ASSERT(mrx_erase_prefixnt(tt, prefix) == expected);
+    ASSERT(mrx_size(tt) == size - expected);
+    free_value_count = 0;
+    ASSERT(mrxs_erase_prefix(ts, prefix, prefix_len) == expected);
+    ASSERT(free_value_count == expected_sum);
+    ASSERT(mrxs_size(ts) == size - expected);
+}
+
+static void
+mrx_erase_prefix_tests(void)
+{
+    fprintf(stderr, "Test: mrx erase prefix...");
+    {
+        char (*keys)[32] = malloc(ERASE_PREFIX_KEY_COUNT * sizeof(*keys));
+        bool *alive = calloc(ERASE_PREFIX_KEY_COUNT, sizeof(*alive));
+        mrx_t *tt = mrx_new(~0u);
+        mrxs_t *ts = mrxs_new(~0u);
+        for (uintptr_t i = 0; i < ERASE_PREFIX_KEY_COUNT; i++) {
+            const unsigned tenant = tausrand(taus_state) % 300;
+            switch (tausrand(taus_state) % 10) {
+            case 0:
+                // tenant key itself, and keys that share octets with other tenants
+                snprintf(keys[i], sizeof(keys[i]), "t/%u", tenant);
+                break;
+            case 1:
+                snprintf(keys[i], sizeof(keys[i]), "t/%u%c", tenant, 'a' + (int)(tausrand(taus_state) % 26));
+                break;
+            default:
+                snprintf(keys[i], sizeof(keys[i]), "t/%u/%x", tenant, tausrand(taus_state) % 100000);
+                break;
+            }
+            if (mrx_findnt(tt, keys[i]) != NULL) {
+                continue;
+            }
+            alive[i] = true;
+            mrx_insertnt(tt, keys[i], keys[i]);
+            mrxs_insertnt(ts, keys[i], i + 1);
+        }
+        ASSERT(mrx_erase_prefixnt(tt, "x") == 0);
+        ASSERT(mrx_erase_prefixnt(tt, "t/1/nothere") == 0);
+        for (unsigned tenant = 0; tenant < 300; tenant += 1 + tausrand(taus_state) % 5) {
+            char prefix[32];
+            switch (tausrand(taus_state) % 4) {
+            case 0:
+                // ends within the prefix of a node
+                snprintf(prefix, sizeof(prefix), "t/%u", tenant);
+                break;
+            case 1: {
+                // a whole key
+                uintptr_t i = tausrand(taus_state) % ERASE_PREFIX_KEY_COUNT;
+                snprintf(prefix, sizeof(prefix), "%s", keys[i]);
+                break;
+            }
+            default:
+                snprintf(prefix, sizeof(prefix), "t/%u/", tenant);
+                break;
+            }
+            erase_prefix_check(tt, ts, keys, alive, prefix);
+            if (tenant % 20 == 0) {
+                mrx_debug_sanity_check_str2ref(&tt->mrx);
+            }
+        }
+        mrx_debug_sanity_check_str2ref(&tt->mrx);
+        for (uintptr_t i = 0; i < ERASE_PREFIX_KEY_COUNT; i++) {
+            if (alive[i]) {
+                ASSERT(mrx_findnt(tt, keys[i]) == keys[i]);
+                ASSERT(mrxs_findnt(ts, keys[i]) == i + 1);
+            } else {
+                // duplicates were never inserted, so they are not alive either
+                ASSERT(mrx_findnt(tt, keys[i]) != keys[i]);
+            }
+        }
+        // the tree must still be usable after structural erases
+        ASSERT(mrx_insertnt(tt, "t/1/again", (void *)0x1) == (void *)0x1);
+        ASSERT(mrx_findnt(tt, "t/1/again") == (void *)0x1);
+        ASSERT(mrx_erasent(tt, "t/1/again") == (void *)0x1);
+
+        // empty prefix erases everything
+        erase_prefix_check(tt, ts, keys, alive, "");
+        ASSERT(tt->mrx.root == NULL);
+        ASSERT(ts->mrx.root == NULL);
+        ASSERT(mrx_erase_prefixnt(tt, "") == 0);
+        ASSERT(mrx_insertnt(tt, "a", (void *)0x1) == (void *)0x1);
+        ASSERT(mrx_size(tt) == 1);
+
+        mrx_delete(tt);
+        mrxs_delete(ts);
+        free(alive);
+        free(keys);
+    }
+    {
+        // long keys that do not fit the path on stack
+        mrx_t *tt = mrx_new(~0u);
+        char key[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 100];
+        memset(key, 'a', sizeof(key));
+        for (size_t len = 1; len < sizeof(key); len += 7) {
+            mrx_insert(tt, key, len, (void *)len);
+        }
+        const size_t size = mrx_size(tt);
+        ASSERT(mrx_erase_prefix(tt, key, 400) == size - 57);
+        ASSERT(mrx_size(tt) == 57);
+        ASSERT(mrx_find(tt, key, 393) == (void *)393);
+        ASSERT(mrx_find(tt, key, 400) == NULL);
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static void
+mrx_bulk_tests(void)
+{
+    fprintf(stderr, "Test: mrx build from unsorted input...");
+    {
+        const int test_size = 50000;
+        uintptr_t *keys = malloc(test_size * sizeof(uintptr_t));
+        void **values = malloc(test_size * sizeof(void *));
+        for (int i = 0; i < test_size; i++) {
+            keys[i] = random_key();
+            if (i % 10 == 0) {
+                keys[i] &= 0xFFFF; // short keys and some duplicates
+            }
+            if (keys[i] == 0) {
+                keys[i] = 1; // sanity check does not support NULL values
+            }
+            values[i] = (void *)keys[i];
+        }
+        mrxi_t *tt = mrxi_new(~0u);
+        ASSERT(mrxi_build(tt, keys, values, 0) == 0);
+        ASSERT(mrxi_build(tt, keys, values, 1) == 1);
+        ASSERT(mrxi_build(tt, keys, values, test_size) == (size_t)test_size);
+        mrx_debug_sanity_check_int2ref(&tt->mrx);
+        for (int i = 0; i < test_size; i++) {
+            ASSERT(mrxi_find(tt, keys[i]) == (void *)keys[i]);
+        }
+        size_t count = 0;
+        uintptr_t prev_key = 0;
+        for (mrxi_it_t *it = mrxi_beginst(tt, alloca(mrxi_itsize(tt))); it != mrxi_end(); it = mrxi_next(it)) {
+            ASSERT(count == 0 || mrxi_key(it) > prev_key);
+            prev_key = mrxi_key(it);
+            count++;
+        }
+        ASSERT(count == mrxi_size(tt));
+        mrxi_delete(tt);
+
+        // capacity reached
+        tt = mrxi_new(100);
+        const size_t inserted = mrxi_build(tt, keys, values, test_size);
+        ASSERT(inserted >= 100 && inserted < (size_t)test_size);
+        ASSERT(mrxi_size(tt) == 100);
+        // failed inserts are not counted
+        ASSERT(mrxi_build(tt, keys, values, test_size) == 0);
+        mrxi_delete(tt);
+
+        // string keys
+        char (*str)[64] = malloc(test_size * sizeof(*str));
+        const char **skeys = malloc(test_size * sizeof(char *));
+        size_t *ssizes = malloc(test_size * sizeof(size_t));
+        for (int i = 0; i < test_size; i++) {
+            make_string_key(str[i], keys[i]);
+            skeys[i] = str[i];
+            ssizes[i] = (i % 100 == 0) ? i % 3 : strlen(str[i]);
+        }
+        mrx_t *ts = mrx_new(~0u);
+        ASSERT(mrx_build(ts, skeys, ssizes, values, test_size) == (size_t)test_size);
+        mrx_debug_sanity_check_str2ref(&ts->mrx);
+        for (int i = 0; i < test_size; i++) {
+            ASSERT(mrx_find(ts, skeys[i], ssizes[i]) != NULL);
+        }
+        mrx_delete(ts);
+
+        // parallel build, compact and performance mode, the result must equal
+        // a serial build
+        for (unsigned threads = 2; threads <= 5; threads += 3) {
+            ts = mrx_new(~0u);
+            ASSERT(mrx_build_parallel(ts, skeys, ssizes, values, test_size, threads) == (size_t)test_size);
+            mrx_debug_sanity_check_str2ref(&ts->mrx);
+            mrx_t *ref = mrx_new(~0u);
+            mrx_build(ref, skeys, ssizes, values, test_size);
+            ASSERT(mrx_size(ts) == mrx_size(ref));
+            mrx_it_t *it_ref = mrx_begin(ref);
+            for (mrx_it_t *it = mrx_begin(ts); it != mrx_end(); it = mrx_next(it)) {
+                ASSERT(it_ref != mrx_end());
+                ASSERT(mrx_keylen(it) == mrx_keylen(it_ref));
+                ASSERT(memcmp(mrx_key(it), mrx_key(it_ref), mrx_keylen(it)) == 0);
+                ASSERT(mrx_val(it) == mrx_val(it_ref));
+                it_ref = mrx_next(it_ref);
+            }
+            ASSERT(it_ref == mrx_end());
+            ASSERT(mrx_insert(ts, "", 0, values[0]) && mrx_find(ts, "", 0) == values[0]);
+            mrx_delete(ref);
+            mrx_delete(ts);
+
+            tt = mrxi_new(~0u);
+            ASSERT(mrxi_build_parallel(tt, keys, values, test_size, threads) == (size_t)test_size);
+            mrx_debug_sanity_check_int2ref(&tt->mrx);
+            ASSERT(mrxi_size(tt) == count);
+            for (int i = 0; i < test_size; i++) {
+                ASSERT(mrxi_find(tt, keys[i]) == (void *)keys[i]);
+            }
+            // nodes from the worker allocators are freed to the tree
+            for (int i = 0; i < test_size; i += 2) {
+                mrxi_erase(tt, keys[i]);
+            }
+            for (int i = 0; i < test_size; i++) {
+                mrxi_insert(tt, keys[i], values[i]);
+            }
+            mrx_debug_sanity_check_int2ref(&tt->mrx);
+            ASSERT(mrxi_size(tt) == count);
+            mrxi_delete(tt);
+        }
+        // falls back to serial with one first octet, a non-empty tree or in static mode
+        tt = mrxi_new(~0u);
+        ASSERT(mrxi_build_parallel(tt, keys, values, 10, 4) == 10);
+        ASSERT(mrxi_build_parallel(tt, keys, values, test_size, 4) == (size_t)test_size);
+        ASSERT(mrxi_size(tt) == count);
+        mrxi_delete(tt);
+        mrxst_t *tst = mrxst_new(1000);
+        ASSERT(mrxst_build_parallel(tst, keys, values, 1000, 4) == 1000);
+        ASSERT(mrxst_find(tst, keys[999]) == values[999]);
+        mrxst_delete(tst);
+        free(str);
+        free(skeys);
+        free(ssizes);
+        free(keys);
+        free(values);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx set operations...");
+    for (int round = 0; round < 4; round++) {
+        const int test_size = (round == 0) ? 100 : 20000;
+        mrx_t *a = mrx_new(~0u);
+        mrx_t *b = mrx_new(~0u);
+        char string_key[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 1024];
+        for (int i = 0; i < test_size; i++) {
+            uintptr_t key = random_key();
+            if (round == 2) {
+                key &= 0xFFFFF;
+            }
+            make_string_key(string_key, key);
+            if (round == 3 && i % 1000 == 0) {
+                // long keys and keys that are prefixes of other keys
+                memset(&string_key[strlen(string_key)], 'x', MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+                string_key[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 10] = '\0';
+            }
+            if (i % 7 == 0) {
+                string_key[i % 5 + 1] = '\0';
+            }
+            switch (tausrand(taus_state) % 3) {
+            case 0:
+                mrx_insertnt(a, string_key, (void *)0x10);
+                break;
+            case 1:
+                mrx_insertnt(b, string_key, (void *)0x20);
+                break;
+            default:
+                mrx_insertnt(a, string_key, (void *)0x10);
+                mrx_insertnt(b, string_key, (void *)0x20);
+                break;
+            }
+        }
+        mrx_t *u = mrx_new(~0u);
+        mrx_t *in = mrx_new(~0u);
+        mrx_t *d = mrx_new(~0u);
+        mrx_union(u, a, b);
+        mrx_intersection(in, a, b);
+        mrx_difference(d, a, b);
+        mrx_debug_sanity_check_str2ref(&u->mrx);
+        size_t a_only = 0, both = 0;
+        mrx_it_t *it;
+        for (it = mrx_begin(a); it != mrx_end(); it = mrx_next(it)) {
+            const char *key = mrx_key(it);
+            const size_t len = strlen(key);
+            ASSERT(mrx_find(u, key, len) == (void *)0x10);
+            if (mrx_find(b, key, len) != NULL) {
+                ASSERT(mrx_find(in, key, len) == (void *)0x10);
+                ASSERT(mrx_find(d, key, len) == NULL);
+                both++;
+            } else {
+                ASSERT(mrx_find(in, key, len) == NULL);
+                ASSERT(mrx_find(d, key, len) == (void *)0x10);
+                a_only++;
+            }
+        }
+        for (it = mrx_begin(b); it != mrx_end(); it = mrx_next(it)) {
+            const char *key = mrx_key(it);
+            if (mrx_find(a, key, strlen(key)) == NULL) {
+                ASSERT(mrx_find(u, key, strlen(key)) == (void *)0x20);
+            }
+        }
+        ASSERT(mrx_size(u) == mrx_size(a) + mrx_size(b) - both);
+        ASSERT(mrx_size(in) == both);
+        ASSERT(mrx_size(d) == a_only);
+
+        // empty trees
+        mrx_clear(u);
+        mrx_clear(in);
+        mrx_clear(d);
+        mrx_union(u, a, in);
+        mrx_union(d, in, b);
+        ASSERT(mrx_size(u) == mrx_size(a));
+        ASSERT(mrx_size(d) == mrx_size(b));
+        mrx_clear(u);
+        mrx_clear(d);
+        mrx_intersection(u, a, in);
+        mrx_difference(d, in, b);
+        ASSERT(mrx_size(u) == 0);
+        ASSERT(mrx_size(d) == 0);
+        mrx_difference(d, a, in);
+        ASSERT(mrx_size(d) == mrx_size(a));
+        mrx_intersection(u, in, b);
+        mrx_difference(u, in, in);
+        ASSERT(mrx_size(u) == 0);
+
+        // deep trees, each key is a prefix of the next
+        mrx_clear(a);
+        mrx_clear(b);
+        mrx_clear(u);
+        mrx_clear(in);
+        char *deep_key = malloc(3001);
+        memset(deep_key, 'x', 3001);
+        for (int len = 1; len <= 3000; len++) {
+            mrx_insert(len % 2 == 0 ? a : b, deep_key, len, (void *)0x10);
+            if (len % 3 == 0) {
+                mrx_insert(len % 2 == 0 ? b : a, deep_key, len, (void *)0x10);
+            }
+        }
+        ASSERT(mrx_union(u, a, b));
+        ASSERT(mrx_intersection(in, a, b));
+        ASSERT(mrx_size(u) == 3000);
+        ASSERT(mrx_size(in) == 1000);
+        ASSERT(mrx_find(in, deep_key, 2997) != NULL && mrx_find(in, deep_key, 2998) == NULL);
+        free(deep_key);
+
+        mrx_delete(a);
+        mrx_delete(b);
+        mrx_delete(u);
+        mrx_delete(in);
+        mrx_delete(d);
+    }
+    {
+        mrxa_t *a = mrxa_new(~0u);
+        mrxa_t *b = mrxa_new(~0u);
+        mrxa_t *u = mrxa_new(~0u);
+        for (uintptr_t i = 0; i < 1000; i++) {
+            mrxa_insert(a, i * 3, "a");
+            mrxa_insert(b, i * 5, "b");
+        }
+        mrxa_insert(u, 5, "u");
+        mrxa_union(u, a, b);
+        ASSERT(strcmp(mrxa_find(u, 3), "a") == 0);
+        ASSERT(strcmp(mrxa_find(u, 5), "b") == 0);
+        ASSERT(strcmp(mrxa_find(u, 15), "a") == 0);
+        ASSERT(mrxa_size(u) == 1000 + 1000 - 200);
+        mrxa_delete(a);
+        mrxa_delete(b);
+        mrxa_delete(u);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static unsigned
+levenshtein_ref(const char *a,
+                const char *b)
+{
+    const size_t alen = strlen(a);
+    const size_t blen = strlen(b);
+    unsigned row[blen + 1];
+    for (size_t j = 0; j <= blen; j++) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= alen; i++) {
+        unsigned diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= blen; j++) {
+            unsigned v = diag + (a[i-1] != b[j-1]);
+            if (row[j] + 1 < v) {
+                v = row[j] + 1;
+            }
+            if (row[j-1] + 1 < v) {
+                v = row[j-1] + 1;
+            }
+            diag = row[j];
+            row[j] = v;
+        }
+    }
+    return row[blen];
+}
+
+struct fuzzy_result {
+    mrx_t *found;
+    const char *query;
+    unsigned max_distance;
+};
+
+static void
+fuzzy_collect(const uint8_t key[],
+              unsigned key_len,
+              unsigned distance,
+              void **vref,
+              void *arg)
+{
+    struct fuzzy_result *res = (struct fuzzy_result *)arg;
+    char str[key_len + 1];
+    memcpy(str, key, key_len);
+    str[key_len] = '\0';
+    ASSERT(distance <= res->max_distance);
+    ASSERT(distance == levenshtein_ref(str, res->query));
+    ASSERT(*vref == (void *)0x1);
+    mrx_insert(res->found, str, key_len, (void *)(uintptr_t)(distance + 1));
+}
+
+static int
+uintptr_cmp(const void *a,
+            const void *b)
+{
+    const uintptr_t x = *(const uintptr_t *)a;
+    const uintptr_t y = *(const uintptr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void
+mrx_pop_tests(void)
+{
+    fprintf(stderr, "Test: mrx pop and peek at front and back...");
+    {
+        // sorted integer keys, popped alternately from both ends
+        const unsigned count = 20000;
+        uintptr_t *keys = malloc(count * sizeof(keys[0]));
+        mrxi_t *tt = mrxi_new(~0u);
+        uintptr_t key;
+        ASSERT(mrxi_pop_front(tt, &key) == NULL);
+        ASSERT(mrxi_peek_back(tt, NULL) == NULL);
+        for (unsigned i = 0; i < count; i++) {
+            // narrow ranges give long prefixes, wide ranges mask nodes
+            do {
+                keys[i] = (i % 2 == 0) ? random_key() : 0x1000 + tausrand(taus_state) % 100000;
+            } while (mrxi_find(tt, keys[i]) != NULL);
+            mrxi_insert(tt, keys[i], (void *)~keys[i]);
+        }
+        qsort(keys, count, sizeof(keys[0]), uintptr_cmp);
+        unsigned head = 0;
+        unsigned tail = count;
+        while (head < tail) {
+            ASSERT(mrxi_peek_front(tt, &key) == (void *)~keys[head]);
+            ASSERT(key == keys[head]);
+            ASSERT(mrxi_peek_back(tt, &key) == (void *)~keys[tail - 1]);
+            ASSERT(key == keys[tail - 1]);
+            if (tausrand(taus_state) % 2 == 0) {
+                ASSERT(mrxi_pop_front(tt, &key) == (void *)~keys[head]);
+                ASSERT(key == keys[head]);
+                head++;
+            } else {
+                ASSERT(mrxi_pop_back(tt, NULL) == (void *)~keys[tail - 1]);
+                tail--;
+            }
+            ASSERT(mrxi_size(tt) == tail - head);
+            if (head % 1000 == 0) {
+                mrx_debug_sanity_check_int2ref(&tt->mrx);
+            }
+        }
+        ASSERT(mrxi_empty(tt));
+        ASSERT(tt->mrx.root == NULL);
+
+        // scheduler style, deadlines inserted ahead of the popped minimum
+        mrxi_t *ref = mrxi_new(~0u);
+        void *itbuf = NULL;
+        uintptr_t now = 1000;
+        for (unsigned i = 0; i < 100000; i++) {
+            const uintptr_t deadline = now + tausrand(taus_state) % 5000;
+            mrxi_insert(tt, deadline, (void *)deadline);
+            mrxi_insert(ref, deadline, (void *)deadline);
+            if (itbuf == NULL) {
+                // iterator size depends on key length, known after first insert
+                itbuf = malloc(mrxi_itsize(ref));
+            }
+            if (tausrand(taus_state) % 3 != 0) {
+                const uintptr_t min = mrxi_key(mrxi_beginst(ref, itbuf));
+                ASSERT(mrxi_pop_front(tt, &key) == (void *)min);
+                ASSERT(key == min);
+                mrxi_erase(ref, min);
+                now = min;
+            }
+        }
+        ASSERT(mrxi_size(tt) == mrxi_size(ref));
+        free(itbuf);
+        mrxi_delete(ref);
+        mrxi_delete(tt);
+        free(keys);
+    }
+    {
+        // values are freed on pop but not on peek
+        mrxc_t *tt = mrxc_new(~0u);
+        mrxc_insert(tt, 7, 5);
+        mrxc_insert(tt, 3, 2);
+        free_value_count = 0;
+        uintptr_t key;
+        ASSERT(mrxc_peek_front(tt, &key) == 2 && key == 3);
+        ASSERT(free_value_count == 0);
+        ASSERT(mrxc_pop_back(tt, &key) == 5 && key == 7);
+        ASSERT(free_value_count == 5);
+        mrxc_delete(tt);
+    }
+#if defined(__SIZEOF_INT128__)
+    {
+        mrxq_t *tt = mrxq_new(~0u);
+        const unsigned __int128 big = ((unsigned __int128)1 << 100) + 5;
+        mrxq_insert(tt, big, 1);
+        mrxq_insert(tt, 5, 2);
+        unsigned __int128 key;
+        ASSERT(mrxq_pop_back(tt, &key) == 1 && key == big);
+        ASSERT(mrxq_pop_back(tt, &key) == 2 && key == 5);
+        ASSERT(mrxq_empty(tt));
+        mrxq_delete(tt);
+    }
+#endif
+    {
+        // variable size keys, a key sorts before the keys it is a prefix of
+        mrx_t *tt = mrx_new(~0u);
+        const char *words[] = { "b", "abc", "a", "ab", "abd", "" };
+        for (unsigned i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+            mrx_insertnt(tt, words[i], (void *)(uintptr_t)(i + 1));
+        }
+        char buf[8];
+        size_t key_size;
+        ASSERT(mrx_pop_front(tt, buf, sizeof(buf), &key_size) == (void *)6);
+        ASSERT(key_size == 0);
+        ASSERT(mrx_peek_front(tt, buf, sizeof(buf), &key_size) == (void *)3);
+        ASSERT(key_size == 1 && buf[0] == 'a');
+        ASSERT(mrx_pop_back(tt, buf, sizeof(buf), &key_size) == (void *)1);
+        ASSERT(key_size == 1 && buf[0] == 'b');
+        ASSERT(mrx_peek_back(tt, buf, 2, &key_size) == (void *)5);
+        ASSERT(key_size == 3 && memcmp(buf, "ab", 2) == 0);
+        ASSERT(mrx_pop_back(tt, NULL, 0, NULL) == (void *)5);
+        ASSERT(mrx_pop_front(tt, buf, sizeof(buf), &key_size) == (void *)3);
+        ASSERT(mrx_pop_front(tt, buf, sizeof(buf), &key_size) == (void *)4);
+        ASSERT(key_size == 2 && memcmp(buf, "ab", 2) == 0);
+        ASSERT(mrx_pop_front(tt, buf, sizeof(buf), &key_size) == (void *)2);
+        ASSERT(key_size == 3 && memcmp(buf, "abc", 3) == 0);
+        ASSERT(mrx_pop_front(tt, buf, sizeof(buf), &key_size) == NULL);
+        ASSERT(mrx_empty(tt));
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+// The first 8 octets encode the id (< 65536), then a varying length tail
+// which gives both shared prefixes and long keys.
+static unsigned
+static_test_key(char key[],
+                const unsigned id)
+{
+    unsigned len = 0;
+    for (; len < 8; len++) {
+        key[len] = (char)('a' + ((id >> (2 * len)) & 3u));
+    }
+    const unsigned tail_len = ((id * 2654435761u) >> 23u) % 400u;
+    for (unsigned i = 0; i < tail_len; i++) {
+        key[len++] = (char)('a' + (i / 16 + id % 3) % 4);
+    }
+    key[len] = '\0';
+    return len;
+}
+
+static void
+mrx_static_tests(void)
+{
+    fprintf(stderr, "Test: mrx static memory mode...");
+    {
+        // integer keys, fill the region until insert fails
+        const size_t mem_size = 65536;
+        void *mem = malloc(mem_size);
+        mrxst_t *tt = mrxst_init(mem, mem_size);
+        ASSERT(mrxst_init(mem, 16) == NULL);
+        const uintptr_t free_count = tt->mrx.nodealloc->sb.region.free_count;
+        ASSERT(free_count > 400);
+        uintptr_t *keys = malloc(65536 * sizeof(keys[0]));
+        unsigned count = 0;
+        for (;;) {
+            uintptr_t key;
+            do {
+                // mix of dense and sparse keys
+                key = (count % 2 == 0) ? random_key() : tausrand(taus_state) % 100000;
+            } while (mrxst_find(tt, key) != NULL);
+            if (mrxst_insert(tt, key, (void *)~key) == NULL) {
+                break;
+            }
+            keys[count++] = key;
+        }
+        ASSERT(count > 400);
+        ASSERT(mrxst_size(tt) == count);
+        ASSERT(tt->mrx.nodealloc->sb.region.free_count < MRX_STATIC_INSERT_RESERVE_(sizeof(uintptr_t)));
+        mrx_debug_sanity_check_int2ref(&tt->mrx);
+        for (unsigned i = 0; i < count; i++) {
+            ASSERT(mrxst_find(tt, keys[i]) == (void *)~keys[i]);
+        }
+
+        // erase a random half and refill
+        for (unsigned i = 0; i < count; i++) {
+            const unsigned j = i + tausrand(taus_state) % (count - i);
+            const uintptr_t key = keys[j];
+            keys[j] = keys[i];
+            keys[i] = key;
+        }
+        for (unsigned i = count / 2; i < count; i++) {
+            ASSERT(mrxst_erase(tt, keys[i]) == (void *)~keys[i]);
+        }
+        count /= 2;
+        mrx_debug_sanity_check_int2ref(&tt->mrx);
+        for (;;) {
+            const uintptr_t key = random_key();
+            if (mrxst_find(tt, key) != NULL) {
+                continue;
+            }
+            if (mrxst_insert(tt, key, (void *)~key) == NULL) {
+                break;
+            }
+            keys[count++] = key;
+        }
+        mrx_debug_sanity_check_int2ref(&tt->mrx);
+
+        // all nodes are returned to the region when the tree is emptied
+        for (unsigned i = 0; i < count; i++) {
+            ASSERT(mrxst_erase(tt, keys[i]) == (void *)~keys[i]);
+        }
+        ASSERT(mrxst_empty(tt));
+        ASSERT(tt->mrx.root == NULL);
+        ASSERT(tt->mrx.nodealloc->sb.region.free_count == free_count);
+
+        ASSERT(mrxst_insert(tt, 1, (void *)1) != NULL);
+        mrxst_clear(tt);
+        ASSERT(mrxst_empty(tt));
+        ASSERT(tt->mrx.nodealloc->sb.region.free_count == free_count);
+        free(keys);
+        free(mem);
+
+        // capacity limit with mrxst_new()
+        tt = mrxst_new(1000);
+        for (uintptr_t i = 0; i < 1000; i++) {
+            ASSERT(mrxst_insert(tt, random_key() | 1u, (void *)1) != NULL);
+        }
+        ASSERT(mrxst_insert(tt, 0, (void *)1) == NULL);
+        mrxst_delete(tt);
+
+        // the cursor has its final size from the start
+        tt = mrxst_new(1000);
+        mrx_cursor_t *cursor = mrxst_cursor_new(tt);
+        ASSERT(cursor->capacity == MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 1);
+        const uint8_t *cursor_key = cursor->key;
+        for (uintptr_t i = 0; i < 1000; i++) {
+            ASSERT(mrxst_insert_hint(cursor, 2 * i, (void *)1) != NULL);
+        }
+        ASSERT(cursor->key == cursor_key);
+        ASSERT(cursor->capacity == MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 1);
+        ASSERT(mrxst_size(tt) == 1000);
+        mrxst_cursor_delete(cursor);
+        mrxst_delete(tt);
+    }
+    {
+        // string keys in random insert/erase load with the region near exhaustion
+        const unsigned id_count = 16384;
+        const size_t mem_size = 262144;
+        void *mem = malloc(mem_size);
+        mrxss_t *tt = mrxss_init(mem, mem_size);
+        const uintptr_t free_count = tt->mrx.nodealloc->sb.region.free_count;
+        bool *present = calloc(id_count, sizeof(present[0]));
+        char key[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 100];
+        unsigned fail_count = 0;
+        for (unsigned i = 0; i < 200000; i++) {
+            const unsigned id = tausrand(taus_state) % id_count;
+            const unsigned len = static_test_key(key, id);
+            if (!present[id] && tausrand(taus_state) % 8 != 0) {
+                if (mrxss_insert(tt, key, len, (void *)(uintptr_t)(id + 1)) == NULL) {
+                    ASSERT(tt->mrx.nodealloc->sb.region.free_count < MRX_STATIC_INSERT_RESERVE_(len));
+                    fail_count++;
+                } else {
+                    present[id] = true;
+                }
+            } else if (present[id]) {
+                ASSERT(mrxss_erase(tt, key, len) == (void *)(uintptr_t)(id + 1));
+                present[id] = false;
+            } else {
+                ASSERT(mrxss_find(tt, key, len) == NULL);
+            }
+            if (i % 50000 == 0) {
+                mrx_debug_sanity_check_str2ref(&tt->mrx);
+            }
+        }
+        ASSERT(fail_count > 0);
+        mrx_debug_sanity_check_str2ref(&tt->mrx);
+
+        // too long keys are refused even with room left
+        mrxss_clear(tt);
+        memset(key, 'k', sizeof(key));
+        ASSERT(mrxss_insert(tt, key, MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 1, (void *)1) == NULL);
+        ASSERT(mrxss_insert(tt, key, MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK, (void *)1) != NULL);
+
+        // iterate with stack memory sized for the longest key
+        void *itbuf = alloca(mrxss_itsize(tt));
+        unsigned it_count = 0;
+        for (mrxss_it_t *it = mrxss_beginst(tt, itbuf); it != mrxss_end(); it = mrxss_next(it)) {
+            ASSERT(mrxss_keylen(it) == MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK);
+            it_count++;
+        }
+        ASSERT(it_count == 1);
+        ASSERT(mrxss_erase(tt, key, MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK) == (void *)1);
+        ASSERT(tt->mrx.nodealloc->sb.region.free_count == free_count);
+        free(present);
+        free(mem);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static void
+mrx_fuzzy_tests(void)
+{
+    fprintf(stderr, "Test: mrx fuzzy find...");
+    {
+        mrx_t *tt = mrx_new(~0u);
+        const char alphabet[] = "abcde";
+        char word[32];
+        for (int i = 0; i < 64; i++) {
+            // make root a mask node
+            word[0] = '0' + i;
+            word[1] = '\0';
+            mrx_insertnt(tt, word, (void *)0x1);
+        }
+        for (int i = 0; i < 20000; i++) {
+            int len = 1 + tausrand(taus_state) % 8;
+            for (int j = 0; j < len; j++) {
+                word[j] = alphabet[tausrand(taus_state) % 5];
+            }
+            word[len] = '\0';
+            mrx_insertnt(tt, word, (void *)0x1);
+        }
+        for (int i = 0; i < 200; i++) {
+            int len = tausrand(taus_state) % 10;
+            for (int j = 0; j < len; j++) {
+                word[j] = alphabet[tausrand(taus_state) % 5];
+            }
+            word[len] = '\0';
+            struct fuzzy_result res = {
+                .found = mrx_new(~0u),
+                .query = word,
+                .max_distance = i % 4
+            };
+            mrx_fuzzy_findnt(tt, word, res.max_distance, fuzzy_collect, &res);
+            for (mrx_it_t *it = mrx_begin(tt); it != mrx_end(); it = mrx_next(it)) {
+                const char *key = mrx_key(it);
+                unsigned d = levenshtein_ref(key, word);
+                if (d <= res.max_distance) {
+                    ASSERT(mrx_findnt(res.found, key) == (void *)(uintptr_t)(d + 1));
+                } else {
+                    ASSERT(mrx_findnt(res.found, key) == NULL);
+                }
+            }
+            mrx_delete(res.found);
+        }
+        mrx_delete(tt);
+
+        // empty tree, and long keys that do not fit the key buffer on stack
+        tt = mrx_new(~0u);
+        struct fuzzy_result res = { .found = mrx_new(~0u), .query = "abc", .max_distance = 1 };
+        mrx_fuzzy_find(tt, "abc", 3, 1, fuzzy_collect, &res);
+        ASSERT(mrx_size(res.found) == 0);
+        char long_key[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 10];
+        memset(long_key, 'a', sizeof(long_key) - 1);
+        long_key[sizeof(long_key) - 1] = '\0';
+        mrx_insertnt(tt, long_key, (void *)0x1);
+        long_key[10] = 'b';
+        res.query = long_key;
+        mrx_fuzzy_findnt(tt, long_key, 1, fuzzy_collect, &res);
+        ASSERT(mrx_size(res.found) == 1);
+        mrx_delete(res.found);
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#define AC_MAX_KEY_COUNT 2000
+#define AC_TEXT_LEN 20000
+
+struct ac_result {
+    const uint8_t *text;
+    const uint8_t (*keys)[8];
+    const unsigned *key_lens;
+    size_t count;
+    uint64_t checksum;
+};
+
+static void
+ac_collect(uint64_t end_pos,
+           unsigned key_len,
+           void **vref,
+           void *arg)
+{
+    struct ac_result *res = (struct ac_result *)arg;
+    const unsigned idx = (unsigned)(uintptr_t)*vref - 1;
+    ASSERT(res->key_lens[idx] == key_len);
+    ASSERT(end_pos >= key_len && end_pos <= AC_TEXT_LEN);
+    ASSERT(memcmp(&res->text[end_pos - key_len], res->keys[idx], key_len) == 0);
+    res->count++;
+    res->checksum += end_pos * 2654435761u + idx;
+}
+
+static void
+ac_count_only(uint64_t end_pos,
+              unsigned key_len,
+              void **vref,
+              void *arg)
+{
+    struct ac_result *res = (struct ac_result *)arg;
+    ASSERT(end_pos >= key_len && (uintptr_t)*vref == key_len);
+    res->count++;
+}
+
+static void
+mrx_ac_tests(void)
+{
+    fprintf(stderr, "Test: mrx Aho-Corasick matching...");
+    {
+        uint8_t (*keys)[8] = malloc(AC_MAX_KEY_COUNT * sizeof(keys[0]));
+        unsigned *key_lens = malloc(AC_MAX_KEY_COUNT * sizeof(key_lens[0]));
+        uint8_t *text = malloc(AC_TEXT_LEN);
+        for (int round = 0; round < 12; round++) {
+            // small alphabets give long failure chains and overlapping
+            // matches, full octets give mask encoded branches
+            const unsigned alphabet_size = (const unsigned[]){ 2, 4, 26, 256 }[round % 4];
+            const unsigned key_count = (const unsigned[]){ 1, 30, AC_MAX_KEY_COUNT }[round / 4];
+            mrx_t *tt = mrx_new(~0u);
+            unsigned n = 0;
+            for (unsigned i = 0; i < key_count; i++) {
+                const unsigned len = 1 + tausrand(taus_state) % (alphabet_size <= 4 ? 8 : 3);
+                for (unsigned j = 0; j < len; j++) {
+                    keys[n][j] = (uint8_t)('a' + tausrand(taus_state) % alphabet_size);
+                }
+                if (mrx_find(tt, (const char *)keys[n], len) == NULL) {
+                    key_lens[n] = len;
+                    mrx_insert(tt, (const char *)keys[n], len, (void *)(uintptr_t)(n + 1));
+                    n++;
+                }
+            }
+            for (unsigned i = 0; i < AC_TEXT_LEN; i++) {
+                text[i] = (uint8_t)('a' + tausrand(taus_state) % alphabet_size);
+            }
+            uint64_t expected_count = 0;
+            uint64_t expected_checksum = 0;
+            for (unsigned e = 1; e <= AC_TEXT_LEN; e++) {
+                for (unsigned k = 0; k < n; k++) {
+                    if (key_lens[k] <= e && memcmp(&text[e - key_lens[k]], keys[k], key_lens[k]) == 0) {
+                        expected_count++;
+                        expected_checksum += (uint64_t)e * 2654435761u + k;
+                    }
+                }
+            }
+
+            mrx_ac_t *ac = mrx_ac_compile(tt);
+            ASSERT(ac != NULL);
+            mrx_delete(tt); // the automaton is self-contained
+            struct ac_result res = { .text = text, .keys = keys, .key_lens = key_lens };
+            mrx_ac_stream_t stream;
+            mrx_ac_stream_init(&stream);
+            mrx_ac_match(ac, &stream, text, AC_TEXT_LEN, ac_collect, &res);
+            ASSERT(res.count == expected_count);
+            ASSERT(res.checksum == expected_checksum);
+            ASSERT(stream.pos == AC_TEXT_LEN);
+
+            // same matches when fed in chunks, including empty ones
+            res.count = 0;
+            res.checksum = 0;
+            mrx_ac_stream_init(&stream);
+            for (size_t pos = 0; pos < AC_TEXT_LEN; ) {
+                size_t chunk = tausrand(taus_state) % 8;
+                if (chunk > AC_TEXT_LEN - pos) {
+                    chunk = AC_TEXT_LEN - pos;
+                }
+                mrx_ac_match(ac, &stream, &text[pos], chunk, ac_collect, &res);
+                pos += chunk;
+            }
+            ASSERT(res.count == expected_count);
+            ASSERT(res.checksum == expected_checksum);
+            mrx_ac_delete(ac);
+        }
+        free(text);
+        free(key_lens);
+        free(keys);
+    }
+    {
+        // empty tree, and the empty key which never matches
+        mrx_t *tt = mrx_new(~0u);
+        mrx_ac_t *ac = mrx_ac_compile(tt);
+        ASSERT(mrx_ac_state_count(ac) == 1);
+        struct ac_result res = { .count = 0 };
+        mrx_ac_stream_t stream;
+        mrx_ac_stream_init(&stream);
+        mrx_ac_match(ac, &stream, (const uint8_t *)"abc", 3, ac_collect, &res);
+        ASSERT(res.count == 0);
+        mrx_ac_delete(ac);
+        mrx_insert(tt, "", 0, (void *)0x1);
+        ac = mrx_ac_compile(tt);
+        mrx_ac_match(ac, &stream, (const uint8_t *)"abc", 3, ac_collect, &res);
+        ASSERT(res.count == 0);
+        ASSERT(stream.pos == 6);
+        mrx_ac_delete(ac);
+        mrx_ac_delete(NULL);
+        mrx_delete(tt);
+    }
+    {
+        // long keys branching at every octet, many more states than the
+        // initial state array
+        enum { LONG_AC_KEY_LEN = 20000 };
+        mrx_t *tt = mrx_new(~0u);
+        uint8_t *key = malloc(LONG_AC_KEY_LEN + 1);
+        memset(key, 'a', LONG_AC_KEY_LEN + 1);
+        for (unsigned len = 0; len < LONG_AC_KEY_LEN; len++) {
+            key[len] = 'b';
+            mrx_insert(tt, (const char *)key, len + 1, (void *)(uintptr_t)(len + 1));
+            key[len] = 'a';
+        }
+        mrx_insert(tt, (const char *)key, LONG_AC_KEY_LEN, (void *)0x1);
+        mrx_ac_t *ac = mrx_ac_compile(tt);
+        ASSERT(ac != NULL);
+        ASSERT(mrx_ac_state_count(ac) == 2 * LONG_AC_KEY_LEN + 1);
+        struct ac_result res = { .count = 0 };
+        mrx_ac_stream_t stream;
+        mrx_ac_stream_init(&stream);
+        key[LONG_AC_KEY_LEN - 1] = 'b';
+        mrx_ac_match(ac, &stream, key, LONG_AC_KEY_LEN, ac_count_only, &res);
+        ASSERT(res.count == LONG_AC_KEY_LEN);
+        mrx_ac_delete(ac);
+        free(key);
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+static void
+mrx_hint_tests(void)
+{
+    fprintf(stderr, "Test: mrx insert with cursor hint...");
+    {
+        mrxi_t *tt = mrxi_new(~0u);
+        mrxi_t *ref = mrxi_new(~0u);
+        mrx_cursor_t *cursor = mrxi_cursor_new(tt);
+        uintptr_t key = 1;
+        for (int i = 0; i < 100000; i++) {
+            const int operation = tausrand(taus_state) % 1000;
+            if (operation < 5) {
+                // jump, possibly backwards
+                key = random_key() | 1;
+            } else if (operation < 10) {
+                // insert and erase without cursor
+                const uintptr_t k = key - tausrand(taus_state) % 1000;
+                if (tausrand(taus_state) % 2 == 0) {
+                    mrxi_insert(tt, k, (void *)k);
+                    mrxi_insert(ref, k, (void *)k);
+                } else {
+                    mrxi_erase(tt, k);
+                    mrxi_erase(ref, k);
+                }
+            } else if (operation < 20) {
+                // re-insert existing
+                key -= tausrand(taus_state) % 4;
+            }
+            ASSERT(mrxi_insert_hint(cursor, key, (void *)key) == (void *)key);
+            mrxi_insert(ref, key, (void *)key);
+            key += 1 + tausrand(taus_state) % 300;
+            if (i % 10000 == 0) {
+                mrx_debug_sanity_check_int2ref(&tt->mrx);
+            }
+        }
+        mrx_debug_sanity_check_int2ref(&tt->mrx);
+        ASSERT(mrxi_size(tt) == mrxi_size(ref));
+        for (mrxi_it_t *it = mrxi_begin(ref); it != mrxi_end(); it = mrxi_next(it)) {
+            ASSERT(mrxi_find(tt, mrxi_key(it)) == mrxi_val(it));
+        }
+        mrxi_clear(tt);
+        ASSERT(mrxi_insert_hint(cursor, 1, (void *)1) == (void *)1);
+        ASSERT(mrxi_insert_hint(cursor, 2, (void *)2) == (void *)2);
+        ASSERT(mrxi_size(tt) == 2);
+        tt->mrx.capacity = 2;
+        ASSERT(mrxi_insert_hint(cursor, 3, (void *)3) == NULL);
+        ASSERT(mrxi_insert_hint(cursor, 2, (void *)4) == NULL);
+        mrxi_cursor_delete(cursor);
+        mrxi_cursor_delete(NULL);
+        mrxi_delete(ref);
+        mrxi_delete(tt);
+    }
+    {
+        mrx_t *tt = mrx_new(~0u);
+        mrx_cursor_t *cursor = mrx_cursor_new(tt);
+        char str[MRX_MAX_KEY_LENGTH_FOR_PATH_ON_STACK + 100];
+        unsigned count = 0;
+        for (unsigned i = 0; i < 20000; i++) {
+            const int len = sprintf(str, "tenant/%u/event/%u", i / 1000, i % 1000);
+            if (i % 3000 == 0) {
+                // long key, which grows the cursor and does not fit the path on stack
+                memset(&str[len], 'x', sizeof(str) - len - 1);
+                str[sizeof(str) - 1] = '\0';
+            }
+            ASSERT(mrx_insert_hintnt(cursor, str, (void *)(uintptr_t)(i + 1)) == (void *)(uintptr_t)(i + 1));
+            count++;
+            // prefix of previous key, ends in existing node
+            str[len - 1] = '\0';
+            if (mrx_findnt(tt, str) == NULL) {
+                count++;
+            }
+            mrx_insert_hint(cursor, str, strlen(str), (void *)0x1);
+        }
+        mrx_debug_sanity_check_str2ref(&tt->mrx);
+        ASSERT(mrx_size(tt) == count);
+        mrx_cursor_delete(cursor);
+        mrx_delete(tt);
+    }
+    {
+        mrxa_t *tt = mrxa_new(~0u);
+        mrx_cursor_t *cursor = mrxa_cursor_new(tt);
+        mrxa_insert_hint(cursor, 1, "a");
+        ASSERT(strcmp(mrxa_insert_hint(cursor, 1, "b"), "b") == 0);
+        ASSERT(strcmp(mrxa_find(tt, 1), "b") == 0);
+        mrxa_cursor_delete(cursor);
+        mrxa_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+struct lpm_ref_route {
+    uint8_t prefix[16];
+    unsigned bit_len;
+    bool is_erased;
+};
+
+static bool
+lpm_ref_prefix_matches(const uint8_t prefix[],
+                       const uint8_t addr[],
+                       unsigned bit_len)
+{
+    const unsigned q = bit_len / 8;
+    const unsigned r = bit_len % 8;
+    if (memcmp(prefix, addr, q) != 0) {
+        return false;
+    }
+    if (r == 0) {
+        return true;
+    }
+    const uint8_t mask = (uint8_t)(0xFFu << (8 - r));
+    return ((prefix[q] ^ addr[q]) & mask) == 0;
+}
+
+// Returns index of longest matching route, latest one if duplicates.
+static int
+lpm_ref_lookup(const struct lpm_ref_route routes[],
+               int route_count,
+               const uint8_t addr[])
+{
+    int best = -1;
+    for (int i = 0; i < route_count; i++) {
+        if (routes[i].is_erased || !lpm_ref_prefix_matches(routes[i].prefix, addr, routes[i].bit_len)) {
+            continue;
+        }
+        if (best == -1 || routes[i].bit_len >= routes[best].bit_len) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void
+mrx_lpm_random_tests(const unsigned addr_len,
+                     const int route_count)
+{
+    struct lpm_ref_route *routes = calloc(route_count, sizeof(routes[0]));
+    mrx_lpm_t *tt = mrx_lpm_new(~0u);
+    for (int i = 0; i < route_count; i++) {
+        // few prefix octets to get both deep overlaps and partial octets on the same entry
+        for (unsigned j = 0; j < addr_len; j++) {
+            routes[i].prefix[j] = (uint8_t)(tausrand(taus_state) % 4);
+        }
+        routes[i].bit_len = tausrand(taus_state) % (8 * addr_len + 1);
+        mrx_lpm_insert(tt, routes[i].prefix, routes[i].bit_len, (void *)(uintptr_t)(i + 1));
+        ASSERT(mrx_lpm_find(tt, routes[i].prefix, routes[i].bit_len) == (void *)(uintptr_t)(i + 1));
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 4 * route_count; i++) {
+            uint8_t addr[16];
+            for (unsigned j = 0; j < addr_len; j++) {
+                addr[j] = (uint8_t)(tausrand(taus_state) % 4);
+            }
+            if (i % 2 == 0) {
+                // random bits in the partial octet
+                addr[tausrand(taus_state) % addr_len] = (uint8_t)tausrand(taus_state);
+            }
+            const int best = lpm_ref_lookup(routes, route_count, addr);
+            unsigned match_bit_len = ~0u;
+            void *val = mrx_lpm_lookup(tt, addr, addr_len, &match_bit_len);
+            if (best == -1) {
+                ASSERT(val == NULL);
+                ASSERT(match_bit_len == ~0u);
+            } else {
+                ASSERT(val == (void *)(uintptr_t)(best + 1));
+                ASSERT(match_bit_len == routes[best].bit_len);
+                ASSERT(mrx_lpm_lookup(tt, addr, addr_len, NULL) == val);
+            }
+        }
+        // erase about half the routes and test again
+        for (int i = 0; i < route_count; i++) {
+            if (routes[i].is_erased || tausrand(taus_state) % 2 == 0) {
+                continue;
+            }
+            ASSERT(mrx_lpm_erase(tt, routes[i].prefix, routes[i].bit_len));
+            ASSERT(!mrx_lpm_erase(tt, routes[i].prefix, routes[i].bit_len));
+            ASSERT(mrx_lpm_find(tt, routes[i].prefix, routes[i].bit_len) == NULL);
+            // duplicates are erased together
+            for (int j = 0; j < route_count; j++) {
+                if (routes[j].bit_len == routes[i].bit_len &&
+                    lpm_ref_prefix_matches(routes[j].prefix, routes[i].prefix, routes[i].bit_len))
+                {
+                    routes[j].is_erased = true;
+                }
+            }
+        }
+    }
+    size_t count = 0;
+    for (int i = 0; i < route_count; i++) {
+        if (routes[i].is_erased) {
+            continue;
+        }
+        bool is_duplicate = false;
+        for (int j = i + 1; j < route_count && !is_duplicate; j++) {
+            is_duplicate = (routes[j].bit_len == routes[i].bit_len &&
+                            lpm_ref_prefix_matches(routes[j].prefix, routes[i].prefix, routes[i].bit_len));
+        }
+        count += !is_duplicate;
+    }
+    ASSERT(mrx_lpm_size(tt) == count);
+    mrx_lpm_delete(tt);
+    free(routes);
+}
+
+static void
+mrx_lpm_tests(void)
+{
+    fprintf(stderr, "Test: mrx_lpm random IPv4 and IPv6 tables...");
+    mrx_lpm_random_tests(4, 3000);
+    mrx_lpm_random_tests(16, 3000);
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_lpm all partial octets in one entry...");
+    {
+        mrx_lpm_t *tt = mrx_lpm_new(~0u);
+        ASSERT(mrx_lpm_empty(tt));
+        for (unsigned bit_len = 0; bit_len < 8; bit_len++) {
+            for (unsigned bits = 0; bits < (1u << bit_len); bits++) {
+                const uint8_t prefix = (uint8_t)(bits << (8 - bit_len));
+                mrx_lpm_insert(tt, &prefix, bit_len, (void *)(uintptr_t)(bit_len + 1));
+            }
+        }
+        ASSERT(mrx_lpm_size(tt) == 255);
+        for (unsigned a = 0; a < 256; a++) {
+            const uint8_t addr = (uint8_t)a;
+            unsigned match_bit_len;
+            ASSERT(mrx_lpm_lookup(tt, &addr, 1, &match_bit_len) == (void *)8);
+            ASSERT(match_bit_len == 7);
+            // zero length address only matches the default route
+            ASSERT(mrx_lpm_lookup(tt, &addr, 0, &match_bit_len) == (void *)1);
+            ASSERT(match_bit_len == 0);
+        }
+        const uint8_t addr = 0xA5;
+        ASSERT(mrx_lpm_erase(tt, &addr, 7));
+        ASSERT(mrx_lpm_lookup(tt, &addr, 1, NULL) == (void *)7);
+        ASSERT(!mrx_lpm_empty(tt));
+        mrx_lpm_clear(tt);
+        ASSERT(mrx_lpm_empty(tt));
+        ASSERT(mrx_lpm_lookup(tt, &addr, 1, NULL) == NULL);
+        ASSERT(mrx_lpm_find(tt, &addr, 0) == NULL);
+        ASSERT(!mrx_lpm_erase(tt, &addr, 0));
+        mrx_lpm_insert(tt, &addr, 8, (void *)1);
+        ASSERT(mrx_lpm_find(tt, &addr, 7) == NULL);
+        ASSERT(!mrx_lpm_erase(tt, &addr, 7));
+        mrx_lpm_delete(tt);
+        mrx_lpm_delete(NULL);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_lpm value copying...");
+    {
+        const uint8_t prefix[] = { 10, 0, 0, 0 };
+        mrx_lpma_t *tt = mrx_lpma_new(~0u);
+        ASSERT(strcmp(mrx_lpma_insert(tt, prefix, 8, "a"), "a") == 0);
+        ASSERT(strcmp(mrx_lpma_insert(tt, prefix, 8, "b"), "b") == 0);
+        ASSERT(strcmp(mrx_lpma_insert(tt, prefix, 12, "c"), "c") == 0);
+        ASSERT(strcmp(mrx_lpma_lookup(tt, prefix, 4, NULL), "c") == 0);
+        ASSERT(mrx_lpma_size(tt) == 2);
+        ASSERT(mrx_lpma_erase(tt, prefix, 12));
+        ASSERT(strcmp(mrx_lpma_find(tt, prefix, 8), "b") == 0);
+        mrx_lpma_clear(tt);
+        mrx_lpma_insert(tt, prefix, 8, "d");
+        mrx_lpma_delete(tt);
+
+        // node capacity reached
+        mrx_lpm_t *tl = mrx_lpm_new(1);
+        ASSERT(mrx_lpm_insert(tl, prefix, 8, (void *)1) == (void *)1);
+        ASSERT(mrx_lpm_insert(tl, prefix, 16, (void *)2) == NULL);
+        ASSERT(mrx_lpm_size(tl) == 1);
+        mrx_lpm_delete(tl);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#define INTERN_KEY_COUNT 5000
+
+static void
+mrx_intern_tests(void)
+{
+    fprintf(stderr, "Test: mrx_intern dense IDs and reverse lookup...");
+    {
+        mrx_intern_t *pool = mrx_intern_new(~0u);
+        char (*strs)[16] = malloc(INTERN_KEY_COUNT * sizeof(strs[0]));
+        ASSERT(mrx_intern_empty(pool));
+        ASSERT(mrx_intern_findnt(pool, "miss") == MRX_INTERN_NO_ID);
+        ASSERT(mrx_intern_str(pool, 0, NULL) == NULL);
+        for (unsigned i = 0; i < INTERN_KEY_COUNT; i++) {
+            sprintf(strs[i], "s%u", i * 7919u);
+            ASSERT(mrx_intern_internnt(pool, strs[i]) == i);
+        }
+        ASSERT(mrx_intern_size(pool) == INTERN_KEY_COUNT);
+        for (unsigned i = 0; i < INTERN_KEY_COUNT; i++) {
+            size_t len;
+            ASSERT(mrx_intern_internnt(pool, strs[i]) == i);
+            ASSERT(mrx_intern_findnt(pool, strs[i]) == i);
+            const char *str = mrx_intern_str(pool, i, &len);
+            ASSERT(len == strlen(strs[i]));
+            ASSERT(strcmp(str, strs[i]) == 0);
+            ASSERT(mrx_intern_str(pool, i, NULL) == str);
+        }
+        ASSERT(mrx_intern_size(pool) == INTERN_KEY_COUNT);
+        ASSERT(mrx_intern_str(pool, INTERN_KEY_COUNT, NULL) == NULL);
+
+        // empty string and embedded NUL
+        const uint32_t id0 = mrx_intern_intern(pool, "", 0);
+        const uint32_t id1 = mrx_intern_intern(pool, "a\0b", 3);
+        const uint32_t id2 = mrx_intern_intern(pool, "a\0c", 3);
+        ASSERT(id0 == INTERN_KEY_COUNT && id1 == id0 + 1 && id2 == id1 + 1);
+        ASSERT(mrx_intern_find(pool, "a", 1) == MRX_INTERN_NO_ID);
+        ASSERT(mrx_intern_find(pool, "a\0b", 3) == id1);
+        size_t len;
+        ASSERT(memcmp(mrx_intern_str(pool, id2, &len), "a\0c", 4) == 0 && len == 3);
+        ASSERT(strcmp(mrx_intern_str(pool, id0, &len), "") == 0 && len == 0);
+
+        mrx_intern_clear(pool);
+        ASSERT(mrx_intern_empty(pool));
+        ASSERT(mrx_intern_findnt(pool, strs[0]) == MRX_INTERN_NO_ID);
+        ASSERT(mrx_intern_internnt(pool, strs[1]) == 0);
+        ASSERT(strcmp(mrx_intern_str(pool, 0, NULL), strs[1]) == 0);
+        free(strs);
+        mrx_intern_delete(pool);
+        mrx_intern_delete(NULL);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_intern batch calls...");
+    for (unsigned count = 1; count <= 1000; count *= 10) {
+        mrx_intern_t *single = mrx_intern_new(~0u);
+        mrx_internp_t *batch = mrx_internp_new(~0u);
+        char (*buf)[16] = malloc(count * sizeof(buf[0]));
+        const char **strs = malloc(count * sizeof(strs[0]));
+        size_t *lens = malloc(count * sizeof(lens[0]));
+        uint32_t *ids = malloc(count * sizeof(ids[0]));
+        for (unsigned round = 0; round < 3; round++) {
+            for (unsigned i = 0; i < count; i++) {
+                // duplicates within and across batches
+                sprintf(buf[i], "k%u", tausrand(taus_state) % (2 * count));
+                strs[i] = buf[i];
+                lens[i] = strlen(buf[i]);
+            }
+            mrx_internp_find_batch(batch, strs, round == 1 ? NULL : lens, count, ids);
+            for (unsigned i = 0; i < count; i++) {
+                ASSERT(ids[i] == mrx_intern_findnt(single, strs[i]));
+            }
+            ASSERT(mrx_internp_intern_batch(batch, strs, round == 1 ? NULL : lens, count, ids) == count);
+            for (unsigned i = 0; i < count; i++) {
+                ASSERT(ids[i] == mrx_intern_internnt(single, strs[i]));
+            }
+            ASSERT(mrx_internp_size(batch) == mrx_intern_size(single));
+        }
+        free(ids);
+        free(lens);
+        free(strs);
+        free(buf);
+        mrx_internp_delete(batch);
+        mrx_intern_delete(single);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_intern hash collisions and capacity...");
+    {
+        mrx_intern_t *pool = mrx_intern_new(~0u);
+        ASSERT(mrx_intern_internnt(pool, "a") == 0);
+
+        // occupy the hash key of "b" with the ID of "a" to force probing
+        const uint64_t hash = mrx_intern_hash_((const uint8_t *)"b", 1);
+        bool is_occupied;
+        void **vref = mrx_insert_(&pool->pool.mrx, (const uint8_t *)&hash, sizeof(hash), &is_occupied);
+        ASSERT(vref != NULL && !is_occupied);
+        *vref = (void *)(uintptr_t)0;
+        ASSERT(mrx_intern_findnt(pool, "b") == MRX_INTERN_NO_ID);
+        ASSERT(mrx_intern_internnt(pool, "b") == 1);
+        ASSERT(mrx_intern_internnt(pool, "b") == 1);
+        ASSERT(mrx_intern_findnt(pool, "b") == 1);
+        ASSERT(mrx_intern_findnt(pool, "a") == 0);
+        const uint64_t next_hash = hash + 1;
+        ASSERT(mrx_find_(pool->pool.mrx.root, (const uint8_t *)&next_hash, sizeof(next_hash)) != NULL);
+        mrx_intern_delete(pool);
+
+        // node capacity reached
+        mrx_internp_t *pp = mrx_internp_new(1);
+        ASSERT(mrx_internp_internnt(pp, "a") == 0);
+        ASSERT(mrx_internp_internnt(pp, "b") == MRX_INTERN_NO_ID);
+        ASSERT(mrx_internp_size(pp) == 1);
+        ASSERT(mrx_internp_findnt(pp, "a") == 0);
+        ASSERT(mrx_internp_str(pp, 1, NULL) == NULL);
+        mrx_internp_delete(pp);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#define KEYENC_TUPLE_COUNT 5000
+
+struct keyenc_tuple {
+    uint32_t tenant;
+    int64_t timestamp;
+    size_t name_len;
+    char name[8];
+};
+
+static int
+keyenc_tuple_cmp(const void *a_,
+                 const void *b_)
+{
+    const struct keyenc_tuple *a = a_;
+    const struct keyenc_tuple *b = b_;
+    if (a->tenant != b->tenant) {
+        return a->tenant < b->tenant ? -1 : 1;
+    }
+    if (a->timestamp != b->timestamp) {
+        return a->timestamp < b->timestamp ? -1 : 1;
+    }
+    const size_t len = a->name_len < b->name_len ? a->name_len : b->name_len;
+    const int cmp = memcmp(a->name, b->name, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return a->name_len < b->name_len ? -1 : (a->name_len > b->name_len);
+}
+
+static size_t
+keyenc_tuple_encode(const struct keyenc_tuple *t,
+                    uint8_t buf[],
+                    const size_t size)
+{
+    mrx_keyenc_t enc;
+    mrx_keyenc_init(&enc, buf, size);
+    mrx_keyenc_u32(&enc, t->tenant);
+    mrx_keyenc_i64(&enc, t->timestamp);
+    mrx_keyenc_str(&enc, t->name, t->name_len);
+    ASSERT(mrx_keyenc_ok(&enc));
+    return enc.len;
+}
+
+static void
+mrx_keyenc_tests(void)
+{
+    fprintf(stderr, "Test: mrx_keyenc composite key order and seek...");
+    {
+        struct keyenc_tuple *tuples = malloc(KEYENC_TUPLE_COUNT * sizeof(*tuples));
+        mrx_t *tt = mrx_new(~0u);
+        size_t count = 0;
+        for (unsigned i = 0; i < KEYENC_TUPLE_COUNT; i++) {
+            struct keyenc_tuple *t = &tuples[count];
+            memset(t, 0, sizeof(*t));
+            t->tenant = tausrand(taus_state) % 3 == 0 ? UINT32_MAX - tausrand(taus_state) % 4 : tausrand(taus_state) % 8;
+            t->timestamp = (int64_t)(tausrand(taus_state) % 64) - 32;
+            if (tausrand(taus_state) % 8 == 0) {
+                t->timestamp = tausrand(taus_state) % 2 == 0 ? INT64_MIN : INT64_MAX;
+            }
+            // short names from a small alphabet that includes 0x00 and 0xFF
+            t->name_len = tausrand(taus_state) % 4;
+            for (size_t j = 0; j < t->name_len; j++) {
+                const char alphabet[] = { '\0', '\001', 'a', (char)0xFF };
+                t->name[j] = alphabet[tausrand(taus_state) % 4];
+            }
+            uint8_t buf[64];
+            const size_t len = keyenc_tuple_encode(t, buf, sizeof(buf));
+            if (mrx_find(tt, (const char *)buf, len) == NULL) {
+                mrx_insert(tt, (const char *)buf, len, (void *)(uintptr_t)(count + 1));
+                count++;
+            }
+        }
+        ASSERT(mrx_size(tt) == count);
+        qsort(tuples, count, sizeof(tuples[0]), keyenc_tuple_cmp);
+
+        size_t i = 0;
+        mrx_it_t *it;
+        for (it = mrx_begin(tt); it != mrx_end(); it = mrx_next(it)) {
+            const char *key = mrx_key(it);
+            mrx_keydec_t dec;
+            char name[8];
+            mrx_keydec_init(&dec, key, mrx_keylen(it));
+            ASSERT(i < count);
+            ASSERT(mrx_keydec_u32(&dec) == tuples[i].tenant);
+            ASSERT(mrx_keydec_i64(&dec) == tuples[i].timestamp);
+            ASSERT(mrx_keydec_str(&dec, name, sizeof(name)) == tuples[i].name_len);
+            ASSERT(memcmp(name, tuples[i].name, tuples[i].name_len) == 0);
+            ASSERT(name[tuples[i].name_len] == '\0');
+            ASSERT(mrx_keydec_end(&dec));
+            i++;
+        }
+        ASSERT(i == count);
+
+        // seek to the first tuple of one tenant at or after a timestamp, and
+        // scan the rest of that tenant with the encoded tenant as prefix
+        const struct keyenc_tuple *from = &tuples[count / 2];
+        uint8_t seek[12];
+        mrx_keyenc_t senc;
+        mrx_keyenc_init(&senc, seek, sizeof(seek));
+        mrx_keyenc_u32(&senc, from->tenant);
+        mrx_keyenc_i64(&senc, from->timestamp);
+        ASSERT(mrx_keyenc_ok(&senc) && senc.len == 12);
+        i = count / 2;
+        while (i > 0 && tuples[i - 1].tenant == from->tenant && tuples[i - 1].timestamp == from->timestamp) {
+            i--;
+        }
+        const size_t first = i;
+        void *itspace = malloc(mrx_itsize(tt));
+        for (it = mrx_lower_boundst(tt, (const char *)seek, senc.len, itspace);
+             it != mrx_end() && mrx_keylen(it) >= 4 && memcmp(mrx_key(it), seek, 4) == 0;
+             it = mrx_next(it)) {
+            mrx_keydec_t dec;
+            mrx_keydec_init(&dec, mrx_key(it), mrx_keylen(it));
+            ASSERT(i < count);
+            ASSERT(mrx_keydec_u32(&dec) == tuples[i].tenant);
+            ASSERT(mrx_keydec_i64(&dec) == tuples[i].timestamp);
+            ASSERT((uintptr_t)mrx_val(it) != 0);
+            i++;
+        }
+        ASSERT(i > first);
+        ASSERT(i == count || tuples[i].tenant != from->tenant);
+        free(itspace);
+
+        // erase all tuples of one tenant, using the encoded leading field as prefix
+        uint8_t prefix[4];
+        mrx_keyenc_t enc;
+        mrx_keyenc_init(&enc, prefix, sizeof(prefix));
+        mrx_keyenc_u32(&enc, tuples[0].tenant);
+        size_t tenant_count = 0;
+        for (i = 0; i < count && tuples[i].tenant == tuples[0].tenant; i++) {
+            tenant_count++;
+        }
+        ASSERT(mrx_erase_prefix(tt, (const char *)prefix, enc.len) == tenant_count);
+        ASSERT(mrx_size(tt) == count - tenant_count);
+        mrx_delete(tt);
+        free(tuples);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_keyenc integer and float fields...");
+    {
+        const int64_t ivals[] = { INT64_MIN, INT32_MIN, -65536, -1, 0, 1, 127, 128, INT32_MAX, INT64_MAX };
+        const double fvals[] = { -INFINITY, -1e300, -1.0, -1e-300, -0.0, 0.0, 1e-300, 1.0, 1e300, INFINITY };
+        const size_t n = sizeof(ivals) / sizeof(ivals[0]);
+        uint8_t prev[4][8], buf[4][8];
+        for (size_t i = 0; i < n; i++) {
+            mrx_keyenc_t enc[4];
+            for (unsigned j = 0; j < 4; j++) {
+                mrx_keyenc_init(&enc[j], buf[j], 8);
+            }
+            mrx_keyenc_i64(&enc[0], ivals[i]);
+            mrx_keyenc_f64(&enc[1], fvals[i]);
+            mrx_keyenc_f32(&enc[2], (float)fvals[i]);
+            mrx_keyenc_u64(&enc[3], (uint64_t)ivals[i] ^ 0x8000000000000000u);
+            ASSERT(enc[0].len == 8 && enc[1].len == 8 && enc[2].len == 4 && enc[3].len == 8);
+            // signed integers encode as the offset unsigned value
+            ASSERT(memcmp(buf[0], buf[3], 8) == 0);
+            if (i > 0) {
+                ASSERT(memcmp(prev[0], buf[0], 8) < 0);
+                ASSERT(memcmp(prev[1], buf[1], 8) < 0);
+                // float has less range, so only order is preserved here
+                ASSERT(memcmp(prev[2], buf[2], 4) <= 0);
+            }
+            memcpy(prev, buf, sizeof(buf));
+
+            mrx_keydec_t dec;
+            mrx_keydec_init(&dec, buf[0], 8);
+            ASSERT(mrx_keydec_i64(&dec) == ivals[i]);
+            ASSERT(mrx_keydec_end(&dec));
+            mrx_keydec_init(&dec, buf[1], 8);
+            const double d = mrx_keydec_f64(&dec);
+            ASSERT(memcmp(&d, &fvals[i], sizeof(d)) == 0);
+            mrx_keydec_init(&dec, buf[2], 4);
+            ASSERT(mrx_keydec_f32(&dec) == (float)fvals[i]);
+            ASSERT(mrx_keydec_end(&dec));
+        }
+
+        uint8_t b[16];
+        mrx_keyenc_t enc;
+        mrx_keyenc_init(&enc, b, sizeof(b));
+        mrx_keyenc_i8(&enc, -128);
+        mrx_keyenc_i16(&enc, -2);
+        mrx_keyenc_i32(&enc, 5);
+        mrx_keyenc_u8(&enc, 200);
+        mrx_keyenc_u16(&enc, 0xABCD);
+        mrx_keyenc_u32(&enc, 7);
+        ASSERT(mrx_keyenc_ok(&enc) && enc.len == 14);
+        ASSERT(b[0] == 0x00 && b[1] == 0x7F && b[2] == 0xFE && b[3] == 0x80);
+        mrx_keydec_t dec;
+        mrx_keydec_init(&dec, b, enc.len);
+        ASSERT(mrx_keydec_i8(&dec) == -128);
+        ASSERT(mrx_keydec_i16(&dec) == -2);
+        ASSERT(mrx_keydec_i32(&dec) == 5);
+        ASSERT(mrx_keydec_u8(&dec) == 200);
+        ASSERT(mrx_keydec_u16(&dec) == 0xABCD);
+        ASSERT(mrx_keydec_u32(&dec) == 7);
+        ASSERT(mrx_keydec_end(&dec));
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_keyenc string escaping, overflow and decode errors...");
+    {
+        uint8_t b[16];
+        mrx_keyenc_t enc;
+        mrx_keyenc_init(&enc, b, sizeof(b));
+        mrx_keyenc_str(&enc, "a\0b", 3);
+        ASSERT(enc.len == 6 && memcmp(b, "a\0\xFF" "b\0\001", 6) == 0);
+        mrx_keyenc_strprefix(&enc, "xy", 2);
+        ASSERT(enc.len == 8);
+        mrx_keyenc_strnt(&enc, "");
+        ASSERT(enc.len == 10 && mrx_keyenc_ok(&enc));
+
+        // the shorter string sorts first, also when followed by other fields
+        uint8_t k1[16], k2[16];
+        mrx_keyenc_t e1, e2;
+        mrx_keyenc_init(&e1, k1, sizeof(k1));
+        mrx_keyenc_init(&e2, k2, sizeof(k2));
+        mrx_keyenc_strnt(&e1, "a");
+        mrx_keyenc_u8(&e1, 0xFF);
+        mrx_keyenc_str(&e2, "a\0", 2);
+        mrx_keyenc_u8(&e2, 0x00);
+        ASSERT(memcmp(k1, k2, e1.len < e2.len ? e1.len : e2.len) < 0);
+
+        // overflow is sticky, and no partial field is written
+        mrx_keyenc_init(&enc, b, 6);
+        mrx_keyenc_u32(&enc, 1);
+        mrx_keyenc_u32(&enc, 2);
+        ASSERT(!mrx_keyenc_ok(&enc) && enc.len == 4);
+        mrx_keyenc_u8(&enc, 3);
+        ASSERT(!mrx_keyenc_ok(&enc) && enc.len == 4);
+        mrx_keyenc_init(&enc, b, 4);
+        mrx_keyenc_str(&enc, "ab", 2);
+        ASSERT(mrx_keyenc_ok(&enc) && enc.len == 4);
+        mrx_keyenc_init(&enc, b, 4);
+        mrx_keyenc_str(&enc, "a\0", 2);
+        ASSERT(!mrx_keyenc_ok(&enc) && enc.len == 0);
+
+        mrx_keydec_t dec;
+        char s[4];
+        mrx_keydec_init(&dec, "abcde\0\001", 7);
+        ASSERT(mrx_keydec_str(&dec, s, sizeof(s)) == 5);
+        ASSERT(strcmp(s, "abc") == 0);
+        ASSERT(mrx_keydec_end(&dec));
+        mrx_keydec_init(&dec, "ab\0\001", 4);
+        ASSERT(mrx_keydec_str(&dec, NULL, 0) == 2);
+        ASSERT(mrx_keydec_end(&dec));
+        mrx_keydec_init(&dec, "ab\0\001", 4);
+        ASSERT(mrx_keydec_str(&dec, s, 0) == 2);
+        mrx_keydec_init(&dec, "ab", 2);
+        ASSERT(mrx_keydec_str(&dec, s, sizeof(s)) == 0);
+        ASSERT(!mrx_keydec_ok(&dec));
+        mrx_keydec_init(&dec, "ab\0", 3);
+        ASSERT(mrx_keydec_str(&dec, s, sizeof(s)) == 0);
+        ASSERT(!mrx_keydec_ok(&dec));
+        mrx_keydec_init(&dec, "ab\0\002", 4);
+        ASSERT(mrx_keydec_str(&dec, s, sizeof(s)) == 0);
+        ASSERT(!mrx_keydec_ok(&dec));
+        ASSERT(mrx_keydec_u8(&dec) == 0);
+        mrx_keydec_init(&dec, "\x80\x00\x00", 3);
+        ASSERT(mrx_keydec_i32(&dec) == 0);
+        ASSERT(!mrx_keydec_ok(&dec) && !mrx_keydec_end(&dec));
+        mrx_keydec_init(&dec, "\x80\x00\x00", 3);
+        ASSERT(mrx_keydec_f32(&dec) == 0);
+        ASSERT(mrx_keydec_f64(&dec) == 0);
+        ASSERT(mrx_keydec_i64(&dec) == 0);
+        ASSERT(mrx_keydec_i16(&dec) == 0);
+        ASSERT(mrx_keydec_i8(&dec) == 0);
+        ASSERT(mrx_keydec_u64(&dec) == 0);
+        ASSERT(mrx_keydec_str(&dec, s, sizeof(s)) == 0);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+#define TOPK_KEY_COUNT 3000
+#define TOPK_MAX_KEY_LEN 160
+
+struct topk_ref_key {
+    uint8_t key[TOPK_MAX_KEY_LEN];
+    unsigned len;
+    uint32_t score;
+    bool alive;
+};
+
+struct topk_result {
+    unsigned count;
+    uint8_t keys[100][TOPK_MAX_KEY_LEN];
+    unsigned lens[100];
+    uint32_t scores[100];
+};
+
+static void
+topk_result_cb(const uint8_t key[],
+               unsigned key_len,
+               uint32_t score,
+               void *arg)
+{
+    struct topk_result *res = arg;
+    ASSERT(res->count < 100 && key_len <= TOPK_MAX_KEY_LEN);
+    memcpy(res->keys[res->count], key, key_len);
+    res->lens[res->count] = key_len;
+    res->scores[res->count] = score;
+    res->count++;
+}
+
+static int
+topk_score_cmp_desc(const void *a,
+                    const void *b)
+{
+    const uint32_t sa = *(const uint32_t *)a;
+    const uint32_t sb = *(const uint32_t *)b;
+    return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+static void
+topk_check_query(mrx_topk_t *tt,
+                 mrx_topkp_t *tp,
+                 const struct topk_ref_key ref[],
+                 const unsigned ref_count,
+                 const uint8_t prefix[],
+                 const unsigned prefix_len,
+                 const unsigned k)
+{
+    static uint32_t expected[TOPK_KEY_COUNT];
+    unsigned match_count = 0;
+    for (unsigned i = 0; i < ref_count; i++) {
+        if (ref[i].alive && ref[i].len >= prefix_len && memcmp(ref[i].key, prefix, prefix_len) == 0) {
+            expected[match_count++] = ref[i].score;
+        }
+    }
+    qsort(expected, match_count, sizeof(expected[0]), topk_score_cmp_desc);
+    const unsigned expected_count = match_count < k ? match_count : k;
+
+    struct topk_result res[2];
+    res[0].count = 0;
+    res[1].count = 0;
+    ASSERT(mrx_topk_query(tt, (const char *)prefix, prefix_len, k, topk_result_cb, &res[0]) == expected_count);
+    ASSERT(mrx_topkp_query(tp, (const char *)prefix, prefix_len, k, topk_result_cb, &res[1]) == expected_count);
+    for (unsigned r = 0; r < 2; r++) {
+        ASSERT(res[r].count == expected_count);
+        for (unsigned i = 0; i < expected_count; i++) {
+            // scores are unique per rank, keys may differ between equal scores
+            ASSERT(res[r].scores[i] == expected[i]);
+            ASSERT(res[r].lens[i] >= prefix_len && memcmp(res[r].keys[i], prefix, prefix_len) == 0);
+            uint32_t score;
+            ASSERT(mrx_topk_find(tt, (const char *)res[r].keys[i], res[r].lens[i], &score));
+            ASSERT(score == res[r].scores[i]);
+            for (unsigned j = 0; j < i; j++) {
+                ASSERT(res[r].lens[i] != res[r].lens[j] || memcmp(res[r].keys[i], res[r].keys[j], res[r].lens[i]) != 0);
+            }
+        }
+    }
+}
+
+static void
+mrx_topk_tests(void)
+{
+    fprintf(stderr, "Test: mrx_topk random inserts, updates and erases...");
+    {
+        struct topk_ref_key *ref = calloc(TOPK_KEY_COUNT, sizeof(*ref));
+        mrx_topk_t *tt = mrx_topk_new(~0u);
+        mrx_topkp_t *tp = mrx_topkp_new(~0u);
+        unsigned ref_count = 0;
+        ASSERT(mrx_topk_empty(tt));
+        topk_check_query(tt, tp, ref, ref_count, (const uint8_t *)"", 0, 10);
+        for (unsigned op = 0; op < 4 * TOPK_KEY_COUNT; op++) {
+            const unsigned r = tausrand(taus_state) % 10;
+            if (ref_count < TOPK_KEY_COUNT && (r < 5 || ref_count == 0)) {
+                struct topk_ref_key *rk = &ref[ref_count];
+                switch (tausrand(taus_state) % 8) {
+                case 0:
+                    // many branches at one position, which gives mask nodes
+                    rk->len = 2;
+                    rk->key[0] = 'm';
+                    rk->key[1] = (uint8_t)(tausrand(taus_state) % 256);
+                    break;
+                case 1:
+                    // longer than the prefix of a single node
+                    rk->len = 130 + tausrand(taus_state) % 30;
+                    memset(rk->key, 'l', rk->len);
+                    rk->key[tausrand(taus_state) % rk->len] = 'a' + tausrand(taus_state) % 3;
+                    break;
+                default:
+                    rk->len = 1 + tausrand(taus_state) % 8;
+                    for (unsigned i = 0; i < rk->len; i++) {
+                        rk->key[i] = 'a' + tausrand(taus_state) % 3;
+                    }
+                    break;
+                }
+                rk->score = tausrand(taus_state) % 1000;
+                bool is_dup = false;
+                for (unsigned i = 0; i < ref_count && !is_dup; i++) {
+                    is_dup = ref[i].len == rk->len && memcmp(ref[i].key, rk->key, rk->len) == 0;
+                }
+                if (is_dup) {
+                    continue;
+                }
+                ASSERT(mrx_topk_insert(tt, (const char *)rk->key, rk->len, rk->score));
+                ASSERT(mrx_topkp_insert(tp, (const char *)rk->key, rk->len, rk->score));
+                rk->alive = true;
+                ref_count++;
+            } else {
+                struct topk_ref_key *rk = &ref[tausrand(taus_state) % ref_count];
+                if (r < 8) {
+                    // new score, or re-insert of an erased key
+                    rk->score = tausrand(taus_state) % 1000;
+                    rk->alive = true;
+                    ASSERT(mrx_topk_insert(tt, (const char *)rk->key, rk->len, rk->score));
+                    ASSERT(mrx_topkp_insert(tp, (const char *)rk->key, rk->len, rk->score));
+                } else {
+                    ASSERT(mrx_topk_erase(tt, (const char *)rk->key, rk->len) == rk->alive);
+                    ASSERT(mrx_topkp_erase(tp, (const char *)rk->key, rk->len) == rk->alive);
+                    rk->alive = false;
+                    ASSERT(!mrx_topk_find(tt, (const char *)rk->key, rk->len, NULL));
+                }
+            }
+            if (op % 16 == 0) {
+                const struct topk_ref_key *rk = &ref[tausrand(taus_state) % ref_count];
+                const unsigned prefix_len = tausrand(taus_state) % (rk->len + 1);
+                const unsigned ks[] = { 1, 3, 10, 100 };
+                topk_check_query(tt, tp, ref, ref_count, rk->key, prefix_len, ks[tausrand(taus_state) % 4]);
+            }
+        }
+        unsigned alive_count = 0;
+        for (unsigned i = 0; i < ref_count; i++) {
+            alive_count += ref[i].alive;
+        }
+        ASSERT(mrx_topk_size(tt) == alive_count);
+        ASSERT(mrx_topkp_size(tp) == alive_count);
+        topk_check_query(tt, tp, ref, ref_count, (const uint8_t *)"", 0, 100);
+        topk_check_query(tt, tp, ref, ref_count, (const uint8_t *)"m", 1, 100);
+        topk_check_query(tt, tp, ref, ref_count, (const uint8_t *)"x", 1, 10);
+
+        // erase everything, which should leave no score entries behind
+        for (unsigned i = 0; i < ref_count; i++) {
+            if (ref[i].alive) {
+                ASSERT(mrx_topk_erase(tt, (const char *)ref[i].key, ref[i].len));
+                ASSERT(mrx_topkp_erase(tp, (const char *)ref[i].key, ref[i].len));
+                ref[i].alive = false;
+            }
+        }
+        ASSERT(mrx_topk_empty(tt));
+        ASSERT(mrx_topkp_empty(tp));
+        ASSERT(tt->t.maxes->root == NULL);
+        ASSERT(tp->t.maxes->root == NULL);
+        topk_check_query(tt, tp, ref, 0, (const uint8_t *)"", 0, 10);
+        ASSERT(!mrx_topk_erasent(tt, "a"));
+
+        // keys too long for the scratch space to be on the stack
+        {
+            static char long_key[3000];
+            memset(long_key, 'q', sizeof(long_key));
+            uint32_t score;
+            ASSERT(mrx_topk_insert(tt, long_key, sizeof(long_key), 7));
+            ASSERT(mrx_topk_insert(tt, long_key, sizeof(long_key) - 1000, 9));
+            ASSERT(mrx_topk_insert(tt, long_key, sizeof(long_key), 3));
+            ASSERT(mrx_topk_find(tt, long_key, sizeof(long_key), &score) && score == 3);
+            ASSERT(mrx_topk_erase(tt, long_key, sizeof(long_key) - 1000));
+            ASSERT(mrx_topk_erase(tt, long_key, sizeof(long_key)));
+            ASSERT(mrx_topk_empty(tt));
+            ASSERT(tt->t.maxes->root == NULL);
+        }
+
+        mrx_topkp_clear(tp);
+        ASSERT(mrx_topkp_insertnt(tp, "abc", 5));
+        ASSERT(mrx_topkp_findnt(tp, "abc", NULL));
+        ASSERT(mrx_topkp_erasent(tp, "abc"));
+        mrx_topkp_delete(tp);
+        mrx_topk_delete(tt);
+        mrx_topk_delete(NULL);
+        free(ref);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: mrx_topk completion example...");
+    {
+        mrx_topk_t *tt = mrx_topk_new(~0u);
+        const char *words[] = { "car", "card", "care", "careful", "cart", "cat", "dog" };
+        const uint32_t scores[] = { 50, 10, 40, 70, 20, 90, 100 };
+        for (unsigned i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+            ASSERT(mrx_topk_insertnt(tt, words[i], scores[i]));
+        }
+        struct topk_result res = { .count = 0 };
+        ASSERT(mrx_topk_querynt(tt, "car", 3, topk_result_cb, &res) == 3);
+        ASSERT(res.lens[0] == 7 && memcmp(res.keys[0], "careful", 7) == 0);
+        ASSERT(res.lens[1] == 3 && memcmp(res.keys[1], "car", 3) == 0);
+        ASSERT(res.lens[2] == 4 && memcmp(res.keys[2], "care", 4) == 0);
+        ASSERT(mrx_topk_insertnt(tt, "careful", 1));
+        ASSERT(mrx_topk_erasent(tt, "car"));
+        res.count = 0;
+        ASSERT(mrx_topk_querynt(tt, "ca", 2, topk_result_cb, &res) == 2);
+        ASSERT(res.lens[0] == 3 && memcmp(res.keys[0], "cat", 3) == 0);
+        ASSERT(res.lens[1] == 4 && memcmp(res.keys[1], "care", 4) == 0);
+        res.count = 0;
+        ASSERT(mrx_topk_querynt(tt, "cab", 2, topk_result_cb, &res) == 0);
+        ASSERT(mrx_topk_querynt(tt, "car", 0, topk_result_cb, &res) == 0);
+        mrx_topk_delete(tt);
+
+        // capacity reached
+        tt = mrx_topk_new(1);
+        ASSERT(mrx_topk_insertnt(tt, "a", 1));
+        ASSERT(!mrx_topk_insertnt(tt, "b", 2));
+        ASSERT(mrx_topk_insertnt(tt, "a", 3));
+        res.count = 0;
+        ASSERT(mrx_topk_querynt(tt, "", 10, topk_result_cb, &res) == 1);
+        ASSERT(res.scores[0] == 3);
+        mrx_topk_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+}
+
+struct shard_thread_arg {
+    mrxsh_t *sh;
+    unsigned id;
+    unsigned count;
+    bool is_reader;
+};
+
+// distinct keys for all threads, spread over all shards
+#define SHARD_TEST_KEY(id, i) (((uintptr_t)(i) * 8u + (id)) * (uintptr_t)0x9E3779B97F4A7C15ull)
+
+static void *
+shard_thread(void *arg_)
+{
+    struct shard_thread_arg *arg = (struct shard_thread_arg *)arg_;
+    if (arg->is_reader) {
+        // iterates while the writers insert, keys must stay in order
+        for (unsigned round = 0; round < 20; round++) {
+            uintptr_t prev = 0;
+            bool is_first = true;
+            for (mrxsh_it_t *it = mrxsh_begin(arg->sh); it != mrxsh_end(); it = mrxsh_next(it)) {
+                const uintptr_t key = mrxsh_key(it);
+                ASSERT(is_first || key > prev);
+                ASSERT(mrxsh_val(it) == (void *)~key);
+                prev = key;
+                is_first = false;
+            }
+        }
+        return NULL;
+    }
+    for (unsigned i = 0; i < arg->count; i++) {
+        const uintptr_t key = SHARD_TEST_KEY(arg->id, i);
+        mrxsh_insert(arg->sh, key, (void *)~key);
+        if (i % 3 == 0) {
+            ASSERT(mrxsh_find(arg->sh, key) == (void *)~key);
+        }
+        if (i % 5 == 0 && i > 0) {
+            const uintptr_t erase_key = SHARD_TEST_KEY(arg->id, i - 1);
+            ASSERT(mrxsh_erase(arg->sh, erase_key) == (void *)~erase_key);
+        }
+    }
+    return NULL;
+}
+
+static void
+mrx_shard_tests(void)
+{
+    fprintf(stderr, "Test: mrx lower_bound...");
+    {
+        const unsigned count = 20000;
+        uintptr_t *keys = malloc(count * sizeof(keys[0]));
+        mrxi_t *tt = mrxi_new(~0u);
+        ASSERT(mrxi_lower_bound(tt, 5) == mrxi_end());
+        for (unsigned i = 0; i < count; i++) {
+            do {
+                keys[i] = (i % 2 == 0) ? random_key() : 0x1000 + tausrand(taus_state) % 100000;
+            } while (mrxi_find(tt, keys[i]) != NULL);
+            mrxi_insert(tt, keys[i], (void *)~keys[i]);
+        }
+        qsort(keys, count, sizeof(keys[0]), uintptr_cmp);
+        void *itbuf = malloc(mrxi_itsize(tt));
+        for (unsigned i = 0; i < 20000; i++) {
+            // existing keys, neighbours, and random probes
+            uintptr_t probe = keys[tausrand(taus_state) % count];
+            switch (i % 4) {
+            case 1: probe++; break;
+            case 2: probe--; break;
+            case 3: probe = (i % 8 == 3) ? random_key() : 0x1000 + tausrand(taus_state) % 100000; break;
+            default: break;
+            }
+            unsigned lo = 0, hi = count;
+            while (lo < hi) {
+                const unsigned mid = lo + (hi - lo) / 2;
+                if (keys[mid] < probe) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            mrxi_it_t *it = mrxi_lower_boundst(tt, probe, itbuf);
+            if (lo == count) {
+                ASSERT(it == mrxi_end());
+                continue;
+            }
+            ASSERT(it != mrxi_end());
+            ASSERT(mrxi_key(it) == keys[lo]);
+            ASSERT(mrxi_val(it) == (void *)~keys[lo]);
+            for (unsigned j = lo + 1; j < lo + 4 && j < count; j++) {
+                it = mrxi_next(it);
+                ASSERT(mrxi_key(it) == keys[j]);
+            }
+        }
+        mrxi_it_t *it = mrxi_lower_bound(tt, 0);
+        ASSERT(mrxi_key(it) == keys[0]);
+        free(it);
+        free(itbuf);
+        mrxi_delete(tt);
+        free(keys);
+    }
+    {
+        // string keys where the key is a prefix of others or passes their end
+        mrx_t *tt = mrx_new(~0u);
+        mrx_insertnt(tt, "abc", (void *)1);
+        mrx_insertnt(tt, "abcdef", (void *)2);
+        mrx_insertnt(tt, "abd", (void *)3);
+        mrx_insertnt(tt, "b", (void *)4);
+        void *itbuf = malloc(mrx_itsize(tt));
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "", 0, itbuf)), "abc") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "abc", 3, itbuf)), "abc") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "abca", 4, itbuf)), "abcdef") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "abcdefg", 7, itbuf)), "abd") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "abcz", 4, itbuf)), "abd") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "ab", 2, itbuf)), "abc") == 0);
+        ASSERT(strcmp(mrx_key(mrx_lower_boundst(tt, "abe", 3, itbuf)), "b") == 0);
+        ASSERT(mrx_lower_boundst(tt, "b\0", 2, itbuf) == mrx_end());
+        ASSERT(mrx_lower_boundst(tt, "c", 1, itbuf) == mrx_end());
+        free(itbuf);
+        mrx_delete(tt);
+    }
+    fprintf(stderr, "pass\n");
+
+    fprintf(stderr, "Test: sharded mrx...");
+    {
+        ASSERT(mrx_shard_new(0, NULL, ~0u) == NULL);
+        ASSERT(mrx_shard_new(257, NULL, ~0u) == NULL);
+        ASSERT(mrx_shard_new(3, (const uint8_t[]){ 'b', 'b' }, ~0u) == NULL);
+        ASSERT(mrx_shard_new(2, (const uint8_t[]){ 0 }, ~0u) == NULL);
+
+        // string keys split on their first character, iterated in key order across shards
+        const uint8_t split[] = { '4', '8', 'c' };
+        mrx_shard_t *sh = mrx_shard_new(4, split, ~0u);
+        mrx_t *ref = mrx_new(~0u);
+        ASSERT(mrx_shard_begin(sh) == mrx_shard_end());
+        ASSERT(mrx_shard_lower_bound(sh, "x", 1) == mrx_shard_end());
+        ASSERT(mrx_shard_shard_index(sh, "", 0) == 0);
+        ASSERT(mrx_shard_shard_index(sh, "3", 1) == 0);
+        ASSERT(mrx_shard_shard_index(sh, "4", 1) == 1);
+        ASSERT(mrx_shard_shard_index(sh, "bz", 2) == 2);
+        ASSERT(mrx_shard_shard_index(sh, "\xff", 1) == 3);
+        for (unsigned i = 0; i < 5000; i++) {
+            char str[64];
+            // leave the shard starting with '4' empty
+            do {
+                snprintf(str, sizeof(str), "%llx", (unsigned long long)random_key());
+            } while (str[0] >= '4' && str[0] < '8');
+            if (i % 7 == 0) {
+                str[1 + i % 3] = '\0';
+            }
+            mrx_shard_insertnt(sh, str, (void *)(uintptr_t)(i + 1));
+            mrx_insertnt(ref, str, (void *)(uintptr_t)(i + 1));
+        }
+        ASSERT(mrx_shard_size(sh) == mrx_size(ref));
+        ASSERT(!mrx_shard_empty(sh));
+        ASSERT(mrx_shard_findnt(sh, "xyz") == NULL);
+        mrx_it_t *rit = mrx_begin(ref);
+        for (mrx_shard_it_t *it = mrx_shard_begin(sh); it != mrx_shard_end(); it = mrx_shard_next(it)) {
+            ASSERT(rit != mrx_end());
+            ASSERT(strcmp(mrx_shard_key(it), mrx_key(rit)) == 0);
+            ASSERT(mrx_shard_keylen(it) == strlen(mrx_key(rit)));
+            ASSERT(mrx_shard_val(it) == mrx_val(rit));
+            ASSERT(mrx_shard_findnt(sh, mrx_key(rit)) == mrx_val(rit));
+            rit = mrx_next(rit);
+        }
+        ASSERT(rit == mrx_end());
+        void *itbuf = malloc(mrx_itsize(ref));
+        const char *probes[] = { "", "0", "3f", "4", "5", "7fff", "8", "b", "bfff", "c", "f", "ffffffffffffffffff", "g" };
+        for (unsigned i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+            mrx_it_t *rit1 = mrx_lower_boundst(ref, probes[i], strlen(probes[i]), itbuf);
+            mrx_shard_it_t *it = mrx_shard_lower_bound(sh, probes[i], strlen(probes[i]));
+            if (rit1 == mrx_end()) {
+                ASSERT(it == mrx_shard_end());
+                continue;
+            }
+            ASSERT(it != mrx_shard_end());
+            ASSERT(strcmp(mrx_shard_key(it), mrx_key(rit1)) == 0);
+            mrx_shard_itdelete(it);
+        }
+        free(itbuf);
+        mrx_shard_itdelete(NULL);
+        for (rit = mrx_begin(ref); rit != mrx_end(); rit = mrx_next(rit)) {
+            if ((uintptr_t)mrx_val(rit) % 2 == 0) {
+                ASSERT(mrx_shard_erasent(sh, mrx_key(rit)) == mrx_val(rit));
+            }
+        }
+        ASSERT(mrx_shard_erasent(sh, "xyz") == NULL);
+        for (mrx_shard_it_t *it = mrx_shard_begin(sh); it != mrx_shard_end(); it = mrx_shard_next(it)) {
+            ASSERT((uintptr_t)mrx_shard_val(it) % 2 == 1);
+        }
+        mrx_shard_clear(sh);
+        ASSERT(mrx_shard_empty(sh));
+        mrx_shard_delete(sh);
+        mrx_shard_delete(NULL);
+        mrx_delete(ref);
+    }
+    {
+        // concurrent writers on an evenly split integer map, and one reader
+        const unsigned thread_count = 5;
+        const unsigned count = 20000;
+        mrxsh_t *sh = mrxsh_new(16, NULL, ~0u);
+        pthread_t thread_id[thread_count];
+        struct shard_thread_arg arg[thread_count];
+        for (unsigned i = 0; i < thread_count; i++) {
+            arg[i].sh = sh;
+            arg[i].id = i;
+            arg[i].count = count;
+            arg[i].is_reader = (i == thread_count - 1);
+            pthread_create(&thread_id[i], NULL, shard_thread, &arg[i]);
+        }
+        for (unsigned i = 0; i < thread_count; i++) {
+            pthread_join(thread_id[i], NULL);
+        }
+        // every fifth key but the last is erased
+        size_t expected = 0;
+        for (unsigned i = 0; i < count; i++) {
+            expected += ((i + 1) % 5 != 0 || i + 1 == count) ? 1 : 0;
+        }
+        ASSERT(mrxsh_size(sh) == expected * (thread_count - 1));
+        uintptr_t prev = 0;
+        size_t n = 0;
+        for (mrxsh_it_t *it = mrxsh_begin(sh); it != mrxsh_end(); it = mrxsh_next(it)) {
+            ASSERT(n == 0 || mrxsh_key(it) > prev);
+            prev = mrxsh_key(it);
+            n++;
+        }
+        ASSERT(n == expected * (thread_count - 1));
+        for (unsigned id = 0; id < thread_count - 1; id++) {
+            const uintptr_t key = SHARD_TEST_KEY(id, 7);
+            mrxsh_it_t *it = mrxsh_lower_bound(sh, key);
+            ASSERT(mrxsh_key(it) == key);
+            mrxsh_itdelete(it);
+        }
+        mrxsh_delete(sh);
+    }
+    fprintf(stderr, "pass\n");
+}
+
 static void
 mrx_complementary_tests(void)
 {
@@ -744,6 +3128,20 @@ main(void)
     mrx_scan_tests();
     mrx_allocator_tests();
     mrx_random_tree_tests();
+    mrx_clear_tests();
+    mrx_erase_prefix_tests();
+    mrx_key16_tests();
+    mrx_bulk_tests();
+    mrx_pop_tests();
+    mrx_static_tests();
+    mrx_fuzzy_tests();
+    mrx_ac_tests();
+    mrx_hint_tests();
+    mrx_lpm_tests();
+    mrx_intern_tests();
+    mrx_keyenc_tests();
+    mrx_topk_tests();
+    mrx_shard_tests();
     mrx_complementary_tests();
 
 #if TRACKMEM_DEBUG - 0 != 0
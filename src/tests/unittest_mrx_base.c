@@ -366,7 +366,7 @@ test_set_link_in_parent(void)
 
             void **vref;
             uint8_t rest_string[1] = { (uint8_t)'a' };
-            union mrx_node *child = new_leaf(mrx, rest_string, 1, &vref);
+            union mrx_node *child = new_leaf(mrx, rest_string, 1, NULL, &vref);
             *vref = (void *)0xDEADBABEDEADBEEFu;
             //fprintf(stderr, "before\n");
             //mrx_print_node_(parent);
@@ -1126,7 +1126,7 @@ test_mask_node_insert_branch(void)
                         }
                         void **vref;
                         uint8_t rest_string[1] = { (uint8_t)'a' };
-                        union mrx_node *leaf = new_leaf(mrx, rest_string, 1, &vref);
+                        union mrx_node *leaf = new_leaf(mrx, rest_string, 1, NULL, &vref);
                         *vref = (void *)0xDEADBABEDEADBEEFu;
 
                         union mrx_node *branches[256];
@@ -1229,7 +1229,7 @@ test_scan_node_to_mask_node_and_enlarge_node(void)
 
                 void **vref;
                 uint8_t rest_string[1] = { (uint8_t)'a' };
-                union mrx_node *leaf = new_leaf(mrx, rest_string, 1, &vref);
+                union mrx_node *leaf = new_leaf(mrx, rest_string, 1, NULL, &vref);
                 *vref = (void *)0xDEADBABEDEADBEEFu;
                 nodeptrs[br_len] = leaf;
 
@@ -1303,7 +1303,7 @@ test_scan_node_insert_branch(void)
                     const uint8_t br_len = HDR_BR_LEN(node->hdr);
                     void **vref;
                     uint8_t rest_string[1] = { (uint8_t)'a' };
-                    union mrx_node *leaf = new_leaf(mrx, rest_string, 1, &vref);
+                    union mrx_node *leaf = new_leaf(mrx, rest_string, 1, NULL, &vref);
                     *vref = (void *)0xDEADBABEDEADBEEFu;
                     struct mrx_iterator_path_element path[3];
 
@@ -1493,7 +1493,7 @@ test_new_leaf(void)
         for (int i = 0; i < 100; i++) {
             for (unsigned rest_length = 0; rest_length < test_size; rest_length++) {
                 mrx_test_configure_allocator(i > 0, true); // use one pass with one allocator, trigger long pointer cases for the rest
-                union mrx_node *node = new_leaf(mrx, rest_string, rest_length, &vref);
+                union mrx_node *node = new_leaf(mrx, rest_string, rest_length, NULL, &vref);
                 *vref = NULL;
                 mrx_debug_sanity_check_node_with_children(node);
                 mrx->root = node;